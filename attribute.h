@@ -9,13 +9,13 @@ class Attribute {
   const VulkanContext& ctx;
 
   Attribute() = delete;
-  Attribute(const VulkanContext& ctx, const std::vector<DataFormat>& data, VkBufferUsageFlagBits usage);
+  Attribute(const VulkanContext& ctx, const std::vector<DataFormat>& data, VkBufferUsageFlags usage);
   Attribute(const Attribute& attribute) = delete;
   ~Attribute();
 };
 
 template <typename DataFormat>
-Attribute<DataFormat>::Attribute(const VulkanContext& ctx, const std::vector<DataFormat>& cpuData, VkBufferUsageFlagBits usage) : ctx{ctx} {
+Attribute<DataFormat>::Attribute(const VulkanContext& ctx, const std::vector<DataFormat>& cpuData, VkBufferUsageFlags usage) : ctx{ctx} {
   VkDeviceSize bufferSize = sizeof(DataFormat) * cpuData.size();
 
   // Create a buffer on the GPU which can have data copied into it from the CPU
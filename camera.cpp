@@ -3,7 +3,10 @@
 #include <math.h>
 
 #include <algorithm>
+#include <fstream>
 #include <glm/gtc/matrix_transform.hpp>
+#include <sstream>
+#include <stdexcept>
 
 Camera::Camera(float pitch, float yaw, float distance, glm::vec3 up,
                float fov, float aspect, float near, float far) : pitch{pitch}, yaw{yaw}, distance{distance}, up{up}, fov{fov}, aspect(aspect), near{near}, far{far} {
@@ -49,3 +52,36 @@ void Camera::updatePosition() {
   position = normalize(position);
   position *= distance;
 }
+
+/**
+ * Read one view per line as "pitch yaw distance fov". Empty lines and lines starting with # are skipped
+ */
+std::vector<CameraView> loadCameraViews(const std::string& path) {
+  std::ifstream file(path);
+  if (!file.is_open()) {
+    throw std::runtime_error("Failed to open camera views " + path);
+  }
+
+  std::vector<CameraView> views;
+  std::string line;
+  uint32_t lineNumber = 0;
+  while (std::getline(file, line)) {
+    lineNumber++;
+    if (line.empty() || line[0] == '#') {
+      continue;
+    }
+
+    std::istringstream stream(line);
+    CameraView view{};
+    if (!(stream >> view.pitch >> view.yaw >> view.distance >> view.fov)) {
+      throw std::runtime_error("Invalid camera view on line " + std::to_string(lineNumber) + " of " + path);
+    }
+    views.push_back(view);
+  }
+
+  if (views.empty()) {
+    throw std::runtime_error("No camera views in " + path);
+  }
+
+  return views;
+}
@@ -1,4 +1,6 @@
 #include <glm/glm.hpp>
+#include <string>
+#include <vector>
 
 /**
  * Orbit camera looking at the origin
@@ -25,4 +27,16 @@ struct Camera {
   void updateMatrices();
   void updateCoordinates(glm::vec2 delta);
   void updatePosition();
-};
\ No newline at end of file
+};
+
+/**
+ * Orbit parameters of a view rendered in batch mode. Angles are in radians
+ */
+struct CameraView {
+  float pitch;
+  float yaw;
+  float distance;
+  float fov;
+};
+
+std::vector<CameraView> loadCameraViews(const std::string& path);
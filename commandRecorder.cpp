@@ -0,0 +1,185 @@
+#include "commandRecorder.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <stdexcept>
+
+/**
+ * Split a draw list into one range per worker, in draw list order. Only the first threads workers get draws, and no
+ * more workers than there are draws, so that small lists are not split into empty ranges. Every range is empty when
+ * there are no draws
+ */
+std::vector<DrawRange> splitDraws(uint32_t drawCount, uint32_t threads, uint32_t workerCount) {
+  threads = std::max(1u, std::min({threads, drawCount, workerCount}));
+
+  std::vector<DrawRange> ranges(workerCount);
+  uint32_t firstDraw = 0;
+  for (uint32_t i = 0; i < workerCount; i++) {
+    uint32_t count = i < threads ? drawCount / threads + (i < drawCount % threads ? 1 : 0) : 0;
+    ranges[i] = {firstDraw, count};
+    firstDraw += count;
+  }
+  return ranges;
+}
+
+CommandRecorder::CommandRecorder(const VulkanContext& ctx, uint32_t framesInFlight, uint32_t threadCount) : ctx{ctx} {
+  QueueFamilyIndices queueFamilyIndices = findQueueFamilies(ctx.physicalDevice, ctx.surface);
+
+  VkCommandPoolCreateInfo poolInfo{};
+  poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+  // Buffers are re-recorded every frame and the pool is reset as a whole
+  poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+  poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily.value();
+
+  commandPools.resize(framesInFlight, std::vector<VkCommandPool>(threadCount));
+  commandBuffers.resize(framesInFlight, std::vector<VkCommandBuffer>(threadCount));
+
+  for (uint32_t frame = 0; frame < framesInFlight; frame++) {
+    for (uint32_t i = 0; i < threadCount; i++) {
+      if (vkCreateCommandPool(ctx.device, &poolInfo, nullptr, &commandPools[frame][i]) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create command pool");
+      }
+
+      VkCommandBufferAllocateInfo allocInfo{};
+      allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+      allocInfo.commandPool = commandPools[frame][i];
+      allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+      allocInfo.commandBufferCount = 1;
+
+      if (vkAllocateCommandBuffers(ctx.device, &allocInfo, &commandBuffers[frame][i]) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to allocate secondary command buffers");
+      }
+    }
+  }
+
+  tasks.resize(threadCount);
+  for (uint32_t i = 0; i < threadCount; i++) {
+    workers.emplace_back(&CommandRecorder::workerLoop, this, i);
+  }
+}
+
+CommandRecorder::~CommandRecorder() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  tasksAvailable.notify_all();
+  for (auto& worker : workers) {
+    worker.join();
+  }
+
+  // Command buffers are freed with their pools
+  for (auto& framePools : commandPools) {
+    for (auto& pool : framePools) {
+      vkDestroyCommandPool(ctx.device, pool, nullptr);
+    }
+  }
+}
+
+uint32_t CommandRecorder::threadCount() const {
+  return workers.size();
+}
+
+/**
+ * Record the draw list for a frame in parallel and return the secondary command buffers to execute, in draw list
+ * order. The list is empty when there are no draws, and must then not be executed. The frame's previous submission
+ * must have completed. Blocks until all workers have finished
+ */
+const std::vector<VkCommandBuffer>& CommandRecorder::record(uint32_t frame, const VkCommandBufferInheritanceInfo& inheritance,
+                                                            uint32_t drawCount, const RecordFunction& recordDraws, uint32_t activeThreads) {
+  auto startTime = std::chrono::high_resolution_clock::now();
+
+  std::vector<DrawRange> ranges = splitDraws(drawCount, activeThreads == 0 ? threadCount() : activeThreads, threadCount());
+
+  recordedBuffers.clear();
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+
+    for (uint32_t i = 0; i < threadCount(); i++) {
+      tasks[i] = {frame, ranges[i].firstDraw, ranges[i].drawCount};
+      if (ranges[i].drawCount > 0) {
+        recordedBuffers.push_back(commandBuffers[frame][i]);
+      }
+    }
+
+    this->inheritance = &inheritance;
+    this->recordDraws = &recordDraws;
+    error = nullptr;
+    remaining = threadCount();
+    generation++;
+    tasksAvailable.notify_all();
+
+    tasksFinished.wait(lock, [&] { return remaining == 0; });
+  }
+
+  if (error) {
+    std::rethrow_exception(error);
+  }
+
+  auto endTime = std::chrono::high_resolution_clock::now();
+  recordCount++;
+  totalRecordTime += std::chrono::duration<double, std::milli>(endTime - startTime).count();
+
+  return recordedBuffers;
+}
+
+void CommandRecorder::report() const {
+  if (recordCount > 0) {
+    std::cout << "Parallel recording on " << threadCount() << " threads: average " << totalRecordTime / recordCount << " ms" << std::endl;
+  }
+}
+
+void CommandRecorder::workerLoop(uint32_t workerIndex) {
+  uint64_t seenGeneration = 0;
+
+  while (true) {
+    Task task;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      tasksAvailable.wait(lock, [&] { return stopping || generation != seenGeneration; });
+      if (stopping) {
+        return;
+      }
+      seenGeneration = generation;
+      task = tasks[workerIndex];
+    }
+
+    if (task.drawCount > 0) {
+      try {
+        recordTask(workerIndex, task);
+      } catch (...) {
+        std::lock_guard<std::mutex> lock(mutex);
+        error = std::current_exception();
+      }
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      remaining--;
+    }
+    tasksFinished.notify_one();
+  }
+}
+
+void CommandRecorder::recordTask(uint32_t workerIndex, const Task& task) {
+  // Resetting the pool is cheaper than resetting its command buffers individually
+  vkResetCommandPool(ctx.device, commandPools[task.frame][workerIndex], 0);
+
+  VkCommandBuffer commandBuffer = commandBuffers[task.frame][workerIndex];
+
+  VkCommandBufferBeginInfo beginInfo{};
+  beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+  beginInfo.pInheritanceInfo = inheritance;
+
+  if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to begin recording secondary command buffer");
+  }
+
+  (*recordDraws)(commandBuffer, task.firstDraw, task.drawCount);
+
+  if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to record secondary command buffer");
+  }
+}
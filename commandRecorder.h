@@ -0,0 +1,72 @@
+#pragma once
+
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "vulkanUtils.h"
+
+// Contiguous range of a draw list recorded by one worker
+struct DrawRange {
+  uint32_t firstDraw;
+  uint32_t drawCount;
+};
+
+std::vector<DrawRange> splitDraws(uint32_t drawCount, uint32_t threads, uint32_t workerCount);
+
+/**
+ * Records a draw list into secondary command buffers on worker threads. Every worker owns one command pool per
+ * frame in flight, so pools are never shared between threads and are reset as a whole once the frame has completed.
+ * The draw list is split into contiguous ranges, one per worker
+ */
+class CommandRecorder {
+ public:
+  const VulkanContext& ctx;
+
+  // Records draws [firstDraw, firstDraw + drawCount) into a secondary command buffer which has been begun
+  using RecordFunction = std::function<void(VkCommandBuffer commandBuffer, uint32_t firstDraw, uint32_t drawCount)>;
+
+  CommandRecorder() = delete;
+  CommandRecorder(const VulkanContext& ctx, uint32_t framesInFlight, uint32_t threadCount);
+  CommandRecorder(const CommandRecorder& commandRecorder) = delete;
+  ~CommandRecorder();
+
+  const std::vector<VkCommandBuffer>& record(uint32_t frame, const VkCommandBufferInheritanceInfo& inheritance, uint32_t drawCount,
+                                             const RecordFunction& recordDraws, uint32_t activeThreads = 0);
+  uint32_t threadCount() const;
+  void report() const;
+
+ private:
+  struct Task {
+    uint32_t frame;
+    uint32_t firstDraw;
+    uint32_t drawCount;
+  };
+
+  // Indexed by [frame][worker]
+  std::vector<std::vector<VkCommandPool>> commandPools;
+  std::vector<std::vector<VkCommandBuffer>> commandBuffers;
+  std::vector<VkCommandBuffer> recordedBuffers;
+
+  std::vector<std::thread> workers;
+  std::vector<Task> tasks;
+  const VkCommandBufferInheritanceInfo* inheritance = nullptr;
+  const RecordFunction* recordDraws = nullptr;
+  uint64_t generation = 0;
+  uint32_t remaining = 0;
+  bool stopping = false;
+  std::exception_ptr error;
+
+  std::mutex mutex;
+  std::condition_variable tasksAvailable;
+  std::condition_variable tasksFinished;
+
+  uint64_t recordCount = 0;
+  double totalRecordTime = 0.0;
+
+  void workerLoop(uint32_t workerIndex);
+  void recordTask(uint32_t workerIndex, const Task& task);
+};
@@ -0,0 +1,300 @@
+#include "cpuCuller.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <glm/gtc/matrix_transform.hpp>
+#include <iostream>
+#include <numeric>
+
+// Spheres per leaf. A multiple of the AVX2 width so that full leaves are tested without a scalar tail. Splits keep
+// every left child a multiple of it, so only the leaf at the end of the slots holds the remainder and has a tail
+const uint32_t LEAF_SIZE = 32;
+
+/*----- SphereBounds -----*/
+
+void SphereBounds::push(float centerX, float centerY, float centerZ, float sphereRadius) {
+  x.push_back(centerX);
+  y.push_back(centerY);
+  z.push_back(centerZ);
+  radius.push_back(sphereRadius);
+}
+
+uint32_t SphereBounds::size() const {
+  return static_cast<uint32_t>(x.size());
+}
+
+/*--------------- CpuCuller ---------------*/
+
+CpuCuller::CpuCuller(const SphereBounds& bounds) : simdLevel{detectSimdLevel()} {
+  uint32_t count = bounds.size();
+  if (count == 0) {
+    return;
+  }
+
+  // Split on the median of the longest axis of the sphere centres until leaves are small enough
+  ids.resize(count);
+  std::iota(ids.begin(), ids.end(), 0);
+
+  const std::vector<float>* axes[3] = {&bounds.x, &bounds.y, &bounds.z};
+
+  nodes.push_back({});
+  nodes[0].first = 0;
+  nodes[0].count = count;
+
+  for (uint32_t index = 0; index < nodes.size(); index++) {
+    if (nodes[index].count <= LEAF_SIZE) {
+      continue;
+    }
+
+    uint32_t first = nodes[index].first;
+    uint32_t nodeCount = nodes[index].count;
+
+    float minimum[3] = {INFINITY, INFINITY, INFINITY};
+    float maximum[3] = {-INFINITY, -INFINITY, -INFINITY};
+    for (uint32_t i = first; i < first + nodeCount; i++) {
+      for (int axis = 0; axis < 3; axis++) {
+        minimum[axis] = std::min(minimum[axis], (*axes[axis])[ids[i]]);
+        maximum[axis] = std::max(maximum[axis], (*axes[axis])[ids[i]]);
+      }
+    }
+
+    int splitAxis = 0;
+    for (int axis = 1; axis < 3; axis++) {
+      if (maximum[axis] - minimum[axis] > maximum[splitAxis] - minimum[splitAxis]) {
+        splitAxis = axis;
+      }
+    }
+
+    // Keep the left half a multiple of the leaf size, which leaves the remainder to the rightmost leaf
+    uint32_t leftCount = std::max(LEAF_SIZE, (nodeCount / 2) / LEAF_SIZE * LEAF_SIZE);
+    const std::vector<float>& keys = *axes[splitAxis];
+    std::nth_element(ids.begin() + first, ids.begin() + first + leftCount, ids.begin() + first + nodeCount,
+                     [&](uint32_t a, uint32_t b) { return keys[a] < keys[b]; });
+
+    uint32_t leftChild = static_cast<uint32_t>(nodes.size());
+    nodes[index].leftChild = leftChild;
+
+    Node left{};
+    left.first = first;
+    left.count = leftCount;
+    left.parent = index;
+
+    Node right{};
+    right.first = first + leftCount;
+    right.count = nodeCount - leftCount;
+    right.parent = index;
+
+    nodes.push_back(left);
+    nodes.push_back(right);
+  }
+
+  // ----- Tree order -----
+  slots.resize(count);
+  slotLeaves.resize(count);
+  for (uint32_t slot = 0; slot < count; slot++) {
+    uint32_t id = ids[slot];
+    sorted.push(bounds.x[id], bounds.y[id], bounds.z[id], bounds.radius[id]);
+    slots[id] = slot;
+  }
+
+  for (uint32_t index = 0; index < nodes.size(); index++) {
+    if (nodes[index].leftChild == 0) {
+      std::fill(slotLeaves.begin() + nodes[index].first, slotLeaves.begin() + nodes[index].first + nodes[index].count, index);
+    }
+  }
+
+  // Children come after their parents so a reverse sweep fits every node after its children
+  for (uint32_t index = static_cast<uint32_t>(nodes.size()); index-- > 0;) {
+    if (nodes[index].leftChild == 0) {
+      fitLeaf(nodes[index]);
+    } else {
+      fitInternal(nodes[index]);
+    }
+  }
+}
+
+void CpuCuller::fitLeaf(Node& node) {
+  for (int axis = 0; axis < 3; axis++) {
+    node.minimum[axis] = INFINITY;
+    node.maximum[axis] = -INFINITY;
+  }
+
+  const float* centers[3] = {sorted.x.data(), sorted.y.data(), sorted.z.data()};
+  for (uint32_t i = node.first; i < node.first + node.count; i++) {
+    for (int axis = 0; axis < 3; axis++) {
+      node.minimum[axis] = std::min(node.minimum[axis], centers[axis][i] - sorted.radius[i]);
+      node.maximum[axis] = std::max(node.maximum[axis], centers[axis][i] + sorted.radius[i]);
+    }
+  }
+}
+
+// Returns whether the bounds changed
+bool CpuCuller::fitInternal(Node& node) {
+  const Node& left = nodes[node.leftChild];
+  const Node& right = nodes[node.leftChild + 1];
+
+  bool changed = false;
+  for (int axis = 0; axis < 3; axis++) {
+    float minimum = std::min(left.minimum[axis], right.minimum[axis]);
+    float maximum = std::max(left.maximum[axis], right.maximum[axis]);
+    changed = changed || minimum != node.minimum[axis] || maximum != node.maximum[axis];
+    node.minimum[axis] = minimum;
+    node.maximum[axis] = maximum;
+  }
+  return changed;
+}
+
+/**
+ * Move a sphere. The tree is not updated until refit is called
+ */
+void CpuCuller::update(uint32_t id, float centerX, float centerY, float centerZ, float radius) {
+  uint32_t slot = slots[id];
+  sorted.x[slot] = centerX;
+  sorted.y[slot] = centerY;
+  sorted.z[slot] = centerZ;
+  sorted.radius[slot] = radius;
+  dirtyLeaves.push_back(slotLeaves[slot]);
+}
+
+/**
+ * Refit the leaves of moved spheres and their ancestors. Stops walking up once a box is unchanged, as everything
+ * above it already contains it
+ */
+void CpuCuller::refit() {
+  for (uint32_t leaf : dirtyLeaves) {
+    fitLeaf(nodes[leaf]);
+    for (uint32_t index = leaf; index != 0;) {
+      index = nodes[index].parent;
+      if (!fitInternal(nodes[index])) {
+        break;
+      }
+    }
+  }
+  dirtyLeaves.clear();
+}
+
+/**
+ * Replace the contents of visible with the ids of the spheres which intersect the frustum
+ */
+void CpuCuller::cull(const Frustum& frustum, std::vector<uint32_t>& visible) {
+  auto startTime = std::chrono::high_resolution_clock::now();
+
+  visible.clear();
+  if (!nodes.empty()) {
+    stack.push_back(0);
+  }
+
+  while (!stack.empty()) {
+    const Node& node = nodes[stack.back()];
+    stack.pop_back();
+
+    Containment containment = boxInFrustum(frustum, node.minimum, node.maximum);
+    if (containment == Containment::Outside) {
+      continue;
+    }
+
+    if (containment == Containment::Inside) {
+      visible.insert(visible.end(), ids.begin() + node.first, ids.begin() + node.first + node.count);
+    } else if (node.leftChild == 0) {
+      cullSpheres(frustum, &sorted.x[node.first], &sorted.y[node.first], &sorted.z[node.first], &sorted.radius[node.first],
+                  &ids[node.first], node.count, visible, simdLevel);
+    } else {
+      stack.push_back(node.leftChild + 1);
+      stack.push_back(node.leftChild);
+    }
+  }
+
+  auto endTime = std::chrono::high_resolution_clock::now();
+  cullTime += std::chrono::duration<double, std::milli>(endTime - startTime).count();
+  culledFrames++;
+  visibleTotal += visible.size();
+}
+
+/**
+ * Test every sphere without the hierarchy. Used as the benchmark baseline
+ */
+void CpuCuller::cullAll(const Frustum& frustum, std::vector<uint32_t>& visible) const {
+  visible.clear();
+  cullSpheres(frustum, sorted.x.data(), sorted.y.data(), sorted.z.data(), sorted.radius.data(), ids.data(), sorted.size(),
+              visible, simdLevel);
+}
+
+void CpuCuller::report() const {
+  if (culledFrames > 0) {
+    std::cout << "CPU culling (" << simdLevelName(simdLevel) << "): average " << (double)visibleTotal / culledFrames << " of "
+              << sorted.size() << " instances visible, " << cullTime / culledFrames << " ms" << std::endl;
+  }
+}
+
+/*----- Benchmark -----*/
+
+/**
+ * Cull a grid of unit spheres from an orbiting camera with every instruction set, with and without the hierarchy.
+ * Needs no window or GPU
+ */
+void benchmarkCulling(uint32_t instanceCount) {
+  const uint32_t frames = 200;
+  const float pi = 3.14159265f;
+
+  uint32_t columns = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<double>(instanceCount))));
+  float extent = 2.0f * columns;
+
+  SphereBounds bounds;
+  for (uint32_t i = 0; i < instanceCount; i++) {
+    bounds.push(2.0f * (i % columns) - 0.5f * extent, 2.0f * (i / columns) - 0.5f * extent, 0.0f, 1.0f);
+  }
+
+  CpuCuller culler(bounds);
+  SimdLevel bestLevel = culler.simdLevel;
+
+  std::vector<Frustum> frustums;
+  for (uint32_t frame = 0; frame < frames; frame++) {
+    float angle = 2.0f * pi * frame / frames;
+    glm::vec3 eye = 0.25f * extent * glm::vec3{std::cos(angle), std::sin(angle), 0.5f};
+    glm::mat4 view = glm::lookAt(eye, glm::vec3{0.0f}, glm::vec3{0.0f, 0.0f, 1.0f});
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), 16.0f / 10.0f, 0.1f, extent);
+    frustums.push_back(extractFrustum(projection * view));
+  }
+
+  std::cout << "Culling " << instanceCount << " spheres, average of " << frames << " frames" << std::endl;
+
+  std::vector<uint32_t> visible;
+  auto measure = [&](const std::string& name, const std::function<void(uint32_t)>& cullFrame) {
+    uint64_t visibleCount = 0;
+    auto startTime = std::chrono::high_resolution_clock::now();
+    for (uint32_t frame = 0; frame < frames; frame++) {
+      cullFrame(frame);
+      visibleCount += visible.size();
+    }
+    auto endTime = std::chrono::high_resolution_clock::now();
+
+    double time = std::chrono::duration<double, std::milli>(endTime - startTime).count() / frames;
+    std::cout << name << ": " << time << " ms, " << instanceCount / time / 1000.0 << " million spheres/s, "
+              << visibleCount / frames << " visible" << std::endl;
+  };
+
+  for (SimdLevel level : {SimdLevel::Scalar, SimdLevel::SSE2, SimdLevel::AVX2}) {
+    if (level > bestLevel) {
+      break;
+    }
+    culler.simdLevel = level;
+    measure(std::string("All spheres, ") + simdLevelName(level), [&](uint32_t frame) { culler.cullAll(frustums[frame], visible); });
+  }
+
+  culler.simdLevel = bestLevel;
+  measure(std::string("Hierarchy, ") + simdLevelName(bestLevel), [&](uint32_t frame) { culler.cull(frustums[frame], visible); });
+
+  // Bob 1% of the spheres up and down to include the cost of refitting
+  uint32_t movingCount = std::max(1u, instanceCount / 100);
+  measure(std::string("Hierarchy with 1% moving, ") + simdLevelName(bestLevel), [&](uint32_t frame) {
+    float height = std::sin(2.0f * pi * frame / frames);
+    for (uint32_t i = 0; i < movingCount; i++) {
+      uint32_t id = i * (instanceCount / movingCount);
+      culler.update(id, bounds.x[id], bounds.y[id], height, bounds.radius[id]);
+    }
+    culler.refit();
+    culler.cull(frustums[frame], visible);
+  });
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "frustum.h"
+
+/**
+ * World space bounding spheres as one array per component
+ */
+struct SphereBounds {
+  std::vector<float> x;
+  std::vector<float> y;
+  std::vector<float> z;
+  std::vector<float> radius;
+
+  void push(float centerX, float centerY, float centerZ, float sphereRadius);
+  uint32_t size() const;
+};
+
+/**
+ * Frustum culling of bounding spheres on the CPU over a bounding volume hierarchy. Boxes which are fully inside or
+ * outside the frustum accept or reject their subtree. The spheres of intersecting leaves are tested in batches with
+ * the widest instruction set available. The tree topology is built once and moved spheres only refit the boxes on
+ * the path to the root
+ */
+class CpuCuller {
+ public:
+  CpuCuller() = delete;
+  CpuCuller(const SphereBounds& bounds);
+  CpuCuller(const CpuCuller& cpuCuller) = delete;
+  ~CpuCuller() = default;
+
+  void update(uint32_t id, float centerX, float centerY, float centerZ, float radius);
+  void refit();
+  void cull(const Frustum& frustum, std::vector<uint32_t>& visible);
+  void cullAll(const Frustum& frustum, std::vector<uint32_t>& visible) const;
+  void report() const;
+
+  SimdLevel simdLevel;
+
+ private:
+  // Children are allocated in pairs after their parent. Every node covers a contiguous range of slots
+  struct Node {
+    float minimum[3];
+    float maximum[3];
+    uint32_t first;
+    uint32_t count;
+    // 0 for leaves as the root is never a child
+    uint32_t leftChild;
+    uint32_t parent;
+  };
+
+  std::vector<Node> nodes;
+  // Spheres in tree order so that every leaf is a contiguous batch
+  SphereBounds sorted;
+  std::vector<uint32_t> ids;
+  std::vector<uint32_t> slots;
+  std::vector<uint32_t> slotLeaves;
+  std::vector<uint32_t> dirtyLeaves;
+  std::vector<uint32_t> stack;
+
+  uint64_t culledFrames = 0;
+  uint64_t visibleTotal = 0;
+  double cullTime = 0.0;
+
+  void fitLeaf(Node& node);
+  bool fitInternal(Node& node);
+};
+
+void benchmarkCulling(uint32_t instanceCount);
@@ -0,0 +1,177 @@
+#include "deferredShading.h"
+
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include "gpuBenchmark.h"
+#include "image.h"
+
+const uint32_t GBUFFER_BINDINGS = 3;
+
+DeferredShading::DeferredShading(const VulkanContext& ctx, DeletionQueue& deletionQueue)
+    : ctx{ctx}, deletionQueue{deletionQueue} {
+  std::array<VkDescriptorSetLayoutBinding, GBUFFER_BINDINGS> bindings{};
+  for (uint32_t i = 0; i < bindings.size(); i++) {
+    bindings[i].binding = i;
+    bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+    bindings[i].descriptorCount = 1;
+    bindings[i].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+  }
+
+  VkDescriptorSetLayoutCreateInfo layoutInfo{};
+  layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+  layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+  layoutInfo.pBindings = bindings.data();
+
+  if (vkCreateDescriptorSetLayout(ctx.device, &layoutInfo, nullptr, &setLayout) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to create G-buffer descriptor set layout");
+  }
+}
+
+// The device must be idle
+DeferredShading::~DeferredShading() {
+  vkDestroyDescriptorPool(ctx.device, descriptorPool, nullptr);
+  vkDestroyDescriptorSetLayout(ctx.device, setLayout, nullptr);
+}
+
+// Color attachments of the first subpass, in the order of the bindings
+std::array<VkFormat, 2> DeferredShading::gbufferFormats() const {
+  return {albedoFormat, normalFormat};
+}
+
+uint32_t DeferredShading::bytesPerPixel() const {
+  return 4 + 4;
+}
+
+/**
+ * Point the set at new attachments. The old set may still be in use by frames in flight and its pool is retired
+ * through the deletion queue. Command buffers using the set must be re-recorded
+ */
+void DeferredShading::setAttachments(VkImageView albedoView, VkImageView normalView, VkImageView depthView) {
+  if (descriptorPool != VK_NULL_HANDLE) {
+    deletionQueue.push([device = ctx.device, descriptorPool = descriptorPool] {
+      vkDestroyDescriptorPool(device, descriptorPool, nullptr);
+    });
+  }
+
+  VkDescriptorPoolSize poolSize{};
+  poolSize.type = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+  poolSize.descriptorCount = GBUFFER_BINDINGS;
+
+  VkDescriptorPoolCreateInfo poolInfo{};
+  poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+  poolInfo.poolSizeCount = 1;
+  poolInfo.pPoolSizes = &poolSize;
+  poolInfo.maxSets = 1;
+
+  if (vkCreateDescriptorPool(ctx.device, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to create G-buffer descriptor pool");
+  }
+
+  VkDescriptorSetAllocateInfo allocInfo{};
+  allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+  allocInfo.descriptorPool = descriptorPool;
+  allocInfo.descriptorSetCount = 1;
+  allocInfo.pSetLayouts = &setLayout;
+
+  if (vkAllocateDescriptorSets(ctx.device, &allocInfo, &descriptorSet) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to allocate G-buffer descriptor set");
+  }
+
+  // In the layouts of the second subpass
+  std::array<VkDescriptorImageInfo, GBUFFER_BINDINGS> imageInfos{};
+  imageInfos[0] = {VK_NULL_HANDLE, albedoView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+  imageInfos[1] = {VK_NULL_HANDLE, normalView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+  imageInfos[2] = {VK_NULL_HANDLE, depthView, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL};
+
+  std::array<VkWriteDescriptorSet, GBUFFER_BINDINGS> descriptorWrites{};
+  for (uint32_t i = 0; i < descriptorWrites.size(); i++) {
+    descriptorWrites[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptorWrites[i].dstSet = descriptorSet;
+    descriptorWrites[i].dstBinding = i;
+    descriptorWrites[i].descriptorType = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+    descriptorWrites[i].descriptorCount = 1;
+    descriptorWrites[i].pImageInfo = &imageInfos[i];
+  }
+
+  vkUpdateDescriptorSets(ctx.device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+}
+
+/*----- Shading comparison -----*/
+
+ShadingComparison::ShadingComparison(const VulkanContext& ctx, DeletionQueue& deletionQueue, VkExtent2D extent,
+                                     VkFormat colorFormat, VkFormat depthFormat, VkSampleCountFlagBits forwardSamples,
+                                     DrawFunction draw, LightingFunction light)
+    : ctx{ctx},
+      forwardSamples{forwardSamples},
+      gbuffer(ctx, deletionQueue),
+      forwardGraph(ctx, deletionQueue),
+      deferredGraph(ctx, deletionQueue),
+      draw{std::move(draw)},
+      light{std::move(light)} {
+  VkClearValue clearColor{};
+  clearColor.color = {{0.0f, 0.0f, 0.0f, 1.0f}};
+  VkClearValue clearDepth{};
+  clearDepth.depthStencil = {1.0f, 0};
+
+  // ----- Target -----
+  createImage(ctx, extent.width, extent.height, 1, VK_SAMPLE_COUNT_1_BIT, colorFormat, VK_IMAGE_TILING_OPTIMAL,
+              VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, targetImage, targetMemory);
+  targetView = createImageView(ctx.device, targetImage, colorFormat, VK_IMAGE_ASPECT_COLOR_BIT, 1);
+
+  // ----- Forward -----
+  // Resolves the samples into the target
+  RenderGraph::RasterPassDescription forward;
+  forward.color = {forwardGraph.createImage("color", colorFormat, forwardSamples, VK_IMAGE_ASPECT_COLOR_BIT), true, clearColor};
+  forward.depth = {forwardGraph.createImage("depth", depthFormat, forwardSamples, VK_IMAGE_ASPECT_DEPTH_BIT), true, clearDepth};
+  forward.resolve = forwardGraph.importImage("target", colorFormat, VK_IMAGE_ASPECT_COLOR_BIT, ImageAccess::ColorAttachment);
+  forwardPass = forwardGraph.addRasterPass("forward", forward, [this](VkCommandBuffer commandBuffer, const RenderGraph::PassContext&) {
+    this->draw(commandBuffer, forwardPipeline);
+  });
+  forwardGraph.compile();
+  forwardGraph.setImportedImages(forward.resolve, {targetImage}, {targetView});
+  forwardGraph.allocate(extent);
+
+  // ----- Deferred -----
+  RenderGraph::Resource target = deferredGraph.importImage("target", colorFormat, VK_IMAGE_ASPECT_COLOR_BIT, ImageAccess::ColorAttachment);
+  RenderGraph::RasterPassDescription deferred;
+  deferred.color = {target, true, clearColor};
+  deferred.depth = {deferredGraph.createImage("depth", depthFormat, VK_SAMPLE_COUNT_1_BIT, VK_IMAGE_ASPECT_DEPTH_BIT), true, clearDepth};
+  deferred.inputs = {{deferredGraph.createImage("albedo", gbuffer.albedoFormat, VK_SAMPLE_COUNT_1_BIT, VK_IMAGE_ASPECT_COLOR_BIT), true, {}},
+                     {deferredGraph.createImage("normal", gbuffer.normalFormat, VK_SAMPLE_COUNT_1_BIT, VK_IMAGE_ASPECT_COLOR_BIT), true, {}}};
+  deferredPass = deferredGraph.addRasterPass("deferred", deferred, [this](VkCommandBuffer commandBuffer, const RenderGraph::PassContext&) {
+    this->draw(commandBuffer, gbufferPipeline);
+    vkCmdNextSubpass(commandBuffer, VK_SUBPASS_CONTENTS_INLINE);
+    this->light(commandBuffer, lightingPipeline, gbuffer.descriptorSet);
+  });
+  deferredGraph.compile();
+  deferredGraph.setImportedImages(target, {targetImage}, {targetView});
+  deferredGraph.allocate(extent);
+  gbuffer.setAttachments(deferredGraph.view(deferred.inputs[0].resource), deferredGraph.view(deferred.inputs[1].resource),
+                         deferredGraph.view(deferred.depth.resource));
+}
+
+// The device must be idle
+ShadingComparison::~ShadingComparison() {
+  vkDestroyImageView(ctx.device, targetView, nullptr);
+  vkDestroyImage(ctx.device, targetImage, nullptr);
+  vkFreeMemory(ctx.device, targetMemory, nullptr);
+}
+
+void ShadingComparison::setPipelines(VkPipeline forwardPipeline, VkPipeline gbufferPipeline, VkPipeline lightingPipeline) {
+  this->forwardPipeline = forwardPipeline;
+  this->gbufferPipeline = gbufferPipeline;
+  this->lightingPipeline = lightingPipeline;
+}
+
+void ShadingComparison::run(uint32_t iterations, VkRect2D renderArea) {
+  GpuBenchmark benchmark(ctx, iterations);
+
+  double forwardTime = benchmark.measure("Forward, " + std::to_string(static_cast<uint32_t>(forwardSamples)) + "x MSAA with sample shading",
+                                         [&](VkCommandBuffer commandBuffer) { forwardGraph.execute(commandBuffer, 0, renderArea); });
+  double deferredTime = benchmark.measure("Deferred, " + std::to_string(gbuffer.bytesPerPixel()) + " byte G-buffer",
+                                          [&](VkCommandBuffer commandBuffer) { deferredGraph.execute(commandBuffer, 0, renderArea); });
+  std::cout << "Deferred speedup " << forwardTime / deferredTime << std::endl;
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <array>
+#include <functional>
+
+#include "deletionQueue.h"
+#include "renderGraph.h"
+#include "vulkanUtils.h"
+
+/**
+ * Compact G-buffer of the deferred shading path. The first subpass of the scene pass writes the albedo and an
+ * octahedral normal, 8 bytes per pixel beside the depth. The second subpass reads them and the depth as input
+ * attachments and lights each pixel once, so tiled GPUs never write the G-buffer to memory
+ */
+class DeferredShading {
+ public:
+  const VulkanContext& ctx;
+
+  // Albedo with a coverage flag in alpha, which is 0 where nothing was drawn
+  const VkFormat albedoFormat = VK_FORMAT_R8G8B8A8_SRGB;
+  // Octahedral encoding of the surface normal
+  const VkFormat normalFormat = VK_FORMAT_R16G16_SFLOAT;
+
+  // Bindings 0, 1 and 2 read the albedo, the normal and the depth as input attachments
+  VkDescriptorSetLayout setLayout;
+  // Replaced whenever the attachments are
+  VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+
+  DeferredShading() = delete;
+  DeferredShading(const VulkanContext& ctx, DeletionQueue& deletionQueue);
+  DeferredShading(const DeferredShading& deferredShading) = delete;
+  ~DeferredShading();
+
+  std::array<VkFormat, 2> gbufferFormats() const;
+  uint32_t bytesPerPixel() const;
+  void setAttachments(VkImageView albedoView, VkImageView normalView, VkImageView depthView);
+
+ private:
+  DeletionQueue& deletionQueue;
+
+  VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+};
+
+/**
+ * The scene pass with forward shading of every MSAA sample and with deferred shading, each in its own render graph
+ * drawing into the same target, to compare their GPU time. The caller creates the pipelines against the render passes
+ * of the graphs and records the shared passes beforehand
+ */
+class ShadingComparison {
+ public:
+  const VulkanContext& ctx;
+
+  const VkSampleCountFlagBits forwardSamples;
+
+  // Owned by the comparison, not by the deferred path of the renderer
+  DeferredShading gbuffer;
+  RenderGraph forwardGraph;
+  RenderGraph::Pass forwardPass;
+  RenderGraph deferredGraph;
+  RenderGraph::Pass deferredPass;
+
+  // Records the draws of the scene with the given pipeline
+  using DrawFunction = std::function<void(VkCommandBuffer commandBuffer, VkPipeline pipeline)>;
+  // Records the lighting subpass, which reads the G-buffer through the given set
+  using LightingFunction = std::function<void(VkCommandBuffer commandBuffer, VkPipeline pipeline, VkDescriptorSet gbufferSet)>;
+
+  ShadingComparison() = delete;
+  ShadingComparison(const VulkanContext& ctx, DeletionQueue& deletionQueue, VkExtent2D extent, VkFormat colorFormat,
+                    VkFormat depthFormat, VkSampleCountFlagBits forwardSamples, DrawFunction draw, LightingFunction light);
+  ShadingComparison(const ShadingComparison& shadingComparison) = delete;
+  ~ShadingComparison();
+
+  void setPipelines(VkPipeline forwardPipeline, VkPipeline gbufferPipeline, VkPipeline lightingPipeline);
+  void run(uint32_t iterations, VkRect2D renderArea);
+
+ private:
+  DrawFunction draw;
+  LightingFunction light;
+
+  VkPipeline forwardPipeline = VK_NULL_HANDLE;
+  VkPipeline gbufferPipeline = VK_NULL_HANDLE;
+  VkPipeline lightingPipeline = VK_NULL_HANDLE;
+
+  VkImage targetImage;
+  VkDeviceMemory targetMemory;
+  VkImageView targetView;
+};
@@ -0,0 +1,45 @@
+#include "deletionQueue.h"
+
+DeletionQueue::DeletionQueue(const VulkanContext& ctx) : ctx{ctx} {}
+
+void DeletionQueue::push(std::function<void()> destroy) {
+  std::lock_guard<std::mutex> lock(mutex);
+  entries.push_back({std::move(destroy), 0});
+}
+
+/**
+ * Called after submitting a frame with its timeline value. Everything retired since the previous frame may be used
+ * by this frame's commands
+ */
+void DeletionQueue::stamp(uint64_t value) {
+  std::lock_guard<std::mutex> lock(mutex);
+  // Unstamped entries are at the back
+  for (auto entry = entries.rbegin(); entry != entries.rend() && entry->value == 0; entry++) {
+    entry->value = value;
+  }
+}
+
+/**
+ * Destroy the entries whose submissions have completed. Does not block
+ */
+void DeletionQueue::collect() {
+  uint64_t completed = ctx.completedValue();
+
+  std::lock_guard<std::mutex> lock(mutex);
+  // Entries are stamped in submission order
+  while (!entries.empty() && entries.front().value != 0 && entries.front().value <= completed) {
+    entries.front().destroy();
+    entries.pop_front();
+  }
+}
+
+/**
+ * Destroy everything immediately. The device must be idle
+ */
+void DeletionQueue::flush() {
+  std::lock_guard<std::mutex> lock(mutex);
+  for (auto& entry : entries) {
+    entry.destroy();
+  }
+  entries.clear();
+}
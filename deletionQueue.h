@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+
+#include "vulkanUtils.h"
+
+/**
+ * Destroys resources once every submission which may have used them has completed, without waiting for the device
+ * to go idle. Entries are stamped with the timeline value of the next frame submitted after they were retired, as
+ * commands recorded before their retirement are submitted no later than that. Safe to push from any thread
+ */
+class DeletionQueue {
+ public:
+  const VulkanContext& ctx;
+
+  DeletionQueue() = delete;
+  DeletionQueue(const VulkanContext& ctx);
+  DeletionQueue(const DeletionQueue& deletionQueue) = delete;
+
+  void push(std::function<void()> destroy);
+  void stamp(uint64_t value);
+  void collect();
+  void flush();
+
+ private:
+  struct Entry {
+    std::function<void()> destroy;
+    // 0 until the next frame has been submitted
+    uint64_t value;
+  };
+
+  std::deque<Entry> entries;
+
+  std::mutex mutex;
+};
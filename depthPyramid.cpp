@@ -0,0 +1,296 @@
+#include "depthPyramid.h"
+
+#include <algorithm>
+#include <array>
+#include <stdexcept>
+#include <string>
+
+#include "image.h"
+
+const uint32_t PYRAMID_WORKGROUP_SIZE = 8;
+const VkFormat PYRAMID_FORMAT = VK_FORMAT_R32_SFLOAT;
+
+static uint32_t previousPowerOfTwo(uint32_t value) {
+  uint32_t result = 1;
+  while (result * 2 <= value) {
+    result *= 2;
+  }
+  return result;
+}
+
+DepthPyramid::DepthPyramid(const VulkanContext& ctx, PipelineManager& pipelineManager, ShaderLibrary& shaderLibrary,
+                           DeletionQueue& deletionQueue, VkSampleCountFlagBits depthSamples)
+    : ctx{ctx}, pipelineManager{pipelineManager}, deletionQueue{deletionQueue} {
+  // ----- Sampler -----
+  // Unfiltered so that depths are never blended with nearer ones
+  VkSamplerCreateInfo samplerInfo{};
+  samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+  samplerInfo.magFilter = VK_FILTER_NEAREST;
+  samplerInfo.minFilter = VK_FILTER_NEAREST;
+  samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+  samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+  samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+  samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+  samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+
+  if (vkCreateSampler(ctx.device, &samplerInfo, nullptr, &sampler) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to create depth pyramid sampler");
+  }
+
+  // ----- Descriptor set layouts -----
+  // Source level or depth attachment, destination level
+  std::array<VkDescriptorSetLayoutBinding, 2> reductionBindings{};
+  for (uint32_t i = 0; i < reductionBindings.size(); i++) {
+    reductionBindings[i].binding = i;
+    reductionBindings[i].descriptorType = i == 0 ? VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER : VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    reductionBindings[i].descriptorCount = 1;
+    reductionBindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+  }
+
+  VkDescriptorSetLayoutCreateInfo layoutInfo{};
+  layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+  layoutInfo.bindingCount = static_cast<uint32_t>(reductionBindings.size());
+  layoutInfo.pBindings = reductionBindings.data();
+
+  if (vkCreateDescriptorSetLayout(ctx.device, &layoutInfo, nullptr, &reductionSetLayout) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to create depth pyramid descriptor set layout");
+  }
+
+  VkDescriptorSetLayoutBinding samplingBinding{};
+  samplingBinding.binding = 0;
+  samplingBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+  samplingBinding.descriptorCount = 1;
+  samplingBinding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+  layoutInfo.bindingCount = 1;
+  layoutInfo.pBindings = &samplingBinding;
+
+  if (vkCreateDescriptorSetLayout(ctx.device, &layoutInfo, nullptr, &samplingSetLayout) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to create depth pyramid descriptor set layout");
+  }
+
+  // ----- Pipelines -----
+  VkPushConstantRange pushConstantRange{};
+  pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+  pushConstantRange.offset = 0;
+  pushConstantRange.size = sizeof(Reduction);
+
+  pipelineLayout = pipelineManager.layout({reductionSetLayout}, {pushConstantRange});
+
+  std::string samples = std::to_string(static_cast<uint32_t>(depthSamples));
+  for (bool depthSource : {true, false}) {
+    PipelineDescription description{};
+    description.stages = {shaderLibrary.load("depthPyramid.comp", VK_SHADER_STAGE_COMPUTE_BIT,
+                                             {{"DEPTH_SOURCE", depthSource ? "1" : "0"}, {"DEPTH_SAMPLES", samples}})};
+    description.layout = pipelineLayout;
+    (depthSource ? depthPipeline : reducePipeline) = pipelineManager.request(description);
+  }
+  pipelineManager.wait(*depthPipeline);
+  pipelineManager.wait(*reducePipeline);
+}
+
+// The device must be idle
+DepthPyramid::~DepthPyramid() {
+  destroyImage();
+  vkDestroyDescriptorSetLayout(ctx.device, reductionSetLayout, nullptr);
+  vkDestroyDescriptorSetLayout(ctx.device, samplingSetLayout, nullptr);
+  vkDestroySampler(ctx.device, sampler, nullptr);
+}
+
+// The depth attachment is read in a compute shader, and the pyramid written as a storage image
+bool DepthPyramid::isSupported(const VulkanContext& ctx, VkFormat depthFormat) {
+  VkFormatProperties depthProperties;
+  vkGetPhysicalDeviceFormatProperties(ctx.physicalDevice, depthFormat, &depthProperties);
+  VkFormatProperties pyramidProperties;
+  vkGetPhysicalDeviceFormatProperties(ctx.physicalDevice, PYRAMID_FORMAT, &pyramidProperties);
+
+  return (depthProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT) &&
+         (pyramidProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT);
+}
+
+/**
+ * Recreate the pyramid for a new depth attachment. The old one may still be in use by frames in flight and is retired
+ * through the deletion queue. Command buffers using the sampling set must be re-recorded
+ */
+void DepthPyramid::resize(VkExtent2D depthExtent, VkImageView depthView) {
+  if (image != VK_NULL_HANDLE) {
+    deletionQueue.push([device = ctx.device, image = image, memory = memory, view = view, levelViews = levelViews,
+                        descriptorPool = descriptorPool] {
+      vkDestroyDescriptorPool(device, descriptorPool, nullptr);
+      for (auto levelView : levelViews) {
+        vkDestroyImageView(device, levelView, nullptr);
+      }
+      vkDestroyImageView(device, view, nullptr);
+      vkDestroyImage(device, image, nullptr);
+      vkFreeMemory(device, memory, nullptr);
+    });
+  }
+
+  extent = {previousPowerOfTwo(depthExtent.width), previousPowerOfTwo(depthExtent.height)};
+  levelCount = 1;
+  while ((std::max(extent.width, extent.height) >> levelCount) > 0) {
+    levelCount++;
+  }
+
+  createImage(ctx, extent.width, extent.height, levelCount, VK_SAMPLE_COUNT_1_BIT, PYRAMID_FORMAT, VK_IMAGE_TILING_OPTIMAL,
+              VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, image, memory);
+
+  view = createImageView(ctx.device, image, PYRAMID_FORMAT, VK_IMAGE_ASPECT_COLOR_BIT, levelCount);
+  levelViews.resize(levelCount);
+  for (uint32_t level = 0; level < levelCount; level++) {
+    VkImageViewCreateInfo viewInfo{};
+    viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    viewInfo.image = image;
+    viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    viewInfo.format = PYRAMID_FORMAT;
+    viewInfo.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, level, 1, 0, 1};
+
+    if (vkCreateImageView(ctx.device, &viewInfo, nullptr, &levelViews[level]) != VK_SUCCESS) {
+      throw std::runtime_error("Failed to create depth pyramid level view");
+    }
+  }
+
+  // The pyramid stays in the general layout
+  VkCommandBuffer commandBuffer;
+  beginCommand(ctx, commandBuffer);
+
+  VkImageMemoryBarrier barrier{};
+  barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+  barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.image = image;
+  barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, levelCount, 0, 1};
+  barrier.srcAccessMask = 0;
+  barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+  vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+                       0, nullptr, 0, nullptr, 1, &barrier);
+
+  submitCommand(ctx, commandBuffer, ctx.graphicsQueue);
+
+  createDescriptorSets(depthView);
+}
+
+void DepthPyramid::createDescriptorSets(VkImageView depthView) {
+  std::array<VkDescriptorPoolSize, 2> poolSizes{};
+  poolSizes[0].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+  poolSizes[0].descriptorCount = levelCount + 1;
+  poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+  poolSizes[1].descriptorCount = levelCount;
+
+  VkDescriptorPoolCreateInfo poolInfo{};
+  poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+  poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+  poolInfo.pPoolSizes = poolSizes.data();
+  poolInfo.maxSets = levelCount + 1;
+
+  if (vkCreateDescriptorPool(ctx.device, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to create depth pyramid descriptor pool");
+  }
+
+  std::vector<VkDescriptorSetLayout> layouts(levelCount, reductionSetLayout);
+  layouts.push_back(samplingSetLayout);
+  std::vector<VkDescriptorSet> sets(layouts.size());
+
+  VkDescriptorSetAllocateInfo allocInfo{};
+  allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+  allocInfo.descriptorPool = descriptorPool;
+  allocInfo.descriptorSetCount = static_cast<uint32_t>(layouts.size());
+  allocInfo.pSetLayouts = layouts.data();
+
+  if (vkAllocateDescriptorSets(ctx.device, &allocInfo, sets.data()) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to allocate depth pyramid descriptor sets");
+  }
+  samplingSet = sets.back();
+  sets.pop_back();
+  reductionSets = sets;
+
+  // Level 0 reads the depth attachment, which the render pass leaves read only
+  std::vector<VkDescriptorImageInfo> sourceInfos(levelCount);
+  std::vector<VkDescriptorImageInfo> destinationInfos(levelCount);
+  std::vector<VkWriteDescriptorSet> descriptorWrites;
+
+  for (uint32_t level = 0; level < levelCount; level++) {
+    if (level == 0) {
+      sourceInfos[level] = {sampler, depthView, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL};
+    } else {
+      sourceInfos[level] = {sampler, levelViews[level - 1], VK_IMAGE_LAYOUT_GENERAL};
+    }
+    destinationInfos[level] = {VK_NULL_HANDLE, levelViews[level], VK_IMAGE_LAYOUT_GENERAL};
+
+    VkWriteDescriptorSet write{};
+    write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write.dstSet = reductionSets[level];
+    write.descriptorCount = 1;
+
+    write.dstBinding = 0;
+    write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    write.pImageInfo = &sourceInfos[level];
+    descriptorWrites.push_back(write);
+
+    write.dstBinding = 1;
+    write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    write.pImageInfo = &destinationInfos[level];
+    descriptorWrites.push_back(write);
+  }
+
+  VkDescriptorImageInfo samplingInfo{sampler, view, VK_IMAGE_LAYOUT_GENERAL};
+  VkWriteDescriptorSet samplingWrite{};
+  samplingWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+  samplingWrite.dstSet = samplingSet;
+  samplingWrite.dstBinding = 0;
+  samplingWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+  samplingWrite.descriptorCount = 1;
+  samplingWrite.pImageInfo = &samplingInfo;
+  descriptorWrites.push_back(samplingWrite);
+
+  vkUpdateDescriptorSets(ctx.device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+}
+
+/**
+ * Record the reduction of the render area of the depth attachment into every level. Must be recorded outside of a
+ * render pass which has made its depth writes visible to compute shaders. Leaves the pyramid visible to compute shaders
+ */
+void DepthPyramid::build(VkCommandBuffer commandBuffer, VkExtent2D renderExtent) {
+  // Culling of earlier frames must have read the pyramid before it is overwritten
+  VkMemoryBarrier barrier{};
+  barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  barrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+  barrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+  vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+                       1, &barrier, 0, nullptr, 0, nullptr);
+
+  // Each level is read by the next one
+  barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+  VkExtent2D sourceExtent = renderExtent;
+  for (uint32_t level = 0; level < levelCount; level++) {
+    VkExtent2D levelExtent = {std::max(extent.width >> level, 1u), std::max(extent.height >> level, 1u)};
+
+    VkPipeline pipeline = pipelineManager.resolve(level == 0 ? *depthPipeline : *reducePipeline, VK_NULL_HANDLE);
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &reductionSets[level], 0, nullptr);
+
+    Reduction reduction{{sourceExtent.width, sourceExtent.height}, {levelExtent.width, levelExtent.height}};
+    vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(reduction), &reduction);
+    vkCmdDispatch(commandBuffer, (levelExtent.width + PYRAMID_WORKGROUP_SIZE - 1) / PYRAMID_WORKGROUP_SIZE,
+                  (levelExtent.height + PYRAMID_WORKGROUP_SIZE - 1) / PYRAMID_WORKGROUP_SIZE, 1);
+
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+                         1, &barrier, 0, nullptr, 0, nullptr);
+    sourceExtent = levelExtent;
+  }
+}
+
+// The device must be idle
+void DepthPyramid::destroyImage() {
+  vkDestroyDescriptorPool(ctx.device, descriptorPool, nullptr);
+  for (auto levelView : levelViews) {
+    vkDestroyImageView(ctx.device, levelView, nullptr);
+  }
+  vkDestroyImageView(ctx.device, view, nullptr);
+  vkDestroyImage(ctx.device, image, nullptr);
+  vkFreeMemory(ctx.device, memory, nullptr);
+}
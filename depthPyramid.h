@@ -0,0 +1,67 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "deletionQueue.h"
+#include "pipelineManager.h"
+#include "shaderLibrary.h"
+#include "vulkanUtils.h"
+
+/**
+ * Hierarchical depth buffer for occlusion culling. Each texel of a level holds the farthest depth of the texels it
+ * covers in the level below, so a bound whose nearest depth is farther than the texels under it is hidden. Level 0 is
+ * the largest power of two that fits the depth attachment and covers the render area. Built by a compute dispatch per
+ * level and kept in the general layout, as it is written as a storage image and sampled by the next level
+ */
+class DepthPyramid {
+ public:
+  const VulkanContext& ctx;
+
+  // Binding 0 samples all levels with a nearest filter. For shaders testing bounds against the pyramid
+  VkDescriptorSetLayout samplingSetLayout;
+  // Replaced whenever the pyramid is resized
+  VkDescriptorSet samplingSet = VK_NULL_HANDLE;
+  VkExtent2D extent{};
+  uint32_t levelCount = 0;
+
+  DepthPyramid() = delete;
+  DepthPyramid(const VulkanContext& ctx, PipelineManager& pipelineManager, ShaderLibrary& shaderLibrary,
+               DeletionQueue& deletionQueue, VkSampleCountFlagBits depthSamples);
+  DepthPyramid(const DepthPyramid& depthPyramid) = delete;
+  ~DepthPyramid();
+
+  static bool isSupported(const VulkanContext& ctx, VkFormat depthFormat);
+
+  void resize(VkExtent2D depthExtent, VkImageView depthView);
+  void build(VkCommandBuffer commandBuffer, VkExtent2D renderExtent);
+
+ private:
+  // Matches the push constants in depthPyramid.comp
+  struct Reduction {
+    uint32_t sourceExtent[2];
+    uint32_t destinationExtent[2];
+  };
+
+  PipelineManager& pipelineManager;
+  DeletionQueue& deletionQueue;
+
+  // Reduces the depth attachment into level 0, and each level into the next
+  std::shared_ptr<PipelineHandle> depthPipeline;
+  std::shared_ptr<PipelineHandle> reducePipeline;
+  VkDescriptorSetLayout reductionSetLayout;
+  VkPipelineLayout pipelineLayout;
+  VkSampler sampler;
+
+  VkImage image = VK_NULL_HANDLE;
+  VkDeviceMemory memory = VK_NULL_HANDLE;
+  // All levels, for sampling
+  VkImageView view = VK_NULL_HANDLE;
+  // One per level, for storing and for reading by the next level
+  std::vector<VkImageView> levelViews;
+  VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+  std::vector<VkDescriptorSet> reductionSets;
+
+  void createDescriptorSets(VkImageView depthView);
+  void destroyImage();
+};
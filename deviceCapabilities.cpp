@@ -0,0 +1,95 @@
+#include "deviceCapabilities.h"
+
+#include <algorithm>
+
+const char* featureTierName(FeatureTier tier) {
+  switch (tier) {
+    case FeatureTier::Minimal:
+      return "minimal";
+    case FeatureTier::Standard:
+      return "standard";
+    case FeatureTier::High:
+      return "high";
+  }
+  return "unknown";
+}
+
+std::optional<FeatureTier> parseFeatureTier(const std::string& name) {
+  for (auto tier : {FeatureTier::Minimal, FeatureTier::Standard, FeatureTier::High}) {
+    if (name == featureTierName(tier)) {
+      return tier;
+    }
+  }
+  return std::nullopt;
+}
+
+static int64_t deviceTypeScore(VkPhysicalDeviceType type) {
+  switch (type) {
+    case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:
+      return 1000000;
+    case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU:
+      return 100000;
+    case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU:
+      return 50000;
+    default:
+      // CPU implementations such as lavapipe are the last resort
+      return 0;
+  }
+}
+
+DeviceCapabilities queryDeviceCapabilities(VkPhysicalDevice physicalDevice) {
+  DeviceCapabilities capabilities{};
+  capabilities.physicalDevice = physicalDevice;
+  vkGetPhysicalDeviceProperties(physicalDevice, &capabilities.properties);
+
+  // ----- Memory -----
+  VkPhysicalDeviceMemoryProperties memoryProperties;
+  vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+  for (uint32_t i = 0; i < memoryProperties.memoryHeapCount; i++) {
+    if (memoryProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) {
+      capabilities.deviceLocalMemory = std::max(capabilities.deviceLocalMemory, memoryProperties.memoryHeaps[i].size);
+    }
+  }
+
+  // ----- Features -----
+  VkPhysicalDeviceVulkan11Features features11{};
+  features11.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_1_FEATURES;
+  VkPhysicalDeviceVulkan12Features features12{};
+  features12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+  features12.pNext = &features11;
+  VkPhysicalDeviceFeatures2 features2{};
+  features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+  features2.pNext = &features12;
+
+  // The 1.1 and 1.2 structures cannot be queried from older devices
+  bool vulkan12 = capabilities.properties.apiVersion >= VK_API_VERSION_1_2;
+  if (vulkan12) {
+    vkGetPhysicalDeviceFeatures2(physicalDevice, &features2);
+  } else {
+    vkGetPhysicalDeviceFeatures(physicalDevice, &features2.features);
+  }
+
+  const VkPhysicalDeviceFeatures& features = features2.features;
+  capabilities.multiDrawIndirect = features.multiDrawIndirect;
+  capabilities.drawIndirectFirstInstance = features.drawIndirectFirstInstance;
+
+  if (vulkan12) {
+    capabilities.drawIndirectCount = features12.drawIndirectCount;
+    capabilities.multiview = features11.multiview;
+    capabilities.timelineSemaphore = features12.timelineSemaphore;
+  }
+
+  // ----- Tier -----
+  bool standard = capabilities.multiDrawIndirect && capabilities.drawIndirectFirstInstance && capabilities.multiview;
+  bool high = standard && capabilities.drawIndirectCount;
+  capabilities.tier = high ? FeatureTier::High : standard ? FeatureTier::Standard : FeatureTier::Minimal;
+
+  // ----- Score -----
+  int64_t score = deviceTypeScore(capabilities.properties.deviceType);
+  // One point per 64 MiB, at most 64 GiB so that memory never outweighs the device type
+  score += static_cast<int64_t>(std::min<VkDeviceSize>(capabilities.deviceLocalMemory, 64ull << 30) >> 26);
+  score += 2000 * static_cast<int64_t>(capabilities.tier);
+  capabilities.score = score;
+
+  return capabilities;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <optional>
+#include <string>
+
+/**
+ * Sets of optional features the renderer uses together. Each tier includes the ones below it
+ *  Minimal:  the required features only
+ *  Standard: GPU-driven drawing with multi-draw indirect and a first instance, multiview
+ *  High:     draw count from a buffer
+ */
+enum class FeatureTier {
+  Minimal,
+  Standard,
+  High
+};
+
+const char* featureTierName(FeatureTier tier);
+std::optional<FeatureTier> parseFeatureTier(const std::string& name);
+
+/**
+ * Device chosen by the user, by index in enumeration order or by part of its name, and the highest tier to enable.
+ * Empty or unset selects automatically
+ */
+struct DeviceSelection {
+  std::string device;
+  std::optional<FeatureTier> maxTier;
+};
+
+/**
+ * What a physical device offers the renderer, and a score to choose between devices. The device type dominates the
+ * score, then the feature tier and device local memory break ties. Only what the renderer uses is scored
+ */
+struct DeviceCapabilities {
+  VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
+  VkPhysicalDeviceProperties properties{};
+
+  // Largest device local heap
+  VkDeviceSize deviceLocalMemory = 0;
+
+  bool multiDrawIndirect = false;
+  bool drawIndirectFirstInstance = false;
+  bool drawIndirectCount = false;
+  bool multiview = false;
+  bool timelineSemaphore = false;
+
+  // Highest tier whose features are all supported
+  FeatureTier tier = FeatureTier::Minimal;
+  int64_t score = 0;
+};
+
+DeviceCapabilities queryDeviceCapabilities(VkPhysicalDevice physicalDevice);
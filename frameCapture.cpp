@@ -0,0 +1,232 @@
+#include "frameCapture.h"
+
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <utility>
+
+static double toMilliseconds(std::chrono::steady_clock::duration duration) {
+  return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+FrameCapture::FrameCapture(const VulkanContext& ctx, uint32_t framesInFlight) : ctx{ctx} {
+  frames.resize(framesInFlight);
+
+  std::vector<VkCommandBuffer> commandBuffers(framesInFlight);
+  VkCommandBufferAllocateInfo allocInfo{};
+  allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+  allocInfo.commandPool = ctx.commandPool;
+  allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+  allocInfo.commandBufferCount = framesInFlight;
+
+  if (vkAllocateCommandBuffers(ctx.device, &allocInfo, commandBuffers.data()) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to allocate capture command buffers");
+  }
+  for (uint32_t i = 0; i < framesInFlight; i++) {
+    frames[i].commandBuffer = commandBuffers[i];
+  }
+}
+
+// The device must be idle. Captures which have not been delivered are dropped
+FrameCapture::~FrameCapture() {
+  for (auto& state : frames) {
+    vkFreeCommandBuffers(ctx.device, ctx.commandPool, 1, &state.commandBuffer);
+    if (state.buffer != VK_NULL_HANDLE) {
+      vkDestroyBuffer(ctx.device, state.buffer, nullptr);
+      vkFreeMemory(ctx.device, state.memory, nullptr);
+    }
+  }
+}
+
+// 8 bit formats whose texels can be copied out as they are
+bool FrameCapture::isSupported(VkFormat format) {
+  switch (format) {
+    case VK_FORMAT_R8G8B8A8_SRGB:
+    case VK_FORMAT_R8G8B8A8_UNORM:
+    case VK_FORMAT_B8G8R8A8_SRGB:
+    case VK_FORMAT_B8G8R8A8_UNORM:
+      return true;
+    default:
+      return false;
+  }
+}
+
+// Capture the next frame drawn. Requests made before the same frame share its copy
+void FrameCapture::request(Callback callback) {
+  if (requested.empty()) {
+    requestTime = Clock::now();
+  }
+  requested.push_back(std::move(callback));
+}
+
+std::future<FrameImage> FrameCapture::request() {
+  auto promise = std::make_shared<std::promise<FrameImage>>();
+  request([promise](FrameImage image) { promise->set_value(std::move(image)); });
+  return promise->get_future();
+}
+
+/**
+ * Record the copy of a frame's resolved color image if a capture has been requested. Returns the command buffer to
+ * submit after the frame's draw commands, or VK_NULL_HANDLE. The frame's previous submission must have completed.
+ * The image is returned to its layout so that presentation is unaffected
+ */
+VkCommandBuffer FrameCapture::record(uint32_t frame, VkImage image, VkFormat format, VkExtent2D extent, VkImageLayout layout) {
+  if (requested.empty()) {
+    return VK_NULL_HANDLE;
+  }
+  if (!isSupported(format)) {
+    std::cerr << "Frames of format " << format << " cannot be captured" << std::endl;
+    requested.clear();
+    return VK_NULL_HANDLE;
+  }
+
+  auto startTime = Clock::now();
+
+  FrameState& state = frames[frame];
+  // Delivered when the frame slot was waited on, unless nothing has polled since
+  if (!state.callbacks.empty()) {
+    deliver(state);
+  }
+
+  resizeBuffer(state, static_cast<VkDeviceSize>(extent.width) * extent.height * 4);
+  state.callbacks = std::move(requested);
+  requested.clear();
+  state.requestTime = requestTime;
+  state.timelineValue = 0;
+  state.extent = extent;
+  state.swizzle = format == VK_FORMAT_B8G8R8A8_SRGB || format == VK_FORMAT_B8G8R8A8_UNORM;
+
+  VkCommandBuffer commandBuffer = state.commandBuffer;
+  vkResetCommandBuffer(commandBuffer, 0);
+
+  VkCommandBufferBeginInfo beginInfo{};
+  beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+  if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to begin recording capture command buffer");
+  }
+
+  // The image was last written either as an attachment, resolved by the scene pass, or by the upscaling blit
+  VkImageMemoryBarrier barrier{};
+  barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+  barrier.oldLayout = layout;
+  barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.image = image;
+  barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+  barrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+  vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+                       VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+  VkBufferImageCopy region{};
+  region.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+  region.imageOffset = {0, 0, 0};
+  region.imageExtent = {extent.width, extent.height, 1};
+
+  vkCmdCopyImageToBuffer(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, state.buffer, 1, &region);
+
+  // Back to the layout the image is presented or read in. Presentation waits on the frame's semaphore
+  VkImageMemoryBarrier restoreBarrier = barrier;
+  restoreBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+  restoreBarrier.newLayout = layout;
+  restoreBarrier.srcAccessMask = 0;
+  restoreBarrier.dstAccessMask = 0;
+
+  VkBufferMemoryBarrier bufferBarrier{};
+  bufferBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+  bufferBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  bufferBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+  bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  bufferBarrier.buffer = state.buffer;
+  bufferBarrier.offset = 0;
+  bufferBarrier.size = VK_WHOLE_SIZE;
+
+  vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT | VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+                       0, nullptr, 1, &bufferBarrier, layout == VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL ? 0 : 1, &restoreBarrier);
+
+  if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to record capture command buffer");
+  }
+
+  totalCpuTime += toMilliseconds(Clock::now() - startTime);
+  return commandBuffer;
+}
+
+// Timeline value of the submission containing the command buffer returned by record
+void FrameCapture::submitted(uint32_t frame, uint64_t timelineValue) {
+  frames[frame].timelineValue = timelineValue;
+}
+
+// Deliver the captures of completed frames. Never blocks
+void FrameCapture::poll() {
+  std::optional<uint64_t> completed;
+  for (auto& state : frames) {
+    if (state.callbacks.empty()) {
+      continue;
+    }
+    if (!completed) {
+      completed = ctx.completedValue();
+    }
+    if (state.timelineValue != 0 && state.timelineValue <= *completed) {
+      deliver(state);
+    }
+  }
+}
+
+void FrameCapture::deliver(FrameState& state) {
+  auto startTime = Clock::now();
+
+  FrameImage image{state.extent.width, state.extent.height};
+  image.pixels.resize(static_cast<size_t>(state.extent.width) * state.extent.height * 4);
+  memcpy(image.pixels.data(), state.mapped, image.pixels.size());
+
+  if (state.swizzle) {
+    for (size_t i = 0; i < image.pixels.size(); i += 4) {
+      std::swap(image.pixels[i], image.pixels[i + 2]);
+    }
+  }
+
+  auto callbacks = std::move(state.callbacks);
+  state.callbacks.clear();
+  state.timelineValue = 0;
+
+  captureCount++;
+  totalLatency += toMilliseconds(Clock::now() - state.requestTime);
+  totalCpuTime += toMilliseconds(Clock::now() - startTime);
+
+  // The last callback can take the pixels
+  for (size_t i = 0; i + 1 < callbacks.size(); i++) {
+    callbacks[i](image);
+  }
+  callbacks.back()(std::move(image));
+}
+
+// The frame's previous submission has completed so the buffer can be replaced immediately
+void FrameCapture::resizeBuffer(FrameState& state, VkDeviceSize size) {
+  if (state.buffer != VK_NULL_HANDLE && state.size == size) {
+    return;
+  }
+  if (state.buffer != VK_NULL_HANDLE) {
+    vkDestroyBuffer(ctx.device, state.buffer, nullptr);
+    vkFreeMemory(ctx.device, state.memory, nullptr);
+  }
+
+  createBuffer(ctx, size, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+               VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, state.buffer, state.memory);
+  vkMapMemory(ctx.device, state.memory, 0, size, 0, &state.mapped);
+  state.size = size;
+}
+
+void FrameCapture::report() const {
+  if (captureCount > 0) {
+    std::cout << "Frame captures: " << captureCount << ", render thread cost average " << totalCpuTime / captureCount
+              << " ms, delivered after average " << totalLatency / captureCount << " ms" << std::endl;
+  }
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <future>
+#include <vector>
+
+#include "offscreenTarget.h"
+#include "vulkanUtils.h"
+
+/**
+ * Asynchronous readback of rendered frames. A request is attached to the next frame drawn, whose resolved color
+ * image is copied to a host-visible buffer by a command buffer submitted together with the frame's draw commands.
+ * The pixels are delivered once the frame's timeline value has been reached, which is polled at the start of every
+ * frame, so capturing never waits for the device. The copy is kept out of the draw command buffer so that cached
+ * and parallel recorded draws are unaffected.
+ * Depth is not captured: it is a render graph image at the MSAA sample count, which cannot be copied to a buffer, and
+ * is only stored when a later pass of the graph reads it
+ */
+class FrameCapture {
+ public:
+  const VulkanContext& ctx;
+
+  // Called on the render thread with RGBA8 pixels
+  using Callback = std::function<void(FrameImage image)>;
+
+  FrameCapture() = delete;
+  FrameCapture(const VulkanContext& ctx, uint32_t framesInFlight);
+  FrameCapture(const FrameCapture& frameCapture) = delete;
+  ~FrameCapture();
+
+  static bool isSupported(VkFormat format);
+
+  void request(Callback callback);
+  std::future<FrameImage> request();
+
+  VkCommandBuffer record(uint32_t frame, VkImage image, VkFormat format, VkExtent2D extent, VkImageLayout layout);
+  void submitted(uint32_t frame, uint64_t timelineValue);
+  void poll();
+  void report() const;
+
+ private:
+  using Clock = std::chrono::steady_clock;
+
+  struct FrameState {
+    VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+    VkBuffer buffer = VK_NULL_HANDLE;
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    void* mapped = nullptr;
+    VkDeviceSize size = 0;
+
+    // Capture in flight, delivered once the timeline value is reached
+    std::vector<Callback> callbacks;
+    Clock::time_point requestTime;
+    uint64_t timelineValue = 0;
+    VkExtent2D extent{};
+    bool swizzle = false;
+  };
+
+  std::vector<FrameState> frames;
+  std::vector<Callback> requested;
+  Clock::time_point requestTime;
+
+  uint64_t captureCount = 0;
+  // CPU time spent recording copies and converting pixels on the render thread
+  double totalCpuTime = 0.0;
+  // Time from the request to delivery
+  double totalLatency = 0.0;
+
+  void resizeBuffer(FrameState& state, VkDeviceSize size);
+  void deliver(FrameState& state);
+};
@@ -0,0 +1,156 @@
+#include "framePacer.h"
+
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+
+void FramePacer::Statistic::record(double milliseconds) {
+  count++;
+  total += milliseconds;
+  max = std::max(max, milliseconds);
+}
+
+double FramePacer::Statistic::average() const {
+  return count > 0 ? total / count : 0.0;
+}
+
+static double toMilliseconds(std::chrono::steady_clock::duration duration) {
+  return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+/*--------------- FramePacer ---------------*/
+
+FramePacer::FramePacer(const VulkanContext& ctx, uint32_t framesInFlight, double maxFrameRate) : ctx{ctx} {
+  if (maxFrameRate > 0.0) {
+    framePeriod = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / maxFrameRate));
+  }
+  nextFrameTime = Clock::now();
+
+  // Timestamps are only available if the graphics queue has valid timestamp bits
+  QueueFamilyIndices indices = findQueueFamilies(ctx.physicalDevice, ctx.surface);
+  uint32_t queueFamilyCount{};
+  vkGetPhysicalDeviceQueueFamilyProperties(ctx.physicalDevice, &queueFamilyCount, nullptr);
+  std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+  vkGetPhysicalDeviceQueueFamilyProperties(ctx.physicalDevice, &queueFamilyCount, queueFamilies.data());
+
+  if (queueFamilies[indices.graphicsFamily.value()].timestampValidBits == 0) {
+    std::cerr << "Timestamp queries are not supported. GPU frame time will not be measured" << std::endl;
+    return;
+  }
+  timestampPeriod = ctx.properties.limits.timestampPeriod;
+
+  VkQueryPoolCreateInfo queryPoolInfo{};
+  queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+  queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+  queryPoolInfo.queryCount = 2 * framesInFlight;
+
+  if (vkCreateQueryPool(ctx.device, &queryPoolInfo, nullptr, &queryPool) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to create timestamp query pool");
+  }
+  timestampsWritten.resize(framesInFlight, false);
+}
+
+FramePacer::~FramePacer() {
+  vkDestroyQueryPool(ctx.device, queryPool, nullptr);
+}
+
+/**
+ * Sleep until the next frame is due. Called before polling input so that input is sampled as late as possible
+ */
+void FramePacer::waitForNextFrame() {
+  if (framePeriod == Clock::duration::zero()) {
+    return;
+  }
+
+  std::this_thread::sleep_until(nextFrameTime);
+  // Do not try to catch up on frames missed because of a slow frame
+  nextFrameTime = std::max(nextFrameTime + framePeriod, Clock::now());
+}
+
+void FramePacer::markInput() {
+  inputTime = Clock::now();
+}
+
+/**
+ * Called after waiting for the timeline value of the frame, which guarantees that its previous timestamps are available.
+ * Returns the GPU time in milliseconds of the previous submission of the frame, if it was measured
+ */
+std::optional<double> FramePacer::beginFrame(uint32_t frame) {
+  previousFrameStart = frameStart;
+  frameStart = Clock::now();
+  if (previousFrameStart != Clock::time_point{}) {
+    frameInterval.record(toMilliseconds(frameStart - previousFrameStart));
+  }
+
+  if (queryPool == VK_NULL_HANDLE || !timestampsWritten[frame]) {
+    return std::nullopt;
+  }
+  timestampsWritten[frame] = false;
+
+  uint64_t timestamps[2];
+  if (vkGetQueryPoolResults(ctx.device, queryPool, 2 * frame, 2, sizeof(timestamps), timestamps, sizeof(uint64_t),
+                            VK_QUERY_RESULT_64_BIT) != VK_SUCCESS) {
+    return std::nullopt;
+  }
+  double milliseconds = (timestamps[1] - timestamps[0]) * timestampPeriod * 1e-6;
+  gpuTime.record(milliseconds);
+  return milliseconds;
+}
+
+// Must be recorded outside of a render pass
+void FramePacer::writeBeginTimestamp(VkCommandBuffer commandBuffer, uint32_t frame) {
+  if (queryPool == VK_NULL_HANDLE) {
+    return;
+  }
+  vkCmdResetQueryPool(commandBuffer, queryPool, 2 * frame, 2);
+  vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPool, 2 * frame);
+}
+
+void FramePacer::writeEndTimestamp(VkCommandBuffer commandBuffer, uint32_t frame) {
+  if (queryPool == VK_NULL_HANDLE) {
+    return;
+  }
+  vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, 2 * frame + 1);
+}
+
+/**
+ * Called once vkQueuePresentKHR has returned. Latency is measured from the last input polled for the frame, if any,
+ * up to the present call as the time the image reaches the display is not known without present timing extensions
+ */
+void FramePacer::endFrame(uint32_t frame) {
+  if (queryPool != VK_NULL_HANDLE) {
+    timestampsWritten[frame] = true;
+  }
+
+  auto now = Clock::now();
+  cpuTime.record(toMilliseconds(now - frameStart));
+  if (inputTime) {
+    latency.record(toMilliseconds(now - *inputTime));
+    inputTime.reset();
+  }
+}
+
+void FramePacer::report() const {
+  if (frameInterval.count == 0) {
+    return;
+  }
+  std::cout << "Frame interval: average " << frameInterval.average() << " ms (" << 1000.0 / frameInterval.average()
+            << " fps), max " << frameInterval.max << " ms" << std::endl;
+  std::cout << "CPU frame time: average " << cpuTime.average() << " ms, max " << cpuTime.max << " ms" << std::endl;
+  if (gpuTime.count > 0) {
+    std::cout << "GPU frame time: average " << gpuTime.average() << " ms, max " << gpuTime.max << " ms" << std::endl;
+  }
+  if (latency.count > 0) {
+    std::cout << "Input to present latency: average " << latency.average() << " ms, max " << latency.max << " ms" << std::endl;
+  }
+}
+
+// Milliseconds the GPU spent on all measured frames
+double FramePacer::totalGpuTime() const {
+  return gpuTime.total;
+}
+
+bool FramePacer::measuresGpuTime() const {
+  return queryPool != VK_NULL_HANDLE;
+}
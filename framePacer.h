@@ -0,0 +1,62 @@
+#pragma once
+
+#include <chrono>
+#include <optional>
+#include <vector>
+
+#include "vulkanUtils.h"
+
+/**
+ * Optionally caps the frame rate and measures frame interval, CPU and GPU frame time and the latency from
+ * polling input to handing the frame to the presentation engine. GPU time is taken from timestamp queries which
+ * are read back once the frame's timeline value has been waited on, so measuring never stalls the pipeline
+ */
+class FramePacer {
+ public:
+  const VulkanContext& ctx;
+
+  FramePacer() = delete;
+  FramePacer(const VulkanContext& ctx, uint32_t framesInFlight, double maxFrameRate);
+  FramePacer(const FramePacer& framePacer) = delete;
+  ~FramePacer();
+
+  void waitForNextFrame();
+  void markInput();
+  std::optional<double> beginFrame(uint32_t frame);
+  void writeBeginTimestamp(VkCommandBuffer commandBuffer, uint32_t frame);
+  void writeEndTimestamp(VkCommandBuffer commandBuffer, uint32_t frame);
+  void endFrame(uint32_t frame);
+  void report() const;
+  double totalGpuTime() const;
+  bool measuresGpuTime() const;
+
+ private:
+  using Clock = std::chrono::steady_clock;
+
+  struct Statistic {
+    uint64_t count = 0;
+    double total = 0.0;
+    double max = 0.0;
+
+    void record(double milliseconds);
+    double average() const;
+  };
+
+  Clock::duration framePeriod{};
+  Clock::time_point nextFrameTime;
+  // Unset until input is polled for the next frame. Headless and batch runs poll no input and measure no latency
+  std::optional<Clock::time_point> inputTime;
+  Clock::time_point frameStart;
+  Clock::time_point previousFrameStart;
+
+  // Two timestamps per frame in flight
+  VkQueryPool queryPool = VK_NULL_HANDLE;
+  float timestampPeriod = 0.0f;
+  // Set once the frame has been submitted. Command buffers may be replayed without being re-recorded
+  std::vector<bool> timestampsWritten;
+
+  Statistic frameInterval;
+  Statistic cpuTime;
+  Statistic gpuTime;
+  Statistic latency;
+};
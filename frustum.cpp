@@ -0,0 +1,184 @@
+#include "frustum.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define FRUSTUM_X86
+#endif
+
+/**
+ * Extract the planes of a view projection matrix (Gribb and Hartmann). Clip space z is in [0, w], the Vulkan depth
+ * range which every projection is built with
+ */
+Frustum extractFrustum(const glm::mat4& viewProjection) {
+  // GLM matrices are column major
+  auto row = [&](int i) {
+    return glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+  };
+
+  Frustum frustum{};
+  frustum.planes[0] = row(3) + row(0);
+  frustum.planes[1] = row(3) - row(0);
+  frustum.planes[2] = row(3) + row(1);
+  frustum.planes[3] = row(3) - row(1);
+  frustum.planes[4] = row(2);
+  frustum.planes[5] = row(3) - row(2);
+
+  // Normalize so that plane distances can be compared with sphere radii
+  for (auto& plane : frustum.planes) {
+    plane /= glm::length(glm::vec3(plane));
+  }
+
+  return frustum;
+}
+
+bool sphereInFrustum(const Frustum& frustum, glm::vec3 center, float radius) {
+  for (const auto& plane : frustum.planes) {
+    if (glm::dot(glm::vec3(plane), center) + plane.w < -radius) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/**
+ * Test the corner furthest along each plane normal to reject the box and the nearest corner to accept it
+ */
+Containment boxInFrustum(const Frustum& frustum, const float minimum[3], const float maximum[3]) {
+  Containment result = Containment::Inside;
+
+  for (const auto& plane : frustum.planes) {
+    float furthest = plane.w;
+    float nearest = plane.w;
+    for (int axis = 0; axis < 3; axis++) {
+      furthest += plane[axis] * (plane[axis] > 0.0f ? maximum[axis] : minimum[axis]);
+      nearest += plane[axis] * (plane[axis] > 0.0f ? minimum[axis] : maximum[axis]);
+    }
+
+    if (furthest < 0.0f) {
+      return Containment::Outside;
+    }
+    if (nearest < 0.0f) {
+      result = Containment::Intersecting;
+    }
+  }
+
+  return result;
+}
+
+/*----- Batched sphere tests -----*/
+
+SimdLevel detectSimdLevel() {
+#ifdef FRUSTUM_X86
+  if (__builtin_cpu_supports("avx2")) {
+    return SimdLevel::AVX2;
+  }
+  return SimdLevel::SSE2;
+#else
+  return SimdLevel::Scalar;
+#endif
+}
+
+const char* simdLevelName(SimdLevel level) {
+  switch (level) {
+    case SimdLevel::AVX2:
+      return "AVX2";
+    case SimdLevel::SSE2:
+      return "SSE2";
+    default:
+      return "scalar";
+  }
+}
+
+static void cullSpheresScalar(const Frustum& frustum, const float* x, const float* y, const float* z, const float* radius,
+                              const uint32_t* ids, uint32_t count, std::vector<uint32_t>& visible) {
+  for (uint32_t i = 0; i < count; i++) {
+    if (sphereInFrustum(frustum, {x[i], y[i], z[i]}, radius[i])) {
+      visible.push_back(ids[i]);
+    }
+  }
+}
+
+#ifdef FRUSTUM_X86
+
+// Lanes are tested against all planes without branching and the visible ones are picked from the movemask
+static void cullSpheresSSE2(const Frustum& frustum, const float* x, const float* y, const float* z, const float* radius,
+                            const uint32_t* ids, uint32_t count, std::vector<uint32_t>& visible) {
+  const uint32_t width = 4;
+  uint32_t batched = count - count % width;
+
+  for (uint32_t i = 0; i < batched; i += width) {
+    __m128 px = _mm_loadu_ps(x + i);
+    __m128 py = _mm_loadu_ps(y + i);
+    __m128 pz = _mm_loadu_ps(z + i);
+    __m128 negativeRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(radius + i));
+
+    __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+    for (const auto& plane : frustum.planes) {
+      __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(px, _mm_set1_ps(plane.x)), _mm_mul_ps(py, _mm_set1_ps(plane.y))),
+                                   _mm_add_ps(_mm_mul_ps(pz, _mm_set1_ps(plane.z)), _mm_set1_ps(plane.w)));
+      inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, negativeRadius));
+    }
+
+    for (int mask = _mm_movemask_ps(inside); mask != 0; mask &= mask - 1) {
+      visible.push_back(ids[i + __builtin_ctz(mask)]);
+    }
+  }
+
+  cullSpheresScalar(frustum, x + batched, y + batched, z + batched, radius + batched, ids + batched, count - batched, visible);
+}
+
+__attribute__((target("avx2"))) static void cullSpheresAVX2(const Frustum& frustum, const float* x, const float* y, const float* z,
+                                                            const float* radius, const uint32_t* ids, uint32_t count,
+                                                            std::vector<uint32_t>& visible) {
+  const uint32_t width = 8;
+  uint32_t batched = count - count % width;
+
+  __m256 planeX[6], planeY[6], planeZ[6], planeW[6];
+  for (int p = 0; p < 6; p++) {
+    planeX[p] = _mm256_set1_ps(frustum.planes[p].x);
+    planeY[p] = _mm256_set1_ps(frustum.planes[p].y);
+    planeZ[p] = _mm256_set1_ps(frustum.planes[p].z);
+    planeW[p] = _mm256_set1_ps(frustum.planes[p].w);
+  }
+
+  for (uint32_t i = 0; i < batched; i += width) {
+    __m256 px = _mm256_loadu_ps(x + i);
+    __m256 py = _mm256_loadu_ps(y + i);
+    __m256 pz = _mm256_loadu_ps(z + i);
+    __m256 negativeRadius = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(radius + i));
+
+    __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+    for (int p = 0; p < 6; p++) {
+      __m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(px, planeX[p]), _mm256_mul_ps(py, planeY[p])),
+                                      _mm256_add_ps(_mm256_mul_ps(pz, planeZ[p]), planeW[p]));
+      inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, negativeRadius, _CMP_GE_OQ));
+    }
+
+    for (int mask = _mm256_movemask_ps(inside); mask != 0; mask &= mask - 1) {
+      visible.push_back(ids[i + __builtin_ctz(mask)]);
+    }
+  }
+
+  cullSpheresSSE2(frustum, x + batched, y + batched, z + batched, radius + batched, ids + batched, count - batched, visible);
+}
+
+#endif
+
+/**
+ * Append the ids of the spheres which intersect the frustum. Spheres are given as separate coordinate arrays so that
+ * a batch of them loads into one register per component
+ */
+void cullSpheres(const Frustum& frustum, const float* x, const float* y, const float* z, const float* radius,
+                 const uint32_t* ids, uint32_t count, std::vector<uint32_t>& visible, SimdLevel level) {
+#ifdef FRUSTUM_X86
+  if (level == SimdLevel::AVX2) {
+    cullSpheresAVX2(frustum, x, y, z, radius, ids, count, visible);
+    return;
+  }
+  if (level == SimdLevel::SSE2) {
+    cullSpheresSSE2(frustum, x, y, z, radius, ids, count, visible);
+    return;
+  }
+#endif
+  cullSpheresScalar(frustum, x, y, z, radius, ids, count, visible);
+}
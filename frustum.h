@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <vector>
+
+/**
+ * World space frustum as six planes: left, right, bottom, top, near, far. The normals (xyz) point inwards and w is
+ * the plane offset, so a point p is inside a plane if dot(plane.xyz, p) + plane.w >= 0
+ */
+struct Frustum {
+  glm::vec4 planes[6];
+};
+
+// Instruction set used for testing spheres in batches
+enum class SimdLevel {
+  Scalar,
+  SSE2,
+  AVX2
+};
+
+// Result of testing a bounding box against the frustum
+enum class Containment {
+  Outside,
+  Intersecting,
+  Inside
+};
+
+Frustum extractFrustum(const glm::mat4& viewProjection);
+bool sphereInFrustum(const Frustum& frustum, glm::vec3 center, float radius);
+Containment boxInFrustum(const Frustum& frustum, const float minimum[3], const float maximum[3]);
+
+SimdLevel detectSimdLevel();
+const char* simdLevelName(SimdLevel level);
+void cullSpheres(const Frustum& frustum, const float* x, const float* y, const float* z, const float* radius,
+                 const uint32_t* ids, uint32_t count, std::vector<uint32_t>& visible, SimdLevel level);
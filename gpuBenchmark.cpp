@@ -0,0 +1,100 @@
+#include "gpuBenchmark.h"
+
+#include <array>
+#include <chrono>
+#include <iostream>
+#include <stdexcept>
+
+GpuBenchmark::GpuBenchmark(const VulkanContext& ctx, uint32_t iterations) : ctx{ctx}, iterations{iterations} {
+  VkCommandBufferAllocateInfo allocInfo{};
+  allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+  allocInfo.commandPool = ctx.commandPool;
+  allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+  allocInfo.commandBufferCount = 1;
+
+  if (vkAllocateCommandBuffers(ctx.device, &allocInfo, &commandBuffer) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to allocate benchmark command buffer");
+  }
+
+  if (ctx.properties.limits.timestampComputeAndGraphics) {
+    VkQueryPoolCreateInfo queryPoolInfo{};
+    queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    queryPoolInfo.queryCount = 2;
+
+    if (vkCreateQueryPool(ctx.device, &queryPoolInfo, nullptr, &queryPool) != VK_SUCCESS) {
+      vkFreeCommandBuffers(ctx.device, ctx.commandPool, 1, &commandBuffer);
+      throw std::runtime_error("Failed to create benchmark query pool");
+    }
+  }
+}
+
+// The command buffer must not be pending, which holds after every measure
+GpuBenchmark::~GpuBenchmark() {
+  if (queryPool != VK_NULL_HANDLE) {
+    vkDestroyQueryPool(ctx.device, queryPool, nullptr);
+  }
+  vkFreeCommandBuffers(ctx.device, ctx.commandPool, 1, &commandBuffer);
+}
+
+/**
+ * Print the average recording, GPU and submit to completion time of the work in milliseconds. Returns the GPU time,
+ * or the submit to completion time without timestamps
+ */
+double GpuBenchmark::measure(const std::string& name, const RecordFunction& record) {
+  bool timestamps = queryPool != VK_NULL_HANDLE;
+  double recordTime = 0.0;
+  double gpuTime = 0.0;
+  double frameTime = 0.0;
+
+  for (uint32_t i = 0; i <= iterations; i++) {
+    auto startTime = std::chrono::high_resolution_clock::now();
+
+    vkResetCommandBuffer(commandBuffer, 0);
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+      throw std::runtime_error("Failed to begin recording benchmark command buffer");
+    }
+    if (timestamps) {
+      vkCmdResetQueryPool(commandBuffer, queryPool, 0, 2);
+      vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPool, 0);
+    }
+
+    record(commandBuffer);
+
+    if (timestamps) {
+      vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, 1);
+    }
+    if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+      throw std::runtime_error("Failed to record benchmark command buffer");
+    }
+    auto recordedTime = std::chrono::high_resolution_clock::now();
+
+    Submission submission{};
+    submission.commandBuffers = {commandBuffer};
+    ctx.wait(ctx.submit(ctx.graphicsQueue, submission));
+    auto endTime = std::chrono::high_resolution_clock::now();
+
+    if (i == 0) {
+      continue;
+    }
+    recordTime += std::chrono::duration<double, std::milli>(recordedTime - startTime).count();
+    frameTime += std::chrono::duration<double, std::milli>(endTime - startTime).count();
+
+    if (timestamps) {
+      std::array<uint64_t, 2> ticks;
+      vkGetQueryPoolResults(ctx.device, queryPool, 0, 2, sizeof(ticks), ticks.data(), sizeof(uint64_t),
+                            VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT);
+      gpuTime += (ticks[1] - ticks[0]) * ctx.properties.limits.timestampPeriod * 1e-6;
+    }
+  }
+
+  std::cout << name << ": record " << recordTime / iterations << " ms";
+  if (timestamps) {
+    std::cout << ", GPU " << gpuTime / iterations << " ms";
+  }
+  std::cout << ", submit to completion " << frameTime / iterations << " ms" << std::endl;
+  return timestamps ? gpuTime / iterations : frameTime / iterations;
+}
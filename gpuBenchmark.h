@@ -0,0 +1,33 @@
+#pragma once
+
+#include <functional>
+#include <string>
+
+#include "vulkanUtils.h"
+
+/**
+ * Times work recorded into a one-time command buffer on the graphics queue. Each iteration is recorded, submitted
+ * and waited for on its own, between timestamps at the top and bottom of the pipe if the queue supports them.
+ * The first iteration warms up and is not counted
+ */
+class GpuBenchmark {
+ public:
+  const VulkanContext& ctx;
+
+  const uint32_t iterations;
+
+  // Records the measured work. Called once per iteration
+  using RecordFunction = std::function<void(VkCommandBuffer commandBuffer)>;
+
+  GpuBenchmark() = delete;
+  GpuBenchmark(const VulkanContext& ctx, uint32_t iterations);
+  GpuBenchmark(const GpuBenchmark& gpuBenchmark) = delete;
+  ~GpuBenchmark();
+
+  double measure(const std::string& name, const RecordFunction& record);
+
+ private:
+  VkCommandBuffer commandBuffer;
+  // Null if the graphics queue has no timestamps
+  VkQueryPool queryPool = VK_NULL_HANDLE;
+};
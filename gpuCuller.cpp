@@ -0,0 +1,308 @@
+#include "gpuCuller.h"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+const uint32_t CULLING_WORKGROUP_SIZE = 64;
+
+GpuCuller::GpuCuller(const VulkanContext& ctx, PipelineManager& pipelineManager, ShaderLibrary& shaderLibrary, uint32_t framesInFlight,
+                     VkBuffer meshBuffer, VkBuffer instanceBuffer, uint32_t instanceCount, const DepthPyramid* depthPyramid)
+    : ctx{ctx}, pipelineManager{pipelineManager}, instanceCount{instanceCount}, depthPyramid{depthPyramid} {
+  // ----- Buffers -----
+  drawCommandBuffers.resize(framesInFlight);
+  drawCommandMemory.resize(framesInFlight);
+  drawCountBuffers.resize(framesInFlight);
+  drawCountMemory.resize(framesInFlight);
+  drawCountMapped.resize(framesInFlight);
+  cullingBuffers.resize(framesInFlight);
+  cullingMemory.resize(framesInFlight);
+  cullingMapped.resize(framesInFlight);
+  submitted.resize(framesInFlight, false);
+
+  uint32_t phaseCount = depthPyramid ? 2 : 1;
+  for (uint32_t i = 0; i < framesInFlight; i++) {
+    createBuffer(ctx, sizeof(VkDrawIndexedIndirectCommand) * instanceCount * phaseCount,
+                 VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, drawCommandBuffers[i], drawCommandMemory[i]);
+
+    createBuffer(ctx, sizeof(DrawCounts),
+                 VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, drawCountBuffers[i], drawCountMemory[i]);
+    vkMapMemory(ctx.device, drawCountMemory[i], 0, sizeof(DrawCounts), 0, &drawCountMapped[i]);
+
+    createBuffer(ctx, sizeof(CullingData), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, cullingBuffers[i], cullingMemory[i]);
+    vkMapMemory(ctx.device, cullingMemory[i], 0, sizeof(CullingData), 0, &cullingMapped[i]);
+  }
+
+  // Everything is drawn in the early phase of the first frame
+  if (depthPyramid) {
+    createBuffer(ctx, sizeof(uint32_t) * instanceCount, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, visibilityBuffer, visibilityMemory);
+
+    VkCommandBuffer commandBuffer;
+    beginCommand(ctx, commandBuffer);
+    vkCmdFillBuffer(commandBuffer, visibilityBuffer, 0, VK_WHOLE_SIZE, 1);
+    submitCommand(ctx, commandBuffer, ctx.graphicsQueue);
+  }
+
+  createDescriptorSets(meshBuffer, instanceBuffer);
+
+  // ----- Pipelines -----
+  pipelineLayout = pipelineManager.layout({descriptorSetLayout});
+
+  std::string compact = ctx.drawIndirectCount ? "1" : "0";
+  PipelineDescription description{};
+  description.stages = {shaderLibrary.load("cull.comp", VK_SHADER_STAGE_COMPUTE_BIT,
+                                           {{"COMPACT", compact}, {"OCCLUSION_PHASE", depthPyramid ? "1" : "0"}})};
+  description.layout = pipelineLayout;
+
+  pipeline = pipelineManager.request(description);
+  pipelineManager.wait(*pipeline);
+
+  if (depthPyramid) {
+    latePipelineLayout = pipelineManager.layout({descriptorSetLayout, depthPyramid->samplingSetLayout});
+
+    description.stages = {shaderLibrary.load("cull.comp", VK_SHADER_STAGE_COMPUTE_BIT,
+                                             {{"COMPACT", compact}, {"OCCLUSION_PHASE", "2"}})};
+    description.layout = latePipelineLayout;
+
+    latePipeline = pipelineManager.request(description);
+    pipelineManager.wait(*latePipeline);
+  }
+}
+
+GpuCuller::~GpuCuller() {
+  vkDestroyBuffer(ctx.device, visibilityBuffer, nullptr);
+  vkFreeMemory(ctx.device, visibilityMemory, nullptr);
+  vkDestroyDescriptorPool(ctx.device, descriptorPool, nullptr);
+  vkDestroyDescriptorSetLayout(ctx.device, descriptorSetLayout, nullptr);
+
+  for (size_t i = 0; i < drawCommandBuffers.size(); i++) {
+    vkDestroyBuffer(ctx.device, drawCommandBuffers[i], nullptr);
+    vkFreeMemory(ctx.device, drawCommandMemory[i], nullptr);
+    vkDestroyBuffer(ctx.device, drawCountBuffers[i], nullptr);
+    vkFreeMemory(ctx.device, drawCountMemory[i], nullptr);
+    vkDestroyBuffer(ctx.device, cullingBuffers[i], nullptr);
+    vkFreeMemory(ctx.device, cullingMemory[i], nullptr);
+  }
+}
+
+// Culled instances must still be drawable from their slot with a non-zero first instance
+bool GpuCuller::isSupported(const VulkanContext& ctx) {
+  return ctx.drawIndirectFirstInstance && (ctx.drawIndirectCount || ctx.multiDrawIndirect);
+}
+
+void GpuCuller::createDescriptorSets(VkBuffer meshBuffer, VkBuffer instanceBuffer) {
+  // Meshes, instances, draw commands, draw count, culling data, and visibility with a depth pyramid
+  std::vector<VkDescriptorSetLayoutBinding> bindings(depthPyramid ? 6 : 5);
+  for (uint32_t i = 0; i < bindings.size(); i++) {
+    bindings[i].binding = i;
+    bindings[i].descriptorType = i == 4 ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    bindings[i].descriptorCount = 1;
+    bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+  }
+
+  VkDescriptorSetLayoutCreateInfo layoutInfo{};
+  layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+  layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+  layoutInfo.pBindings = bindings.data();
+
+  if (vkCreateDescriptorSetLayout(ctx.device, &layoutInfo, nullptr, &descriptorSetLayout) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to create culling descriptor set layout");
+  }
+
+  uint32_t frameCount = static_cast<uint32_t>(drawCommandBuffers.size());
+
+  std::array<VkDescriptorPoolSize, 2> poolSizes{};
+  poolSizes[0].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+  poolSizes[0].descriptorCount = static_cast<uint32_t>(bindings.size() - 1) * frameCount;
+  poolSizes[1].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+  poolSizes[1].descriptorCount = frameCount;
+
+  VkDescriptorPoolCreateInfo poolInfo{};
+  poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+  poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+  poolInfo.pPoolSizes = poolSizes.data();
+  poolInfo.maxSets = frameCount;
+
+  if (vkCreateDescriptorPool(ctx.device, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to create culling descriptor pool");
+  }
+
+  std::vector<VkDescriptorSetLayout> layouts(frameCount, descriptorSetLayout);
+  VkDescriptorSetAllocateInfo allocInfo{};
+  allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+  allocInfo.descriptorPool = descriptorPool;
+  allocInfo.descriptorSetCount = frameCount;
+  allocInfo.pSetLayouts = layouts.data();
+
+  descriptorSets.resize(frameCount);
+  if (vkAllocateDescriptorSets(ctx.device, &allocInfo, descriptorSets.data()) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to allocate culling descriptor sets");
+  }
+
+  for (uint32_t i = 0; i < frameCount; i++) {
+    std::array<VkDescriptorBufferInfo, 6> bufferInfos{};
+    bufferInfos[0] = {meshBuffer, 0, VK_WHOLE_SIZE};
+    bufferInfos[1] = {instanceBuffer, 0, VK_WHOLE_SIZE};
+    bufferInfos[2] = {drawCommandBuffers[i], 0, VK_WHOLE_SIZE};
+    bufferInfos[3] = {drawCountBuffers[i], 0, VK_WHOLE_SIZE};
+    bufferInfos[4] = {cullingBuffers[i], 0, VK_WHOLE_SIZE};
+    bufferInfos[5] = {visibilityBuffer, 0, VK_WHOLE_SIZE};
+
+    std::vector<VkWriteDescriptorSet> descriptorWrites(bindings.size());
+    for (uint32_t j = 0; j < descriptorWrites.size(); j++) {
+      descriptorWrites[j].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+      descriptorWrites[j].dstSet = descriptorSets[i];
+      descriptorWrites[j].dstBinding = j;
+      descriptorWrites[j].descriptorType = bindings[j].descriptorType;
+      descriptorWrites[j].descriptorCount = 1;
+      descriptorWrites[j].pBufferInfo = &bufferInfos[j];
+    }
+
+    vkUpdateDescriptorSets(ctx.device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+  }
+}
+
+/**
+ * Called once per frame after waiting for the frame. Collects the visible count of the previous use of this frame and
+ * writes the frustum for the next one. The frustum is read from a buffer so that recorded command buffers stay valid
+ */
+void GpuCuller::update(uint32_t frame, const glm::mat4& viewProjection) {
+  if (submitted[frame]) {
+    DrawCounts counts;
+    memcpy(&counts, drawCountMapped[frame], sizeof(counts));
+    culledFrames++;
+    visibleInstances += counts.early + counts.late;
+    lateInstances += counts.late;
+    occludedInstances += counts.occluded;
+    maxOccludedInstances = std::max(maxOccludedInstances, counts.occluded);
+  }
+  submitted[frame] = true;
+
+  Frustum frustum = extractFrustum(viewProjection);
+
+  CullingData cullingData{};
+  memcpy(cullingData.planes, frustum.planes, sizeof(cullingData.planes));
+  cullingData.viewProjection = viewProjection;
+  if (depthPyramid) {
+    cullingData.pyramidExtent = glm::vec2(depthPyramid->extent.width, depthPyramid->extent.height);
+  }
+  cullingData.instanceCount = instanceCount;
+  memcpy(cullingMapped[frame], &cullingData, sizeof(cullingData));
+}
+
+/**
+ * Record the culling dispatch, or the early phase with a depth pyramid. Must be recorded outside of a render pass
+ */
+void GpuCuller::cull(VkCommandBuffer commandBuffer, uint32_t frame) {
+  vkCmdFillBuffer(commandBuffer, drawCountBuffers[frame], 0, VK_WHOLE_SIZE, 0);
+
+  VkBufferMemoryBarrier clearBarrier{};
+  clearBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+  clearBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  clearBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+  clearBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  clearBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  clearBarrier.buffer = drawCountBuffers[frame];
+  clearBarrier.offset = 0;
+  clearBarrier.size = VK_WHOLE_SIZE;
+
+  vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+                       0, nullptr, 1, &clearBarrier, 0, nullptr);
+
+  // Visibility is written by the late phase of the previous frame
+  if (depthPyramid) {
+    VkMemoryBarrier visibilityBarrier{};
+    visibilityBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    visibilityBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    visibilityBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+                         1, &visibilityBarrier, 0, nullptr, 0, nullptr);
+  }
+
+  dispatch(commandBuffer, frame, false);
+}
+
+/**
+ * Record the late phase, which tests against the depth pyramid. The pyramid must have been built from the depth of the
+ * early phase's draws. Must be recorded outside of a render pass
+ */
+void GpuCuller::cullLate(VkCommandBuffer commandBuffer, uint32_t frame) {
+  // The early phase must have read the visibility before it is overwritten
+  VkMemoryBarrier barrier{};
+  barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  barrier.srcAccessMask = 0;
+  barrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+  vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+                       1, &barrier, 0, nullptr, 0, nullptr);
+
+  dispatch(commandBuffer, frame, true);
+}
+
+void GpuCuller::dispatch(VkCommandBuffer commandBuffer, uint32_t frame, bool late) {
+  if (late) {
+    std::array<VkDescriptorSet, 2> sets = {descriptorSets[frame], depthPyramid->samplingSet};
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineManager.resolve(*latePipeline, VK_NULL_HANDLE));
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, latePipelineLayout, 0,
+                            static_cast<uint32_t>(sets.size()), sets.data(), 0, nullptr);
+  } else {
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineManager.resolve(*pipeline, VK_NULL_HANDLE));
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &descriptorSets[frame], 0, nullptr);
+  }
+  vkCmdDispatch(commandBuffer, (instanceCount + CULLING_WORKGROUP_SIZE - 1) / CULLING_WORKGROUP_SIZE, 1, 1);
+
+  // Draw commands and count are consumed by the indirect draw
+  std::array<VkBufferMemoryBarrier, 2> cullBarriers{};
+  for (auto& barrier : cullBarriers) {
+    barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.offset = 0;
+    barrier.size = VK_WHOLE_SIZE;
+  }
+  cullBarriers[0].buffer = drawCommandBuffers[frame];
+  cullBarriers[1].buffer = drawCountBuffers[frame];
+
+  vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, 0,
+                       0, nullptr, static_cast<uint32_t>(cullBarriers.size()), cullBarriers.data(), 0, nullptr);
+}
+
+/**
+ * Record the indirect draws written by a phase's culling pass. The graphics pipeline, vertex and index buffers and
+ * descriptor sets must be bound
+ */
+void GpuCuller::draw(VkCommandBuffer commandBuffer, uint32_t frame, CullPhase phase) {
+  const uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+  bool late = phase == CullPhase::Late;
+  VkDeviceSize commandOffset = late ? stride * instanceCount : 0;
+  VkDeviceSize countOffset = late ? offsetof(DrawCounts, late) : offsetof(DrawCounts, early);
+
+  if (ctx.drawIndirectCount) {
+    vkCmdDrawIndexedIndirectCount(commandBuffer, drawCommandBuffers[frame], commandOffset, drawCountBuffers[frame],
+                                  countOffset, instanceCount, stride);
+  } else {
+    vkCmdDrawIndexedIndirect(commandBuffer, drawCommandBuffers[frame], commandOffset, instanceCount, stride);
+  }
+}
+
+void GpuCuller::report() const {
+  if (culledFrames == 0) {
+    return;
+  }
+  std::cout << "GPU culling: average " << (double)visibleInstances / culledFrames << " of " << instanceCount
+            << " instances visible" << std::endl;
+  if (depthPyramid) {
+    std::cout << "Occlusion culling: per frame " << (double)occludedInstances / culledFrames << " instances occluded (max "
+              << maxOccludedInstances << "), " << (double)lateInstances / culledFrames
+              << " drawn after the depth pyramid was built" << std::endl;
+  }
+}
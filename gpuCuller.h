@@ -0,0 +1,101 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "depthPyramid.h"
+#include "frustum.h"
+#include "pipelineManager.h"
+#include "shaderLibrary.h"
+#include "vulkanUtils.h"
+
+// Culling pass whose draw commands are drawn. Without a depth pyramid there is only the early phase
+enum class CullPhase {
+  Early,
+  Late
+};
+
+/**
+ * GPU-driven drawing. A compute pass tests every instance against the view frustum and writes an indexed indirect
+ * draw command for each visible one, so the CPU cost of a frame does not depend on the number of instances.
+ * With drawIndirectCount the commands are compacted and drawn with vkCmdDrawIndexedIndirectCount. Otherwise every
+ * instance keeps its slot, culled ones get an instance count of 0 and everything is drawn with multi-draw indirect.
+ *
+ * With a depth pyramid, culling also skips occluded instances in two phases. The early phase draws the instances
+ * visible in the previous frame. The late phase tests every instance against the pyramid built from their depth, and
+ * draws those which have become visible. Instances are tested against the current frame's depth, so nothing visible
+ * is culled
+ */
+class GpuCuller {
+ public:
+  const VulkanContext& ctx;
+
+  GpuCuller() = delete;
+  GpuCuller(const VulkanContext& ctx, PipelineManager& pipelineManager, ShaderLibrary& shaderLibrary, uint32_t framesInFlight,
+            VkBuffer meshBuffer, VkBuffer instanceBuffer, uint32_t instanceCount, const DepthPyramid* depthPyramid = nullptr);
+  GpuCuller(const GpuCuller& gpuCuller) = delete;
+  ~GpuCuller();
+
+  static bool isSupported(const VulkanContext& ctx);
+
+  void update(uint32_t frame, const glm::mat4& viewProjection);
+  void cull(VkCommandBuffer commandBuffer, uint32_t frame);
+  void cullLate(VkCommandBuffer commandBuffer, uint32_t frame);
+  void draw(VkCommandBuffer commandBuffer, uint32_t frame, CullPhase phase);
+  void report() const;
+
+ private:
+  // Matches the uniform block in cull.comp
+  struct CullingData {
+    glm::vec4 planes[6];
+    glm::mat4 viewProjection;
+    glm::vec2 pyramidExtent;
+    uint32_t instanceCount;
+  };
+
+  // Matches the draw count block in cull.comp
+  struct DrawCounts {
+    uint32_t early;
+    uint32_t late;
+    uint32_t occluded;
+  };
+
+  PipelineManager& pipelineManager;
+  // Frustum culling, or the early phase with a depth pyramid
+  std::shared_ptr<PipelineHandle> pipeline;
+  std::shared_ptr<PipelineHandle> latePipeline;
+  uint32_t instanceCount;
+  const DepthPyramid* depthPyramid;
+
+  VkDescriptorSetLayout descriptorSetLayout;
+  VkPipelineLayout pipelineLayout;
+  // Adds the pyramid's sampling set
+  VkPipelineLayout latePipelineLayout = VK_NULL_HANDLE;
+  VkDescriptorPool descriptorPool;
+  std::vector<VkDescriptorSet> descriptorSets;
+
+  // Shared by frames in flight, as every frame reads the visibility written by the previous one
+  VkBuffer visibilityBuffer = VK_NULL_HANDLE;
+  VkDeviceMemory visibilityMemory = VK_NULL_HANDLE;
+
+  // Per frame in flight. The late phase's draw commands follow the early ones
+  std::vector<VkBuffer> drawCommandBuffers;
+  std::vector<VkDeviceMemory> drawCommandMemory;
+  // Host visible so that the draw counts can be read back after waiting for the frame
+  std::vector<VkBuffer> drawCountBuffers;
+  std::vector<VkDeviceMemory> drawCountMemory;
+  std::vector<void*> drawCountMapped;
+  std::vector<VkBuffer> cullingBuffers;
+  std::vector<VkDeviceMemory> cullingMemory;
+  std::vector<void*> cullingMapped;
+  std::vector<bool> submitted;
+
+  uint64_t culledFrames = 0;
+  uint64_t visibleInstances = 0;
+  uint64_t lateInstances = 0;
+  uint64_t occludedInstances = 0;
+  uint32_t maxOccludedInstances = 0;
+
+  void createDescriptorSets(VkBuffer meshBuffer, VkBuffer instanceBuffer);
+  void dispatch(VkCommandBuffer commandBuffer, uint32_t frame, bool late);
+};
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// FNV-1a. Collisions of the 64 bit hash are treated as impossible wherever it is used as a key
+
+const uint64_t HASH_SEED = 14695981039346656037ull;
+
+inline void hashBytes(uint64_t& hash, const void* data, size_t size) {
+  const uint8_t* bytes = static_cast<const uint8_t*>(data);
+  for (size_t i = 0; i < size; i++) {
+    hash ^= bytes[i];
+    hash *= 1099511628211ull;
+  }
+}
+
+template <typename T>
+void hashValue(uint64_t& hash, const T& value) {
+  hashBytes(hash, &value, sizeof(T));
+}
+
+template <typename T>
+void hashVector(uint64_t& hash, const std::vector<T>& values) {
+  hashValue(hash, values.size());
+  hashBytes(hash, values.data(), values.size() * sizeof(T));
+}
+
+inline void hashString(uint64_t& hash, const std::string& value) {
+  hashValue(hash, value.size());
+  hashBytes(hash, value.data(), value.size());
+}
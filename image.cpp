@@ -2,9 +2,9 @@
 
 #include <stdexcept>
 
-void createImage(const VulkanContext& ctx, uint32_t width, uint32_t height, uint32_t mipLevels, VkSampleCountFlagBits numSamples,
-                 VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties,
-                 VkImage& image, VkDeviceMemory& imageMemory) {
+// Image without backing memory
+VkImage createImage(const VulkanContext& ctx, uint32_t width, uint32_t height, uint32_t mipLevels, VkSampleCountFlagBits numSamples,
+                    VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage) {
   VkImageCreateInfo imageInfo{};
   imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
   imageInfo.imageType = VK_IMAGE_TYPE_2D;
@@ -20,10 +20,19 @@ void createImage(const VulkanContext& ctx, uint32_t width, uint32_t height, uint
   imageInfo.samples = numSamples;
   imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
+  VkImage image;
   if (vkCreateImage(ctx.device, &imageInfo, nullptr, &image) != VK_SUCCESS) {
     throw std::runtime_error("Failed to create image");
   }
 
+  return image;
+}
+
+void createImage(const VulkanContext& ctx, uint32_t width, uint32_t height, uint32_t mipLevels, VkSampleCountFlagBits numSamples,
+                 VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties,
+                 VkImage& image, VkDeviceMemory& imageMemory) {
+  image = createImage(ctx, width, height, mipLevels, numSamples, format, tiling, usage);
+
   VkMemoryRequirements memRequirements;
   vkGetImageMemoryRequirements(ctx.device, image, &memRequirements);
 
@@ -73,31 +82,19 @@ void generateMipmaps(const VulkanContext& ctx, VkImage image, VkFormat imageForm
   VkCommandBuffer commandBuffer;
   beginCommand(ctx, commandBuffer);
 
-  VkImageMemoryBarrier barrier{};
-  barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-  barrier.image = image;
-  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-  barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-  barrier.subresourceRange.baseArrayLayer = 0;
-  barrier.subresourceRange.layerCount = 1;
-  barrier.subresourceRange.levelCount = 1;
+  // Each level is read by the blit into the next once written. The transitions to sampling are batched after the
+  // last blit, as nothing samples the image before the upload completes
+  BarrierBatch sampledBarriers;
 
   int32_t mipWidth = texWidth;
   int32_t mipHeight = texHeight;
 
   for (uint32_t i = 1; i < mipLevels; i++) {
-    barrier.subresourceRange.baseMipLevel = i - 1;
-    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-    barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-    barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-
-    vkCmdPipelineBarrier(commandBuffer,
-                         VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
-                         0, nullptr,
-                         0, nullptr,
-                         1, &barrier);
+    VkImageSubresourceRange source{VK_IMAGE_ASPECT_COLOR_BIT, i - 1, 1, 0, 1};
+
+    BarrierBatch sourceBarrier;
+    sourceBarrier.transition(image, source, ImageAccess::TransferDestination, ImageAccess::TransferSource);
+    sourceBarrier.record(commandBuffer);
 
     VkImageBlit blit{};
     blit.srcOffsets[0] = {0, 0, 0};
@@ -119,16 +116,7 @@ void generateMipmaps(const VulkanContext& ctx, VkImage image, VkFormat imageForm
                    1, &blit,
                    VK_FILTER_LINEAR);
 
-    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-    barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-    barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-
-    vkCmdPipelineBarrier(commandBuffer,
-                         VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
-                         0, nullptr,
-                         0, nullptr,
-                         1, &barrier);
+    sampledBarriers.transition(image, source, ImageAccess::TransferSource, ImageAccess::ShaderSampled);
 
     if (mipWidth > 1) {
       mipWidth /= 2;
@@ -138,17 +126,9 @@ void generateMipmaps(const VulkanContext& ctx, VkImage image, VkFormat imageForm
     }
   }
 
-  barrier.subresourceRange.baseMipLevel = mipLevels - 1;
-  barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-  barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-  barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-  barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-
-  vkCmdPipelineBarrier(commandBuffer,
-                       VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
-                       0, nullptr,
-                       0, nullptr,
-                       1, &barrier);
+  sampledBarriers.transition(image, {VK_IMAGE_ASPECT_COLOR_BIT, mipLevels - 1, 1, 0, 1}, ImageAccess::TransferDestination,
+                             ImageAccess::ShaderSampled);
+  sampledBarriers.record(commandBuffer);
 
   submitCommand(ctx, commandBuffer, ctx.graphicsQueue);
 }
@@ -180,50 +160,13 @@ void copyBufferToImage(const VulkanContext& ctx, VkBuffer buffer, VkImage image,
 
 /*----- Memory layout-----*/
 
-void transitionImageLayout(const VulkanContext& ctx, VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout, uint32_t mipLevels) {
+void transitionImageLayout(const VulkanContext& ctx, VkImage image, ImageAccess from, ImageAccess to, uint32_t mipLevels) {
   VkCommandBuffer commandBuffer;
   beginCommand(ctx, commandBuffer);
 
-  VkImageMemoryBarrier barrier{};
-  barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-  barrier.oldLayout = oldLayout;
-  barrier.newLayout = newLayout;
-  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-
-  barrier.image = image;
-  barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-  barrier.subresourceRange.baseMipLevel = 0;
-  barrier.subresourceRange.levelCount = mipLevels;
-  barrier.subresourceRange.baseArrayLayer = 0;
-  barrier.subresourceRange.layerCount = 1;
-
-  VkPipelineStageFlags sourceStage;
-  VkPipelineStageFlags destinationStage;
-
-  if (oldLayout == VK_IMAGE_LAYOUT_UNDEFINED && newLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL) {
-    barrier.srcAccessMask = 0;
-    barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-
-    sourceStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-    destinationStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-  } else if (oldLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL && newLayout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL) {
-    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-
-    sourceStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-    destinationStage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
-  } else {
-    throw std::invalid_argument("Unsupported layout transition");
-  }
-
-  vkCmdPipelineBarrier(
-      commandBuffer,
-      sourceStage, destinationStage,
-      0,
-      0, nullptr,
-      0, nullptr,
-      1, &barrier);
+  BarrierBatch barrier;
+  barrier.transition(image, {VK_IMAGE_ASPECT_COLOR_BIT, 0, mipLevels, 0, 1}, from, to);
+  barrier.record(commandBuffer);
 
   submitCommand(ctx, commandBuffer, ctx.graphicsQueue);
 }
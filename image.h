@@ -1,5 +1,8 @@
+#include "imageAccess.h"
 #include "vulkanUtils.h"
 
+VkImage createImage(const VulkanContext& ctx, uint32_t width, uint32_t height, uint32_t mipLevels, VkSampleCountFlagBits numSamples,
+                    VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage);
 void createImage(const VulkanContext& ctx, uint32_t width, uint32_t height, uint32_t mipLevels, VkSampleCountFlagBits numSamples,
                  VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties,
                  VkImage& image, VkDeviceMemory& imageMemory);
@@ -7,4 +10,4 @@ VkImageView createImageView(const VkDevice& device, VkImage image, VkFormat form
 
 void generateMipmaps(const VulkanContext& ctx, VkImage image, VkFormat imageFormat, int32_t texWidth, int32_t texHeight, uint32_t mipLevels);
 void copyBufferToImage(const VulkanContext& ctx, VkBuffer buffer, VkImage image, uint32_t width, uint32_t height);
-void transitionImageLayout(const VulkanContext& ctx, VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout, uint32_t mipLevels);
+void transitionImageLayout(const VulkanContext& ctx, VkImage image, ImageAccess from, ImageAccess to, uint32_t mipLevels);
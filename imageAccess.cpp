@@ -0,0 +1,84 @@
+#include "imageAccess.h"
+
+#include <stdexcept>
+
+ImageAccessInfo imageAccessInfo(ImageAccess access) {
+  switch (access) {
+    case ImageAccess::Undefined:
+      return {VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0, VK_IMAGE_LAYOUT_UNDEFINED};
+    case ImageAccess::ColorAttachment:
+      return {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+              VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL};
+    case ImageAccess::DepthAttachment:
+      return {VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+              VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+              VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL};
+    case ImageAccess::DepthSampled:
+      return {VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT,
+              VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL};
+    case ImageAccess::ShaderSampled:
+      return {VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT,
+              VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+    case ImageAccess::TransferSource:
+      return {VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL};
+    case ImageAccess::TransferDestination:
+      return {VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL};
+    case ImageAccess::Present:
+      // The acquire semaphore is waited on at the color attachment output stage, so transitions from the
+      // presented image wait for it too
+      return {VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_TRANSFER_READ_BIT,
+              VK_IMAGE_LAYOUT_PRESENT_SRC_KHR};
+  }
+  throw std::invalid_argument("Unknown image access");
+}
+
+bool accessWrites(ImageAccess access) {
+  return writeAccess(imageAccessInfo(access).access) != 0;
+}
+
+VkAccessFlags writeAccess(VkAccessFlags access) {
+  return access & (VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT |
+                   VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_HOST_WRITE_BIT | VK_ACCESS_MEMORY_WRITE_BIT);
+}
+
+/*--------------- BarrierBatch ---------------*/
+
+void BarrierBatch::transition(VkImage image, VkImageSubresourceRange range, ImageAccess from, ImageAccess to) {
+  ImageAccessInfo source = imageAccessInfo(from);
+  transition(image, range, source.stages, source.access, source.layout, to);
+}
+
+void BarrierBatch::transition(VkImage image, VkImageSubresourceRange range, VkPipelineStageFlags srcStageMask,
+                              VkAccessFlags srcAccess, VkImageLayout oldLayout, ImageAccess to) {
+  ImageAccessInfo destination = imageAccessInfo(to);
+
+  VkImageMemoryBarrier barrier{};
+  barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+  barrier.oldLayout = oldLayout;
+  barrier.newLayout = destination.layout;
+  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.image = image;
+  barrier.subresourceRange = range;
+  barrier.srcAccessMask = writeAccess(srcAccess);
+  barrier.dstAccessMask = destination.access;
+  barriers.push_back(barrier);
+
+  srcStages |= srcStageMask;
+  dstStages |= destination.stages;
+}
+
+bool BarrierBatch::empty() const {
+  return barriers.empty();
+}
+
+void BarrierBatch::record(VkCommandBuffer commandBuffer) {
+  if (barriers.empty()) {
+    return;
+  }
+  vkCmdPipelineBarrier(commandBuffer, srcStages, dstStages, 0, 0, nullptr, 0, nullptr,
+                       static_cast<uint32_t>(barriers.size()), barriers.data());
+  barriers.clear();
+  srcStages = 0;
+  dstStages = 0;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <vector>
+
+#include "vulkanUtils.h"
+
+/**
+ * Ways in which commands use an image. Barriers and render pass dependencies are derived from the stages, access
+ * and layout of the uses on either side rather than written out by hand
+ */
+enum class ImageAccess {
+  // Contents are discarded. The source of transitions of images which are written over
+  Undefined,
+  ColorAttachment,
+  DepthAttachment,
+  // Depth sampled by fragment or compute shaders
+  DepthSampled,
+  ShaderSampled,
+  TransferSource,
+  TransferDestination,
+  // Presented, or copied out by frame captures
+  Present
+};
+
+struct ImageAccessInfo {
+  VkPipelineStageFlags stages;
+  VkAccessFlags access;
+  VkImageLayout layout;
+};
+
+ImageAccessInfo imageAccessInfo(ImageAccess access);
+bool accessWrites(ImageAccess access);
+VkAccessFlags writeAccess(VkAccessFlags access);
+
+/**
+ * Image barriers collected and recorded with one pipeline barrier command. Only writes are made available, as reads
+ * need an execution dependency alone
+ */
+class BarrierBatch {
+ public:
+  void transition(VkImage image, VkImageSubresourceRange range, ImageAccess from, ImageAccess to);
+  void transition(VkImage image, VkImageSubresourceRange range, VkPipelineStageFlags srcStages, VkAccessFlags srcAccess,
+                  VkImageLayout oldLayout, ImageAccess to);
+
+  bool empty() const;
+  void record(VkCommandBuffer commandBuffer);
+
+ private:
+  VkPipelineStageFlags srcStages = 0;
+  VkPipelineStageFlags dstStages = 0;
+  std::vector<VkImageMemoryBarrier> barriers;
+};
@@ -0,0 +1,101 @@
+#include "imageWriter.h"
+
+#include <algorithm>
+#include <chrono>
+
+ImageWriter::ImageWriter(uint32_t threadCount) {
+  threadCount = std::max(1u, threadCount);
+  // Enough to keep every worker busy while the next images are read back
+  maxQueuedJobs = 2 * threadCount;
+
+  for (uint32_t i = 0; i < threadCount; i++) {
+    workers.emplace_back(&ImageWriter::workerLoop, this);
+  }
+}
+
+ImageWriter::~ImageWriter() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+    // Images still queued are dropped
+    jobs.clear();
+  }
+  jobAvailable.notify_all();
+  for (auto& worker : workers) {
+    if (worker.joinable()) {
+      worker.join();
+    }
+  }
+}
+
+// Queue an image to be written. Blocks while the queue is full
+void ImageWriter::push(std::string path, FrameImage image) {
+  auto startTime = std::chrono::high_resolution_clock::now();
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    jobTaken.wait(lock, [&] { return jobs.size() < maxQueuedJobs || error; });
+    if (error) {
+      std::rethrow_exception(error);
+    }
+    jobs.push_back({std::move(path), std::move(image)});
+
+    auto endTime = std::chrono::high_resolution_clock::now();
+    blockedTime += std::chrono::duration<double, std::milli>(endTime - startTime).count();
+  }
+  jobAvailable.notify_one();
+}
+
+// Write all queued images and stop the workers. Rethrows the first error of a worker
+void ImageWriter::finish() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  jobAvailable.notify_all();
+  for (auto& worker : workers) {
+    worker.join();
+  }
+
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
+
+uint64_t ImageWriter::writtenCount() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  return written;
+}
+
+double ImageWriter::blockedMilliseconds() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  return blockedTime;
+}
+
+// Workers drain the queue before stopping
+void ImageWriter::workerLoop() {
+  while (true) {
+    Job job;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      jobAvailable.wait(lock, [&] { return stopping || !jobs.empty(); });
+      if (jobs.empty()) {
+        return;
+      }
+      job = std::move(jobs.front());
+      jobs.pop_front();
+    }
+    jobTaken.notify_one();
+
+    try {
+      writePng(job.path, job.image);
+      std::lock_guard<std::mutex> lock(mutex);
+      written++;
+    } catch (...) {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (!error) {
+        error = std::current_exception();
+      }
+      jobTaken.notify_all();
+    }
+  }
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "offscreenTarget.h"
+
+/**
+ * Encodes frames to PNG files on worker threads so that encoding overlaps rendering. The queue is bounded, so the
+ * renderer is held back rather than buffering every image in memory when encoding is the bottleneck
+ */
+class ImageWriter {
+ public:
+  ImageWriter() = delete;
+  ImageWriter(uint32_t threadCount);
+  ImageWriter(const ImageWriter& imageWriter) = delete;
+  ~ImageWriter();
+
+  void push(std::string path, FrameImage image);
+  void finish();
+
+  uint64_t writtenCount() const;
+  // Time the render thread was blocked on a full queue
+  double blockedMilliseconds() const;
+
+ private:
+  struct Job {
+    std::string path;
+    FrameImage image;
+  };
+
+  std::vector<std::thread> workers;
+  std::deque<Job> jobs;
+  size_t maxQueuedJobs;
+
+  uint64_t written = 0;
+  double blockedTime = 0.0;
+  bool stopping = false;
+  // First failure on a worker, rethrown on the render thread
+  std::exception_ptr error;
+
+  mutable std::mutex mutex;
+  std::condition_variable jobAvailable;
+  std::condition_variable jobTaken;
+
+  void workerLoop();
+};
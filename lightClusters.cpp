@@ -0,0 +1,709 @@
+#include "lightClusters.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+
+#include "attribute.h"
+#include "camera.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CLUSTERS_X86
+#endif
+
+// Lights overlapping each point of the scene's floor on average
+const float LIGHT_OVERLAP = 4.0f;
+
+/**
+ * Lights scattered uniformly over a box. Their radius shrinks as their number grows so that the number of lights
+ * reaching a point of the box's floor stays about the same
+ */
+std::vector<PointLight> createLights(uint32_t count, glm::vec3 minimum, glm::vec3 maximum) {
+  const float pi = 3.14159265f;
+
+  // Fixed seed so that runs are comparable
+  std::mt19937 generator(1);
+  std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+  glm::vec3 size = maximum - minimum;
+  float radius = std::sqrt(LIGHT_OVERLAP * std::max(size.x * size.y, 1e-6f) / (pi * std::max(count, 1u)));
+
+  std::vector<PointLight> lights(count);
+  for (auto& light : lights) {
+    glm::vec3 position = minimum + size * glm::vec3{unit(generator), unit(generator), unit(generator)};
+    light.positionRadius = glm::vec4{position, radius * (0.75f + 0.5f * unit(generator))};
+    light.colorIntensity = glm::vec4{0.3f + 0.7f * unit(generator), 0.3f + 0.7f * unit(generator), 0.3f + 0.7f * unit(generator), 1.0f};
+  }
+  return lights;
+}
+
+/*----- ClusterGrid -----*/
+
+ClusterGrid ClusterGrid::create(const Camera& camera, VkExtent2D renderExtent) {
+  ClusterGrid grid{};
+  float tanHalfFovY = std::tan(0.5f * camera.fov);
+  grid.tanHalfFov = {tanHalfFovY * camera.aspect, tanHalfFovY};
+  grid.renderExtent = {static_cast<float>(renderExtent.width), static_cast<float>(renderExtent.height)};
+  grid.tileSize = glm::ceil(grid.renderExtent / glm::vec2{CLUSTER_COUNT_X, CLUSTER_COUNT_Y});
+  grid.near = camera.near;
+  grid.far = camera.far;
+
+  float logDepthRange = std::log(camera.far / camera.near);
+  grid.sliceScale = CLUSTER_COUNT_Z / logDepthRange;
+  grid.sliceBias = -std::log(camera.near) * grid.sliceScale;
+  return grid;
+}
+
+// Same expression as in the fragment shader
+uint32_t ClusterGrid::slice(float depth) const {
+  return static_cast<uint32_t>(std::clamp(std::log(depth) * sliceScale + sliceBias, 0.0f, static_cast<float>(CLUSTER_COUNT_Z - 1)));
+}
+
+/*----- Batched light bounds -----*/
+
+// Rows of the view matrix and the mapping from ratios of view space x and y to depth to tile coordinates
+struct BoundConstants {
+  float view[12];
+  float near;
+  float far;
+  float scaleX;
+  float offsetX;
+  float scaleY;
+  float offsetY;
+};
+
+struct LightArrays {
+  const float* x;
+  const float* y;
+  const float* z;
+  const float* radius;
+  float* viewX;
+  float* viewY;
+  float* depth;
+  float* tileMinX;
+  float* tileMaxX;
+  float* tileMinY;
+  float* tileMaxY;
+};
+
+/**
+ * The sphere is bounded by a box in view space, clipped to the near plane. Its extreme ratios of x and y to depth are
+ * at the corners of the box, so the nearest and farthest depth bound them. Screen y points down, so the scale along
+ * y is negative and the ends of the range swap
+ */
+static void boundLightsScalar(const BoundConstants& c, const LightArrays& lights, uint32_t first, uint32_t end) {
+  for (uint32_t i = first; i < end; i++) {
+    float x = lights.x[i];
+    float y = lights.y[i];
+    float z = lights.z[i];
+    float r = lights.radius[i];
+
+    float viewX = c.view[0] * x + c.view[1] * y + c.view[2] * z + c.view[3];
+    float viewY = c.view[4] * x + c.view[5] * y + c.view[6] * z + c.view[7];
+    float depth = 0.0f - (c.view[8] * x + c.view[9] * y + c.view[10] * z + c.view[11]);
+
+    float inverseNearest = 1.0f / std::max(depth - r, c.near);
+    float inverseFarthest = 1.0f / (depth + r);
+    float minRatioX = std::min((viewX - r) * inverseNearest, (viewX - r) * inverseFarthest);
+    float maxRatioX = std::max((viewX + r) * inverseNearest, (viewX + r) * inverseFarthest);
+    float minRatioY = std::min((viewY - r) * inverseNearest, (viewY - r) * inverseFarthest);
+    float maxRatioY = std::max((viewY + r) * inverseNearest, (viewY + r) * inverseFarthest);
+    bool inRange = depth + r >= c.near && depth - r <= c.far;
+
+    lights.viewX[i] = viewX;
+    lights.viewY[i] = viewY;
+    lights.depth[i] = depth;
+    lights.tileMinX[i] = inRange ? minRatioX * c.scaleX + c.offsetX : INFINITY;
+    lights.tileMaxX[i] = maxRatioX * c.scaleX + c.offsetX;
+    lights.tileMinY[i] = maxRatioY * c.scaleY + c.offsetY;
+    lights.tileMaxY[i] = minRatioY * c.scaleY + c.offsetY;
+  }
+}
+
+#ifdef CLUSTERS_X86
+
+static void boundLightsSSE2(const BoundConstants& c, const LightArrays& lights, uint32_t first, uint32_t end) {
+  const uint32_t width = 4;
+  uint32_t batched = first + (end - first) / width * width;
+
+  __m128 view[12];
+  for (int i = 0; i < 12; i++) {
+    view[i] = _mm_set1_ps(c.view[i]);
+  }
+  __m128 near = _mm_set1_ps(c.near);
+  __m128 far = _mm_set1_ps(c.far);
+  __m128 one = _mm_set1_ps(1.0f);
+  __m128 infinity = _mm_set1_ps(INFINITY);
+
+  for (uint32_t i = first; i < batched; i += width) {
+    __m128 x = _mm_loadu_ps(lights.x + i);
+    __m128 y = _mm_loadu_ps(lights.y + i);
+    __m128 z = _mm_loadu_ps(lights.z + i);
+    __m128 r = _mm_loadu_ps(lights.radius + i);
+
+    __m128 viewX = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(view[0], x), _mm_mul_ps(view[1], y)), _mm_mul_ps(view[2], z)), view[3]);
+    __m128 viewY = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(view[4], x), _mm_mul_ps(view[5], y)), _mm_mul_ps(view[6], z)), view[7]);
+    __m128 viewZ = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(view[8], x), _mm_mul_ps(view[9], y)), _mm_mul_ps(view[10], z)), view[11]);
+    __m128 depth = _mm_sub_ps(_mm_setzero_ps(), viewZ);
+
+    __m128 inverseNearest = _mm_div_ps(one, _mm_max_ps(_mm_sub_ps(depth, r), near));
+    __m128 inverseFarthest = _mm_div_ps(one, _mm_add_ps(depth, r));
+    __m128 lowX = _mm_sub_ps(viewX, r);
+    __m128 highX = _mm_add_ps(viewX, r);
+    __m128 lowY = _mm_sub_ps(viewY, r);
+    __m128 highY = _mm_add_ps(viewY, r);
+    __m128 minRatioX = _mm_min_ps(_mm_mul_ps(lowX, inverseNearest), _mm_mul_ps(lowX, inverseFarthest));
+    __m128 maxRatioX = _mm_max_ps(_mm_mul_ps(highX, inverseNearest), _mm_mul_ps(highX, inverseFarthest));
+    __m128 minRatioY = _mm_min_ps(_mm_mul_ps(lowY, inverseNearest), _mm_mul_ps(lowY, inverseFarthest));
+    __m128 maxRatioY = _mm_max_ps(_mm_mul_ps(highY, inverseNearest), _mm_mul_ps(highY, inverseFarthest));
+    __m128 inRange = _mm_and_ps(_mm_cmpge_ps(_mm_add_ps(depth, r), near), _mm_cmple_ps(_mm_sub_ps(depth, r), far));
+
+    __m128 tileMinX = _mm_add_ps(_mm_mul_ps(minRatioX, _mm_set1_ps(c.scaleX)), _mm_set1_ps(c.offsetX));
+    _mm_storeu_ps(lights.viewX + i, viewX);
+    _mm_storeu_ps(lights.viewY + i, viewY);
+    _mm_storeu_ps(lights.depth + i, depth);
+    _mm_storeu_ps(lights.tileMinX + i, _mm_or_ps(_mm_and_ps(inRange, tileMinX), _mm_andnot_ps(inRange, infinity)));
+    _mm_storeu_ps(lights.tileMaxX + i, _mm_add_ps(_mm_mul_ps(maxRatioX, _mm_set1_ps(c.scaleX)), _mm_set1_ps(c.offsetX)));
+    _mm_storeu_ps(lights.tileMinY + i, _mm_add_ps(_mm_mul_ps(maxRatioY, _mm_set1_ps(c.scaleY)), _mm_set1_ps(c.offsetY)));
+    _mm_storeu_ps(lights.tileMaxY + i, _mm_add_ps(_mm_mul_ps(minRatioY, _mm_set1_ps(c.scaleY)), _mm_set1_ps(c.offsetY)));
+  }
+
+  boundLightsScalar(c, lights, batched, end);
+}
+
+__attribute__((target("avx2"))) static void boundLightsAVX2(const BoundConstants& c, const LightArrays& lights, uint32_t count) {
+  const uint32_t width = 8;
+  uint32_t batched = count - count % width;
+
+  __m256 view[12];
+  for (int i = 0; i < 12; i++) {
+    view[i] = _mm256_set1_ps(c.view[i]);
+  }
+  __m256 near = _mm256_set1_ps(c.near);
+  __m256 far = _mm256_set1_ps(c.far);
+  __m256 one = _mm256_set1_ps(1.0f);
+  __m256 infinity = _mm256_set1_ps(INFINITY);
+
+  for (uint32_t i = 0; i < batched; i += width) {
+    __m256 x = _mm256_loadu_ps(lights.x + i);
+    __m256 y = _mm256_loadu_ps(lights.y + i);
+    __m256 z = _mm256_loadu_ps(lights.z + i);
+    __m256 r = _mm256_loadu_ps(lights.radius + i);
+
+    __m256 viewX = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(view[0], x), _mm256_mul_ps(view[1], y)), _mm256_mul_ps(view[2], z)), view[3]);
+    __m256 viewY = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(view[4], x), _mm256_mul_ps(view[5], y)), _mm256_mul_ps(view[6], z)), view[7]);
+    __m256 viewZ = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(view[8], x), _mm256_mul_ps(view[9], y)), _mm256_mul_ps(view[10], z)), view[11]);
+    __m256 depth = _mm256_sub_ps(_mm256_setzero_ps(), viewZ);
+
+    __m256 inverseNearest = _mm256_div_ps(one, _mm256_max_ps(_mm256_sub_ps(depth, r), near));
+    __m256 inverseFarthest = _mm256_div_ps(one, _mm256_add_ps(depth, r));
+    __m256 lowX = _mm256_sub_ps(viewX, r);
+    __m256 highX = _mm256_add_ps(viewX, r);
+    __m256 lowY = _mm256_sub_ps(viewY, r);
+    __m256 highY = _mm256_add_ps(viewY, r);
+    __m256 minRatioX = _mm256_min_ps(_mm256_mul_ps(lowX, inverseNearest), _mm256_mul_ps(lowX, inverseFarthest));
+    __m256 maxRatioX = _mm256_max_ps(_mm256_mul_ps(highX, inverseNearest), _mm256_mul_ps(highX, inverseFarthest));
+    __m256 minRatioY = _mm256_min_ps(_mm256_mul_ps(lowY, inverseNearest), _mm256_mul_ps(lowY, inverseFarthest));
+    __m256 maxRatioY = _mm256_max_ps(_mm256_mul_ps(highY, inverseNearest), _mm256_mul_ps(highY, inverseFarthest));
+    __m256 inRange = _mm256_and_ps(_mm256_cmp_ps(_mm256_add_ps(depth, r), near, _CMP_GE_OQ),
+                                   _mm256_cmp_ps(_mm256_sub_ps(depth, r), far, _CMP_LE_OQ));
+
+    __m256 tileMinX = _mm256_add_ps(_mm256_mul_ps(minRatioX, _mm256_set1_ps(c.scaleX)), _mm256_set1_ps(c.offsetX));
+    _mm256_storeu_ps(lights.viewX + i, viewX);
+    _mm256_storeu_ps(lights.viewY + i, viewY);
+    _mm256_storeu_ps(lights.depth + i, depth);
+    _mm256_storeu_ps(lights.tileMinX + i, _mm256_blendv_ps(infinity, tileMinX, inRange));
+    _mm256_storeu_ps(lights.tileMaxX + i, _mm256_add_ps(_mm256_mul_ps(maxRatioX, _mm256_set1_ps(c.scaleX)), _mm256_set1_ps(c.offsetX)));
+    _mm256_storeu_ps(lights.tileMinY + i, _mm256_add_ps(_mm256_mul_ps(maxRatioY, _mm256_set1_ps(c.scaleY)), _mm256_set1_ps(c.offsetY)));
+    _mm256_storeu_ps(lights.tileMaxY + i, _mm256_add_ps(_mm256_mul_ps(minRatioY, _mm256_set1_ps(c.scaleY)), _mm256_set1_ps(c.offsetY)));
+  }
+
+  boundLightsSSE2(c, lights, batched, count);
+}
+
+#endif
+
+static void boundLights(const BoundConstants& constants, const LightArrays& lights, uint32_t count, SimdLevel level) {
+#ifdef CLUSTERS_X86
+  if (level == SimdLevel::AVX2) {
+    boundLightsAVX2(constants, lights, count);
+    return;
+  }
+  if (level == SimdLevel::SSE2) {
+    boundLightsSSE2(constants, lights, 0, count);
+    return;
+  }
+#endif
+  boundLightsScalar(constants, lights, 0, count);
+}
+
+/*--------------- LightAssigner ---------------*/
+
+LightAssigner::LightAssigner(const std::vector<PointLight>& lights) : simdLevel{detectSimdLevel()} {
+  for (const auto& light : lights) {
+    x.push_back(light.positionRadius.x);
+    y.push_back(light.positionRadius.y);
+    z.push_back(light.positionRadius.z);
+    radius.push_back(light.positionRadius.w);
+  }
+
+  size_t count = lights.size();
+  viewX.resize(count);
+  viewY.resize(count);
+  depth.resize(count);
+  tileMinX.resize(count);
+  tileMaxX.resize(count);
+  tileMinY.resize(count);
+  tileMaxY.resize(count);
+  counts.resize(CLUSTER_COUNT);
+}
+
+// Same bounds as in the compute shader
+void LightAssigner::buildBoxes(const ClusterGrid& grid) {
+  boxes.resize(2 * CLUSTER_COUNT);
+  boxGrid = grid;
+
+  for (uint32_t z = 0; z < CLUSTER_COUNT_Z; z++) {
+    float nearDepth = grid.near * std::pow(grid.far / grid.near, static_cast<float>(z) / CLUSTER_COUNT_Z);
+    float farDepth = grid.near * std::pow(grid.far / grid.near, static_cast<float>(z + 1) / CLUSTER_COUNT_Z);
+
+    for (uint32_t y = 0; y < CLUSTER_COUNT_Y; y++) {
+      for (uint32_t x = 0; x < CLUSTER_COUNT_X; x++) {
+        glm::vec2 ndcMin = glm::vec2{x, y} * grid.tileSize / grid.renderExtent * 2.0f - 1.0f;
+        glm::vec2 ndcMax = glm::vec2{x + 1, y + 1} * grid.tileSize / grid.renderExtent * 2.0f - 1.0f;
+        glm::vec2 ratioMin = glm::vec2{ndcMin.x, -ndcMax.y} * grid.tanHalfFov;
+        glm::vec2 ratioMax = glm::vec2{ndcMax.x, -ndcMin.y} * grid.tanHalfFov;
+
+        uint32_t cluster = (z * CLUSTER_COUNT_Y + y) * CLUSTER_COUNT_X + x;
+        boxes[2 * cluster] = glm::vec3{glm::min(ratioMin * nearDepth, ratioMin * farDepth), -farDepth};
+        boxes[2 * cluster + 1] = glm::vec3{glm::max(ratioMax * nearDepth, ratioMax * farDepth), -nearDepth};
+      }
+    }
+  }
+}
+
+void LightAssigner::assign(const glm::mat4& view, const ClusterGrid& grid, uint32_t* clusters, uint32_t* lightIndices) {
+  auto startTime = std::chrono::high_resolution_clock::now();
+
+  if (boxes.empty() || !(grid == boxGrid)) {
+    buildBoxes(grid);
+  }
+
+  // GLM matrices are column major
+  BoundConstants constants{};
+  for (int row = 0; row < 3; row++) {
+    for (int column = 0; column < 4; column++) {
+      constants.view[4 * row + column] = view[column][row];
+    }
+  }
+  constants.near = grid.near;
+  constants.far = grid.far;
+  constants.scaleX = 0.5f * grid.renderExtent.x / (grid.tanHalfFov.x * grid.tileSize.x);
+  constants.offsetX = 0.5f * grid.renderExtent.x / grid.tileSize.x;
+  constants.scaleY = -0.5f * grid.renderExtent.y / (grid.tanHalfFov.y * grid.tileSize.y);
+  constants.offsetY = 0.5f * grid.renderExtent.y / grid.tileSize.y;
+
+  LightArrays arrays{x.data(), y.data(), z.data(), radius.data(), viewX.data(), viewY.data(), depth.data(),
+                     tileMinX.data(), tileMaxX.data(), tileMinY.data(), tileMaxY.data()};
+  uint32_t lightCount = static_cast<uint32_t>(x.size());
+  boundLights(constants, arrays, lightCount, simdLevel);
+
+  auto boundEndTime = std::chrono::high_resolution_clock::now();
+
+  // ----- Test the clusters in the range of each light -----
+  assignments.clear();
+  std::fill(counts.begin(), counts.end(), 0);
+
+  for (uint32_t i = 0; i < lightCount; i++) {
+    // Also rejects the empty ranges of lights outside the depth range
+    if (!(tileMinX[i] <= tileMaxX[i] && tileMinY[i] <= tileMaxY[i]) || tileMaxX[i] < 0.0f || tileMaxY[i] < 0.0f ||
+        tileMinX[i] >= CLUSTER_COUNT_X || tileMinY[i] >= CLUSTER_COUNT_Y) {
+      continue;
+    }
+    uint32_t minX = static_cast<uint32_t>(std::max(tileMinX[i], 0.0f));
+    uint32_t maxX = static_cast<uint32_t>(std::min(tileMaxX[i], static_cast<float>(CLUSTER_COUNT_X - 1)));
+    uint32_t minY = static_cast<uint32_t>(std::max(tileMinY[i], 0.0f));
+    uint32_t maxY = static_cast<uint32_t>(std::min(tileMaxY[i], static_cast<float>(CLUSTER_COUNT_Y - 1)));
+    uint32_t minZ = grid.slice(std::max(depth[i] - radius[i], grid.near));
+    uint32_t maxZ = grid.slice(std::min(depth[i] + radius[i], grid.far));
+
+    glm::vec3 center{viewX[i], viewY[i], -depth[i]};
+    float radiusSquared = radius[i] * radius[i];
+
+    for (uint32_t clusterZ = minZ; clusterZ <= maxZ; clusterZ++) {
+      for (uint32_t clusterY = minY; clusterY <= maxY; clusterY++) {
+        for (uint32_t clusterX = minX; clusterX <= maxX; clusterX++) {
+          uint32_t cluster = (clusterZ * CLUSTER_COUNT_Y + clusterY) * CLUSTER_COUNT_X + clusterX;
+          glm::vec3 offset = center - glm::clamp(center, boxes[2 * cluster], boxes[2 * cluster + 1]);
+          if (glm::dot(offset, offset) <= radiusSquared) {
+            assignments.push_back(cluster);
+            assignments.push_back(i);
+            counts[cluster]++;
+          }
+        }
+      }
+    }
+  }
+
+  // ----- Compact the lists with a counting sort -----
+  uint32_t offset = 0;
+  for (uint32_t cluster = 0; cluster < CLUSTER_COUNT; cluster++) {
+    uint32_t count = std::min(counts[cluster], MAX_CLUSTER_LIGHTS);
+    overflowTotal += counts[cluster] > MAX_CLUSTER_LIGHTS ? 1 : 0;
+    maxClusterLights = std::max(maxClusterLights, counts[cluster]);
+    clusters[2 * cluster] = offset;
+    clusters[2 * cluster + 1] = count;
+    offset += count;
+    // Reused as the number of lights written so far
+    counts[cluster] = 0;
+  }
+
+  for (size_t i = 0; i < assignments.size(); i += 2) {
+    uint32_t cluster = assignments[i];
+    if (counts[cluster] < clusters[2 * cluster + 1]) {
+      lightIndices[clusters[2 * cluster] + counts[cluster]++] = assignments[i + 1];
+    }
+  }
+
+  auto endTime = std::chrono::high_resolution_clock::now();
+  assignedFrames++;
+  assignedTotal += offset;
+  boundTime += std::chrono::duration<double, std::milli>(boundEndTime - startTime).count();
+  assignTime += std::chrono::duration<double, std::milli>(endTime - startTime).count();
+}
+
+void LightAssigner::report() const {
+  if (assignedFrames == 0) {
+    return;
+  }
+  std::cout << "Light assignment (" << simdLevelName(simdLevel) << ", " << x.size() << " lights): average "
+            << assignTime / assignedFrames << " ms (bounds " << boundTime / assignedFrames << " ms), "
+            << (double)assignedTotal / assignedFrames << " light references per frame, max " << maxClusterLights
+            << " lights in a cluster, " << overflowTotal << " clusters overflowed" << std::endl;
+}
+
+/*--------------- LightClusters ---------------*/
+
+LightClusters::LightClusters(const VulkanContext& ctx, PipelineManager& pipelineManager, ShaderLibrary& shaderLibrary,
+                             uint32_t framesInFlight, const std::vector<PointLight>& lights, bool gpuAssignment)
+    : ctx{ctx}, pipelineManager{pipelineManager}, lightCount{static_cast<uint32_t>(lights.size())} {
+  lightAttribute = std::make_unique<Attribute<PointLight>>(ctx, lights, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+  if (!gpuAssignment) {
+    assigner = std::make_unique<LightAssigner>(lights);
+  }
+
+  // ----- Buffers -----
+  clusterBuffers.resize(framesInFlight);
+  clusterMemory.resize(framesInFlight);
+  clusterMapped.resize(framesInFlight, nullptr);
+  indexBuffers.resize(framesInFlight);
+  indexMemory.resize(framesInFlight);
+  indexMapped.resize(framesInFlight, nullptr);
+  counterBuffers.resize(framesInFlight);
+  counterMemory.resize(framesInFlight);
+  counterMapped.resize(framesInFlight);
+  dataBuffers.resize(framesInFlight);
+  dataMemory.resize(framesInFlight);
+  dataMapped.resize(framesInFlight);
+  submitted.resize(framesInFlight, false);
+
+  // The CPU writes the lists straight into memory the GPU reads
+  VkMemoryPropertyFlags listProperties =
+      gpuAssignment ? VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT : VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+  VkDeviceSize clusterSize = 2 * sizeof(uint32_t) * CLUSTER_COUNT;
+  VkDeviceSize indexSize = sizeof(uint32_t) * CLUSTER_COUNT * MAX_CLUSTER_LIGHTS;
+
+  for (uint32_t i = 0; i < framesInFlight; i++) {
+    createBuffer(ctx, clusterSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, listProperties, clusterBuffers[i], clusterMemory[i]);
+    createBuffer(ctx, indexSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, listProperties, indexBuffers[i], indexMemory[i]);
+    if (!gpuAssignment) {
+      vkMapMemory(ctx.device, clusterMemory[i], 0, clusterSize, 0, &clusterMapped[i]);
+      vkMapMemory(ctx.device, indexMemory[i], 0, indexSize, 0, &indexMapped[i]);
+    }
+
+    createBuffer(ctx, sizeof(Counters), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, counterBuffers[i], counterMemory[i]);
+    vkMapMemory(ctx.device, counterMemory[i], 0, sizeof(Counters), 0, &counterMapped[i]);
+
+    createBuffer(ctx, sizeof(ClusterData), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, dataBuffers[i], dataMemory[i]);
+    vkMapMemory(ctx.device, dataMemory[i], 0, sizeof(ClusterData), 0, &dataMapped[i]);
+  }
+
+  createDescriptorSets();
+
+  // ----- Pipeline -----
+  if (!gpuAssignment) {
+    return;
+  }
+
+  pipelineLayout = pipelineManager.layout({setLayout});
+
+  PipelineDescription description{};
+  description.stages = {shaderLibrary.load("lightClusters.comp", VK_SHADER_STAGE_COMPUTE_BIT, shaderDefines())};
+  description.layout = pipelineLayout;
+
+  pipeline = pipelineManager.request(description);
+  pipelineManager.wait(*pipeline);
+}
+
+LightClusters::~LightClusters() {
+  vkDestroyDescriptorPool(ctx.device, descriptorPool, nullptr);
+  vkDestroyDescriptorSetLayout(ctx.device, setLayout, nullptr);
+
+  for (size_t i = 0; i < clusterBuffers.size(); i++) {
+    vkDestroyBuffer(ctx.device, clusterBuffers[i], nullptr);
+    vkFreeMemory(ctx.device, clusterMemory[i], nullptr);
+    vkDestroyBuffer(ctx.device, indexBuffers[i], nullptr);
+    vkFreeMemory(ctx.device, indexMemory[i], nullptr);
+    vkDestroyBuffer(ctx.device, counterBuffers[i], nullptr);
+    vkFreeMemory(ctx.device, counterMemory[i], nullptr);
+    vkDestroyBuffer(ctx.device, dataBuffers[i], nullptr);
+    vkFreeMemory(ctx.device, dataMemory[i], nullptr);
+  }
+}
+
+// Unsigned so that they mix with the unsigned cluster coordinates
+std::vector<ShaderDefine> LightClusters::shaderDefines() {
+  return {{"CLUSTER_COUNT_X", std::to_string(CLUSTER_COUNT_X) + "u"},
+          {"CLUSTER_COUNT_Y", std::to_string(CLUSTER_COUNT_Y) + "u"},
+          {"CLUSTER_COUNT_Z", std::to_string(CLUSTER_COUNT_Z) + "u"},
+          {"MAX_CLUSTER_LIGHTS", std::to_string(MAX_CLUSTER_LIGHTS) + "u"}};
+}
+
+void LightClusters::createDescriptorSets() {
+  // Lights, clusters, light indices, counters and cluster data. The fragment shader reads all but the counters
+  std::array<VkDescriptorSetLayoutBinding, 5> bindings{};
+  for (uint32_t i = 0; i < bindings.size(); i++) {
+    bindings[i].binding = i;
+    bindings[i].descriptorType = i == 4 ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    bindings[i].descriptorCount = 1;
+    bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+  }
+
+  VkDescriptorSetLayoutCreateInfo layoutInfo{};
+  layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+  layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+  layoutInfo.pBindings = bindings.data();
+
+  if (vkCreateDescriptorSetLayout(ctx.device, &layoutInfo, nullptr, &setLayout) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to create light cluster descriptor set layout");
+  }
+
+  uint32_t frameCount = static_cast<uint32_t>(clusterBuffers.size());
+
+  std::array<VkDescriptorPoolSize, 2> poolSizes{};
+  poolSizes[0].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+  poolSizes[0].descriptorCount = static_cast<uint32_t>(bindings.size() - 1) * frameCount;
+  poolSizes[1].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+  poolSizes[1].descriptorCount = frameCount;
+
+  VkDescriptorPoolCreateInfo poolInfo{};
+  poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+  poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+  poolInfo.pPoolSizes = poolSizes.data();
+  poolInfo.maxSets = frameCount;
+
+  if (vkCreateDescriptorPool(ctx.device, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to create light cluster descriptor pool");
+  }
+
+  std::vector<VkDescriptorSetLayout> layouts(frameCount, setLayout);
+  VkDescriptorSetAllocateInfo allocInfo{};
+  allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+  allocInfo.descriptorPool = descriptorPool;
+  allocInfo.descriptorSetCount = frameCount;
+  allocInfo.pSetLayouts = layouts.data();
+
+  descriptorSets.resize(frameCount);
+  if (vkAllocateDescriptorSets(ctx.device, &allocInfo, descriptorSets.data()) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to allocate light cluster descriptor sets");
+  }
+
+  for (uint32_t i = 0; i < frameCount; i++) {
+    std::array<VkDescriptorBufferInfo, 5> bufferInfos{};
+    bufferInfos[0] = {lightAttribute->buffer, 0, VK_WHOLE_SIZE};
+    bufferInfos[1] = {clusterBuffers[i], 0, VK_WHOLE_SIZE};
+    bufferInfos[2] = {indexBuffers[i], 0, VK_WHOLE_SIZE};
+    bufferInfos[3] = {counterBuffers[i], 0, VK_WHOLE_SIZE};
+    bufferInfos[4] = {dataBuffers[i], 0, VK_WHOLE_SIZE};
+
+    std::array<VkWriteDescriptorSet, 5> descriptorWrites{};
+    for (uint32_t j = 0; j < descriptorWrites.size(); j++) {
+      descriptorWrites[j].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+      descriptorWrites[j].dstSet = descriptorSets[i];
+      descriptorWrites[j].dstBinding = j;
+      descriptorWrites[j].descriptorType = bindings[j].descriptorType;
+      descriptorWrites[j].descriptorCount = 1;
+      descriptorWrites[j].pBufferInfo = &bufferInfos[j];
+    }
+
+    vkUpdateDescriptorSets(ctx.device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+  }
+}
+
+VkDescriptorSet LightClusters::descriptorSet(uint32_t frame) const {
+  return descriptorSets[frame];
+}
+
+/**
+ * Called once per frame after waiting for the frame. Collects the counts of the previous assignment in this frame's
+ * buffers and writes the grid of the camera. On the CPU the lights are assigned here, into the frame's lists
+ */
+void LightClusters::update(uint32_t frame, const Camera& camera, VkExtent2D renderExtent) {
+  if (submitted[frame] && !assigner) {
+    Counters counters;
+    memcpy(&counters, counterMapped[frame], sizeof(counters));
+    assignedFrames++;
+    assignedTotal += counters.assigned;
+    overflowTotal += counters.overflowed;
+  }
+  submitted[frame] = true;
+
+  ClusterGrid grid = ClusterGrid::create(camera, renderExtent);
+
+  ClusterData data{};
+  data.view = camera.viewMatrix;
+  data.cameraPosition = glm::vec4{camera.position, 1.0f};
+  data.tanHalfFov = grid.tanHalfFov;
+  data.tileSize = grid.tileSize;
+  data.renderExtent = grid.renderExtent;
+  data.near = grid.near;
+  data.far = grid.far;
+  data.sliceScale = grid.sliceScale;
+  data.sliceBias = grid.sliceBias;
+  data.lightCount = lightCount;
+  memcpy(dataMapped[frame], &data, sizeof(data));
+
+  if (assigner) {
+    assigner->assign(camera.viewMatrix, grid, static_cast<uint32_t*>(clusterMapped[frame]), static_cast<uint32_t*>(indexMapped[frame]));
+  }
+}
+
+/**
+ * Record the light assignment dispatch, which the fragment shader of the frame reads. Records nothing when assigning
+ * on the CPU, as host writes are visible to the frame's submission. Must be recorded outside of a render pass
+ */
+void LightClusters::assign(VkCommandBuffer commandBuffer, uint32_t frame) {
+  if (assigner) {
+    return;
+  }
+
+  vkCmdFillBuffer(commandBuffer, counterBuffers[frame], 0, VK_WHOLE_SIZE, 0);
+
+  VkBufferMemoryBarrier clearBarrier{};
+  clearBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+  clearBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  clearBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+  clearBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  clearBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  clearBarrier.buffer = counterBuffers[frame];
+  clearBarrier.offset = 0;
+  clearBarrier.size = VK_WHOLE_SIZE;
+
+  vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+                       0, nullptr, 1, &clearBarrier, 0, nullptr);
+
+  vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineManager.resolve(*pipeline, VK_NULL_HANDLE));
+  vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &descriptorSets[frame], 0, nullptr);
+  vkCmdDispatch(commandBuffer, CLUSTER_COUNT_X, CLUSTER_COUNT_Y, CLUSTER_COUNT_Z);
+
+  // Lists are read by the fragment shader of the same frame
+  std::array<VkBufferMemoryBarrier, 2> listBarriers{};
+  for (auto& barrier : listBarriers) {
+    barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.offset = 0;
+    barrier.size = VK_WHOLE_SIZE;
+  }
+  listBarriers[0].buffer = clusterBuffers[frame];
+  listBarriers[1].buffer = indexBuffers[frame];
+
+  vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+                       0, nullptr, static_cast<uint32_t>(listBarriers.size()), listBarriers.data(), 0, nullptr);
+}
+
+void LightClusters::report() const {
+  if (assigner) {
+    assigner->report();
+    return;
+  }
+  if (assignedFrames == 0) {
+    return;
+  }
+  std::cout << "Light assignment (compute, " << lightCount << " lights): average " << (double)assignedTotal / assignedFrames
+            << " light references per frame in " << CLUSTER_COUNT_X << "x" << CLUSTER_COUNT_Y << "x" << CLUSTER_COUNT_Z
+            << " clusters, " << overflowTotal << " clusters overflowed" << std::endl;
+}
+
+/*----- Benchmark -----*/
+
+/**
+ * Assign 1k to 16k lights scattered over a floor to the clusters of a camera orbiting it, with each instruction set.
+ * The lists are hashed per frame to check that every instruction set assigns the same lights
+ */
+void benchmarkLightAssignment() {
+  const uint32_t frames = 100;
+  const float pi = 3.14159265f;
+  const VkExtent2D renderExtent{1920, 1080};
+
+  std::vector<uint32_t> clusters(2 * CLUSTER_COUNT);
+  std::vector<uint32_t> lightIndices(CLUSTER_COUNT * MAX_CLUSTER_LIGHTS);
+
+  std::cout << "Light assignment to " << CLUSTER_COUNT_X << "x" << CLUSTER_COUNT_Y << "x" << CLUSTER_COUNT_Z << " clusters at "
+            << renderExtent.width << "x" << renderExtent.height << ", average of " << frames << " frames" << std::endl;
+
+  SimdLevel bestLevel = detectSimdLevel();
+  for (uint32_t lightCount = 1024; lightCount <= 16384; lightCount *= 4) {
+    std::vector<PointLight> lights = createLights(lightCount, {-50.0f, -50.0f, 0.0f}, {50.0f, 50.0f, 5.0f});
+
+    std::vector<uint64_t> reference;
+    for (SimdLevel level : {SimdLevel::Scalar, SimdLevel::SSE2, SimdLevel::AVX2}) {
+      if (level > bestLevel) {
+        break;
+      }
+
+      LightAssigner assigner(lights);
+      assigner.simdLevel = level;
+
+      std::vector<uint64_t> hashes;
+      for (uint32_t frame = 0; frame < frames; frame++) {
+        float yaw = 2.0f * pi * frame / frames;
+        Camera camera(1.1f, yaw, 60.0f, {0.0f, 0.0f, 1.0f}, glm::radians(60.0f), 16.0f / 9.0f, 0.1f, 200.0f);
+        assigner.assign(camera.viewMatrix, ClusterGrid::create(camera, renderExtent), clusters.data(), lightIndices.data());
+
+        // FNV-1a over the lists
+        uint64_t hash = 14695981039346656037ull;
+        uint32_t used = clusters[2 * (CLUSTER_COUNT - 1)] + clusters[2 * CLUSTER_COUNT - 1];
+        for (const auto* values : {&clusters, &lightIndices}) {
+          uint32_t size = values == &clusters ? static_cast<uint32_t>(clusters.size()) : used;
+          for (uint32_t i = 0; i < size; i++) {
+            hash = (hash ^ (*values)[i]) * 1099511628211ull;
+          }
+        }
+        hashes.push_back(hash);
+      }
+      assigner.report();
+
+      if (reference.empty()) {
+        reference = std::move(hashes);
+      } else if (hashes != reference) {
+        uint32_t mismatches = 0;
+        for (uint32_t frame = 0; frame < frames; frame++) {
+          mismatches += hashes[frame] != reference[frame];
+        }
+        std::cout << "  " << mismatches << " frames differ from the scalar result" << std::endl;
+      }
+    }
+  }
+}
@@ -0,0 +1,191 @@
+#pragma once
+
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <memory>
+#include <vector>
+
+#include "frustum.h"
+#include "pipelineManager.h"
+#include "shaderLibrary.h"
+#include "vulkanUtils.h"
+
+struct Camera;
+template <typename DataFormat>
+class Attribute;
+
+// Froxel grid: screen tiles along x and y and depth slices along z
+const uint32_t CLUSTER_COUNT_X = 16;
+const uint32_t CLUSTER_COUNT_Y = 9;
+const uint32_t CLUSTER_COUNT_Z = 24;
+const uint32_t CLUSTER_COUNT = CLUSTER_COUNT_X * CLUSTER_COUNT_Y * CLUSTER_COUNT_Z;
+// Lights beyond this many in one cluster are dropped
+const uint32_t MAX_CLUSTER_LIGHTS = 256;
+
+// Matches PointLight in clusters.glsl
+struct PointLight {
+  // World space position and radius of influence
+  glm::vec4 positionRadius;
+  glm::vec4 colorIntensity;
+};
+
+std::vector<PointLight> createLights(uint32_t count, glm::vec3 minimum, glm::vec3 maximum);
+
+/**
+ * Froxel grid of a camera at a render extent. Slices are spaced exponentially between the near and far plane, so
+ * that clusters keep similar proportions at every depth
+ */
+struct ClusterGrid {
+  // Tangent of half the field of view along x and y
+  glm::vec2 tanHalfFov;
+  glm::vec2 tileSize;
+  glm::vec2 renderExtent;
+  float near;
+  float far;
+  float sliceScale;
+  float sliceBias;
+
+  static ClusterGrid create(const Camera& camera, VkExtent2D renderExtent);
+  uint32_t slice(float depth) const;
+  bool operator==(const ClusterGrid& other) const = default;
+};
+
+/**
+ * Light assignment on the CPU. The lights are transformed to view space and bounded by a range of tiles and slices
+ * in batches with the widest instruction set available. Each light is then tested against the bounding boxes of the
+ * clusters in its range, and the lists are compacted with a counting sort. The lists are in light order like those of
+ * the compute shader, but may be shorter: the range also rejects lights that touch the bounding box of a cluster only
+ * outside its frustum, and which therefore cannot light it
+ */
+class LightAssigner {
+ public:
+  LightAssigner() = delete;
+  LightAssigner(const std::vector<PointLight>& lights);
+  LightAssigner(const LightAssigner& lightAssigner) = delete;
+  ~LightAssigner() = default;
+
+  // Clusters are pairs of an offset into the light indices and a count. The light indices hold CLUSTER_COUNT *
+  // MAX_CLUSTER_LIGHTS entries
+  void assign(const glm::mat4& view, const ClusterGrid& grid, uint32_t* clusters, uint32_t* lightIndices);
+  void report() const;
+
+  SimdLevel simdLevel;
+
+ private:
+  // One array per component so that a batch of lights loads into one register per component
+  std::vector<float> x;
+  std::vector<float> y;
+  std::vector<float> z;
+  std::vector<float> radius;
+
+  // ----- Per frame -----
+  // View space positions with the depth in front of the camera, and the tile range of each light as floating point
+  // tile coordinates. Lights outside the depth range get an empty range
+  std::vector<float> viewX;
+  std::vector<float> viewY;
+  std::vector<float> depth;
+  std::vector<float> tileMinX;
+  std::vector<float> tileMaxX;
+  std::vector<float> tileMinY;
+  std::vector<float> tileMaxY;
+  std::vector<uint32_t> counts;
+  // Pairs of cluster and light
+  std::vector<uint32_t> assignments;
+
+  // View space bounding boxes of the clusters, as minimum and maximum corners. Rebuilt when the grid changes
+  std::vector<glm::vec3> boxes;
+  ClusterGrid boxGrid{};
+
+  uint64_t assignedFrames = 0;
+  uint64_t assignedTotal = 0;
+  uint64_t overflowTotal = 0;
+  uint32_t maxClusterLights = 0;
+  double boundTime = 0.0;
+  double assignTime = 0.0;
+
+  void buildBoxes(const ClusterGrid& grid);
+};
+
+/**
+ * Clustered forward lighting. Point lights are assigned to the clusters of a froxel grid built from the camera, and
+ * each fragment shades with the lights of its own cluster only, so the cost of a fragment depends on the lights
+ * around it rather than on the number of lights. Lights are assigned every frame in a compute shader, or on the CPU
+ * into host visible buffers.
+ *
+ * The descriptor set holds the lights, the per cluster lists and the grid, and is bound for the fragment shader
+ */
+class LightClusters {
+ public:
+  const VulkanContext& ctx;
+  VkDescriptorSetLayout setLayout;
+
+  LightClusters() = delete;
+  LightClusters(const VulkanContext& ctx, PipelineManager& pipelineManager, ShaderLibrary& shaderLibrary, uint32_t framesInFlight,
+                const std::vector<PointLight>& lights, bool gpuAssignment);
+  LightClusters(const LightClusters& lightClusters) = delete;
+  ~LightClusters();
+
+  // Defines of the shaders which include clusters.glsl
+  static std::vector<ShaderDefine> shaderDefines();
+
+  VkDescriptorSet descriptorSet(uint32_t frame) const;
+  void update(uint32_t frame, const Camera& camera, VkExtent2D renderExtent);
+  void assign(VkCommandBuffer commandBuffer, uint32_t frame);
+  void report() const;
+
+ private:
+  // Matches the uniform block in clusters.glsl
+  struct ClusterData {
+    glm::mat4 view;
+    glm::vec4 cameraPosition;
+    glm::vec2 tanHalfFov;
+    glm::vec2 tileSize;
+    glm::vec2 renderExtent;
+    float near;
+    float far;
+    float sliceScale;
+    float sliceBias;
+    uint32_t lightCount;
+  };
+
+  // Matches the counter block in lightClusters.comp
+  struct Counters {
+    uint32_t assigned;
+    uint32_t overflowed;
+  };
+
+  PipelineManager& pipelineManager;
+  std::shared_ptr<PipelineHandle> pipeline;
+  VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+  uint32_t lightCount;
+  std::unique_ptr<Attribute<PointLight>> lightAttribute;
+  // Assigns on the CPU when set
+  std::unique_ptr<LightAssigner> assigner;
+
+  VkDescriptorPool descriptorPool;
+  std::vector<VkDescriptorSet> descriptorSets;
+
+  // Per frame in flight. Host visible when assigning on the CPU
+  std::vector<VkBuffer> clusterBuffers;
+  std::vector<VkDeviceMemory> clusterMemory;
+  std::vector<void*> clusterMapped;
+  std::vector<VkBuffer> indexBuffers;
+  std::vector<VkDeviceMemory> indexMemory;
+  std::vector<void*> indexMapped;
+  // Host visible so that the counts can be read back after waiting for the frame
+  std::vector<VkBuffer> counterBuffers;
+  std::vector<VkDeviceMemory> counterMemory;
+  std::vector<void*> counterMapped;
+  std::vector<VkBuffer> dataBuffers;
+  std::vector<VkDeviceMemory> dataMemory;
+  std::vector<void*> dataMapped;
+  std::vector<bool> submitted;
+
+  uint64_t assignedFrames = 0;
+  uint64_t assignedTotal = 0;
+  uint64_t overflowTotal = 0;
+
+  void createDescriptorSets();
+};
+
+void benchmarkLightAssignment();
@@ -1,21 +1,20 @@
 #define GLFW_INCLUDE_VULKAN
-#define GLM_FORCE_DEFAULT_ALIGNED_GENTYPES
-#define GLM_FORCE_DEPTH_ZERO_TO_ONE
 
 #include <GLFW/glfw3.h>
 #define GLM_ENABLE_EXPERIMENTAL
 #include <glm/gtx/hash.hpp>
 
-#define STB_IMAGE_IMPLEMENTATION
-#include <stb_image.h>
 #define TINYOBJLOADER_IMPLEMENTATION
 #include <tiny_obj_loader.h>
 
 #include <algorithm>
 #include <chrono>
+#include <cmath>
+#include <cstdio>
 #include <cstdlib>
 #include <cstring>
-#include <fstream>
+#include <ctime>
+#include <filesystem>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <iostream>
@@ -24,12 +23,33 @@
 #include <optional>
 #include <set>
 #include <stdexcept>
+#include <thread>
 #include <unordered_map>
 #include <vector>
 
 #include "attribute.h"
 #include "camera.h"
+#include "commandRecorder.h"
+#include "cpuCuller.h"
+#include "deferredShading.h"
+#include "deletionQueue.h"
+#include "depthPyramid.h"
+#include "frameCapture.h"
+#include "framePacer.h"
+#include "gpuCuller.h"
 #include "image.h"
+#include "imageWriter.h"
+#include "lightClusters.h"
+#include "multiview.h"
+#include "occlusionCuller.h"
+#include "offscreenTarget.h"
+#include "pipelineManager.h"
+#include "renderGraph.h"
+#include "resolutionScaler.h"
+#include "scene.h"
+#include "settings.h"
+#include "shaderLibrary.h"
+#include "shadowMaps.h"
 #include "texture.h"
 #include "vulkanUtils.h"
 
@@ -38,9 +58,10 @@ const uint32_t HEIGHT = 1200;
 
 const std::string MODEL_PATH = "obj/viking-room/viking_room.obj";
 const std::string TEXTURE_PATH = "obj/viking-room/viking_room.png";
-
-const int MAX_FRAMES_IN_FLIGHT = 2;
-uint32_t currentFrame = 0;
+const std::string PIPELINE_CACHE_PATH = "pipeline_cache.bin";
+const std::string SHADER_PATH = "shaders";
+const std::string SHADER_CACHE_PATH = "shaders/cache";
+const std::string SCREENSHOT_PREFIX = "screenshot_";
 
 struct Vertex {
   glm::vec3 pos;
@@ -93,86 +114,308 @@ struct hash<Vertex> {
 }  // namespace std
 
 struct UniformBufferObject {
-  glm::mat4 model;
   glm::mat4 view;
   glm::mat4 proj;
 };
 
-static std::vector<char> readFile(const std::string& filename) {
-  // Start at end, treat as binary
-  std::ifstream file(filename, std::ios::ate | std::ios::binary);
+// Range of the index buffer drawn by a single draw call
+struct Draw {
+  uint32_t indexCount;
+  uint32_t firstIndex;
+  // Applied before the instance transform
+  glm::mat4 model{1.0f};
+  uint32_t materialIndex = 0;
+};
 
-  if (!file.is_open()) {
-    throw std::runtime_error("failed to open file!");
+// Per draw values pushed before every draw call. Matches the push constant block in the shaders
+struct DrawConstants {
+  // Top three rows of the draw's model matrix
+  glm::vec4 transform[3];
+  uint32_t materialIndex;
+  // Added to gl_InstanceIndex to index the instance storage buffer
+  uint32_t instanceOffset;
+
+  static DrawConstants create(const glm::mat4& model, uint32_t materialIndex, uint32_t instanceOffset) {
+    DrawConstants constants{};
+    for (int row = 0; row < 3; row++) {
+      constants.transform[row] = {model[0][row], model[1][row], model[2][row], model[3][row]};
+    }
+    constants.materialIndex = materialIndex;
+    constants.instanceOffset = instanceOffset;
+    return constants;
   }
+};
+
+// Consecutive visible instances drawn by a single instanced draw call
+struct InstanceRun {
+  uint32_t firstInstance;
+  uint32_t instanceCount;
+};
+
+// Command buffer together with the state it was recorded against
+struct CachedCommandBuffer {
+  VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+  uint64_t drawStateVersion = 0;
+  uint64_t pipelineGeneration = 0;
+};
+
+// Triangles of the simplified model rasterized by the software occlusion culler
+const uint32_t OCCLUDER_TRIANGLES = 256;
+
+// Constant and slope scaled depth bias of shadow casters, in units of the depth format and of the depth slope
+const float SHADOW_DEPTH_BIAS_CONSTANT = 1.25f;
+const float SHADOW_DEPTH_BIAS_SLOPE = 1.75f;
+// Angle of the sun above the ground plane, and its direction around the up axis before it starts turning
+const float SUN_ELEVATION = glm::radians(50.0f);
+const float SUN_AZIMUTH = 0.6f;
+
+// Brightness added by every shaded fragment in the overdraw view. The view saturates at 1 / step fragments
+const double OVERDRAW_STEP = 1.0 / 16.0;
+
+// Variants of the scene pipeline
+enum class ScenePass {
+  Color,
+  // Positions only, writing depth for the color pass
+  DepthOnly,
+  // Counts shaded fragments with additive blending
+  Overdraw,
+  // Writes the G-buffer of deferred shading, lit by a second subpass
+  GBuffer
+};
+
+// Pipelines of the main pass, resolved once per frame so that all recording threads use the same ones
+struct FramePipelines {
+  // Null without a depth pre-pass
+  VkPipeline depth = VK_NULL_HANDLE;
+  VkPipeline shading = VK_NULL_HANDLE;
+  // Lighting subpass of deferred shading. Null with forward shading
+  VkPipeline lighting = VK_NULL_HANDLE;
+};
+
+// Seconds to block for events when idle in on-demand mode. Bounds the latency of picking up shader edits
+const double IDLE_WAIT_TIMEOUT = 0.25;
+// Seconds to block for events while pipelines are compiling, so that they are shown soon after they are ready
+const double STREAMING_WAIT_TIMEOUT = 1.0 / 60.0;
+
+/**
+ * Reasons to render a frame in on-demand mode. Cleared when a frame is drawn
+ */
+struct RedrawState {
+  bool camera = false;
+  bool resize = false;
+  // Draw list, descriptors or pipelines changed. Set for the first frame
+  bool scene = true;
+  // A frame capture is waiting for the next frame
+  bool capture = false;
+
+  bool any() const {
+    return camera || resize || scene || capture;
+  }
+};
 
-  // Starting the end and getting the current position with tellg() gives the size
-  size_t fileSize = (size_t)file.tellg();
-  // Create a buffer to store all binary data
-  std::vector<char> buffer(fileSize);
+/**
+ * Cost of swap chain recreation on resize
+ */
+struct ResizeStats {
+  uint32_t recreations = 0;
+  uint32_t allocations = 0;
+  uint32_t reusedAllocations = 0;
+  uint32_t frames = 0;
+
+  double totalRecreationTime = 0.0;
+  double maxRecreationTime = 0.0;
+  double totalFrameTime = 0.0;
+  double maxFrameTime = 0.0;
+
+  void recordRecreation(double milliseconds) {
+    recreations++;
+    totalRecreationTime += milliseconds;
+    maxRecreationTime = std::max(maxRecreationTime, milliseconds);
+  }
 
-  // Move to the start and read all data
-  file.seekg(0);
-  file.read(buffer.data(), fileSize);
-  file.close();
+  void recordFrame(double milliseconds) {
+    frames++;
+    totalFrameTime += milliseconds;
+    maxFrameTime = std::max(maxFrameTime, milliseconds);
+  }
 
-  return buffer;
-}
+  void report() const {
+    if (recreations == 0) {
+      return;
+    }
+    std::cout << "Swap chain recreated " << recreations << " times. Average " << totalRecreationTime / recreations
+              << " ms, max " << maxRecreationTime << " ms" << std::endl;
+    if (frames > 0) {
+      std::cout << "Resize frames: average " << totalFrameTime / frames << " ms, max " << maxFrameTime << " ms" << std::endl;
+    }
+    std::cout << "Attachment allocations reused: " << reusedAllocations << " of " << allocations << std::endl;
+  }
+};
 
 class Renderer {
  public:
-  Renderer() {
-    initWindow();
-    ctx.initContext(window);
-    msaaSamples = std::min(VK_SAMPLE_COUNT_8_BIT, ctx.maxMSAASamples);
+  Renderer(const Settings& settings) : settings{settings} {
+    // A headless context has no surface
+    if (!settings.headless) {
+      initWindow();
+    }
+    ctx.initContext(window, settings.deviceSelection);
+    // Deferred shading lights each pixel once, which multisampling would multiply again
+    msaaSamples = settings.deferredShading ? VK_SAMPLE_COUNT_1_BIT : std::min(VK_SAMPLE_COUNT_8_BIT, ctx.maxMSAASamples);
+    depthPrepass = settings.depthPrepass;
+    overdrawView = settings.overdrawView;
   }
   void run() {
     initVulkan();
-    mainLoop();
+    if (settings.benchmarkRecording) {
+      benchmarkRecording();
+    } else if (settings.benchmarkMultiviewViews > 0) {
+      benchmarkMultiview();
+    } else if (settings.benchmarkShading) {
+      benchmarkShading();
+    } else if (!settings.batchPath.empty()) {
+      renderBatch();
+    } else if (ctx.headless()) {
+      renderHeadless();
+    } else {
+      mainLoop();
+    }
     cleanup();
   }
 
  private:
   VulkanContext ctx;
+  Settings settings;
 
-  GLFWwindow* window;
+  // Index of the frame in flight being recorded
+  uint32_t currentFrame = 0;
 
-  VkSwapchainKHR swapChain;
-  // Contained images are created and destroyed automatically
+  GLFWwindow* window = nullptr;
+
+  VkSwapchainKHR swapChain = VK_NULL_HANDLE;
+  // Contained images are created and destroyed automatically. Without a surface they are the offscreen images
   std::vector<VkImage> swapChainImages;
   std::vector<VkImageView> swapChainImageViews;
 
-  VkImage depthImage;
-  VkDeviceMemory depthImageMemory;
-  VkImageView depthImageView;
-
   VkFormat swapChainImageFormat;
   VkExtent2D swapChainExtent;
+  // Part of the attachments the scene is rendered to. The swap chain extent unless the resolution is scaled
+  VkExtent2D renderExtent;
+
+  // Holds the resolved scene at the render extent while the resolution is scaled. It is upscaled into the swap
+  // chain image by a blit, which needs neither a pipeline nor a descriptor set
+  std::unique_ptr<ResolutionScaler> resolutionScaler;
+
+  // Rendered to in place of the swap chain when headless
+  std::unique_ptr<OffscreenTarget> offscreenTarget;
+  // Image written by the most recently submitted frame
+  uint32_t lastImageIndex = 0;
 
   // Uniforms and push values
-  VkDescriptorSetLayout descriptorSetLayout;
+  VkDescriptorSetLayout frameSetLayout;
+  VkDescriptorSetLayout sceneSetLayout;
   VkDescriptorPool descriptorPool;
-  // Freed automatically with pool
-  std::vector<VkDescriptorSet> descriptorSets;
+  // Freed automatically with pool. Camera matrices per frame in flight
+  std::vector<VkDescriptorSet> frameDescriptorSets;
+  // Textures and instances
+  VkDescriptorSet sceneDescriptorSet;
 
   VkPipelineLayout pipelineLayout;
 
+  // Attachments and passes of a frame. The swap chain images are imported into it
+  std::unique_ptr<RenderGraph> renderGraph;
+  // Not declared with deferred shading, which renders single sampled into the resolve target
+  RenderGraph::Resource colorImage = RenderGraph::NONE;
+  RenderGraph::Resource depthImage;
+  // G-buffer of deferred shading. Only declared with deferred shading
+  RenderGraph::Resource albedoImage = RenderGraph::NONE;
+  RenderGraph::Resource normalImage = RenderGraph::NONE;
+  // Only declared while the resolution is scaled
+  RenderGraph::Resource sceneImage = RenderGraph::NONE;
+  RenderGraph::Resource swapChainImage;
+  // Draws the scene. With occlusion culling this is the late pass, drawn after an early pass into the same attachments
+  RenderGraph::Pass scenePass;
+  // Owned by the render graph. Pipelines of the scene are created against it, and are compatible with the early pass
   VkRenderPass renderPass;
-  VkPipeline graphicsPipeline;
-
-  std::vector<VkFramebuffer> swapChainFramebuffers;
+  // Resolved before the render graph is executed, so that its passes draw with the same ones
+  FramePipelines framePipelines;
+  uint32_t frameDrawCount = 0;
+
+  std::unique_ptr<ShaderLibrary> shaderLibrary;
+  std::unique_ptr<PipelineManager> pipelineManager;
+  std::shared_ptr<PipelineHandle> graphicsPipeline;
+  // Indexed by [overdraw view][after depth pre-pass]. The first is the graphics pipeline
+  std::array<std::array<std::shared_ptr<PipelineHandle>, 2>, 2> shadingPipelines;
+  std::shared_ptr<PipelineHandle> depthPipeline;
+  // Draw the depth of the scene before shading it, so that every sample is shaded once
+  bool depthPrepass = false;
+  // Show the number of fragments shaded per pixel instead of the scene
+  bool overdrawView = false;
+  // Bound in place of pipelines which are still compiling. Read at every use as a reload replaces its pipeline
+  std::shared_ptr<PipelineHandle> fallbackPipeline;
 
   std::vector<VkCommandBuffer> drawCommandBuffers;
 
+  // Off when the recorded draws would change every frame anyway
+  bool cacheCommandBuffers = false;
+  // Replayed while the draw state is unchanged. Indexed by [frame * image count + image]
+  std::vector<CachedCommandBuffer> cachedCommandBuffers;
+  // Incremented when geometry, descriptors or the swap chain extent change
+  uint64_t drawStateVersion = 1;
+  uint64_t reusedCommandBufferFrames = 0;
+  uint64_t recordedCommandBufferFrames = 0;
+
   std::vector<VkSemaphore> imageAvailableSemaphores;
   std::vector<VkSemaphore> renderFinishedSemaphores;
-  std::vector<VkFence> inFlightFences;
+  // Timeline value of the last submission of each frame in flight. Its resources are free once it is reached
+  std::vector<uint64_t> frameTimelineValues;
 
   std::vector<Vertex> vertices;
   std::vector<uint32_t> indices;
+  std::vector<Draw> draws;
+  std::vector<uint32_t> visibleInstances;
+  // Culling result of the current frame, swapped with the visible instances if it differs
+  std::vector<uint32_t> culledInstances;
+  // Visible instances merged into runs. Every run is drawn with every range of the draw list
+  std::vector<InstanceRun> instanceRuns;
+
+  // Model space bounding sphere of the loaded model
+  glm::vec4 boundingSphere;
+  std::vector<MeshData> meshes;
+  std::vector<InstanceData> instances;
 
   std::vector<std::shared_ptr<Attribute<Vertex>>> vertexAttributes;
   std::vector<std::shared_ptr<Attribute<uint32_t>>> indexAttributes;
+  std::shared_ptr<Attribute<MeshData>> meshAttribute;
+  std::shared_ptr<Attribute<InstanceData>> instanceAttribute;
+
+  // Culls and draws the instances on the GPU when enabled
+  std::unique_ptr<GpuCuller> gpuCuller;
+  // Cull GPU-driven instances against a depth pyramid built from the depth of the early render pass
+  bool occlusionCulling = false;
+  std::unique_ptr<DepthPyramid> depthPyramid;
+  // Culls the instances before recording otherwise
+  std::unique_ptr<CpuCuller> cpuCuller;
+  // Removes the frustum culled instances hidden behind the nearest ones when enabled
+  std::unique_ptr<OcclusionCuller> occlusionCuller;
+  // Clustered forward lighting of the point lights. Null when the scene is drawn unlit
+  std::unique_ptr<LightClusters> lightClusters;
+  // Cascaded shadows of the sun. Null without shadows
+  std::unique_ptr<ShadowMaps> shadowMaps;
+  // Draws the scene into a G-buffer lit in a second subpass. Null with forward shading
+  std::unique_ptr<DeferredShading> deferredShading;
+  // The scene layout with the G-buffer in place of the scene set, and no draw constants
+  VkPipelineLayout lightingPipelineLayout = VK_NULL_HANDLE;
+  std::shared_ptr<PipelineHandle> lightingPipeline;
+  std::shared_ptr<PipelineHandle> shadowPipeline;
+  // Static casters of every cascade rendered this frame, culled before recording. Indexed by cascade
+  std::vector<std::vector<InstanceRun>> shadowCasterRuns;
+  std::vector<uint32_t> shadowCasterInstances;
+  // Towards the sun
+  glm::vec3 sunDirection{0.0f, 0.0f, 1.0f};
+  // World transforms of the copies of the model circling above the scene this frame. Drawn after the draw list, and
+  // into the shadow maps as dynamic casters
+  std::vector<glm::mat4> dynamicObjects;
 
   std::vector<VkBuffer> uniformBuffers;
   std::vector<VkDeviceMemory> uniformBuffersMemory;
@@ -180,13 +423,25 @@ class Renderer {
 
   std::vector<std::shared_ptr<Texture>> textures;
 
-  VkImage colorImage;
-  VkDeviceMemory colorImageMemory;
-  VkImageView colorImageView;
-
   VkSampleCountFlagBits msaaSamples = VK_SAMPLE_COUNT_1_BIT;
 
   bool framebufferResized = false;
+  ResizeStats resizeStats;
+
+  // Destroys resources once the frames which use them have completed
+  std::unique_ptr<DeletionQueue> deletionQueue;
+  std::unique_ptr<FramePacer> framePacer;
+  // Records the draw list in parallel when enabled
+  std::unique_ptr<CommandRecorder> commandRecorder;
+  // Copies frames back to the host without stalling
+  std::unique_ptr<FrameCapture> frameCapture;
+  // Encodes screenshots off the render thread. Created by the first screenshot
+  std::unique_ptr<ImageWriter> screenshotWriter;
+  uint32_t screenshotCount = 0;
+  // Swap chain images can be copied from
+  bool swapChainCapturable = false;
+  // The swap chain images can be blit destinations
+  bool swapChainBlittable = false;
 
   Camera camera{
       1.0f, 0.5f, 2.0f, glm::vec3{0.0f, 0.0f, 1.0f},
@@ -195,6 +450,11 @@ class Renderer {
 
   bool mouseDown = false;
 
+  RedrawState redraw;
+  // Versions shown by the last frame drawn in on-demand mode
+  uint64_t drawnStateVersion = 0;
+  uint64_t drawnPipelineGeneration = 0;
+
   /*----- GLFW  -----*/
 
   void initWindow() {
@@ -208,11 +468,13 @@ class Renderer {
     glfwSetMouseButtonCallback(window, mouseButtonCallback);
     glfwSetScrollCallback(window, scrollCallback);
     glfwSetCursorPosCallback(window, mouseMoveCallback);
+    glfwSetKeyCallback(window, keyCallback);
   }
 
   static void framebufferResizeCallback(GLFWwindow* window, int width, int height) {
     auto renderer = reinterpret_cast<Renderer*>(glfwGetWindowUserPointer(window));
     renderer->framebufferResized = true;
+    renderer->redraw.resize = true;
   }
 
   static void mouseMoveCallback(GLFWwindow* window, double xpos, double ypos) {
@@ -222,6 +484,7 @@ class Renderer {
     glfwGetCursorPos(window, &oldXPos, &oldYPos);
     if (renderer->mouseDown) {
       renderer->camera.updateCoordinates(glm::vec2{oldXPos - xpos, ypos - oldYPos});
+      renderer->redraw.camera = true;
     }
   }
 
@@ -239,6 +502,225 @@ class Renderer {
   static void scrollCallback(GLFWwindow* window, double xoffset, double yoffset) {
     auto renderer = reinterpret_cast<Renderer*>(glfwGetWindowUserPointer(window));
     renderer->camera.distance = std::max(0.0, renderer->camera.distance - 0.01 * yoffset);
+    renderer->redraw.camera = true;
+  }
+
+  static void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods) {
+    auto renderer = reinterpret_cast<Renderer*>(glfwGetWindowUserPointer(window));
+    if (key == GLFW_KEY_F12 && action == GLFW_PRESS) {
+      renderer->captureScreenshot();
+    }
+    if (key == GLFW_KEY_P && action == GLFW_PRESS) {
+      renderer->depthPrepass = !renderer->depthPrepass;
+      renderer->switchPassMode();
+    }
+    if (key == GLFW_KEY_O && action == GLFW_PRESS) {
+      renderer->overdrawView = !renderer->overdrawView;
+      renderer->switchPassMode();
+    }
+  }
+
+  /*----- Draw list -----*/
+
+  // Split the model into ranges of whole triangles. Multiple draws only exist to stress command recording
+  void createDrawList() {
+    uint64_t triangleCount = indices.size() / 3;
+    uint64_t drawCount = std::min<uint64_t>(settings.drawCount, triangleCount);
+
+    for (uint64_t i = 0; i < drawCount; i++) {
+      uint64_t first = triangleCount * i / drawCount;
+      uint64_t end = triangleCount * (i + 1) / drawCount;
+      draws.push_back({static_cast<uint32_t>(3 * (end - first)), static_cast<uint32_t>(3 * first)});
+    }
+
+    invalidateCommandBuffers();
+  }
+
+  // Number of draw calls recorded for the visible instances
+  uint32_t visibleDrawCount() const {
+    return static_cast<uint32_t>(instanceRuns.size() * draws.size());
+  }
+
+  // The draw list of the visible instances followed by one draw per dynamic object
+  uint32_t listDrawCount() const {
+    return visibleDrawCount() + static_cast<uint32_t>(dynamicObjects.size());
+  }
+
+  void createInstanceRuns() {
+    createRuns(visibleInstances, instanceRuns);
+  }
+
+  // Merge visible instances with consecutive indices so that each run is one instanced draw. Culling output is in
+  // tree order, so the runs are found by marking the visible instances rather than by sorting them
+  void createRuns(const std::vector<uint32_t>& visibleList, std::vector<InstanceRun>& runs) const {
+    std::vector<bool> visible(instances.size(), false);
+    for (uint32_t instance : visibleList) {
+      visible[instance] = true;
+    }
+
+    runs.clear();
+    for (uint32_t i = 0; i < visible.size(); i++) {
+      if (!visible[i]) {
+        continue;
+      }
+      if (!runs.empty() && runs.back().firstInstance + runs.back().instanceCount == i) {
+        runs.back().instanceCount++;
+      } else {
+        runs.push_back({i, 1});
+      }
+    }
+  }
+
+  /*----- Scene -----*/
+
+  // Copies of the model on a square grid in the xy-plane, spaced so that their bounds do not overlap
+  void createScene() {
+    meshes.push_back({static_cast<uint32_t>(indices.size()), 0, 0, 0, boundingSphere});
+
+    uint32_t columns = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<double>(settings.instanceCount))));
+    float spacing = 2.0f * boundingSphere.w;
+    glm::vec3 gridOrigin = -0.5f * spacing * static_cast<float>(columns - 1) * glm::vec3{1.0f, 1.0f, 0.0f};
+
+    for (uint32_t i = 0; i < settings.instanceCount; i++) {
+      glm::vec3 position = gridOrigin + spacing * glm::vec3{static_cast<float>(i % columns), static_cast<float>(i / columns), 0.0f};
+      instances.push_back(InstanceData::create(glm::translate(glm::mat4(1.0f), position), 0));
+      visibleInstances.push_back(i);
+    }
+    createInstanceRuns();
+
+    // Keep the whole grid in front of the far plane
+    camera.far = std::max(camera.far, 2.0f * spacing * columns);
+  }
+
+  // World space bounding box of the instances
+  void sceneBounds(glm::vec3& minimum, glm::vec3& maximum) const {
+    minimum = glm::vec3{INFINITY};
+    maximum = glm::vec3{-INFINITY};
+    for (const auto& instance : instances) {
+      glm::vec3 center = glm::vec3{instance.model() * glm::vec4{glm::vec3{boundingSphere}, 1.0f}};
+      minimum = glm::min(minimum, center - boundingSphere.w);
+      maximum = glm::max(maximum, center + boundingSphere.w);
+    }
+  }
+
+  // Point lights scattered through the bounding box of the instances
+  void createLightClusters() {
+    glm::vec3 minimum;
+    glm::vec3 maximum;
+    sceneBounds(minimum, maximum);
+
+    lightClusters = std::make_unique<LightClusters>(ctx, *pipelineManager, *shaderLibrary, settings.framesInFlight,
+                                                    createLights(settings.lightCount, minimum, maximum), !settings.cpuLightAssignment);
+  }
+
+  /**
+   * Cascades covering the bounding sphere of the scene, raised to include the dynamic objects. The frame set layout
+   * must exist, as the cascades' matrices are bound in its layout
+   */
+  void createShadowMaps() {
+    glm::vec3 minimum;
+    glm::vec3 maximum;
+    sceneBounds(minimum, maximum);
+    if (settings.dynamicObjects > 0) {
+      maximum.z = std::max(maximum.z, dynamicObjectHeight() + boundingSphere.w);
+    }
+    glm::vec3 center = 0.5f * (minimum + maximum);
+
+    ShadowConfig config;
+    config.cascadeCount = settings.shadowCascades;
+    config.resolution = settings.shadowResolution;
+    config.cache = settings.shadowCache;
+    config.updateBudget = settings.shadowUpdateBudget;
+    config.distantInterval = settings.shadowDistantInterval;
+    shadowMaps = std::make_unique<ShadowMaps>(ctx, config, settings.framesInFlight, frameSetLayout,
+                                              glm::vec4{center, 0.5f * glm::length(maximum - minimum)});
+  }
+
+  // World space bounds of the instances, computed once as the scene is static
+  void createCpuCuller() {
+    SphereBounds bounds;
+    for (const auto& instance : instances) {
+      const glm::vec4& sphere = meshes[instance.meshIndex].boundingSphere;
+      glm::mat4 model = instance.model();
+      glm::vec4 center = model * glm::vec4{glm::vec3{sphere}, 1.0f};
+      float scale = std::max({glm::length(glm::vec3{model[0]}), glm::length(glm::vec3{model[1]}), glm::length(glm::vec3{model[2]})});
+      bounds.push(center.x, center.y, center.z, sphere.w * scale);
+    }
+    cpuCuller = std::make_unique<CpuCuller>(bounds);
+  }
+
+  // Every instance can hide others with a simplified copy of the model
+  void createOcclusionCuller() {
+    std::vector<glm::vec3> positions;
+    positions.reserve(vertices.size());
+    for (const auto& vertex : vertices) {
+      positions.push_back(vertex.pos);
+    }
+
+    occlusionCuller = std::make_unique<OcclusionCuller>(std::vector<OccluderMesh>{simplifyOccluder(positions, indices, OCCLUDER_TRIANGLES)});
+    for (const auto& instance : instances) {
+      occlusionCuller->addInstance(instance.model(), instance.meshIndex);
+    }
+  }
+
+  // Only visible instances reach command recording. Recorded command buffers stay valid while the set is unchanged
+  void cullInstances() {
+    if (!cpuCuller) {
+      return;
+    }
+
+    glm::mat4 viewProjection = camera.projectionMatrix * camera.viewMatrix;
+    cpuCuller->cull(extractFrustum(viewProjection), culledInstances);
+    if (occlusionCuller) {
+      occlusionCuller->cull(viewProjection, camera.position, culledInstances);
+    }
+    if (culledInstances != visibleInstances) {
+      std::swap(culledInstances, visibleInstances);
+      createInstanceRuns();
+      invalidateCommandBuffers();
+    }
+  }
+
+  /*----- Animation -----*/
+
+  // Seconds since the first frame
+  float animationTime() const {
+    static auto startTime = std::chrono::high_resolution_clock::now();
+    auto currentTime = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration<float, std::chrono::seconds::period>(currentTime - startTime).count();
+  }
+
+  // Whether frames differ without input, which on-demand mode has to draw
+  bool animated() const {
+    return !dynamicObjects.empty() || (shadowMaps && settings.sunSpeed != 0.0f);
+  }
+
+  // Above the instances, so that the dynamic objects cast their shadows onto them
+  float dynamicObjectHeight() const {
+    return boundingSphere.z + 2.5f * boundingSphere.w;
+  }
+
+  // The dynamic objects circle above the grid while spinning, and the sun turns around the up axis. The objects'
+  // transforms are pushed as draw constants, so the recorded commands change with them
+  void updateAnimation() {
+    float time = animationTime();
+    float azimuth = SUN_AZIMUTH + time * settings.sunSpeed;
+    sunDirection = {std::cos(SUN_ELEVATION) * std::cos(azimuth), std::cos(SUN_ELEVATION) * std::sin(azimuth), std::sin(SUN_ELEVATION)};
+
+    if (settings.dynamicObjects == 0) {
+      return;
+    }
+
+    // About halfway out to the edge of the grid
+    float orbit = boundingSphere.w * (1.0f + 0.6f * std::sqrt(static_cast<float>(instances.size())));
+    dynamicObjects.resize(settings.dynamicObjects);
+    for (uint32_t i = 0; i < dynamicObjects.size(); i++) {
+      float angle = 0.5f * time + 2.0f * static_cast<float>(M_PI) * i / dynamicObjects.size();
+      glm::vec3 position{orbit * std::cos(angle), orbit * std::sin(angle), dynamicObjectHeight()};
+      dynamicObjects[i] = glm::translate(glm::mat4(1.0f), position) * glm::rotate(glm::mat4(1.0f), 2.0f * time, glm::vec3{0.0f, 0.0f, 1.0f}) *
+                          glm::translate(glm::mat4(1.0f), -glm::vec3{boundingSphere});
+    }
+    invalidateCommandBuffers();
   }
 
   /*----- Model Loader -----*/
@@ -279,279 +761,391 @@ class Renderer {
         indices.push_back(uniqueVertices[vertex]);
       }
     }
+
+    // Centre of the bounding box and the distance to the furthest vertex
+    glm::vec3 minimum{std::numeric_limits<float>::max()};
+    glm::vec3 maximum{std::numeric_limits<float>::lowest()};
+    for (const auto& vertex : vertices) {
+      minimum = glm::min(minimum, vertex.pos);
+      maximum = glm::max(maximum, vertex.pos);
+    }
+    glm::vec3 center = 0.5f * (minimum + maximum);
+
+    float radius = 0.0f;
+    for (const auto& vertex : vertices) {
+      radius = std::max(radius, glm::length(vertex.pos - center));
+    }
+    boundingSphere = glm::vec4{center, radius};
   }
 
   /*----- Pipeline -----*/
 
   void createGraphicsPipeline() {
-    // ----- Create shader modules -----
-    auto vertShaderCode = readFile("shaders/vert.spv");
-    auto fragShaderCode = readFile("shaders/frag.spv");
+    // ----- Layout -----
+    std::vector<VkDescriptorSetLayout> setLayouts = {frameSetLayout, sceneSetLayout};
+    if (lightClusters) {
+      setLayouts.push_back(lightClusters->setLayout);
+    }
+    if (shadowMaps) {
+      setLayouts.push_back(shadowMaps->setLayout);
+    }
 
-    VkShaderModule vertShaderModule = createShaderModule(ctx, vertShaderCode);
-    VkShaderModule fragShaderModule = createShaderModule(ctx, fragShaderCode);
+    VkPushConstantRange pushConstantRange{};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(DrawConstants);
 
-    // TODO: pSpecializationInfo
+    pipelineLayout = pipelineManager->layout(setLayouts, {pushConstantRange});
 
-    VkPipelineShaderStageCreateInfo vertShaderStageInfo{};
-    vertShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-    vertShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
+    // ----- Describe pipeline -----
+    graphicsPipeline = pipelineManager->request(describeMainPassPipeline(ScenePass::Color, false));
+    shadingPipelines[0][0] = graphicsPipeline;
 
-    vertShaderStageInfo.module = vertShaderModule;
-    // Specify the entrypoint
-    vertShaderStageInfo.pName = "main";
+    // The default pipeline is the fallback for all others so it has to exist before the first frame
+    pipelineManager->wait(*graphicsPipeline);
+    fallbackPipeline = graphicsPipeline;
 
-    VkPipelineShaderStageCreateInfo fragShaderStageInfo{};
-    fragShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-    fragShaderStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-    fragShaderStageInfo.module = fragShaderModule;
-    // Specify the entrypoint
-    fragShaderStageInfo.pName = "main";
+    // Cascades are only rendered again when they move, so the first ones must not be skipped
+    if (shadowMaps) {
+      shadowPipeline = pipelineManager->request(describeShadowPipeline());
+      pipelineManager->wait(*shadowPipeline);
+    }
 
-    VkPipelineShaderStageCreateInfo shaderStages[] = {vertShaderStageInfo, fragShaderStageInfo};
+    // Without it the G-buffer is never shown
+    if (deferredShading) {
+      lightingPipelineLayout = createLightingPipelineLayout(deferredShading->setLayout);
+      lightingPipeline = pipelineManager->request(describeLightingPipeline(*renderGraph, scenePass, lightingPipelineLayout));
+      pipelineManager->wait(*lightingPipeline);
+    }
+  }
+
+  // Same sets as the scene pipelines, so that the lights and shadows are bound in the same place
+  VkPipelineLayout createLightingPipelineLayout(VkDescriptorSetLayout gbufferSetLayout) {
+    std::vector<VkDescriptorSetLayout> setLayouts = {frameSetLayout, gbufferSetLayout};
+    if (lightClusters) {
+      setLayouts.push_back(lightClusters->setLayout);
+    }
+    if (shadowMaps) {
+      setLayouts.push_back(shadowMaps->setLayout);
+    }
 
-    // ----- Specify which stages will be provided during draw -----
-    std::vector<VkDynamicState> dynamicStates = {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
+    return pipelineManager->layout(setLayouts);
+  }
 
-    VkPipelineDynamicStateCreateInfo dynamicState{};
-    dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
-    dynamicState.dynamicStateCount = dynamicStates.size();
-    dynamicState.pDynamicStates = dynamicStates.data();
+  // Shaders, vertex input and layout of the scene. Multiview pipelines index their matrices by the view. Lit color
+  // pipelines shade with the light clusters of the main camera and the shadowed sun
+  PipelineDescription describeScenePipeline(ScenePass pass, uint32_t multiviewCount, bool lit) {
+    bool depthOnly = pass == ScenePass::DepthOnly;
+    bool gbuffer = pass == ScenePass::GBuffer;
+    bool shade = lit && pass == ScenePass::Color;
+    bool lighting = shade && lightClusters;
+    bool shadows = shade && shadowMaps;
+
+    PipelineDescription description{};
+    description.stages = {shaderLibrary->load("shader.vert", VK_SHADER_STAGE_VERTEX_BIT,
+                                              {{"INSTANCE_ATTRIBUTES", settings.instanceAttributes ? "1" : "0"},
+                                               {"MULTIVIEW", std::to_string(multiviewCount)},
+                                               {"DEPTH_ONLY", depthOnly ? "1" : "0"},
+                                               {"WORLD_POSITION", lighting || shadows || gbuffer ? "1" : "0"}})};
+    if (pass == ScenePass::Color) {
+      std::vector<ShaderDefine> defines = {{"TEXTURE_COUNT", std::to_string(textures.size())}};
+      auto shadingDefines = lightingDefines(lighting, shadows);
+      defines.insert(defines.end(), shadingDefines.begin(), shadingDefines.end());
+      description.stages.push_back(shaderLibrary->load("shader.frag", VK_SHADER_STAGE_FRAGMENT_BIT, defines));
+    } else if (gbuffer) {
+      description.stages.push_back(shaderLibrary->load("gbuffer.frag", VK_SHADER_STAGE_FRAGMENT_BIT,
+                                                       {{"TEXTURE_COUNT", std::to_string(textures.size())}}));
+    } else if (pass == ScenePass::Overdraw) {
+      description.stages.push_back(shaderLibrary->load("overdraw.frag", VK_SHADER_STAGE_FRAGMENT_BIT,
+                                                       {{"OVERDRAW_STEP", std::to_string(OVERDRAW_STEP)}}));
+      description.blendMode = BlendMode::Additive;
+    }
+    // Depth is written without a fragment shader
+    description.colorWrite = !depthOnly;
 
-    // ----- Specify vertex format -----
-    auto bindingDescription = Vertex::getBindingDescription();
     auto attributeDescriptions = Vertex::getAttributeDescriptions();
+    description.bindings = {Vertex::getBindingDescription()};
+    // The position is the first attribute
+    description.attributes = {attributeDescriptions.begin(), depthOnly ? attributeDescriptions.begin() + 1 : attributeDescriptions.end()};
+
+    if (settings.instanceAttributes) {
+      auto instanceAttributeDescriptions = InstanceData::getAttributeDescriptions();
+      description.bindings.push_back(InstanceData::getBindingDescription());
+      description.attributes.insert(description.attributes.end(), instanceAttributeDescriptions.begin(), instanceAttributeDescriptions.end());
+    }
 
-    VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
-    vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-    vertexInputInfo.vertexBindingDescriptionCount = 1;
-    vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());
-    vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
-    vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
-
-    // ----- Input assembly -----
-    VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
-    inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-    inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-    inputAssembly.primitiveRestartEnable = VK_FALSE;
-
-    VkPipelineViewportStateCreateInfo viewportState{};
-    viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-    viewportState.viewportCount = 1;
-    viewportState.scissorCount = 1;
-
-    // ----- Rasterizer -----
-    VkPipelineRasterizationStateCreateInfo rasterizer{};
-    rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-    // Discard fragments beyond the near and far planes instead of clamping them
-    rasterizer.depthClampEnable = VK_FALSE;
-    // Do not disable rendering ???
-    rasterizer.rasterizerDiscardEnable = VK_FALSE;
-    // Fill, wireframe or point
-    rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
-    // Is this needed when rendering triangles?
-    rasterizer.lineWidth = 1.0f;
-
-    rasterizer.cullMode = VK_CULL_MODE_BACK_BIT;
-    rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
-
-    rasterizer.depthBiasEnable = VK_FALSE;
-
-    // ----- Multisampling -----
-    VkPipelineMultisampleStateCreateInfo multisampling{};
-    multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-    multisampling.sampleShadingEnable = VK_FALSE;
-    multisampling.rasterizationSamples = msaaSamples;
-    multisampling.sampleShadingEnable = VK_TRUE;  // enable sample shading in the pipeline
-    multisampling.minSampleShading = 0.2f;        // min fraction for sample shading; closer to one is smoother
-
-    // ----- Blending -----
-    VkPipelineColorBlendAttachmentState colorBlendAttachment{};
-    colorBlendAttachment.colorWriteMask =
-        VK_COLOR_COMPONENT_R_BIT |
-        VK_COLOR_COMPONENT_G_BIT |
-        VK_COLOR_COMPONENT_B_BIT |
-        VK_COLOR_COMPONENT_A_BIT;
-
-    colorBlendAttachment.blendEnable = VK_FALSE;
-
-    // TODO investigate more
-    VkPipelineColorBlendStateCreateInfo colorBlending{};
-    colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-    colorBlending.logicOpEnable = VK_FALSE;
-    colorBlending.attachmentCount = 1;
-    colorBlending.pAttachments = &colorBlendAttachment;
+    description.layout = pipelineLayout;
+    return description;
+  }
 
-    // ----- Layout -----
-    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
-    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-    pipelineLayoutInfo.setLayoutCount = 1;
-    pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout;
+  // Defines of the lighting in lighting.glsl
+  std::vector<ShaderDefine> lightingDefines(bool lighting, bool shadows) {
+    std::vector<ShaderDefine> defines = {{"LIGHTING", lighting ? "1" : "0"}, {"SHADOWS", shadows ? "1" : "0"}};
+    if (lighting) {
+      auto clusterDefines = LightClusters::shaderDefines();
+      defines.insert(defines.end(), clusterDefines.begin(), clusterDefines.end());
+    }
+    if (shadows) {
+      // The shadow set follows the cluster set
+      defines.push_back({"SHADOW_SET", lightClusters ? "3" : "2"});
+      defines.push_back({"MAX_SHADOW_CASCADES", std::to_string(MAX_SHADOW_CASCADES)});
+    }
+    return defines;
+  }
 
-    if (vkCreatePipelineLayout(ctx.device, &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS) {
-      throw std::runtime_error("Failed to create pipeline layout");
+  /**
+   * Scene pipeline of the main render pass. After a depth pre-pass only fragments at the pre-pass depth are shaded.
+   * With deferred shading the color pass writes the G-buffer
+   */
+  PipelineDescription describeMainPassPipeline(ScenePass pass, bool afterPrepass) {
+    if (deferredShading && pass == ScenePass::Color) {
+      pass = ScenePass::GBuffer;
+    }
+    PipelineDescription description = describeScenePipeline(pass, 0, true);
+    description.renderPass = renderPass;
+    description.renderPassKey = renderGraph->renderPassKey(scenePass);
+    description.subpass = 0;
+    if (pass == ScenePass::GBuffer) {
+      auto formats = deferredShading->gbufferFormats();
+      description.colorFormats = {formats.begin(), formats.end()};
+    } else {
+      description.colorFormats = {swapChainImageFormat};
+    }
+    description.depthFormat = findDepthFormat();
+    description.samples = msaaSamples;
+    // MSAA for shader (e.g. texture aliasing)
+    description.sampleShading = pass == ScenePass::Color;
+
+    if (afterPrepass) {
+      description.depthCompareOp = VK_COMPARE_OP_EQUAL;
+      description.depthWrite = false;
     }
+    return description;
+  }
+
+  // Full screen triangle of the second subpass of a deferred render pass, lit as the color pass is in forward shading
+  PipelineDescription describeLightingPipeline(const RenderGraph& graph, RenderGraph::Pass deferredPass, VkPipelineLayout layout) {
+    PipelineDescription description{};
+    description.stages = {shaderLibrary->load("deferred.vert", VK_SHADER_STAGE_VERTEX_BIT, {}),
+                          shaderLibrary->load("deferred.frag", VK_SHADER_STAGE_FRAGMENT_BIT,
+                                              lightingDefines(lightClusters != nullptr, shadowMaps != nullptr))};
+    description.layout = layout;
+    description.renderPass = graph.renderPass(deferredPass);
+    description.renderPassKey = graph.renderPassKey(deferredPass);
+    description.subpass = 1;
+    description.colorFormats = {swapChainImageFormat};
+    // The depth is read as an input attachment
+    description.depthFormat = VK_FORMAT_UNDEFINED;
+    description.depthTest = false;
+    description.depthWrite = false;
+    description.cullMode = VK_CULL_MODE_NONE;
+    return description;
+  }
 
-    // ----- Depth -----
+  // Depth of the casters, biased away from the sun. Both faces are drawn, so thin geometry casts from either side
+  PipelineDescription describeShadowPipeline() {
+    PipelineDescription description = describeScenePipeline(ScenePass::DepthOnly, 0, false);
+    description.renderPass = shadowMaps->renderPass;
+    description.renderPassKey = shadowMaps->renderPassKey;
+    description.subpass = 0;
+    description.colorFormats = {};
+    description.depthFormat = shadowMaps->depthFormat;
+    description.samples = VK_SAMPLE_COUNT_1_BIT;
+    description.cullMode = VK_CULL_MODE_NONE;
+    description.depthBiasConstant = SHADOW_DEPTH_BIAS_CONSTANT;
+    description.depthBiasSlope = SHADOW_DEPTH_BIAS_SLOPE;
+    return description;
+  }
 
-    VkPipelineDepthStencilStateCreateInfo depthStencil{};
-    depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
-    depthStencil.depthTestEnable = VK_TRUE;
-    depthStencil.depthWriteEnable = VK_TRUE;
-    depthStencil.depthCompareOp = VK_COMPARE_OP_LESS;
-    depthStencil.depthBoundsTestEnable = VK_FALSE;
-    depthStencil.minDepthBounds = 0.0f;  // Optional
-    depthStencil.maxDepthBounds = 1.0f;  // Optional
-    depthStencil.stencilTestEnable = VK_FALSE;
-    depthStencil.front = {};  // Optional
-    depthStencil.back = {};   // Optional
+  // Requested when first used, as most runs never switch modes
+  PipelineHandle& shadingPipeline(bool overdraw, bool afterPrepass) {
+    auto& handle = shadingPipelines[overdraw][afterPrepass];
+    if (!handle) {
+      handle = pipelineManager->request(describeMainPassPipeline(overdraw ? ScenePass::Overdraw : ScenePass::Color, afterPrepass));
+    }
+    return *handle;
+  }
 
-    // ----- Create pipeline ----
-    VkGraphicsPipelineCreateInfo pipelineInfo{};
-    pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-    pipelineInfo.stageCount = 2;
-    pipelineInfo.pStages = shaderStages;
+  PipelineHandle& depthPrepassPipeline() {
+    if (!depthPipeline) {
+      depthPipeline = pipelineManager->request(describeMainPassPipeline(ScenePass::DepthOnly, false));
+    }
+    return *depthPipeline;
+  }
 
-    pipelineInfo.pVertexInputState = &vertexInputInfo;
-    pipelineInfo.pInputAssemblyState = &inputAssembly;
-    pipelineInfo.pViewportState = &viewportState;
-    pipelineInfo.pRasterizationState = &rasterizer;
-    pipelineInfo.pMultisampleState = &multisampling;
-    pipelineInfo.pDepthStencilState = nullptr;  // Optional
-    pipelineInfo.pColorBlendState = &colorBlending;
-    pipelineInfo.pDynamicState = &dynamicState;
+  /**
+   * Pipelines for the current mode. The pre-pass is skipped until both of its pipelines are ready, as an equal depth
+   * test without the pre-pass depth would discard everything
+   */
+  FramePipelines resolveFramePipelines() {
+    FramePipelines pipelines;
+    if (depthPrepass) {
+      pipelines.depth = pipelineManager->resolve(depthPrepassPipeline(), VK_NULL_HANDLE);
+      pipelines.shading = pipelineManager->resolve(shadingPipeline(overdrawView, true), VK_NULL_HANDLE);
+      if (pipelines.depth != VK_NULL_HANDLE && pipelines.shading != VK_NULL_HANDLE) {
+        return pipelines;
+      }
+      pipelines.depth = VK_NULL_HANDLE;
+    }
+    pipelines.shading = pipelineManager->resolve(shadingPipeline(overdrawView, false), fallbackPipeline->pipeline);
+    if (lightingPipeline) {
+      pipelines.lighting = pipelineManager->resolve(*lightingPipeline, VK_NULL_HANDLE);
+    }
+    return pipelines;
+  }
 
-    pipelineInfo.layout = pipelineLayout;
+  // Block until the pipelines of the current mode are compiled, so that no frame is drawn with a fallback
+  void waitForFramePipelines() {
+    if (depthPrepass) {
+      pipelineManager->wait(depthPrepassPipeline());
+    }
+    pipelineManager->wait(shadingPipeline(overdrawView, depthPrepass));
+    if (lightingPipeline) {
+      pipelineManager->wait(*lightingPipeline);
+    }
+  }
 
-    pipelineInfo.renderPass = renderPass;
-    pipelineInfo.subpass = 0;
+  /*----- Render Graph -----*/
 
-    pipelineInfo.pDepthStencilState = &depthStencil;
+  /**
+   * Declare the passes of a frame. With occlusion culling the scene is drawn in an early pass, whose depth the depth
+   * pyramid is built from, and a late pass which loads its attachments. The multisampled color is resolved into the
+   * swap chain image, or into the scene image which is upscaled into it while the resolution is scaled. With deferred
+   * shading the scene pass writes the G-buffer and lights it into that image in a second subpass
+   */
+  void createRenderPass() {
+    renderGraph = std::make_unique<RenderGraph>(ctx, *deletionQueue);
 
-    if (vkCreateGraphicsPipelines(ctx.device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &graphicsPipeline) != VK_SUCCESS) {
-      throw std::runtime_error("Failed to create graphics pipeline");
+    if (deferredShading) {
+      albedoImage = renderGraph->createImage("albedo", deferredShading->albedoFormat, msaaSamples, VK_IMAGE_ASPECT_COLOR_BIT);
+      normalImage = renderGraph->createImage("normal", deferredShading->normalFormat, msaaSamples, VK_IMAGE_ASPECT_COLOR_BIT);
+    } else {
+      colorImage = renderGraph->createImage("color", swapChainImageFormat, msaaSamples, VK_IMAGE_ASPECT_COLOR_BIT);
+    }
+    depthImage = renderGraph->createImage("depth", findDepthFormat(), msaaSamples, VK_IMAGE_ASPECT_DEPTH_BIT);
+    if (resolutionScaler) {
+      sceneImage = renderGraph->createImage("scene", swapChainImageFormat, VK_SAMPLE_COUNT_1_BIT, VK_IMAGE_ASPECT_COLOR_BIT);
     }
+    // Offscreen images are copied out rather than presented
+    swapChainImage = renderGraph->importImage("swap chain", swapChainImageFormat, VK_IMAGE_ASPECT_COLOR_BIT,
+                                              ctx.headless() ? ImageAccess::TransferSource : ImageAccess::Present);
+
+    VkClearValue clearColor{};
+    clearColor.color = {{0.0f, 0.0f, 0.0f, 1.0f}};
+    VkClearValue clearDepth{};
+    clearDepth.depthStencil = {1.0f, 0};
+
+    // Culling writes the indirect draws consumed inside the render pass, which the graph does not track
+    renderGraph->addPass("cull", {}, true, [this](VkCommandBuffer commandBuffer, const RenderGraph::PassContext&) {
+      if (gpuCuller) {
+        gpuCuller->cull(commandBuffer, currentFrame);
+      }
+    });
 
-    // ----- Cleanup -----
+    // The cluster lists are read by the fragment shaders of the scene passes, which the graph does not track
+    if (settings.lightCount > 0) {
+      renderGraph->addPass("light assignment", {}, true, [this](VkCommandBuffer commandBuffer, const RenderGraph::PassContext&) {
+        lightClusters->assign(commandBuffer, currentFrame);
+      });
+    }
 
-    // Can be destroyed after pipeline creation
-    vkDestroyShaderModule(ctx.device, fragShaderModule, nullptr);
-    vkDestroyShaderModule(ctx.device, vertShaderModule, nullptr);
-  }
+    // The shadow maps are sampled by the fragment shaders of the scene passes. Their render passes synchronize with them
+    if (settings.shadows) {
+      renderGraph->addPass("shadows", {}, true, [this](VkCommandBuffer commandBuffer, const RenderGraph::PassContext&) {
+        shadowMaps->record(commandBuffer, currentFrame,
+                           [this](VkCommandBuffer commandBuffer, VkDescriptorSet viewSet, uint32_t cascade, ShadowCasters casters) {
+                             return recordShadowCasters(commandBuffer, viewSet, cascade, casters);
+                           });
+      });
+    }
 
-  /*----- Render Pass -----*/
+    auto drawEarlyScene = [this](VkCommandBuffer commandBuffer, const RenderGraph::PassContext&) {
+      recordPasses(commandBuffer, framePipelines, 0, frameDrawCount, CullPhase::Early);
+    };
+
+    RenderGraph::Resource target = resolutionScaler ? sceneImage : swapChainImage;
+    RenderGraph::RasterPassDescription scene;
+    scene.depth = {depthImage, !occlusionCulling, clearDepth};
+    if (deferredShading) {
+      // Cleared to 0, which marks the pixels nothing was drawn to
+      scene.color = {target, true, clearColor};
+      scene.inputs = {{albedoImage, true, {}}, {normalImage, true, {}}};
+    } else {
+      scene.color = {colorImage, !occlusionCulling, clearColor};
+      scene.resolve = target;
+    }
 
-  void createRenderPass() {
-    // --- Color attachement
-    VkAttachmentDescription colorAttachment{};
-    colorAttachment.format = swapChainImageFormat;
-    // For multisampling
-    colorAttachment.samples = msaaSamples;
-    colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-    colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-
-    // 10/10 enum naming
-    colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-    colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-
-    // Data before rendering is not preserved but we clear anyway
-    colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    // After rendering, data should be suitable for swapchain presentation
-    // Multisampled images cannot be presented directly
-    colorAttachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-
-    VkAttachmentReference colorAttachmentRef{};
-    // layout(location = 0) out vec4 outColor
-    colorAttachmentRef.attachment = 0;
-    colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-
-    // --- Depth attachment
-    VkAttachmentDescription depthAttachment{};
-    depthAttachment.format = findDepthFormat();
-    depthAttachment.samples = msaaSamples;
-    depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-    depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-    depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-    depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-    depthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
-
-    VkAttachmentReference depthAttachmentRef{};
-    depthAttachmentRef.attachment = 1;
-    depthAttachmentRef.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
-
-    // --- Resolve attachment (MSAA to presentable)
-    VkAttachmentDescription colorAttachmentResolve{};
-    colorAttachmentResolve.format = swapChainImageFormat;
-    colorAttachmentResolve.samples = VK_SAMPLE_COUNT_1_BIT;
-    colorAttachmentResolve.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-    colorAttachmentResolve.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-    colorAttachmentResolve.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-    colorAttachmentResolve.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-    colorAttachmentResolve.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    colorAttachmentResolve.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
-
-    VkAttachmentReference colorAttachmentResolveRef{};
-    colorAttachmentResolveRef.attachment = 2;
-    colorAttachmentResolveRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-
-    // ---
-
-    VkSubpassDescription subpass{};
-    subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-    subpass.colorAttachmentCount = 1;
-    subpass.pColorAttachments = &colorAttachmentRef;
-    subpass.pDepthStencilAttachment = &depthAttachmentRef;
-    subpass.pResolveAttachments = &colorAttachmentResolveRef;
-
-    std::array<VkAttachmentDescription, 3> attachments = {colorAttachment, depthAttachment, colorAttachmentResolve};
-    VkRenderPassCreateInfo renderPassInfo{};
-    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-    renderPassInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
-    renderPassInfo.pAttachments = attachments.data();
-    renderPassInfo.subpassCount = 1;
-    renderPassInfo.pSubpasses = &subpass;
-
-    VkSubpassDependency dependency{};
-    dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-    dependency.dstSubpass = 0;
-
-    dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
-
-    dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
-    dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
-
-    renderPassInfo.dependencyCount = 1;
-    renderPassInfo.pDependencies = &dependency;
-
-    if (vkCreateRenderPass(ctx.device, &renderPassInfo, nullptr, &renderPass) != VK_SUCCESS) {
-      throw std::runtime_error("Failed to create render pass");
-    }
-  }
-
-  /*----- Framebuffer -----*/
-
-  void createFramebuffers() {
-    swapChainFramebuffers.resize(swapChainImageViews.size());
-
-    for (size_t i = 0; i < swapChainImageViews.size(); i++) {
-      std::array<VkImageView, 3> attachments = {
-          colorImageView,
-          depthImageView,
-          swapChainImageViews[i]};
-
-      VkFramebufferCreateInfo framebufferInfo{};
-      framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-      framebufferInfo.renderPass = renderPass;
-      framebufferInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
-      framebufferInfo.pAttachments = attachments.data();
-      framebufferInfo.width = swapChainExtent.width;
-      framebufferInfo.height = swapChainExtent.height;
-      framebufferInfo.layers = 1;
-
-      if (vkCreateFramebuffer(ctx.device, &framebufferInfo, nullptr, &swapChainFramebuffers[i]) != VK_SUCCESS) {
-        throw std::runtime_error("Failed to create framebuffer");
+    if (occlusionCulling) {
+      RenderGraph::RasterPassDescription early;
+      early.color = {colorImage, true, clearColor};
+      early.depth = {depthImage, true, clearDepth};
+      renderGraph->addRasterPass("early scene", early, drawEarlyScene);
+
+      renderGraph->addPass("depth pyramid", {{depthImage, ImageAccess::DepthSampled}}, true,
+                           [this](VkCommandBuffer commandBuffer, const RenderGraph::PassContext&) {
+                             depthPyramid->build(commandBuffer, renderExtent);
+                           });
+      // Instances which the depth of the early pass does not hide are drawn on top of it
+      renderGraph->addPass("late cull", {}, true, [this](VkCommandBuffer commandBuffer, const RenderGraph::PassContext&) {
+        gpuCuller->cullLate(commandBuffer, currentFrame);
+      });
+    }
+
+    // After an early pass the scene pass draws the instances found by the late phase
+    CullPhase phase = occlusionCulling ? CullPhase::Late : CullPhase::Early;
+    scenePass = renderGraph->addRasterPass("scene", scene, [this, phase](VkCommandBuffer commandBuffer, const RenderGraph::PassContext& pass) {
+      if (!commandRecorder || gpuCuller) {
+        recordPasses(commandBuffer, framePipelines, 0, frameDrawCount, phase);
+      } else {
+        VkCommandBufferInheritanceInfo inheritanceInfo{};
+        inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+        inheritanceInfo.renderPass = pass.renderPass;
+        inheritanceInfo.subpass = 0;
+        inheritanceInfo.framebuffer = pass.framebuffer;
+
+        const auto& secondaryCommandBuffers = commandRecorder->record(
+            currentFrame, inheritanceInfo, frameDrawCount,
+            [&](VkCommandBuffer commandBuffer, uint32_t firstDraw, uint32_t drawCount) {
+              recordPasses(commandBuffer, framePipelines, firstDraw, drawCount, phase);
+            });
+        // Nothing is recorded when every instance was culled, and executing no command buffers is not allowed
+        if (!secondaryCommandBuffers.empty()) {
+          vkCmdExecuteCommands(commandBuffer, static_cast<uint32_t>(secondaryCommandBuffers.size()), secondaryCommandBuffers.data());
+        }
+      }
+
+      // A single draw, recorded inline
+      if (deferredShading) {
+        vkCmdNextSubpass(commandBuffer, VK_SUBPASS_CONTENTS_INLINE);
+        recordLighting(commandBuffer, framePipelines.lighting, lightingPipelineLayout, deferredShading->descriptorSet);
       }
+    });
+
+    if (resolutionScaler) {
+      renderGraph->addPass("upscale", {{sceneImage, ImageAccess::TransferSource}, {swapChainImage, ImageAccess::TransferDestination}},
+                           false, [this](VkCommandBuffer commandBuffer, const RenderGraph::PassContext& pass) {
+                             recordUpscale(commandBuffer, pass.variant);
+                           });
+    }
+
+    renderGraph->compile();
+    renderPass = renderGraph->renderPass(scenePass);
+  }
+
+  /**
+   * Images of the render graph at the swap chain extent. They are full size so that the resolution scale can change
+   * without recreating them or the framebuffers. Frames in flight resolve into the same scene image as they render to
+   * the same multisampled image
+   */
+  void createFrameResources() {
+    renderGraph->setImportedImages(swapChainImage, swapChainImages, swapChainImageViews);
+    resizeStats.reusedAllocations += renderGraph->allocate(swapChainExtent);
+    updateRenderExtent();
+    if (depthPyramid) {
+      depthPyramid->resize(swapChainExtent, renderGraph->view(depthImage));
+    }
+    if (deferredShading) {
+      deferredShading->setAttachments(renderGraph->view(albedoImage), renderGraph->view(normalImage), renderGraph->view(depthImage));
     }
   }
 
@@ -583,15 +1177,6 @@ class Renderer {
         VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT);
   }
 
-  void createDepthResources() {
-    VkFormat depthFormat = findDepthFormat();
-
-    createImage(ctx, swapChainExtent.width, swapChainExtent.height, 1, msaaSamples,
-                depthFormat, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-                depthImage, depthImageMemory);
-    depthImageView = createImageView(ctx.device, depthImage, depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT, 1);
-  }
-
   VkSurfaceFormatKHR chooseSwapSurfaceFormat(const std::vector<VkSurfaceFormatKHR>& availableFormats) {
     for (const auto& availableFormat : availableFormats) {
       if (availableFormat.format == VK_FORMAT_B8G8R8A8_SRGB && availableFormat.colorSpace == VK_COLOR_SPACE_SRGB_NONLINEAR_KHR) {
@@ -603,6 +1188,14 @@ class Renderer {
   }
 
   VkPresentModeKHR chooseSwapPresentMode(const std::vector<VkPresentModeKHR>& availablePresentModes) {
+    if (settings.presentMode) {
+      if (std::find(availablePresentModes.begin(), availablePresentModes.end(), *settings.presentMode) != availablePresentModes.end()) {
+        return *settings.presentMode;
+      }
+      std::cerr << "Requested present mode is not supported. Falling back to FIFO" << std::endl;
+      return VK_PRESENT_MODE_FIFO_KHR;
+    }
+
     for (const auto& availablePresentMode : availablePresentModes) {
       if (availablePresentMode == VK_PRESENT_MODE_MAILBOX_KHR) {
         return availablePresentMode;
@@ -652,7 +1245,17 @@ class Renderer {
     createInfo.imageColorSpace = surfaceFormat.colorSpace;
     createInfo.imageExtent = extent;
     createInfo.imageArrayLayers = 1;
-    createInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;  // VK_IMAGE_USAGE_TRANSFER_DST_BIT to copy data for postprocessing instead
+    createInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+    // Frames are copied out for screenshots
+    swapChainCapturable = swapChainSupport.capabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+    if (swapChainCapturable) {
+      createInfo.imageUsage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+    }
+    // The scene is blitted into the image when rendered at a lower resolution
+    swapChainBlittable = swapChainSupport.capabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    if (settings.targetFrameTime > 0.0 && swapChainBlittable) {
+      createInfo.imageUsage |= VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    }
 
     QueueFamilyIndices indices = findQueueFamilies(ctx.physicalDevice, ctx.surface);
     uint32_t queueFamilyIndices[] = {indices.graphicsFamily.value(), indices.presentFamily.value()};
@@ -674,13 +1277,19 @@ class Renderer {
     createInfo.presentMode = presentMode;
     // No interest in pixels obscured by another window
     createInfo.clipped = VK_TRUE;
-    // Required when swap chain is invalidated e.g. by resizing
-    createInfo.oldSwapchain = VK_NULL_HANDLE;
+    // When the swap chain is invalidated e.g. by resizing, the driver can reuse resources of the old one and
+    // images acquired from it can still be presented
+    VkSwapchainKHR oldSwapChain = swapChain;
+    createInfo.oldSwapchain = oldSwapChain;
 
     if (vkCreateSwapchainKHR(ctx.device, &createInfo, nullptr, &swapChain) != VK_SUCCESS) {
       throw std::runtime_error("Failed to create swap chain");
     }
 
+    if (oldSwapChain != VK_NULL_HANDLE) {
+      deletionQueue->push([device = ctx.device, oldSwapChain] { vkDestroySwapchainKHR(device, oldSwapChain, nullptr); });
+    }
+
     // Note that imageCount is minimum and more images could have been created
     vkGetSwapchainImagesKHR(ctx.device, swapChain, &imageCount, nullptr);
     swapChainImages.resize(imageCount);
@@ -692,6 +1301,18 @@ class Renderer {
     camera.aspect = (float)extent.width / (float)extent.height;
   }
 
+  // Stands in for the swap chain without a surface. One image per frame in flight, never recreated
+  void createOffscreenTarget() {
+    offscreenTarget = std::make_unique<OffscreenTarget>(ctx, VkExtent2D{WIDTH, HEIGHT}, settings.framesInFlight);
+
+    swapChainImages = offscreenTarget->images;
+    swapChainImageFormat = offscreenTarget->format;
+    swapChainExtent = offscreenTarget->extent;
+    swapChainCapturable = true;
+
+    camera.aspect = (float)swapChainExtent.width / (float)swapChainExtent.height;
+  }
+
   void recreateSwapChain() {
     int width{0};
     int height{0};
@@ -701,33 +1322,44 @@ class Renderer {
       glfwWaitEvents();
     }
 
-    vkDeviceWaitIdle(ctx.device);
+    auto startTime = std::chrono::high_resolution_clock::now();
 
-    cleanupSwapChain();
+    // Frames in flight may still use the old resources so they are retired instead of waiting for the device
+    retireSwapChain();
 
     createSwapChain();
     createImageViews();
-    createColorResources();
-    createDepthResources();
-    createFramebuffers();
-  }
+    createFrameResources();
+    resizeStats.allocations += renderGraph->allocationCount();
 
-  void cleanupSwapChain() {
-    vkDestroyImageView(ctx.device, colorImageView, nullptr);
-    vkDestroyImage(ctx.device, colorImage, nullptr);
-    vkFreeMemory(ctx.device, colorImageMemory, nullptr);
+    invalidateCommandBuffers();
+    if (cacheCommandBuffers) {
+      createCachedCommandBuffers();
+    }
 
-    vkDestroyImageView(ctx.device, depthImageView, nullptr);
-    vkDestroyImage(ctx.device, depthImage, nullptr);
-    vkFreeMemory(ctx.device, depthImageMemory, nullptr);
+    auto endTime = std::chrono::high_resolution_clock::now();
+    resizeStats.recordRecreation(std::chrono::duration<double, std::milli>(endTime - startTime).count());
+  }
+
+  void retireSwapChain() {
+    // The render graph retires its framebuffers when it is allocated again
+    deletionQueue->push([device = ctx.device, imageViews = swapChainImageViews] {
+      for (auto imageView : imageViews) {
+        vkDestroyImageView(device, imageView, nullptr);
+      }
+    });
+  }
 
+  // The device must be idle
+  void cleanupSwapChain() {
     for (auto imageView : swapChainImageViews) {
       vkDestroyImageView(ctx.device, imageView, nullptr);
     }
-    for (auto framebuffer : swapChainFramebuffers) {
-      vkDestroyFramebuffer(ctx.device, framebuffer, nullptr);
+    // The swap chain extension is not enabled on a headless device
+    if (swapChain != VK_NULL_HANDLE) {
+      vkDestroySwapchainKHR(ctx.device, swapChain, nullptr);
     }
-    vkDestroySwapchainKHR(ctx.device, swapChain, nullptr);
+    offscreenTarget.reset();
   }
 
   void createImageViews() {
@@ -738,20 +1370,50 @@ class Renderer {
     }
   }
 
-  void createColorResources() {
-    VkFormat colorFormat = swapChainImageFormat;
+  /*----- Dynamic Resolution -----*/
+
+  // The scene is upscaled with a linear filtered blit, which the format must support in both directions
+  void createResolutionScaler() {
+    VkFormatProperties formatProperties;
+    vkGetPhysicalDeviceFormatProperties(ctx.physicalDevice, swapChainImageFormat, &formatProperties);
+    VkFormatFeatureFlags blitFeatures =
+        VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+
+    if (ctx.headless()) {
+      std::cerr << "Dynamic resolution is only available with a window. Rendering at full resolution" << std::endl;
+    } else if (!framePacer->measuresGpuTime()) {
+      std::cerr << "Dynamic resolution requires timestamp queries. Rendering at full resolution" << std::endl;
+    } else if (!swapChainBlittable || (formatProperties.optimalTilingFeatures & blitFeatures) != blitFeatures) {
+      std::cerr << "The swap chain images cannot be blitted to. Rendering at full resolution" << std::endl;
+    } else {
+      resolutionScaler = std::make_unique<ResolutionScaler>(settings.targetFrameTime, settings.minResolutionScale);
+    }
+  }
+
+  void updateRenderExtent() {
+    renderExtent = resolutionScaler ? resolutionScaler->scaledExtent(swapChainExtent) : swapChainExtent;
+  }
 
-    createImage(ctx, swapChainExtent.width, swapChainExtent.height, 1, msaaSamples,
-                colorFormat, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-                colorImage, colorImageMemory);
-    colorImageView = createImageView(ctx.device, colorImage, colorFormat, VK_IMAGE_ASPECT_COLOR_BIT, 1);
+  /**
+   * Stretch the scene from the corner of the scene image it was rendered to over the whole swap chain image. The
+   * render graph transitions both images around the blit
+   */
+  void recordUpscale(VkCommandBuffer commandBuffer, uint32_t imageIndex) {
+    VkImageBlit blit{};
+    blit.srcSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+    blit.srcOffsets[1] = {static_cast<int32_t>(renderExtent.width), static_cast<int32_t>(renderExtent.height), 1};
+    blit.dstSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+    blit.dstOffsets[1] = {static_cast<int32_t>(swapChainExtent.width), static_cast<int32_t>(swapChainExtent.height), 1};
+    vkCmdBlitImage(commandBuffer, renderGraph->image(sceneImage), VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                   swapChainImages[imageIndex], VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit, VK_FILTER_LINEAR);
   }
 
   /*----- Resource descriptors -----*/
 
-  void createDescriptorSetLayout() {
+  // Set 0 changes every frame and set 1 holds the scene. Binding a new frame set keeps set 1 bound
+  void createDescriptorSetLayouts() {
     VkDescriptorSetLayoutBinding uboLayoutBinding{};
-    // layout(binding = 0) in shader
+    // layout(set = 0, binding = 0) in shader
     uboLayoutBinding.binding = 0;
     uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
     // Can pass arrays in which case the count is the number of elements
@@ -760,36 +1422,55 @@ class Renderer {
     uboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
     uboLayoutBinding.pImmutableSamplers = nullptr;  // Optional, for images
 
+    VkDescriptorSetLayoutCreateInfo frameLayoutInfo{};
+    frameLayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    frameLayoutInfo.bindingCount = 1;
+    frameLayoutInfo.pBindings = &uboLayoutBinding;
+
+    if (vkCreateDescriptorSetLayout(ctx.device, &frameLayoutInfo, nullptr, &frameSetLayout) != VK_SUCCESS) {
+      throw std::runtime_error("Failed to create frame descriptor set layout");
+    }
+
+    // Indexed by the material index of the draw
     VkDescriptorSetLayoutBinding samplerLayoutBinding{};
-    samplerLayoutBinding.binding = 1;
-    samplerLayoutBinding.descriptorCount = 1;
+    samplerLayoutBinding.binding = 0;
+    samplerLayoutBinding.descriptorCount = static_cast<uint32_t>(textures.size());
     samplerLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
     samplerLayoutBinding.pImmutableSamplers = nullptr;
     samplerLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
 
-    std::array<VkDescriptorSetLayoutBinding, 2> bindings = {uboLayoutBinding, samplerLayoutBinding};
-    VkDescriptorSetLayoutCreateInfo layoutInfo{};
-    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-    layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
-    layoutInfo.pBindings = bindings.data();
-
-    if (vkCreateDescriptorSetLayout(ctx.device, &layoutInfo, nullptr, &descriptorSetLayout) != VK_SUCCESS) {
-      throw std::runtime_error("Failed to create descriptor set layout");
+    VkDescriptorSetLayoutBinding instanceLayoutBinding{};
+    instanceLayoutBinding.binding = 1;
+    instanceLayoutBinding.descriptorCount = 1;
+    instanceLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    instanceLayoutBinding.pImmutableSamplers = nullptr;
+    instanceLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+
+    std::array<VkDescriptorSetLayoutBinding, 2> bindings = {samplerLayoutBinding, instanceLayoutBinding};
+    VkDescriptorSetLayoutCreateInfo sceneLayoutInfo{};
+    sceneLayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    sceneLayoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+    sceneLayoutInfo.pBindings = bindings.data();
+
+    if (vkCreateDescriptorSetLayout(ctx.device, &sceneLayoutInfo, nullptr, &sceneSetLayout) != VK_SUCCESS) {
+      throw std::runtime_error("Failed to create scene descriptor set layout");
     }
   }
 
   void createDescriptorPool() {
-    std::array<VkDescriptorPoolSize, 2> poolSizes{};
+    std::array<VkDescriptorPoolSize, 3> poolSizes{};
     poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    poolSizes[0].descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
+    poolSizes[0].descriptorCount = static_cast<uint32_t>(settings.framesInFlight);
     poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    poolSizes[1].descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
+    poolSizes[1].descriptorCount = static_cast<uint32_t>(textures.size());
+    poolSizes[2].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    poolSizes[2].descriptorCount = 1;
 
     VkDescriptorPoolCreateInfo poolInfo{};
     poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
     poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
     poolInfo.pPoolSizes = poolSizes.data();
-    poolInfo.maxSets = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
+    poolInfo.maxSets = static_cast<uint32_t>(settings.framesInFlight) + 1;
 
     if (vkCreateDescriptorPool(ctx.device, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS) {
       throw std::runtime_error("Failed to create descriptor pool");
@@ -797,50 +1478,77 @@ class Renderer {
   }
 
   void createDescriptorSets() {
-    std::vector<VkDescriptorSetLayout> layouts(MAX_FRAMES_IN_FLIGHT, descriptorSetLayout);
+    // ----- Frame sets -----
+    std::vector<VkDescriptorSetLayout> layouts(settings.framesInFlight, frameSetLayout);
     VkDescriptorSetAllocateInfo allocInfo{};
     allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
     allocInfo.descriptorPool = descriptorPool;
-    allocInfo.descriptorSetCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
+    allocInfo.descriptorSetCount = static_cast<uint32_t>(settings.framesInFlight);
     allocInfo.pSetLayouts = layouts.data();
 
-    descriptorSets.resize(MAX_FRAMES_IN_FLIGHT);
+    frameDescriptorSets.resize(settings.framesInFlight);
 
-    if (vkAllocateDescriptorSets(ctx.device, &allocInfo, descriptorSets.data()) != VK_SUCCESS) {
-      throw std::runtime_error("Failed to allocate descriptor sets");
+    if (vkAllocateDescriptorSets(ctx.device, &allocInfo, frameDescriptorSets.data()) != VK_SUCCESS) {
+      throw std::runtime_error("Failed to allocate frame descriptor sets");
     }
 
-    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+    for (size_t i = 0; i < settings.framesInFlight; i++) {
       VkDescriptorBufferInfo bufferInfo{};
       bufferInfo.buffer = uniformBuffers[i];
       bufferInfo.offset = 0;
       bufferInfo.range = sizeof(UniformBufferObject);
 
-      VkDescriptorImageInfo imageInfo{};
-      imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-      imageInfo.imageView = textures[0]->imageView;
-      imageInfo.sampler = textures[0]->sampler;
+      VkWriteDescriptorSet descriptorWrite{};
+      descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+      descriptorWrite.dstSet = frameDescriptorSets[i];
+      descriptorWrite.dstBinding = 0;
+      descriptorWrite.dstArrayElement = 0;
+      descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+      descriptorWrite.descriptorCount = 1;
+      descriptorWrite.pBufferInfo = &bufferInfo;
 
-      std::array<VkWriteDescriptorSet, 2> descriptorWrites{};
+      vkUpdateDescriptorSets(ctx.device, 1, &descriptorWrite, 0, nullptr);
+    }
 
-      descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-      descriptorWrites[0].dstSet = descriptorSets[i];
-      descriptorWrites[0].dstBinding = 0;
-      descriptorWrites[0].dstArrayElement = 0;
-      descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-      descriptorWrites[0].descriptorCount = 1;
-      descriptorWrites[0].pBufferInfo = &bufferInfo;
+    // ----- Scene set -----
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts = &sceneSetLayout;
 
-      descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-      descriptorWrites[1].dstSet = descriptorSets[i];
-      descriptorWrites[1].dstBinding = 1;
-      descriptorWrites[1].dstArrayElement = 0;
-      descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-      descriptorWrites[1].descriptorCount = 1;
-      descriptorWrites[1].pImageInfo = &imageInfo;
+    if (vkAllocateDescriptorSets(ctx.device, &allocInfo, &sceneDescriptorSet) != VK_SUCCESS) {
+      throw std::runtime_error("Failed to allocate scene descriptor set");
+    }
 
-      vkUpdateDescriptorSets(ctx.device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+    std::vector<VkDescriptorImageInfo> imageInfos;
+    for (const auto& texture : textures) {
+      imageInfos.push_back({texture->sampler, texture->imageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL});
     }
+
+    VkDescriptorBufferInfo instanceInfo{};
+    instanceInfo.buffer = instanceAttribute->buffer;
+    instanceInfo.offset = 0;
+    instanceInfo.range = VK_WHOLE_SIZE;
+
+    std::array<VkWriteDescriptorSet, 2> descriptorWrites{};
+
+    descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptorWrites[0].dstSet = sceneDescriptorSet;
+    descriptorWrites[0].dstBinding = 0;
+    descriptorWrites[0].dstArrayElement = 0;
+    descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    descriptorWrites[0].descriptorCount = static_cast<uint32_t>(imageInfos.size());
+    descriptorWrites[0].pImageInfo = imageInfos.data();
+
+    descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptorWrites[1].dstSet = sceneDescriptorSet;
+    descriptorWrites[1].dstBinding = 1;
+    descriptorWrites[1].dstArrayElement = 0;
+    descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    descriptorWrites[1].descriptorCount = 1;
+    descriptorWrites[1].pBufferInfo = &instanceInfo;
+
+    vkUpdateDescriptorSets(ctx.device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+
+    invalidateCommandBuffers();
   }
 
   /*----- Buffers -----*/
@@ -849,11 +1557,11 @@ class Renderer {
   void createUniformBuffers() {
     VkDeviceSize bufferSize = sizeof(UniformBufferObject);
 
-    uniformBuffers.resize(MAX_FRAMES_IN_FLIGHT);
-    uniformBuffersMemory.resize(MAX_FRAMES_IN_FLIGHT);
-    uniformBuffersMapped.resize(MAX_FRAMES_IN_FLIGHT);
+    uniformBuffers.resize(settings.framesInFlight);
+    uniformBuffersMemory.resize(settings.framesInFlight);
+    uniformBuffersMapped.resize(settings.framesInFlight);
 
-    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+    for (size_t i = 0; i < settings.framesInFlight; i++) {
       createBuffer(ctx, bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
                    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
                    uniformBuffers[i], uniformBuffersMemory[i]);
@@ -869,18 +1577,24 @@ class Renderer {
     float time = std::chrono::duration<float, std::chrono::seconds::period>(currentTime - startTime).count();
 
     UniformBufferObject ubo{};
-    ubo.model = glm::mat4(1.0f);
     ubo.view = camera.viewMatrix;
     ubo.proj = camera.projectionMatrix;
     ubo.proj[1][1] *= -1;
 
     memcpy(uniformBuffersMapped[currentImage], &ubo, sizeof(ubo));
+
+    if (gpuCuller) {
+      gpuCuller->update(currentImage, ubo.proj * ubo.view);
+    }
+    if (lightClusters) {
+      lightClusters->update(currentImage, camera, renderExtent);
+    }
   }
 
   /*----- Commands -----*/
 
   void createDrawCommandBuffers() {
-    drawCommandBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+    drawCommandBuffers.resize(settings.framesInFlight);
 
     VkCommandBufferAllocateInfo allocInfo{};
     allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
@@ -893,61 +1607,287 @@ class Renderer {
     }
   }
 
-  void recordDrawCommandBuffer(VkCommandBuffer drawCommandBuffer, uint32_t imageIndex) {
-    VkCommandBufferBeginInfo beginInfo{};
-    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-    beginInfo.flags = 0;                   // Optional
-    beginInfo.pInheritanceInfo = nullptr;  // Optional
-
-    if (vkBeginCommandBuffer(drawCommandBuffer, &beginInfo) != VK_SUCCESS) {
-      throw std::runtime_error("Failed to begin recording command buffer");
+  // Records a range of the draw list. Called from recording threads for secondary command buffers. With GPU culling
+  // the culler's indirect draws of the phase replace the draws of the instances, and are recorded by the range which
+  // starts the list
+  void recordDraws(VkCommandBuffer commandBuffer, VkPipeline pipeline, uint32_t firstDraw, uint32_t drawCount, CullPhase phase) {
+    setViewport(commandBuffer, renderExtent);
+
+    if (pipeline != VK_NULL_HANDLE) {
+      bindScene(commandBuffer, pipeline, frameDescriptorSets[currentFrame]);
+
+      uint32_t instanceDrawCount = visibleDrawCount();
+      uint32_t end = firstDraw + drawCount;
+      if (gpuCuller) {
+        if (firstDraw == 0 && drawCount > 0) {
+          // Indirect commands carry the instance index in firstInstance
+          DrawConstants constants = DrawConstants::create(draws[0].model, draws[0].materialIndex, 0);
+          vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0,
+                             sizeof(constants), &constants);
+          gpuCuller->draw(commandBuffer, currentFrame, phase);
+        }
+      } else if (firstDraw < instanceDrawCount) {
+        recordInstanceRuns(commandBuffer, instanceRuns, firstDraw, std::min(end, instanceDrawCount) - firstDraw);
+      }
+      if (end > instanceDrawCount) {
+        uint32_t first = std::max(firstDraw, instanceDrawCount);
+        recordDynamicObjects(commandBuffer, first - instanceDrawCount, end - first);
+      }
     }
+  }
 
-    VkRenderPassBeginInfo renderPassInfo{};
-    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-    renderPassInfo.renderPass = renderPass;
-    renderPassInfo.framebuffer = swapChainFramebuffers[imageIndex];
-
-    renderPassInfo.renderArea.offset = {0, 0};
-    renderPassInfo.renderArea.extent = swapChainExtent;
-
-    std::array<VkClearValue, 2> clearValues{};
-    clearValues[0].color = {{0.0f, 0.0f, 0.0f, 1.0f}};
-    clearValues[1].depthStencil = {1.0f, 0};
-
-    renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
-    renderPassInfo.pClearValues = clearValues.data();
+  // With a depth pre-pass the draw list is recorded twice, depth only and then shaded, as one range of twice the length
+  uint32_t passDrawCount(const FramePipelines& pipelines) const {
+    return listDrawCount() * (pipelines.depth != VK_NULL_HANDLE ? 2 : 1);
+  }
 
-    vkCmdBeginRenderPass(drawCommandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+  // Records a range of the draws of all passes. Recording threads take ranges in order, so the whole pre-pass is
+  // recorded before any shading
+  void recordPasses(VkCommandBuffer commandBuffer, const FramePipelines& pipelines, uint32_t firstDraw, uint32_t drawCount,
+                    CullPhase phase) {
+    if (pipelines.depth == VK_NULL_HANDLE) {
+      recordDraws(commandBuffer, pipelines.shading, firstDraw, drawCount, phase);
+      return;
+    }
 
-    vkCmdBindPipeline(drawCommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
+    uint32_t listSize = listDrawCount();
+    uint32_t end = firstDraw + drawCount;
+    if (firstDraw < listSize) {
+      recordDraws(commandBuffer, pipelines.depth, firstDraw, std::min(end, listSize) - firstDraw, phase);
+    }
+    if (end > listSize) {
+      uint32_t first = std::max(firstDraw, listSize);
+      recordDraws(commandBuffer, pipelines.shading, first - listSize, end - first, phase);
+    }
+  }
 
+  void setViewport(VkCommandBuffer commandBuffer, VkExtent2D extent) {
     VkViewport viewport{};
     viewport.x = 0.0f;
     viewport.y = 0.0f;
-    viewport.width = static_cast<float>(swapChainExtent.width);
-    viewport.height = static_cast<float>(swapChainExtent.height);
+    viewport.width = static_cast<float>(extent.width);
+    viewport.height = static_cast<float>(extent.height);
     viewport.minDepth = 0.0f;
     viewport.maxDepth = 1.0f;
-    vkCmdSetViewport(drawCommandBuffer, 0, 1, &viewport);
+    vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
 
     VkRect2D scissor{};
     scissor.offset = {0, 0};
-    scissor.extent = swapChainExtent;
-    vkCmdSetScissor(drawCommandBuffer, 0, 1, &scissor);
+    scissor.extent = extent;
+    vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+  }
 
-    VkBuffer vertexBuffers[] = {vertexAttributes[0]->buffer};
-    VkDeviceSize offsets[] = {0};
-    vkCmdBindVertexBuffers(drawCommandBuffer, 0, 1, vertexBuffers, offsets);
-    vkCmdBindIndexBuffer(drawCommandBuffer, indexAttributes[0]->buffer, 0, VK_INDEX_TYPE_UINT32);
+  // Pipeline, geometry and descriptor sets. The frame set holds the camera matrices
+  void bindScene(VkCommandBuffer commandBuffer, VkPipeline pipeline, VkDescriptorSet frameSet) {
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
 
-    vkCmdBindDescriptorSets(drawCommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSets[currentFrame], 0, nullptr);
+    VkBuffer vertexBuffers[] = {vertexAttributes[0]->buffer, instanceAttribute->buffer};
+    VkDeviceSize offsets[] = {0, 0};
+    vkCmdBindVertexBuffers(commandBuffer, 0, settings.instanceAttributes ? 2 : 1, vertexBuffers, offsets);
+    vkCmdBindIndexBuffer(commandBuffer, indexAttributes[0]->buffer, 0, VK_INDEX_TYPE_UINT32);
 
-    // Vertex count, instance count, first vertex (and minimum gl_VertexIndex), first instance (gl_InstanceIndex)
-    // vkCmdDraw(commandBuffer, static_cast<uint32_t>(vertices.size()), 1, 0, 0);
-    vkCmdDrawIndexed(drawCommandBuffer, static_cast<uint32_t>(indices.size()), 1, 0, 0, 0);
+    std::vector<VkDescriptorSet> sets = {frameSet, sceneDescriptorSet};
+    if (lightClusters) {
+      sets.push_back(lightClusters->descriptorSet(currentFrame));
+    }
+    if (shadowMaps) {
+      sets.push_back(shadowMaps->descriptorSet(currentFrame));
+    }
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0,
+                            static_cast<uint32_t>(sets.size()), sets.data(), 0, nullptr);
+  }
 
-    vkCmdEndRenderPass(drawCommandBuffer);
+  // Draws every range of the draw list for every run. Draw i is range i % draw list size of run i / draw list size
+  void recordInstanceRuns(VkCommandBuffer commandBuffer, const std::vector<InstanceRun>& runs, uint32_t firstDraw, uint32_t drawCount) {
+    const VkShaderStageFlags pushStages = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+
+    // Instance attributes are fetched from firstInstance, the storage buffer from the pushed offset
+    for (uint32_t i = firstDraw; i < firstDraw + drawCount; i++) {
+      const Draw& draw = draws[i % draws.size()];
+      const InstanceRun& run = runs[i / draws.size()];
+      uint32_t firstInstance = settings.instanceAttributes ? run.firstInstance : 0;
+
+      DrawConstants constants = DrawConstants::create(draw.model, draw.materialIndex, run.firstInstance - firstInstance);
+      vkCmdPushConstants(commandBuffer, pipelineLayout, pushStages, 0, sizeof(constants), &constants);
+
+      // Index count, instance count, first index, vertex offset, first instance (gl_InstanceIndex)
+      vkCmdDrawIndexed(commandBuffer, draw.indexCount, run.instanceCount, draw.firstIndex, 0, firstInstance);
+    }
+  }
+
+  /**
+   * Draws the whole model once per dynamic object. The transform of the first instance is applied by the vertex
+   * shader, so it is undone in the pushed model matrix
+   */
+  void recordDynamicObjects(VkCommandBuffer commandBuffer, uint32_t first, uint32_t count) {
+    glm::mat4 instanceInverse = glm::inverse(instances[0].model());
+    for (uint32_t i = first; i < first + count; i++) {
+      DrawConstants constants = DrawConstants::create(instanceInverse * dynamicObjects[i], draws[0].materialIndex, 0);
+      vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0,
+                         sizeof(constants), &constants);
+      vkCmdDrawIndexed(commandBuffer, static_cast<uint32_t>(indices.size()), 1, 0, 0, 0);
+    }
+  }
+
+  /**
+   * Places the cascades and culls the static casters of those rendered this frame, so that recording only replays the
+   * runs. Returns whether the shadow work differs from the previous frame's
+   */
+  bool updateShadows() {
+    bool changed = shadowMaps->update(currentFrame, camera, sunDirection, !dynamicObjects.empty());
+
+    shadowCasterRuns.resize(shadowMaps->cascadeCount());
+    for (uint32_t i = 0; i < shadowMaps->cascadeCount(); i++) {
+      if (!shadowMaps->rendersStaticCasters(i)) {
+        continue;
+      }
+      if (cpuCuller) {
+        cpuCuller->cullAll(extractFrustum(shadowMaps->viewProjection(i)), shadowCasterInstances);
+        createRuns(shadowCasterInstances, shadowCasterRuns[i]);
+      } else {
+        shadowCasterRuns[i] = {{0, static_cast<uint32_t>(instances.size())}};
+      }
+    }
+    return changed;
+  }
+
+  /**
+   * Draws the casters of a cascade. Static casters are the instance runs culled by updateShadows, and dynamic casters
+   * the dynamic objects
+   */
+  uint32_t recordShadowCasters(VkCommandBuffer commandBuffer, VkDescriptorSet viewSet, uint32_t cascade, ShadowCasters casters) {
+    // Compiled before the first frame, and replaced only once a reloaded pipeline is ready
+    VkPipeline pipeline = pipelineManager->resolve(*shadowPipeline, VK_NULL_HANDLE);
+    if (pipeline == VK_NULL_HANDLE) {
+      return 0;
+    }
+    setViewport(commandBuffer, shadowMaps->extent());
+    bindScene(commandBuffer, pipeline, viewSet);
+
+    uint32_t drawCount = 0;
+    if (casters != ShadowCasters::Dynamic) {
+      const std::vector<InstanceRun>& runs = shadowCasterRuns[cascade];
+      drawCount += static_cast<uint32_t>(runs.size() * draws.size());
+      recordInstanceRuns(commandBuffer, runs, 0, static_cast<uint32_t>(runs.size() * draws.size()));
+    }
+    if (casters != ShadowCasters::Static) {
+      drawCount += static_cast<uint32_t>(dynamicObjects.size());
+      recordDynamicObjects(commandBuffer, 0, static_cast<uint32_t>(dynamicObjects.size()));
+    }
+    return drawCount;
+  }
+
+  // Lights the G-buffer of the first subpass with a full screen triangle. Skipped while the pipeline is compiling
+  void recordLighting(VkCommandBuffer commandBuffer, VkPipeline pipeline, VkPipelineLayout layout, VkDescriptorSet gbufferSet) {
+    if (pipeline == VK_NULL_HANDLE) {
+      return;
+    }
+    // The draws of the first subpass may have been recorded in secondary command buffers
+    setViewport(commandBuffer, renderExtent);
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+
+    std::vector<VkDescriptorSet> sets = {frameDescriptorSets[currentFrame], gbufferSet};
+    if (lightClusters) {
+      sets.push_back(lightClusters->descriptorSet(currentFrame));
+    }
+    if (shadowMaps) {
+      sets.push_back(shadowMaps->descriptorSet(currentFrame));
+    }
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, layout, 0, static_cast<uint32_t>(sets.size()),
+                            sets.data(), 0, nullptr);
+    vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+  }
+
+  /*----- Cached commands -----*/
+
+  // One command buffer per frame in flight and swap chain image. The previous buffers may still be pending
+  void createCachedCommandBuffers() {
+    if (!cachedCommandBuffers.empty()) {
+      std::vector<VkCommandBuffer> retired;
+      for (const auto& cached : cachedCommandBuffers) {
+        retired.push_back(cached.commandBuffer);
+      }
+      deletionQueue->push([device = ctx.device, commandPool = ctx.commandPool, retired] {
+        vkFreeCommandBuffers(device, commandPool, static_cast<uint32_t>(retired.size()), retired.data());
+      });
+    }
+
+    std::vector<VkCommandBuffer> commandBuffers(settings.framesInFlight * swapChainImages.size());
+
+    VkCommandBufferAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.commandPool = ctx.commandPool;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandBufferCount = static_cast<uint32_t>(commandBuffers.size());
+
+    if (vkAllocateCommandBuffers(ctx.device, &allocInfo, commandBuffers.data()) != VK_SUCCESS) {
+      throw std::runtime_error("Failed to allocate cached command buffers");
+    }
+
+    cachedCommandBuffers.clear();
+    for (auto commandBuffer : commandBuffers) {
+      cachedCommandBuffers.push_back({commandBuffer});
+    }
+  }
+
+  // Call when anything recorded into the draw command buffers changes, other than pipelines which are tracked by the manager
+  void invalidateCommandBuffers() {
+    drawStateVersion++;
+  }
+
+  /**
+   * Command buffer to submit for the current frame. With caching, the buffer for this frame and image is only
+   * re-recorded if the draw state or a pipeline has changed since it was recorded. It is not pending as the frame's
+   * timeline value has been waited on
+   */
+  VkCommandBuffer getDrawCommandBuffer(uint32_t imageIndex) {
+    if (!cacheCommandBuffers) {
+      vkResetCommandBuffer(drawCommandBuffers[currentFrame], 0);
+      recordDrawCommandBuffer(drawCommandBuffers[currentFrame], imageIndex);
+      return drawCommandBuffers[currentFrame];
+    }
+
+    CachedCommandBuffer& cached = cachedCommandBuffers[currentFrame * swapChainImages.size() + imageIndex];
+    uint64_t pipelineGeneration = pipelineManager->generation();
+
+    if (cached.drawStateVersion == drawStateVersion && cached.pipelineGeneration == pipelineGeneration) {
+      reusedCommandBufferFrames++;
+      return cached.commandBuffer;
+    }
+
+    vkResetCommandBuffer(cached.commandBuffer, 0);
+    recordDrawCommandBuffer(cached.commandBuffer, imageIndex);
+    cached.drawStateVersion = drawStateVersion;
+    cached.pipelineGeneration = pipelineGeneration;
+    recordedCommandBufferFrames++;
+
+    return cached.commandBuffer;
+  }
+
+  void recordDrawCommandBuffer(VkCommandBuffer drawCommandBuffer, uint32_t imageIndex) {
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = 0;                   // Optional
+    beginInfo.pInheritanceInfo = nullptr;  // Optional
+
+    if (vkBeginCommandBuffer(drawCommandBuffer, &beginInfo) != VK_SUCCESS) {
+      throw std::runtime_error("Failed to begin recording command buffer");
+    }
+
+    framePacer->writeBeginTimestamp(drawCommandBuffer, currentFrame);
+
+    // Skip the draws rather than stall if neither the pipeline nor a fallback has been compiled yet
+    framePipelines = resolveFramePipelines();
+    frameDrawCount = passDrawCount(framePipelines);
+
+    renderGraph->execute(drawCommandBuffer, imageIndex, {{0, 0}, renderExtent});
+
+    // The pixels of batch frames are on the host as soon as the frame completes
+    if (!settings.batchPath.empty()) {
+      offscreenTarget->recordReadback(drawCommandBuffer, imageIndex);
+    }
+
+    framePacer->writeEndTimestamp(drawCommandBuffer, currentFrame);
 
     if (vkEndCommandBuffer(drawCommandBuffer) != VK_SUCCESS) {
       throw std::runtime_error("Failed to record command buffer");
@@ -957,22 +1897,18 @@ class Renderer {
   /*----- Synchronization -----*/
 
   void createSyncObjects() {
-    imageAvailableSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-    renderFinishedSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-    inFlightFences.resize(MAX_FRAMES_IN_FLIGHT);
+    imageAvailableSemaphores.resize(settings.framesInFlight);
+    renderFinishedSemaphores.resize(settings.framesInFlight);
+    // Value 0 is reached from the start so the first frames do not wait
+    frameTimelineValues.resize(settings.framesInFlight, 0);
 
+    // The swap chain only works with binary semaphores. Frames are tracked on the timeline of the context
     VkSemaphoreCreateInfo semaphoreInfo{};
     semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 
-    VkFenceCreateInfo fenceInfo{};
-    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-    // Create in a signaled state to draw first frame immediately
-    fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
-
-    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+    for (size_t i = 0; i < settings.framesInFlight; i++) {
       if (vkCreateSemaphore(ctx.device, &semaphoreInfo, nullptr, &imageAvailableSemaphores[i]) != VK_SUCCESS ||
-          vkCreateSemaphore(ctx.device, &semaphoreInfo, nullptr, &renderFinishedSemaphores[i]) != VK_SUCCESS ||
-          vkCreateFence(ctx.device, &fenceInfo, nullptr, &inFlightFences[i]) != VK_SUCCESS) {
+          vkCreateSemaphore(ctx.device, &semaphoreInfo, nullptr, &renderFinishedSemaphores[i]) != VK_SUCCESS) {
         throw std::runtime_error("Failed to create synchronization objects");
       }
     }
@@ -985,55 +1921,90 @@ class Renderer {
     camera.updateMatrices();
   }
 
+  /*----- Shaders -----*/
+
+  // Recompile pipelines whose shaders were edited. The old pipelines are used until the new ones are ready
+  void reloadShaders() {
+    std::set<std::string> changedFiles = shaderLibrary->pollChanges();
+    if (!changedFiles.empty()) {
+      pipelineManager->reload(*shaderLibrary, changedFiles);
+    }
+  }
+
   /*----- Draw -----*/
 
   void drawFrame() {
-    // Wait for previous frame to finish. Wait for all fences, infinite timeout
-    vkWaitForFences(ctx.device, 1, &inFlightFences[currentFrame], VK_TRUE, UINT64_MAX);
+    // Wait for the previous use of this frame's resources to finish
+    ctx.wait(frameTimelineValues[currentFrame]);
+    deletionQueue->collect();
+    frameCapture->poll();
+    std::optional<double> gpuTime = framePacer->beginFrame(currentFrame);
+    if (resolutionScaler && gpuTime && resolutionScaler->update(*gpuTime)) {
+      updateRenderExtent();
+      invalidateCommandBuffers();
+    }
 
-    // The index of the swap chain image that has become available
-    uint32_t imageIndex;
+    // The index of the swap chain image that has become available. Each frame in flight has its own offscreen image,
+    // which is free now that the frame's previous submission has completed
+    uint32_t imageIndex = currentFrame;
 
-    VkResult result = vkAcquireNextImageKHR(ctx.device, swapChain, UINT64_MAX,
-                                            imageAvailableSemaphores[currentFrame], VK_NULL_HANDLE, &imageIndex);
+    if (!ctx.headless()) {
+      VkResult result = vkAcquireNextImageKHR(ctx.device, swapChain, UINT64_MAX,
+                                              imageAvailableSemaphores[currentFrame], VK_NULL_HANDLE, &imageIndex);
 
-    if (result == VK_ERROR_OUT_OF_DATE_KHR) {
-      recreateSwapChain();
-      return;
-    } else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR) {
-      throw std::runtime_error("Failed to acquire swap chain image");
+      if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+        recreateSwapChain();
+        return;
+      } else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR) {
+        throw std::runtime_error("Failed to acquire swap chain image");
+      }
     }
 
-    vkResetFences(ctx.device, 1, &inFlightFences[currentFrame]);
-
-    vkResetCommandBuffer(drawCommandBuffers[currentFrame], 0);
-    recordDrawCommandBuffer(drawCommandBuffers[currentFrame], imageIndex);
-
     updateCamera();
+    cullInstances();
+    updateAnimation();
+    // Cascades chosen here are recorded into this frame's command buffer
+    if (shadowMaps && updateShadows()) {
+      invalidateCommandBuffers();
+    }
 
-    updateUniformBuffer(currentFrame);
+    VkCommandBuffer drawCommandBuffer = getDrawCommandBuffer(imageIndex);
 
-    VkSubmitInfo submitInfo{};
-    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    updateUniformBuffer(currentFrame);
 
-    // The indices of these two arrays are linked
-    VkSemaphore waitSemaphores[] = {imageAvailableSemaphores[currentFrame]};
-    VkPipelineStageFlags waitStages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
-    submitInfo.waitSemaphoreCount = 1;
-    submitInfo.pWaitSemaphores = waitSemaphores;
-    submitInfo.pWaitDstStageMask = waitStages;
+    // Image layout after the render pass
+    VkImageLayout layout = ctx.headless() ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    VkCommandBuffer captureCommandBuffer =
+        frameCapture->record(currentFrame, swapChainImages[imageIndex], swapChainImageFormat, swapChainExtent, layout);
 
-    submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &drawCommandBuffers[currentFrame];
+    Submission submission{};
+    submission.commandBuffers = {drawCommandBuffer};
+    if (captureCommandBuffer != VK_NULL_HANDLE) {
+      submission.commandBuffers.push_back(captureCommandBuffer);
+    }
+    if (!ctx.headless()) {
+      // The indices of these two arrays are linked
+      submission.waitSemaphores = {imageAvailableSemaphores[currentFrame]};
+      submission.waitStages = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
+      submission.signalSemaphores = {renderFinishedSemaphores[currentFrame]};
+    }
 
-    VkSemaphore signalSemaphores[] = {renderFinishedSemaphores[currentFrame]};
-    submitInfo.signalSemaphoreCount = 1;
-    submitInfo.pSignalSemaphores = signalSemaphores;
+    frameTimelineValues[currentFrame] = ctx.submit(ctx.graphicsQueue, submission);
+    // Resources retired while this frame was recorded are freed once it completes
+    deletionQueue->stamp(frameTimelineValues[currentFrame]);
+    lastImageIndex = imageIndex;
+    if (captureCommandBuffer != VK_NULL_HANDLE) {
+      frameCapture->submitted(currentFrame, frameTimelineValues[currentFrame]);
+    }
 
-    if (vkQueueSubmit(ctx.graphicsQueue, 1, &submitInfo, inFlightFences[currentFrame]) != VK_SUCCESS) {
-      throw std::runtime_error("Failed to submit draw command buffer");
+    if (ctx.headless()) {
+      framePacer->endFrame(currentFrame);
+      currentFrame = (currentFrame + 1) % settings.framesInFlight;
+      return;
     }
 
+    VkSemaphore signalSemaphores[] = {renderFinishedSemaphores[currentFrame]};
+
     VkPresentInfoKHR presentInfo{};
     presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
 
@@ -1048,7 +2019,8 @@ class Renderer {
     // Check swapchain results against success value
     presentInfo.pResults = nullptr;  // Optional
 
-    result = vkQueuePresentKHR(ctx.presentQueue, &presentInfo);
+    VkResult result = vkQueuePresentKHR(ctx.presentQueue, &presentInfo);
+    framePacer->endFrame(currentFrame);
 
     if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || framebufferResized) {
       framebufferResized = false;
@@ -1057,81 +2029,662 @@ class Renderer {
       throw std::runtime_error("Failed to present swap chain image");
     }
 
-    currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+    currentFrame = (currentFrame + 1) % settings.framesInFlight;
   }
 
   /*----- Initialization -----*/
 
   void initVulkan() {
+    deletionQueue = std::make_unique<DeletionQueue>(ctx);
+    framePacer = std::make_unique<FramePacer>(ctx, settings.framesInFlight, settings.maxFrameRate);
+
     // Must be called after logical device creation
-    createSwapChain();
+    if (ctx.headless()) {
+      createOffscreenTarget();
+    } else {
+      createSwapChain();
+    }
     createImageViews();
+    if (settings.targetFrameTime > 0.0) {
+      createResolutionScaler();
+    }
+    if (settings.deferredShading) {
+      deferredShading = std::make_unique<DeferredShading>(ctx, *deletionQueue);
+      // The G-buffer only lives within the scene pass, which is drawn once
+      if (settings.occlusionCulling || depthPrepass || overdrawView) {
+        std::cerr << "Deferred shading draws the G-buffer in a single pass. Ignoring occlusion culling, the depth pre-pass "
+                  << "and the overdraw view" << std::endl;
+        depthPrepass = false;
+        overdrawView = false;
+      }
+    }
+    if (settings.occlusionCulling && !deferredShading) {
+      occlusionCulling = GpuCuller::isSupported(ctx) && DepthPyramid::isSupported(ctx, findDepthFormat());
+      if (!occlusionCulling) {
+        std::cerr << "Occlusion culling requires GPU-driven drawing and a depth format which can be sampled. "
+                  << "Culling against the frustum only" << std::endl;
+      }
+    }
     createRenderPass();
 
-    createDescriptorSetLayout();
-    createGraphicsPipeline();
-    createColorResources();
-    createDepthResources();
-
-    createFramebuffers();
-
+    // The scene set layout has one sampler per texture
     textures.push_back(std::make_shared<Texture>(ctx, TEXTURE_PATH));
+    createDescriptorSetLayouts();
+
+    // Leave one core for the render loop
+    uint32_t pipelineWorkers = std::clamp(std::thread::hardware_concurrency(), 2u, 5u) - 1;
+    shaderLibrary = std::make_unique<ShaderLibrary>(SHADER_PATH, SHADER_CACHE_PATH);
+    pipelineManager = std::make_unique<PipelineManager>(ctx, PIPELINE_CACHE_PATH, pipelineWorkers, *deletionQueue);
 
+    // The lights and shadows cover the scene, and the scene pipelines' layout includes their descriptor sets
     loadModel();
+    createScene();
+    if (settings.lightCount > 0) {
+      createLightClusters();
+    }
+    if (settings.shadows) {
+      createShadowMaps();
+    }
+    createGraphicsPipeline();
+    createFrameResources();
+
+    createDrawList();
 
     vertexAttributes.push_back(std::make_shared<Attribute<Vertex>>(ctx, vertices, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT));
     indexAttributes.push_back(std::make_shared<Attribute<uint32_t>>(ctx, indices, VK_BUFFER_USAGE_INDEX_BUFFER_BIT));
+    meshAttribute = std::make_shared<Attribute<MeshData>>(ctx, meshes, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+    instanceAttribute = std::make_shared<Attribute<InstanceData>>(ctx, instances, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+
+    if (settings.gpuDriven) {
+      if (GpuCuller::isSupported(ctx)) {
+        if (occlusionCulling) {
+          depthPyramid = std::make_unique<DepthPyramid>(ctx, *pipelineManager, *shaderLibrary, *deletionQueue, msaaSamples);
+          depthPyramid->resize(swapChainExtent, renderGraph->view(depthImage));
+        }
+        gpuCuller = std::make_unique<GpuCuller>(ctx, *pipelineManager, *shaderLibrary, settings.framesInFlight,
+                                                meshAttribute->buffer, instanceAttribute->buffer,
+                                                static_cast<uint32_t>(instances.size()), depthPyramid.get());
+      } else {
+        std::cerr << "GPU-driven drawing requires multi-draw indirect with a first instance, which the " << featureTierName(ctx.tier)
+                  << " feature tier does not enable. Drawing on the CPU path" << std::endl;
+      }
+    }
+
+    if (!gpuCuller && settings.cpuCulling) {
+      createCpuCuller();
+      if (settings.softwareOcclusion) {
+        createOcclusionCuller();
+      }
+    } else if (settings.softwareOcclusion) {
+      std::cerr << "Software occlusion culling runs after CPU frustum culling, which is disabled. Not culling occluded instances"
+                << std::endl;
+    }
+
     createUniformBuffers();
     createDescriptorPool();
     createDescriptorSets();
 
     createDrawCommandBuffers();
     createSyncObjects();
+
+    // Dynamic objects are drawn with their transforms as draw constants, a turning sun renders the cascades again and
+    // CPU culling records the visible instances, so each of them changes the recorded draws every frame or camera move
+    cacheCommandBuffers = settings.cacheCommandBuffers;
+    if (cacheCommandBuffers && (settings.dynamicObjects > 0 || (shadowMaps && settings.sunSpeed != 0.0f) || cpuCuller)) {
+      std::cerr << "Dynamic objects, a turning sun and CPU culling change the recorded draws every frame. Not caching "
+                << "command buffers" << std::endl;
+      cacheCommandBuffers = false;
+    }
+    if (cacheCommandBuffers) {
+      createCachedCommandBuffers();
+    }
+
+    // Secondary command buffers are reset every frame so they cannot be executed from cached command buffers
+    if (cacheCommandBuffers && settings.recordingThreads > 0) {
+      std::cerr << "Cached command buffers are recorded inline. Ignoring recording threads" << std::endl;
+    }
+
+    frameCapture = std::make_unique<FrameCapture>(ctx, settings.framesInFlight);
+
+    if ((settings.recordingThreads > 0 && !cacheCommandBuffers) || settings.benchmarkRecording) {
+      uint32_t recordingThreads = settings.recordingThreads > 0 ? settings.recordingThreads : std::max(1u, std::thread::hardware_concurrency());
+      commandRecorder = std::make_unique<CommandRecorder>(ctx, settings.framesInFlight, recordingThreads);
+      if (!gpuCuller) {
+        renderGraph->setSubpassContents(scenePass, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+      }
+    }
+  }
+
+  /*----- Benchmarks -----*/
+
+  // Record the draw list for the first frame with 1 to N threads. Nothing is submitted
+  void benchmarkRecording() {
+    const uint32_t iterations = 100;
+
+    VkCommandBufferInheritanceInfo inheritanceInfo{};
+    inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+    inheritanceInfo.renderPass = renderPass;
+    inheritanceInfo.subpass = 0;
+    inheritanceInfo.framebuffer = renderGraph->framebuffer(scenePass, 0);
+
+    VkPipeline pipeline = pipelineManager->resolve(*graphicsPipeline, fallbackPipeline->pipeline);
+    auto recordFunction = [&](VkCommandBuffer commandBuffer, uint32_t firstDraw, uint32_t drawCount) {
+      recordDraws(commandBuffer, pipeline, firstDraw, drawCount, CullPhase::Early);
+    };
+
+    std::cout << "Recording " << visibleDrawCount() << " draws, average of " << iterations << " iterations" << std::endl;
+    if (gpuCuller) {
+      std::cout << "GPU culling draws all instances with one indirect draw, recorded by the first thread" << std::endl;
+    }
+
+    double singleThreadTime = 0.0;
+    for (uint32_t threads = 1; threads <= commandRecorder->threadCount(); threads++) {
+      auto startTime = std::chrono::high_resolution_clock::now();
+      for (uint32_t i = 0; i < iterations; i++) {
+        commandRecorder->record(0, inheritanceInfo, visibleDrawCount(), recordFunction, threads);
+      }
+      auto endTime = std::chrono::high_resolution_clock::now();
+
+      double time = std::chrono::duration<double, std::milli>(endTime - startTime).count() / iterations;
+      if (threads == 1) {
+        singleThreadTime = time;
+      }
+      std::cout << threads << " threads: " << time << " ms, speedup " << singleThreadTime / time << std::endl;
+    }
+  }
+
+  /**
+   * Render a cube map from the camera position or a stereo pair of the camera view, once with multiview and once
+   * with a pass per view, and compare recording and GPU time. Frustum culling is skipped so that every view draws
+   * every instance
+   */
+  void benchmarkMultiview() {
+    const uint32_t iterations = 100;
+    const uint32_t viewCount = settings.benchmarkMultiviewViews;
+    const VkExtent2D extent{1024, 1024};
+    const float eyeSeparation = 0.065f;
+
+    MultiviewTarget target(ctx, viewCount, extent, findDepthFormat(), frameSetLayout);
+
+    // ----- Matrices -----
+    std::vector<glm::mat4> views;
+    glm::mat4 projection;
+    if (viewCount == 6) {
+      views = cubeMapViews(camera.position);
+      // Not flipped: NDC y = -1 maps to the first texel row in both GL and Vulkan, so the GL face orientations hold
+      projection = glm::perspective(glm::radians(90.0f), 1.0f, camera.near, camera.far);
+    } else {
+      views = stereoViews(camera.viewMatrix, eyeSeparation);
+      projection = glm::perspective(camera.fov, 1.0f, camera.near, camera.far);
+      projection[1][1] *= -1;
+    }
+    target.update(views, std::vector<glm::mat4>(viewCount, projection));
+
+    // ----- Pipelines -----
+    PipelineDescription description = describeScenePipeline(ScenePass::Color, 0, false);
+    description.colorFormats = {target.colorFormat};
+    description.depthFormat = target.depthFormat;
+    description.renderPass = target.layerRenderPass;
+    description.renderPassKey = target.layerRenderPassKey;
+    auto layerPipeline = pipelineManager->request(description);
+
+    std::shared_ptr<PipelineHandle> multiviewPipeline;
+    if (target.multiviewRenderPass != VK_NULL_HANDLE) {
+      description = describeScenePipeline(ScenePass::Color, viewCount, false);
+      description.colorFormats = {target.colorFormat};
+      description.depthFormat = target.depthFormat;
+      description.renderPass = target.multiviewRenderPass;
+      description.renderPassKey = target.multiviewRenderPassKey;
+      description.viewMask = target.viewMask();
+      multiviewPipeline = pipelineManager->request(description);
+      pipelineManager->wait(*multiviewPipeline);
+    } else {
+      std::cerr << "Multiview is not enabled in the " << featureTierName(ctx.tier) << " feature tier. Measuring a pass per view only"
+                << std::endl;
+    }
+    pipelineManager->wait(*layerPipeline);
+
+    // Every instance in one run
+    std::vector<InstanceRun> runs = {{0, static_cast<uint32_t>(instances.size())}};
+    uint32_t drawCount = static_cast<uint32_t>(draws.size());
+
+    std::cout << "Rendering " << viewCount << " views of " << extent.width << "x" << extent.height << " with "
+              << drawCount * instances.size() << " draws per view, average of " << iterations << " iterations" << std::endl;
+
+    ::benchmarkMultiview(
+        target, layerPipeline->pipeline, multiviewPipeline ? multiviewPipeline->pipeline.load() : VK_NULL_HANDLE,
+        [&](VkCommandBuffer commandBuffer, VkDescriptorSet viewSet, VkPipeline pipeline) {
+          setViewport(commandBuffer, extent);
+          bindScene(commandBuffer, pipeline, viewSet);
+          recordInstanceRuns(commandBuffer, runs, 0, drawCount);
+        },
+        iterations);
+  }
+
+  /**
+   * Draw the scene pass with forward shading of every MSAA sample and with deferred shading into the same target, and
+   * compare GPU time. Culling, light assignment and the shadow maps are shared by both and recorded once beforehand
+   */
+  void benchmarkShading() {
+    const uint32_t iterations = 100;
+    const VkFormat depthFormat = findDepthFormat();
+
+    VkPipelineLayout lightingLayout = VK_NULL_HANDLE;
+    ShadingComparison comparison(
+        ctx, *deletionQueue, swapChainExtent, swapChainImageFormat, depthFormat, std::min(VK_SAMPLE_COUNT_8_BIT, ctx.maxMSAASamples),
+        [this](VkCommandBuffer commandBuffer, VkPipeline pipeline) {
+          recordDraws(commandBuffer, pipeline, 0, listDrawCount(), CullPhase::Early);
+        },
+        [this, &lightingLayout](VkCommandBuffer commandBuffer, VkPipeline pipeline, VkDescriptorSet gbufferSet) {
+          recordLighting(commandBuffer, pipeline, lightingLayout, gbufferSet);
+        });
+    lightingLayout = createLightingPipelineLayout(comparison.gbuffer.setLayout);
+
+    // ----- Pipelines -----
+    PipelineDescription description = describeScenePipeline(ScenePass::Color, 0, true);
+    description.renderPass = comparison.forwardGraph.renderPass(comparison.forwardPass);
+    description.renderPassKey = comparison.forwardGraph.renderPassKey(comparison.forwardPass);
+    description.colorFormats = {swapChainImageFormat};
+    description.depthFormat = depthFormat;
+    description.samples = comparison.forwardSamples;
+    description.sampleShading = true;
+    auto forwardHandle = pipelineManager->request(description);
+
+    description = describeScenePipeline(ScenePass::GBuffer, 0, true);
+    description.renderPass = comparison.deferredGraph.renderPass(comparison.deferredPass);
+    description.renderPassKey = comparison.deferredGraph.renderPassKey(comparison.deferredPass);
+    auto formats = comparison.gbuffer.gbufferFormats();
+    description.colorFormats = {formats.begin(), formats.end()};
+    description.depthFormat = depthFormat;
+    auto gbufferHandle = pipelineManager->request(description);
+    auto lightingHandle = pipelineManager->request(describeLightingPipeline(comparison.deferredGraph, comparison.deferredPass, lightingLayout));
+
+    pipelineManager->wait(*forwardHandle);
+    pipelineManager->wait(*gbufferHandle);
+    pipelineManager->wait(*lightingHandle);
+    comparison.setPipelines(forwardHandle->pipeline, gbufferHandle->pipeline, lightingHandle->pipeline);
+
+    // ----- Shared passes -----
+    updateCamera();
+    cullInstances();
+    updateAnimation();
+    if (shadowMaps) {
+      updateShadows();
+    }
+    updateUniformBuffer(currentFrame);
+
+    VkCommandBuffer setupCommandBuffer;
+    beginCommand(ctx, setupCommandBuffer);
+    if (gpuCuller) {
+      gpuCuller->cull(setupCommandBuffer, currentFrame);
+    }
+    if (lightClusters) {
+      lightClusters->assign(setupCommandBuffer, currentFrame);
+    }
+    if (shadowMaps) {
+      shadowMaps->record(setupCommandBuffer, currentFrame,
+                         [this](VkCommandBuffer commandBuffer, VkDescriptorSet viewSet, uint32_t cascade, ShadowCasters casters) {
+                           return recordShadowCasters(commandBuffer, viewSet, cascade, casters);
+                         });
+    }
+    submitCommand(ctx, setupCommandBuffer, ctx.graphicsQueue);
+
+    std::cout << "Shading " << renderExtent.width << "x" << renderExtent.height << " with " << settings.lightCount << " lights"
+              << (shadowMaps ? " and shadows" : "") << ", " << listDrawCount() << " draws, average of " << iterations
+              << " iterations" << std::endl;
+    comparison.run(iterations, {{0, 0}, renderExtent});
+  }
+
+  /*----- Depth pre-pass -----*/
+
+  void switchPassMode() {
+    if (deferredShading && (depthPrepass || overdrawView)) {
+      std::cerr << "The depth pre-pass and the overdraw view are only available with forward shading" << std::endl;
+      depthPrepass = false;
+      overdrawView = false;
+      return;
+    }
+    std::cout << "Depth pre-pass " << (depthPrepass ? "on" : "off") << (overdrawView ? ", overdraw view" : "") << std::endl;
+    invalidateCommandBuffers();
+    if (overdrawView) {
+      measureOverdraw();
+    }
+  }
+
+  // Report the overdraw view of the next frame once it has been rendered
+  void measureOverdraw() {
+    if (!swapChainCapturable || !FrameCapture::isSupported(swapChainImageFormat)) {
+      std::cerr << "The swap chain images cannot be captured to measure overdraw" << std::endl;
+      return;
+    }
+    waitForFramePipelines();
+    frameCapture->request([this, prepass = depthPrepass](FrameImage image) { reportOverdraw(image, prepass); });
+  }
+
+  // Decodes the fragment counts from the overdraw view. Multisampled pixels hold the average over their samples
+  void reportOverdraw(const FrameImage& image, bool prepass) {
+    bool srgb = swapChainImageFormat == VK_FORMAT_B8G8R8A8_SRGB || swapChainImageFormat == VK_FORMAT_R8G8B8A8_SRGB;
+
+    uint64_t coveredPixels = 0;
+    double totalFragments = 0.0;
+    double maxFragments = 0.0;
+    for (size_t i = 0; i < image.pixels.size(); i += 4) {
+      double value = image.pixels[i] / 255.0;
+      if (srgb) {
+        value = value <= 0.04045 ? value / 12.92 : std::pow((value + 0.055) / 1.055, 2.4);
+      }
+      double fragments = value / OVERDRAW_STEP;
+      if (fragments >= 0.5) {
+        coveredPixels++;
+        totalFragments += fragments;
+        maxFragments = std::max(maxFragments, fragments);
+      }
+    }
+
+    uint64_t pixels = static_cast<uint64_t>(image.width) * image.height;
+    std::cout << "Overdraw " << (prepass ? "with" : "without") << " depth pre-pass: "
+              << (coveredPixels > 0 ? totalFragments / coveredPixels : 0.0) << " fragments shaded per covered pixel, maximum "
+              << maxFragments << " (saturates at " << 1.0 / OVERDRAW_STEP << "), " << 100.0 * coveredPixels / pixels
+              << "% of pixels covered" << std::endl;
+  }
+
+  /*----- Capture -----*/
+
+  // Write the next frame to a numbered PNG file once it has been rendered
+  void captureScreenshot() {
+    if (!swapChainCapturable || !FrameCapture::isSupported(swapChainImageFormat)) {
+      std::cerr << "The swap chain images cannot be captured" << std::endl;
+      return;
+    }
+    if (!screenshotWriter) {
+      screenshotWriter = std::make_unique<ImageWriter>(1);
+    }
+
+    std::string path = SCREENSHOT_PREFIX + std::to_string(screenshotCount++) + ".png";
+    frameCapture->request([this, path](FrameImage image) {
+      screenshotWriter->push(path, std::move(image));
+      std::cout << "Captured " << path << std::endl;
+    });
+    redraw.capture = true;
+  }
+
+  /*----- Headless -----*/
+
+  // Copy out the image of the most recently submitted frame. Blocks until it has been rendered
+  FrameImage readFrame() {
+    return offscreenTarget->read(lastImageIndex);
+  }
+
+  // Render a fixed number of frames without a window and read back the last one
+  void renderHeadless() {
+    waitForFramePipelines();
+
+    auto startTime = std::chrono::high_resolution_clock::now();
+    for (uint32_t i = 0; i < settings.headlessFrames; i++) {
+      drawFrame();
+    }
+    FrameImage frame = readFrame();
+    auto endTime = std::chrono::high_resolution_clock::now();
+
+    double seconds = std::chrono::duration<double>(endTime - startTime).count();
+    std::cout << "Rendered " << settings.headlessFrames << " frames of " << frame.width << "x" << frame.height
+              << " headless in " << seconds << " s (" << settings.headlessFrames / seconds << " fps)" << std::endl;
+
+    if (overdrawView) {
+      reportOverdraw(frame, depthPrepass);
+    }
+
+    if (!settings.outputPath.empty()) {
+      writePng(settings.outputPath, frame);
+      std::cout << "Wrote " << settings.outputPath << std::endl;
+    }
+
+    vkDeviceWaitIdle(ctx.device);
+    framePacer->report();
+  }
+
+  /**
+   * Render every camera view to a PNG file. Frames are copied to their readback buffers in their own command buffers
+   * and taken out when their frame in flight comes round again, so with three frames in flight frame N + 2 renders
+   * while frame N is copied and earlier frames are encoded on the writer's threads
+   */
+  void renderBatch() {
+    std::vector<CameraView> views = loadCameraViews(settings.batchPath);
+    std::filesystem::create_directories(settings.batchOutputPath);
+    waitForFramePipelines();
+
+    // Leave one core for the render loop, which also matters for CPU devices such as lavapipe
+    ImageWriter writer(std::max(1u, std::thread::hardware_concurrency() / 2));
+
+    // View rendered by each frame in flight, waiting to be taken from its readback buffer
+    std::vector<std::optional<uint32_t>> pendingViews(settings.framesInFlight);
+    double readbackTime = 0.0;
+
+    auto takeImage = [&](uint32_t frame) {
+      if (!pendingViews[frame]) {
+        return;
+      }
+      auto startTime = std::chrono::high_resolution_clock::now();
+      ctx.wait(frameTimelineValues[frame]);
+      FrameImage image = offscreenTarget->readback(frame);
+      auto endTime = std::chrono::high_resolution_clock::now();
+      readbackTime += std::chrono::duration<double, std::milli>(endTime - startTime).count();
+
+      char name[32];
+      snprintf(name, sizeof(name), "view_%05u.png", *pendingViews[frame]);
+      writer.push((std::filesystem::path(settings.batchOutputPath) / name).string(), std::move(image));
+      pendingViews[frame].reset();
+    };
+
+    auto startTime = std::chrono::high_resolution_clock::now();
+    for (uint32_t i = 0; i < views.size(); i++) {
+      // The readback buffer of this frame is rewritten by the next submission
+      takeImage(currentFrame);
+
+      camera.pitch = views[i].pitch;
+      camera.yaw = views[i].yaw;
+      camera.distance = views[i].distance;
+      camera.fov = views[i].fov;
+
+      uint32_t frame = currentFrame;
+      drawFrame();
+      pendingViews[frame] = i;
+    }
+    for (uint32_t frame = 0; frame < settings.framesInFlight; frame++) {
+      takeImage(frame);
+    }
+    writer.finish();
+    auto endTime = std::chrono::high_resolution_clock::now();
+
+    double seconds = std::chrono::duration<double>(endTime - startTime).count();
+    std::cout << "Rendered " << writer.writtenCount() << " views of " << swapChainExtent.width << "x" << swapChainExtent.height
+              << " to " << settings.batchOutputPath << " in " << seconds << " s (" << writer.writtenCount() / seconds
+              << " images per second)" << std::endl;
+    std::cout << "Waiting for readback: " << readbackTime << " ms, for the encoding queue: " << writer.blockedMilliseconds()
+              << " ms" << std::endl;
+
+    framePacer->report();
   }
 
   /*----- Main loop -----*/
 
+  // Whether a frame has to be drawn in on-demand mode. Without animation, only input, resizing and changes to the
+  // draw state or pipelines cause one
+  bool needsRedraw() {
+    if (animated() || drawStateVersion != drawnStateVersion || pipelineManager->generation() != drawnPipelineGeneration) {
+      redraw.scene = true;
+    }
+    return redraw.any();
+  }
+
   void mainLoop() {
+    auto loopStart = std::chrono::high_resolution_clock::now();
+    std::clock_t cpuStart = std::clock();
+    uint64_t wakeups = 0;
+    uint64_t drawnFrames = 0;
+
+    if (overdrawView) {
+      measureOverdraw();
+    }
+
     while (!glfwWindowShouldClose(window)) {
-      glfwPollEvents();
+      framePacer->waitForNextFrame();
+      if (settings.onDemand) {
+        // Pipelines still compiling replace their fallbacks once ready
+        glfwWaitEventsTimeout(pipelineManager->pendingCount() > 0 || animated() ? STREAMING_WAIT_TIMEOUT : IDLE_WAIT_TIMEOUT);
+        wakeups++;
+      } else {
+        glfwPollEvents();
+      }
+      framePacer->markInput();
+      reloadShaders();
+      // Frames are not drawn while idle in on-demand mode, which would otherwise hold back captures
+      frameCapture->poll();
+
+      if (settings.onDemand && !needsRedraw()) {
+        continue;
+      }
+      // Changes made while drawing, such as a recreated swap chain, request another frame
+      redraw = {false, false, false, false};
+
+      // Frames which recreate the swap chain are timed separately
+      uint32_t recreations = resizeStats.recreations;
+      auto frameStart = std::chrono::high_resolution_clock::now();
       drawFrame();
+      if (resizeStats.recreations != recreations) {
+        auto frameEnd = std::chrono::high_resolution_clock::now();
+        resizeStats.recordFrame(std::chrono::duration<double, std::milli>(frameEnd - frameStart).count());
+        redraw.resize = true;
+      }
+      drawnStateVersion = drawStateVersion;
+      drawnPipelineGeneration = pipelineManager->generation();
+      drawnFrames++;
+
+      // Captures whose pixels are discarded, to measure the cost of capturing
+      if (settings.captureInterval > 0 && drawnFrames % settings.captureInterval == 0) {
+        frameCapture->request([](FrameImage image) {});
+      }
     }
     // Wait for all work to finish before quitting
     vkDeviceWaitIdle(ctx.device);
+
+    // Deliver the captures of the last frames
+    frameCapture->poll();
+    if (screenshotWriter) {
+      screenshotWriter->finish();
+    }
+
+    if (settings.onDemand) {
+      double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - loopStart).count();
+      double cpuSeconds = static_cast<double>(std::clock() - cpuStart) / CLOCKS_PER_SEC;
+      std::cout << "On-demand rendering: " << drawnFrames << " frames drawn in " << wakeups << " wakeups over "
+                << seconds << " s. CPU " << 100.0 * cpuSeconds / seconds << "% of a core, GPU "
+                << 100.0 * framePacer->totalGpuTime() / (1000.0 * seconds) << "% busy" << std::endl;
+    }
+
+    framePacer->report();
+    if (resolutionScaler) {
+      resolutionScaler->report();
+    }
+    if (commandRecorder) {
+      commandRecorder->report();
+    }
+    if (gpuCuller) {
+      gpuCuller->report();
+    }
+    if (cpuCuller) {
+      cpuCuller->report();
+    }
+    if (occlusionCuller) {
+      occlusionCuller->report();
+    }
+    if (lightClusters) {
+      lightClusters->report();
+    }
+    if (shadowMaps) {
+      shadowMaps->report();
+    }
+    if (deferredShading) {
+      std::cout << "Deferred shading: " << deferredShading->bytesPerPixel() << " byte G-buffer per pixel besides the depth"
+                << std::endl;
+    }
+    renderGraph->report();
+    frameCapture->report();
+    if (cacheCommandBuffers) {
+      std::cout << "Cached command buffers: " << reusedCommandBufferFrames << " of "
+                << reusedCommandBufferFrames + recordedCommandBufferFrames << " frames skipped re-recording" << std::endl;
+    } else if (settings.cacheCommandBuffers) {
+      std::cout << "Cached command buffers: off, as the recorded draws change every frame" << std::endl;
+    }
+    resizeStats.report();
   }
 
   /*----- Cleanup -----*/
 
   void cleanup() noexcept {
-    vkDestroyPipelineLayout(ctx.device, pipelineLayout, nullptr);
-    vkDestroyPipeline(ctx.device, graphicsPipeline, nullptr);
-    vkDestroyRenderPass(ctx.device, renderPass, nullptr);
-
-    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+    commandRecorder.reset();
+    frameCapture.reset();
+    gpuCuller.reset();
+    depthPyramid.reset();
+    lightClusters.reset();
+    shadowMaps.reset();
+    deferredShading.reset();
+    // Destroys all pipelines and writes the pipeline cache to disk
+    pipelineManager.reset();
+    shaderLibrary.reset();
+    deletionQueue->flush();
+    framePacer.reset();
+    renderGraph.reset();
+
+    for (size_t i = 0; i < settings.framesInFlight; i++) {
       vkDestroySemaphore(ctx.device, renderFinishedSemaphores[i], nullptr);
       vkDestroySemaphore(ctx.device, imageAvailableSemaphores[i], nullptr);
-      vkDestroyFence(ctx.device, inFlightFences[i], nullptr);
     }
 
     cleanupSwapChain();
 
-    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+    for (size_t i = 0; i < settings.framesInFlight; i++) {
       vkDestroyBuffer(ctx.device, uniformBuffers[i], nullptr);
       vkFreeMemory(ctx.device, uniformBuffersMemory[i], nullptr);
     }
 
     vkDestroyDescriptorPool(ctx.device, descriptorPool, nullptr);
-    vkDestroyDescriptorSetLayout(ctx.device, descriptorSetLayout, nullptr);
+    vkDestroyDescriptorSetLayout(ctx.device, frameSetLayout, nullptr);
+    vkDestroyDescriptorSetLayout(ctx.device, sceneSetLayout, nullptr);
 
-    vkDestroySurfaceKHR(ctx.instance, ctx.surface, nullptr);
+    if (window != nullptr) {
+      vkDestroySurfaceKHR(ctx.instance, ctx.surface, nullptr);
 
-    glfwDestroyWindow(window);
-    glfwTerminate();
+      glfwDestroyWindow(window);
+      glfwTerminate();
+    }
   }
 };
 
-int main() {
-  Renderer renderer;
+int main(int argc, char** argv) {
+  Settings settings;
+  try {
+    settings = parseSettings(argc, argv);
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Runs without a window or device
+  if (settings.benchmarkCulling) {
+    benchmarkCulling(settings.instanceCount);
+    return EXIT_SUCCESS;
+  }
+  if (settings.benchmarkOcclusion) {
+    benchmarkOcclusion(settings.instanceCount);
+    return EXIT_SUCCESS;
+  }
+  if (settings.benchmarkLights) {
+    benchmarkLightAssignment();
+    return EXIT_SUCCESS;
+  }
+
+  Renderer renderer(settings);
 
   try {
     renderer.run();
@@ -0,0 +1,404 @@
+#include "multiview.h"
+
+#include <array>
+#include <cstring>
+#include <glm/gtc/matrix_transform.hpp>
+#include <iostream>
+#include <stdexcept>
+#include <utility>
+
+#include "gpuBenchmark.h"
+
+MultiviewTarget::MultiviewTarget(const VulkanContext& ctx, uint32_t viewCount, VkExtent2D extent, VkFormat depthFormat,
+                                 VkDescriptorSetLayout viewSetLayout)
+    : ctx{ctx}, viewCount{viewCount}, extent{extent}, depthFormat{depthFormat} {
+  if (viewCount == 0 || viewCount > ctx.properties.limits.maxImageArrayLayers) {
+    throw std::runtime_error("Unsupported number of views");
+  }
+
+  // ----- Images -----
+  // Six square layers can also be viewed as a cube map
+  bool cubeCompatible = viewCount == 6 && extent.width == extent.height;
+  auto createLayeredImage = [&](VkFormat format, VkImageUsageFlags usage, VkImage& image, VkDeviceMemory& memory) {
+    VkImageCreateInfo imageInfo{};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.flags = cubeCompatible ? VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT : 0;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.extent = {extent.width, extent.height, 1};
+    imageInfo.mipLevels = 1;
+    imageInfo.arrayLayers = viewCount;
+    imageInfo.format = format;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    imageInfo.usage = usage;
+    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    if (vkCreateImage(ctx.device, &imageInfo, nullptr, &image) != VK_SUCCESS) {
+      throw std::runtime_error("Failed to create layered image");
+    }
+
+    VkMemoryRequirements memRequirements;
+    vkGetImageMemoryRequirements(ctx.device, image, &memRequirements);
+
+    VkMemoryAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.allocationSize = memRequirements.size;
+    allocInfo.memoryTypeIndex = findMemoryType(ctx.physicalDevice, memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+    if (vkAllocateMemory(ctx.device, &allocInfo, nullptr, &memory) != VK_SUCCESS) {
+      throw std::runtime_error("Failed to allocate layered image memory");
+    }
+    vkBindImageMemory(ctx.device, image, memory, 0);
+  };
+
+  createLayeredImage(colorFormat, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+                     colorImage, colorMemory);
+  createLayeredImage(depthFormat, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, depthImage, depthMemory);
+
+  // ----- Render passes and framebuffers -----
+  layerRenderPass = createRenderPass(0, layerRenderPassKey);
+  for (uint32_t i = 0; i < viewCount; i++) {
+    colorLayerViews.push_back(createLayerView(colorImage, colorFormat, VK_IMAGE_ASPECT_COLOR_BIT, i, 1));
+    depthLayerViews.push_back(createLayerView(depthImage, depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT, i, 1));
+    layerFramebuffers.push_back(createFramebuffer(layerRenderPass, colorLayerViews[i], depthLayerViews[i]));
+  }
+
+  // Every implementation supports at least 6 views, enough for a cube map
+  if (ctx.multiview && viewCount <= 6) {
+    multiviewRenderPass = createRenderPass(viewMask(), multiviewRenderPassKey);
+    colorArrayView = createLayerView(colorImage, colorFormat, VK_IMAGE_ASPECT_COLOR_BIT, 0, viewCount);
+    depthArrayView = createLayerView(depthImage, depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT, 0, viewCount);
+    multiviewFramebuffer = createFramebuffer(multiviewRenderPass, colorArrayView, depthArrayView);
+  }
+
+  // ----- Uniforms -----
+  VkDeviceSize alignment = ctx.properties.limits.minUniformBufferOffsetAlignment;
+  auto align = [alignment](VkDeviceSize size) { return (size + alignment - 1) / alignment * alignment; };
+
+  layerUniformOffset = align(2 * viewCount * sizeof(glm::mat4));
+  layerUniformStride = align(2 * sizeof(glm::mat4));
+  VkDeviceSize uniformSize = layerUniformOffset + viewCount * layerUniformStride;
+
+  createBuffer(ctx, uniformSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+               VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, uniformBuffer, uniformMemory);
+  vkMapMemory(ctx.device, uniformMemory, 0, uniformSize, 0, &uniformMapped);
+
+  createDescriptorSets(viewSetLayout);
+}
+
+// The device must be idle
+MultiviewTarget::~MultiviewTarget() {
+  vkDestroyDescriptorPool(ctx.device, descriptorPool, nullptr);
+  vkDestroyBuffer(ctx.device, uniformBuffer, nullptr);
+  vkFreeMemory(ctx.device, uniformMemory, nullptr);
+
+  for (auto framebuffer : layerFramebuffers) {
+    vkDestroyFramebuffer(ctx.device, framebuffer, nullptr);
+  }
+  for (auto view : colorLayerViews) {
+    vkDestroyImageView(ctx.device, view, nullptr);
+  }
+  for (auto view : depthLayerViews) {
+    vkDestroyImageView(ctx.device, view, nullptr);
+  }
+  vkDestroyRenderPass(ctx.device, layerRenderPass, nullptr);
+
+  if (multiviewRenderPass != VK_NULL_HANDLE) {
+    vkDestroyFramebuffer(ctx.device, multiviewFramebuffer, nullptr);
+    vkDestroyImageView(ctx.device, colorArrayView, nullptr);
+    vkDestroyImageView(ctx.device, depthArrayView, nullptr);
+    vkDestroyRenderPass(ctx.device, multiviewRenderPass, nullptr);
+  }
+
+  vkDestroyImage(ctx.device, colorImage, nullptr);
+  vkFreeMemory(ctx.device, colorMemory, nullptr);
+  vkDestroyImage(ctx.device, depthImage, nullptr);
+  vkFreeMemory(ctx.device, depthMemory, nullptr);
+}
+
+// One bit per layer. Bit i renders view i into layer i
+uint32_t MultiviewTarget::viewMask() const {
+  return (1u << viewCount) - 1;
+}
+
+VkRenderPass MultiviewTarget::createRenderPass(uint32_t viewMask, uint64_t& renderPassKey) {
+  std::array<VkAttachmentDescription, 2> attachments{};
+
+  VkAttachmentDescription& colorAttachment = attachments[0];
+  colorAttachment.format = colorFormat;
+  colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+  colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+  colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+  colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+  colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+  colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  // Ready to be sampled by later passes
+  colorAttachment.finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+  VkAttachmentDescription& depthAttachment = attachments[1];
+  depthAttachment.format = depthFormat;
+  depthAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+  depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+  depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+  depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+  depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+  depthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+  VkAttachmentReference colorAttachmentRef{0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL};
+  VkAttachmentReference depthAttachmentRef{1, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL};
+
+  VkSubpassDescription subpass{};
+  subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+  subpass.colorAttachmentCount = 1;
+  subpass.pColorAttachments = &colorAttachmentRef;
+  subpass.pDepthStencilAttachment = &depthAttachmentRef;
+
+  std::array<VkSubpassDependency, 2> dependencies{};
+
+  // Previous passes over the same layers, including sampling of the previous contents
+  dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+  dependencies[0].dstSubpass = 0;
+  dependencies[0].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT |
+                                 VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+  dependencies[0].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+  dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+  dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+  // Sampling or copying the result
+  dependencies[1].srcSubpass = 0;
+  dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+  dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+  dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+  dependencies[1].dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT;
+  dependencies[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT;
+
+  VkRenderPassCreateInfo renderPassInfo{};
+  renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+  renderPassInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+  renderPassInfo.pAttachments = attachments.data();
+  renderPassInfo.subpassCount = 1;
+  renderPassInfo.pSubpasses = &subpass;
+  renderPassInfo.dependencyCount = static_cast<uint32_t>(dependencies.size());
+  renderPassInfo.pDependencies = dependencies.data();
+
+  // Stereo eyes see nearly the same geometry, which lets the implementation share work between them. Cube faces do not
+  uint32_t correlationMask = viewCount == 2 ? viewMask : 0;
+
+  VkRenderPassMultiviewCreateInfo multiviewInfo{};
+  multiviewInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_MULTIVIEW_CREATE_INFO;
+  multiviewInfo.subpassCount = 1;
+  multiviewInfo.pViewMasks = &viewMask;
+  multiviewInfo.correlationMaskCount = correlationMask != 0 ? 1 : 0;
+  multiviewInfo.pCorrelationMasks = &correlationMask;
+
+  if (viewMask != 0) {
+    renderPassInfo.pNext = &multiviewInfo;
+  }
+
+  VkRenderPass renderPass;
+  if (vkCreateRenderPass(ctx.device, &renderPassInfo, nullptr, &renderPass) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to create layered render pass");
+  }
+  renderPassKey = hashRenderPassCompatibility(renderPassInfo);
+  return renderPass;
+}
+
+VkImageView MultiviewTarget::createLayerView(VkImage image, VkFormat format, VkImageAspectFlags aspect, uint32_t baseLayer,
+                                             uint32_t layerCount) {
+  VkImageViewCreateInfo viewInfo{};
+  viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+  viewInfo.image = image;
+  // A multiview framebuffer attaches all layers through one array view
+  viewInfo.viewType = layerCount > 1 ? VK_IMAGE_VIEW_TYPE_2D_ARRAY : VK_IMAGE_VIEW_TYPE_2D;
+  viewInfo.format = format;
+  viewInfo.subresourceRange = {aspect, 0, 1, baseLayer, layerCount};
+
+  VkImageView imageView;
+  if (vkCreateImageView(ctx.device, &viewInfo, nullptr, &imageView) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to create layer image view");
+  }
+  return imageView;
+}
+
+// Multiview framebuffers have a single layer. The view mask selects the layers of the attachments
+VkFramebuffer MultiviewTarget::createFramebuffer(VkRenderPass renderPass, VkImageView colorView, VkImageView depthView) {
+  std::array<VkImageView, 2> attachments = {colorView, depthView};
+
+  VkFramebufferCreateInfo framebufferInfo{};
+  framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+  framebufferInfo.renderPass = renderPass;
+  framebufferInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+  framebufferInfo.pAttachments = attachments.data();
+  framebufferInfo.width = extent.width;
+  framebufferInfo.height = extent.height;
+  framebufferInfo.layers = 1;
+
+  VkFramebuffer framebuffer;
+  if (vkCreateFramebuffer(ctx.device, &framebufferInfo, nullptr, &framebuffer) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to create layered framebuffer");
+  }
+  return framebuffer;
+}
+
+// One set for the multiview pass and one per layer, all of the renderer's frame set layout
+void MultiviewTarget::createDescriptorSets(VkDescriptorSetLayout viewSetLayout) {
+  uint32_t setCount = viewCount + 1;
+
+  VkDescriptorPoolSize poolSize{};
+  poolSize.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+  poolSize.descriptorCount = setCount;
+
+  VkDescriptorPoolCreateInfo poolInfo{};
+  poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+  poolInfo.poolSizeCount = 1;
+  poolInfo.pPoolSizes = &poolSize;
+  poolInfo.maxSets = setCount;
+
+  if (vkCreateDescriptorPool(ctx.device, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to create multiview descriptor pool");
+  }
+
+  std::vector<VkDescriptorSetLayout> layouts(setCount, viewSetLayout);
+  std::vector<VkDescriptorSet> sets(setCount);
+
+  VkDescriptorSetAllocateInfo allocInfo{};
+  allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+  allocInfo.descriptorPool = descriptorPool;
+  allocInfo.descriptorSetCount = setCount;
+  allocInfo.pSetLayouts = layouts.data();
+
+  if (vkAllocateDescriptorSets(ctx.device, &allocInfo, sets.data()) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to allocate multiview descriptor sets");
+  }
+  multiviewSet = sets[0];
+  layerSets.assign(sets.begin() + 1, sets.end());
+
+  std::vector<VkDescriptorBufferInfo> bufferInfos(setCount);
+  std::vector<VkWriteDescriptorSet> writes(setCount);
+  for (uint32_t i = 0; i < setCount; i++) {
+    bufferInfos[i].buffer = uniformBuffer;
+    bufferInfos[i].offset = i == 0 ? 0 : layerUniformOffset + (i - 1) * layerUniformStride;
+    bufferInfos[i].range = (i == 0 ? viewCount : 1) * 2 * sizeof(glm::mat4);
+
+    writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    writes[i].dstSet = sets[i];
+    writes[i].dstBinding = 0;
+    writes[i].dstArrayElement = 0;
+    writes[i].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    writes[i].descriptorCount = 1;
+    writes[i].pBufferInfo = &bufferInfos[i];
+  }
+
+  vkUpdateDescriptorSets(ctx.device, setCount, writes.data(), 0, nullptr);
+}
+
+// Matches the uniform blocks of shader.vert with and without MULTIVIEW
+void MultiviewTarget::update(const std::vector<glm::mat4>& views, const std::vector<glm::mat4>& projections) {
+  if (views.size() != viewCount || projections.size() != viewCount) {
+    throw std::runtime_error("Expected one view and projection per layer");
+  }
+
+  auto* base = static_cast<char*>(uniformMapped);
+  memcpy(base, views.data(), viewCount * sizeof(glm::mat4));
+  memcpy(base + viewCount * sizeof(glm::mat4), projections.data(), viewCount * sizeof(glm::mat4));
+
+  for (uint32_t i = 0; i < viewCount; i++) {
+    char* layer = base + layerUniformOffset + i * layerUniformStride;
+    memcpy(layer, &views[i], sizeof(glm::mat4));
+    memcpy(layer + sizeof(glm::mat4), &projections[i], sizeof(glm::mat4));
+  }
+}
+
+/**
+ * Render all layers. With multiview the draws are recorded once and broadcast to every layer. Otherwise they are
+ * recorded once per layer, each in its own pass
+ */
+void MultiviewTarget::record(VkCommandBuffer commandBuffer, bool multiview, const DrawFunction& draw) {
+  if (multiview && multiviewRenderPass == VK_NULL_HANDLE) {
+    throw std::runtime_error("Multiview is not supported");
+  }
+
+  std::array<VkClearValue, 2> clearValues{};
+  clearValues[0].color = {{0.0f, 0.0f, 0.0f, 1.0f}};
+  clearValues[1].depthStencil = {1.0f, 0};
+
+  VkRenderPassBeginInfo renderPassInfo{};
+  renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+  renderPassInfo.renderArea.offset = {0, 0};
+  renderPassInfo.renderArea.extent = extent;
+  renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
+  renderPassInfo.pClearValues = clearValues.data();
+
+  if (multiview) {
+    renderPassInfo.renderPass = multiviewRenderPass;
+    renderPassInfo.framebuffer = multiviewFramebuffer;
+    vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+    draw(commandBuffer, multiviewSet);
+    vkCmdEndRenderPass(commandBuffer);
+    return;
+  }
+
+  renderPassInfo.renderPass = layerRenderPass;
+  for (uint32_t i = 0; i < viewCount; i++) {
+    renderPassInfo.framebuffer = layerFramebuffers[i];
+    vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+    draw(commandBuffer, layerSets[i]);
+    vkCmdEndRenderPass(commandBuffer);
+  }
+}
+
+/*----- View matrices -----*/
+
+// Faces in the layer order of a cube map: +X, -X, +Y, -Y, +Z, -Z. Rendered with a square 90 degree projection
+std::vector<glm::mat4> cubeMapViews(glm::vec3 position) {
+  const std::array<std::pair<glm::vec3, glm::vec3>, 6> faces = {{
+      {{1.0f, 0.0f, 0.0f}, {0.0f, -1.0f, 0.0f}},
+      {{-1.0f, 0.0f, 0.0f}, {0.0f, -1.0f, 0.0f}},
+      {{0.0f, 1.0f, 0.0f}, {0.0f, 0.0f, 1.0f}},
+      {{0.0f, -1.0f, 0.0f}, {0.0f, 0.0f, -1.0f}},
+      {{0.0f, 0.0f, 1.0f}, {0.0f, -1.0f, 0.0f}},
+      {{0.0f, 0.0f, -1.0f}, {0.0f, -1.0f, 0.0f}},
+  }};
+
+  std::vector<glm::mat4> views;
+  for (const auto& [direction, up] : faces) {
+    views.push_back(glm::lookAt(position, position + direction, up));
+  }
+  return views;
+}
+
+// Left and right eye, offset along the view's x axis
+std::vector<glm::mat4> stereoViews(const glm::mat4& view, float eyeSeparation) {
+  float offset = 0.5f * eyeSeparation;
+  return {glm::translate(glm::mat4(1.0f), glm::vec3(offset, 0.0f, 0.0f)) * view,
+          glm::translate(glm::mat4(1.0f), glm::vec3(-offset, 0.0f, 0.0f)) * view};
+}
+
+/*----- Benchmark -----*/
+
+/**
+ * Render all views of the target with a pass per view and, unless the multiview pipeline is null, in one multiview
+ * pass, and compare the times
+ */
+void benchmarkMultiview(MultiviewTarget& target, VkPipeline layerPipeline, VkPipeline multiviewPipeline,
+                        const MultiviewBenchmarkDraw& draw, uint32_t iterations) {
+  GpuBenchmark benchmark(target.ctx, iterations);
+
+  double sequentialTime = benchmark.measure("Pass per view", [&](VkCommandBuffer commandBuffer) {
+    target.record(commandBuffer, false, [&](VkCommandBuffer commandBuffer, VkDescriptorSet viewSet) {
+      draw(commandBuffer, viewSet, layerPipeline);
+    });
+  });
+  if (multiviewPipeline == VK_NULL_HANDLE) {
+    return;
+  }
+
+  double multiviewTime = benchmark.measure("Multiview", [&](VkCommandBuffer commandBuffer) {
+    target.record(commandBuffer, true, [&](VkCommandBuffer commandBuffer, VkDescriptorSet viewSet) {
+      draw(commandBuffer, viewSet, multiviewPipeline);
+    });
+  });
+  std::cout << "Multiview speedup " << sequentialTime / multiviewTime << std::endl;
+}
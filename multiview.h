@@ -0,0 +1,85 @@
+#pragma once
+
+#include <functional>
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "vulkanUtils.h"
+
+/**
+ * Layered color and depth attachments with one layer per view, for cube maps and stereo pairs. With multiview every
+ * draw of a single pass is broadcast to all layers and selects its matrices with gl_ViewIndex, so N views cost one
+ * submission of the geometry. The fallback renders every layer in its own pass with its own matrices.
+ * Matrices are updated by the host and must not be in use by the device
+ */
+class MultiviewTarget {
+ public:
+  const VulkanContext& ctx;
+
+  uint32_t viewCount;
+  VkExtent2D extent;
+  // Sampled after rendering, e.g. as an environment map
+  VkFormat colorFormat = VK_FORMAT_R8G8B8A8_SRGB;
+  VkFormat depthFormat;
+
+  // Renders all layers in one subpass. Null if multiview is not supported
+  VkRenderPass multiviewRenderPass = VK_NULL_HANDLE;
+  // Renders a single layer. Used once per view by the fallback
+  VkRenderPass layerRenderPass = VK_NULL_HANDLE;
+  // Compatibility keys of the render passes for pipeline descriptions
+  uint64_t multiviewRenderPassKey = 0;
+  uint64_t layerRenderPassKey = 0;
+
+  // Records the draws of a pass. Set 0 holds the matrices of the pass
+  using DrawFunction = std::function<void(VkCommandBuffer commandBuffer, VkDescriptorSet viewSet)>;
+
+  MultiviewTarget() = delete;
+  MultiviewTarget(const VulkanContext& ctx, uint32_t viewCount, VkExtent2D extent, VkFormat depthFormat,
+                  VkDescriptorSetLayout viewSetLayout);
+  MultiviewTarget(const MultiviewTarget& multiviewTarget) = delete;
+  ~MultiviewTarget();
+
+  uint32_t viewMask() const;
+  void update(const std::vector<glm::mat4>& views, const std::vector<glm::mat4>& projections);
+  void record(VkCommandBuffer commandBuffer, bool multiview, const DrawFunction& draw);
+
+ private:
+  VkImage colorImage;
+  VkDeviceMemory colorMemory;
+  VkImage depthImage;
+  VkDeviceMemory depthMemory;
+
+  // Views of all layers for the multiview framebuffer and of single layers for the fallback
+  VkImageView colorArrayView = VK_NULL_HANDLE;
+  VkImageView depthArrayView = VK_NULL_HANDLE;
+  std::vector<VkImageView> colorLayerViews;
+  std::vector<VkImageView> depthLayerViews;
+
+  VkFramebuffer multiviewFramebuffer = VK_NULL_HANDLE;
+  std::vector<VkFramebuffer> layerFramebuffers;
+
+  // The block of all views comes first, followed by one block of a single view per layer
+  VkBuffer uniformBuffer;
+  VkDeviceMemory uniformMemory;
+  void* uniformMapped;
+  VkDeviceSize layerUniformOffset;
+  VkDeviceSize layerUniformStride;
+
+  VkDescriptorPool descriptorPool;
+  VkDescriptorSet multiviewSet;
+  std::vector<VkDescriptorSet> layerSets;
+
+  VkRenderPass createRenderPass(uint32_t viewMask, uint64_t& renderPassKey);
+  VkImageView createLayerView(VkImage image, VkFormat format, VkImageAspectFlags aspect, uint32_t baseLayer, uint32_t layerCount);
+  VkFramebuffer createFramebuffer(VkRenderPass renderPass, VkImageView colorView, VkImageView depthView);
+  void createDescriptorSets(VkDescriptorSetLayout viewSetLayout);
+};
+
+std::vector<glm::mat4> cubeMapViews(glm::vec3 position);
+std::vector<glm::mat4> stereoViews(const glm::mat4& view, float eyeSeparation);
+
+// Records the draws of a benchmarked pass with the given pipeline
+using MultiviewBenchmarkDraw = std::function<void(VkCommandBuffer commandBuffer, VkDescriptorSet viewSet, VkPipeline pipeline)>;
+
+void benchmarkMultiview(MultiviewTarget& target, VkPipeline layerPipeline, VkPipeline multiviewPipeline,
+                        const MultiviewBenchmarkDraw& draw, uint32_t iterations);
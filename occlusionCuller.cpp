@@ -0,0 +1,680 @@
+#include "occlusionCuller.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <glm/gtc/matrix_transform.hpp>
+#include <iostream>
+#include <map>
+#include <set>
+#include <tuple>
+
+#include "cpuCuller.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define OCCLUSION_X86
+#endif
+
+// Tiles are one AVX2 register wide so that a row of a tile is rasterized in one step
+static const uint32_t TILE_WIDTH = 8;
+static const uint32_t TILE_HEIGHT = 8;
+// Triangles smaller than this in pixels cover no pixel centre worth testing
+static const float MIN_AREA = 1e-6f;
+
+/*----- OccluderMesh -----*/
+
+uint32_t OccluderMesh::triangleCount() const {
+  return static_cast<uint32_t>(indices.size() / 3);
+}
+
+/**
+ * Reduce a mesh to at most maxTriangles by clustering its vertices on a grid, coarsening the grid until few enough
+ * triangles survive. Each cluster is replaced by the average of its vertices and triangles collapsed by the
+ * clustering are dropped. The result stays within the bounds of the original but may bulge out of concave parts by
+ * up to a cell, so occluders should be meshes whose simplified silhouette is close to the original
+ */
+OccluderMesh simplifyOccluder(const std::vector<glm::vec3>& positions, const std::vector<uint32_t>& indices, uint32_t maxTriangles) {
+  OccluderMesh mesh{};
+  mesh.minimum = glm::vec3{INFINITY};
+  mesh.maximum = glm::vec3{-INFINITY};
+  for (const auto& position : positions) {
+    mesh.minimum = glm::min(mesh.minimum, position);
+    mesh.maximum = glm::max(mesh.maximum, position);
+  }
+  if (positions.empty()) {
+    mesh.minimum = mesh.maximum = glm::vec3{0.0f};
+    return mesh;
+  }
+
+  glm::vec3 size = glm::max(mesh.maximum - mesh.minimum, glm::vec3{1e-6f});
+
+  for (uint32_t resolution = 64;; resolution = std::max(1u, resolution * 3 / 4)) {
+    // Cluster of each vertex, and the sum of the vertices in each cluster
+    std::map<std::tuple<uint32_t, uint32_t, uint32_t>, uint32_t> cells;
+    std::vector<uint32_t> cluster(positions.size());
+    std::vector<glm::vec3> sums;
+    std::vector<uint32_t> counts;
+
+    for (size_t i = 0; i < positions.size(); i++) {
+      glm::vec3 cell = glm::min((positions[i] - mesh.minimum) / size * static_cast<float>(resolution),
+                                glm::vec3{static_cast<float>(resolution - 1)});
+      auto key = std::make_tuple(static_cast<uint32_t>(cell.x), static_cast<uint32_t>(cell.y), static_cast<uint32_t>(cell.z));
+      auto [it, inserted] = cells.try_emplace(key, static_cast<uint32_t>(sums.size()));
+      if (inserted) {
+        sums.push_back(glm::vec3{0.0f});
+        counts.push_back(0);
+      }
+      cluster[i] = it->second;
+      sums[it->second] += positions[i];
+      counts[it->second]++;
+    }
+
+    // Drop collapsed triangles and duplicates, keeping the winding
+    std::set<std::tuple<uint32_t, uint32_t, uint32_t>> seen;
+    std::vector<uint32_t> clustered;
+    for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+      uint32_t a = cluster[indices[i]];
+      uint32_t b = cluster[indices[i + 1]];
+      uint32_t c = cluster[indices[i + 2]];
+      if (a == b || b == c || c == a) {
+        continue;
+      }
+      // Rotate the smallest index first so that the same triangle always has the same key
+      if (b < a && b < c) {
+        std::tie(a, b, c) = std::make_tuple(b, c, a);
+      } else if (c < a && c < b) {
+        std::tie(a, b, c) = std::make_tuple(c, a, b);
+      }
+      if (seen.insert({a, b, c}).second) {
+        clustered.insert(clustered.end(), {a, b, c});
+      }
+    }
+
+    if (clustered.size() / 3 > maxTriangles && resolution > 1) {
+      continue;
+    }
+
+    mesh.indices = std::move(clustered);
+    for (size_t i = 0; i < sums.size(); i++) {
+      glm::vec3 position = sums[i] / static_cast<float>(counts[i]);
+      mesh.x.push_back(position.x);
+      mesh.y.push_back(position.y);
+      mesh.z.push_back(position.z);
+    }
+    return mesh;
+  }
+}
+
+/*----- Vertex transform -----*/
+
+// Screen x and y in pixels, depth in [0, 1] and clip space z, which is negative in front of the near plane and
+// behind the camera
+struct ScreenVertices {
+  float* x;
+  float* y;
+  float* depth;
+  float* clipZ;
+};
+
+static void transformVerticesScalar(const glm::mat4& m, const float* x, const float* y, const float* z, uint32_t count,
+                                    float halfWidth, float halfHeight, ScreenVertices out) {
+  for (uint32_t i = 0; i < count; i++) {
+    float clipX = (x[i] * m[0][0] + y[i] * m[1][0]) + (z[i] * m[2][0] + m[3][0]);
+    float clipY = (x[i] * m[0][1] + y[i] * m[1][1]) + (z[i] * m[2][1] + m[3][1]);
+    float clipZ = (x[i] * m[0][2] + y[i] * m[1][2]) + (z[i] * m[2][2] + m[3][2]);
+    float clipW = (x[i] * m[0][3] + y[i] * m[1][3]) + (z[i] * m[2][3] + m[3][3]);
+    float inverseW = 1.0f / clipW;
+    out.x[i] = clipX * inverseW * halfWidth + halfWidth;
+    out.y[i] = clipY * inverseW * halfHeight + halfHeight;
+    out.depth[i] = clipZ * inverseW;
+    out.clipZ[i] = clipZ;
+  }
+}
+
+/*----- Row rasterization -----*/
+
+// A triangle covers a pixel when its centre is strictly inside all three edges. Covered pixels keep the nearest depth
+
+static void rasterizeTileScalar(const float edgeA[3], const float edgeB[3], const float edgeC[3], const float depthPlane[3],
+                                float* depth, uint32_t stride, int32_t tileX, int32_t firstRow, int32_t lastRow) {
+  for (int32_t y = firstRow; y <= lastRow; y++) {
+    float py = y + 0.5f;
+    float* row = depth + y * stride + tileX;
+    for (uint32_t lane = 0; lane < TILE_WIDTH; lane++) {
+      float px = tileX + 0.5f + lane;
+      bool inside = true;
+      for (int edge = 0; edge < 3; edge++) {
+        inside &= edgeA[edge] * px + (edgeB[edge] * py + edgeC[edge]) > 0.0f;
+      }
+      float z = depthPlane[0] * px + (depthPlane[1] * py + depthPlane[2]);
+      if (inside) {
+        row[lane] = std::min(row[lane], z);
+      }
+    }
+  }
+}
+
+#ifdef OCCLUSION_X86
+
+static void transformVerticesSSE2(const glm::mat4& m, const float* x, const float* y, const float* z, uint32_t count,
+                                  float halfWidth, float halfHeight, ScreenVertices out) {
+  const uint32_t width = 4;
+  uint32_t batched = count - count % width;
+
+  __m128 column[4][4];
+  for (int c = 0; c < 4; c++) {
+    for (int r = 0; r < 4; r++) {
+      column[c][r] = _mm_set1_ps(m[c][r]);
+    }
+  }
+  __m128 halfW = _mm_set1_ps(halfWidth);
+  __m128 halfH = _mm_set1_ps(halfHeight);
+
+  for (uint32_t i = 0; i < batched; i += width) {
+    __m128 px = _mm_loadu_ps(x + i);
+    __m128 py = _mm_loadu_ps(y + i);
+    __m128 pz = _mm_loadu_ps(z + i);
+
+    __m128 clip[4];
+    for (int r = 0; r < 4; r++) {
+      clip[r] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(px, column[0][r]), _mm_mul_ps(py, column[1][r])),
+                           _mm_add_ps(_mm_mul_ps(pz, column[2][r]), column[3][r]));
+    }
+    __m128 inverseW = _mm_div_ps(_mm_set1_ps(1.0f), clip[3]);
+    _mm_storeu_ps(out.x + i, _mm_add_ps(_mm_mul_ps(_mm_mul_ps(clip[0], inverseW), halfW), halfW));
+    _mm_storeu_ps(out.y + i, _mm_add_ps(_mm_mul_ps(_mm_mul_ps(clip[1], inverseW), halfH), halfH));
+    _mm_storeu_ps(out.depth + i, _mm_mul_ps(clip[2], inverseW));
+    _mm_storeu_ps(out.clipZ + i, clip[2]);
+  }
+
+  transformVerticesScalar(m, x + batched, y + batched, z + batched, count - batched, halfWidth, halfHeight,
+                          {out.x + batched, out.y + batched, out.depth + batched, out.clipZ + batched});
+}
+
+__attribute__((target("avx2"))) static void transformVerticesAVX2(const glm::mat4& m, const float* x, const float* y,
+                                                                  const float* z, uint32_t count, float halfWidth,
+                                                                  float halfHeight, ScreenVertices out) {
+  const uint32_t width = 8;
+  uint32_t batched = count - count % width;
+
+  __m256 column[4][4];
+  for (int c = 0; c < 4; c++) {
+    for (int r = 0; r < 4; r++) {
+      column[c][r] = _mm256_set1_ps(m[c][r]);
+    }
+  }
+  __m256 halfW = _mm256_set1_ps(halfWidth);
+  __m256 halfH = _mm256_set1_ps(halfHeight);
+
+  for (uint32_t i = 0; i < batched; i += width) {
+    __m256 px = _mm256_loadu_ps(x + i);
+    __m256 py = _mm256_loadu_ps(y + i);
+    __m256 pz = _mm256_loadu_ps(z + i);
+
+    __m256 clip[4];
+    for (int r = 0; r < 4; r++) {
+      clip[r] = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(px, column[0][r]), _mm256_mul_ps(py, column[1][r])),
+                              _mm256_add_ps(_mm256_mul_ps(pz, column[2][r]), column[3][r]));
+    }
+    __m256 inverseW = _mm256_div_ps(_mm256_set1_ps(1.0f), clip[3]);
+    _mm256_storeu_ps(out.x + i, _mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(clip[0], inverseW), halfW), halfW));
+    _mm256_storeu_ps(out.y + i, _mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(clip[1], inverseW), halfH), halfH));
+    _mm256_storeu_ps(out.depth + i, _mm256_mul_ps(clip[2], inverseW));
+    _mm256_storeu_ps(out.clipZ + i, clip[2]);
+  }
+
+  transformVerticesSSE2(m, x + batched, y + batched, z + batched, count - batched, halfWidth, halfHeight,
+                        {out.x + batched, out.y + batched, out.depth + batched, out.clipZ + batched});
+}
+
+// Two halves of a tile row. SSE2 has no blend, so covered lanes are selected with and/andnot
+static void rasterizeTileSSE2(const float edgeA[3], const float edgeB[3], const float edgeC[3], const float depthPlane[3],
+                              float* depth, uint32_t stride, int32_t tileX, int32_t firstRow, int32_t lastRow) {
+  const __m128 zero = _mm_setzero_ps();
+  for (uint32_t half = 0; half < TILE_WIDTH; half += 4) {
+    __m128 px = _mm_add_ps(_mm_set1_ps(tileX + 0.5f), _mm_setr_ps(half, half + 1.0f, half + 2.0f, half + 3.0f));
+    __m128 edgeX[3];
+    for (int edge = 0; edge < 3; edge++) {
+      edgeX[edge] = _mm_mul_ps(_mm_set1_ps(edgeA[edge]), px);
+    }
+    __m128 depthX = _mm_mul_ps(_mm_set1_ps(depthPlane[0]), px);
+
+    for (int32_t y = firstRow; y <= lastRow; y++) {
+      float py = y + 0.5f;
+      __m128 inside = _mm_cmpgt_ps(_mm_add_ps(edgeX[0], _mm_set1_ps(edgeB[0] * py + edgeC[0])), zero);
+      inside = _mm_and_ps(inside, _mm_cmpgt_ps(_mm_add_ps(edgeX[1], _mm_set1_ps(edgeB[1] * py + edgeC[1])), zero));
+      inside = _mm_and_ps(inside, _mm_cmpgt_ps(_mm_add_ps(edgeX[2], _mm_set1_ps(edgeB[2] * py + edgeC[2])), zero));
+      if (_mm_movemask_ps(inside) == 0) {
+        continue;
+      }
+
+      __m128 z = _mm_add_ps(depthX, _mm_set1_ps(depthPlane[1] * py + depthPlane[2]));
+      float* row = depth + y * stride + tileX + half;
+      __m128 current = _mm_loadu_ps(row);
+      __m128 nearest = _mm_min_ps(current, z);
+      _mm_storeu_ps(row, _mm_or_ps(_mm_and_ps(inside, nearest), _mm_andnot_ps(inside, current)));
+    }
+  }
+}
+
+__attribute__((target("avx2"))) static void rasterizeTileAVX2(const float edgeA[3], const float edgeB[3],
+                                                              const float edgeC[3], const float depthPlane[3],
+                                                              float* depth, uint32_t stride, int32_t tileX,
+                                                              int32_t firstRow, int32_t lastRow) {
+  const __m256 zero = _mm256_setzero_ps();
+  __m256 px = _mm256_add_ps(_mm256_set1_ps(tileX + 0.5f), _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f));
+  __m256 edgeX[3];
+  for (int edge = 0; edge < 3; edge++) {
+    edgeX[edge] = _mm256_mul_ps(_mm256_set1_ps(edgeA[edge]), px);
+  }
+  __m256 depthX = _mm256_mul_ps(_mm256_set1_ps(depthPlane[0]), px);
+
+  for (int32_t y = firstRow; y <= lastRow; y++) {
+    float py = y + 0.5f;
+    __m256 inside = _mm256_cmp_ps(_mm256_add_ps(edgeX[0], _mm256_set1_ps(edgeB[0] * py + edgeC[0])), zero, _CMP_GT_OQ);
+    inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(edgeX[1], _mm256_set1_ps(edgeB[1] * py + edgeC[1])), zero, _CMP_GT_OQ));
+    inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(edgeX[2], _mm256_set1_ps(edgeB[2] * py + edgeC[2])), zero, _CMP_GT_OQ));
+    if (_mm256_movemask_ps(inside) == 0) {
+      continue;
+    }
+
+    __m256 z = _mm256_add_ps(depthX, _mm256_set1_ps(depthPlane[1] * py + depthPlane[2]));
+    float* row = depth + y * stride + tileX;
+    __m256 current = _mm256_loadu_ps(row);
+    _mm256_storeu_ps(row, _mm256_blendv_ps(current, _mm256_min_ps(current, z), inside));
+  }
+}
+
+#endif
+
+static void transformVertices(const glm::mat4& m, const float* x, const float* y, const float* z, uint32_t count,
+                              float halfWidth, float halfHeight, ScreenVertices out, SimdLevel level) {
+#ifdef OCCLUSION_X86
+  if (level == SimdLevel::AVX2) {
+    transformVerticesAVX2(m, x, y, z, count, halfWidth, halfHeight, out);
+    return;
+  }
+  if (level == SimdLevel::SSE2) {
+    transformVerticesSSE2(m, x, y, z, count, halfWidth, halfHeight, out);
+    return;
+  }
+#endif
+  transformVerticesScalar(m, x, y, z, count, halfWidth, halfHeight, out);
+}
+
+static void rasterizeTile(const float edgeA[3], const float edgeB[3], const float edgeC[3], const float depthPlane[3],
+                          float* depth, uint32_t stride, int32_t tileX, int32_t firstRow, int32_t lastRow, SimdLevel level) {
+#ifdef OCCLUSION_X86
+  if (level == SimdLevel::AVX2) {
+    rasterizeTileAVX2(edgeA, edgeB, edgeC, depthPlane, depth, stride, tileX, firstRow, lastRow);
+    return;
+  }
+  if (level == SimdLevel::SSE2) {
+    rasterizeTileSSE2(edgeA, edgeB, edgeC, depthPlane, depth, stride, tileX, firstRow, lastRow);
+    return;
+  }
+#endif
+  rasterizeTileScalar(edgeA, edgeB, edgeC, depthPlane, depth, stride, tileX, firstRow, lastRow);
+}
+
+/*--------------- OcclusionCuller ---------------*/
+
+OcclusionCuller::OcclusionCuller(std::vector<OccluderMesh> meshes, uint32_t width, uint32_t height, uint32_t maxOccluders)
+    : simdLevel{detectSimdLevel()},
+      maxOccluders{maxOccluders},
+      meshes{std::move(meshes)},
+      width{(std::max(width, TILE_WIDTH) + TILE_WIDTH - 1) / TILE_WIDTH * TILE_WIDTH},
+      height{(std::max(height, TILE_HEIGHT) + TILE_HEIGHT - 1) / TILE_HEIGHT * TILE_HEIGHT} {
+  tileColumns = this->width / TILE_WIDTH;
+  tileRows = this->height / TILE_HEIGHT;
+  depth.resize(this->width * this->height);
+  tileDepth.resize(tileColumns * tileRows);
+  tileTriangles.resize(tileColumns * tileRows);
+}
+
+void OcclusionCuller::addInstance(const glm::mat4& model, uint32_t meshIndex) {
+  const OccluderMesh& mesh = meshes[meshIndex];
+
+  Instance instance{model, meshIndex, glm::vec3{INFINITY}, glm::vec3{-INFINITY}};
+  for (uint32_t corner = 0; corner < 8; corner++) {
+    glm::vec3 local{corner & 1 ? mesh.maximum.x : mesh.minimum.x, corner & 2 ? mesh.maximum.y : mesh.minimum.y,
+                    corner & 4 ? mesh.maximum.z : mesh.minimum.z};
+    glm::vec3 world = glm::vec3(model * glm::vec4(local, 1.0f));
+    instance.minimum = glm::min(instance.minimum, world);
+    instance.maximum = glm::max(instance.maximum, world);
+  }
+  instances.push_back(instance);
+}
+
+/**
+ * Remove the instances hidden behind the occluders from a frustum culled list, keeping the order of the rest
+ */
+void OcclusionCuller::cull(const glm::mat4& viewProjection, const glm::vec3& eye, std::vector<uint32_t>& visible) {
+  auto startTime = std::chrono::high_resolution_clock::now();
+
+  chooseOccluders(eye, visible);
+
+  triangles.clear();
+  for (uint32_t id : occluders) {
+    setupTriangles(meshes[instances[id].meshIndex], viewProjection * instances[id].model);
+  }
+  rasterize();
+
+  auto rasterizedTime = std::chrono::high_resolution_clock::now();
+
+  // Occluders are kept, as rounding in the rasterized depth could otherwise hide them behind themselves
+  size_t tested = visible.size();
+  visible.erase(std::remove_if(visible.begin(), visible.end(),
+                               [&](uint32_t id) {
+                                 return std::find(occluders.begin(), occluders.end(), id) == occluders.end() &&
+                                        !isVisible(instances[id], viewProjection);
+                               }),
+                visible.end());
+
+  auto endTime = std::chrono::high_resolution_clock::now();
+
+  culledFrames++;
+  testedTotal += tested;
+  occludedTotal += tested - visible.size();
+  triangleTotal += triangles.size();
+  rasterTime += std::chrono::duration<double, std::milli>(rasterizedTime - startTime).count();
+  testTime += std::chrono::duration<double, std::milli>(endTime - rasterizedTime).count();
+}
+
+void OcclusionCuller::report() const {
+  if (culledFrames > 0) {
+    std::cout << "Occlusion culling (" << simdLevelName(simdLevel) << ", " << width << "x" << height << "): average "
+              << (double)occludedTotal / culledFrames << " of " << (double)testedTotal / culledFrames
+              << " instances occluded, " << (double)triangleTotal / culledFrames << " occluder triangles, "
+              << rasterTime / culledFrames << " ms rasterizing, " << testTime / culledFrames << " ms testing" << std::endl;
+  }
+}
+
+/**
+ * Pick the visible instances which cover the most of the screen, estimated from the size of their bounds over their
+ * distance from the camera
+ */
+void OcclusionCuller::chooseOccluders(const glm::vec3& eye, const std::vector<uint32_t>& visible) {
+  std::vector<std::pair<float, uint32_t>> candidates;
+  candidates.reserve(visible.size());
+  for (uint32_t id : visible) {
+    const Instance& instance = instances[id];
+    if (meshes[instance.meshIndex].indices.empty()) {
+      continue;
+    }
+    glm::vec3 center = 0.5f * (instance.minimum + instance.maximum);
+    float radius = 0.5f * glm::length(instance.maximum - instance.minimum);
+    float distance = std::max(glm::length(center - eye), 1e-3f);
+    candidates.push_back({radius / distance, id});
+  }
+
+  size_t count = std::min<size_t>(candidates.size(), maxOccluders);
+  std::partial_sort(candidates.begin(), candidates.begin() + count, candidates.end(),
+                    [](const auto& a, const auto& b) { return a.first > b.first; });
+
+  occluders.clear();
+  for (size_t i = 0; i < count; i++) {
+    occluders.push_back(candidates[i].second);
+  }
+}
+
+/**
+ * Project the triangles of an occluder to the screen. Triangles reaching in front of the near plane are skipped
+ * rather than clipped, as the parts the GPU would clip must not hide anything
+ */
+void OcclusionCuller::setupTriangles(const OccluderMesh& mesh, const glm::mat4& modelViewProjection) {
+  uint32_t vertexCount = static_cast<uint32_t>(mesh.x.size());
+  screenX.resize(vertexCount);
+  screenY.resize(vertexCount);
+  screenZ.resize(vertexCount);
+  clipZ.resize(vertexCount);
+  transformVertices(modelViewProjection, mesh.x.data(), mesh.y.data(), mesh.z.data(), vertexCount, 0.5f * width,
+                    0.5f * height, {screenX.data(), screenY.data(), screenZ.data(), clipZ.data()}, simdLevel);
+
+  for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3) {
+    uint32_t v[3] = {mesh.indices[i], mesh.indices[i + 1], mesh.indices[i + 2]};
+    if (clipZ[v[0]] < 0.0f || clipZ[v[1]] < 0.0f || clipZ[v[2]] < 0.0f) {
+      continue;
+    }
+
+    float x[3] = {screenX[v[0]], screenX[v[1]], screenX[v[2]]};
+    float y[3] = {screenY[v[0]], screenY[v[1]], screenY[v[2]]};
+    float z[3] = {screenZ[v[0]], screenZ[v[1]], screenZ[v[2]]};
+
+    ScreenTriangle triangle{};
+    triangle.minX = std::max(0, static_cast<int32_t>(std::floor(std::min({x[0], x[1], x[2]}))));
+    triangle.minY = std::max(0, static_cast<int32_t>(std::floor(std::min({y[0], y[1], y[2]}))));
+    triangle.maxX = std::min(static_cast<int32_t>(width) - 1, static_cast<int32_t>(std::ceil(std::max({x[0], x[1], x[2]}))));
+    triangle.maxY = std::min(static_cast<int32_t>(height) - 1, static_cast<int32_t>(std::ceil(std::max({y[0], y[1], y[2]}))));
+    if (triangle.minX > triangle.maxX || triangle.minY > triangle.maxY) {
+      continue;
+    }
+
+    float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+    if (std::abs(area) < MIN_AREA) {
+      continue;
+    }
+
+    // Both faces are drawn, as keeping the nearest depth makes back faces harmless. Flip the edges of clockwise
+    // triangles so that the inside is positive
+    float sign = area > 0.0f ? 1.0f : -1.0f;
+    for (int edge = 0; edge < 3; edge++) {
+      int a = edge;
+      int b = (edge + 1) % 3;
+      triangle.edgeA[edge] = sign * (y[a] - y[b]);
+      triangle.edgeB[edge] = sign * (x[b] - x[a]);
+      triangle.edgeC[edge] = sign * (x[a] * y[b] - y[a] * x[b]);
+    }
+
+    triangle.depthA = ((z[1] - z[0]) * (y[2] - y[0]) - (z[2] - z[0]) * (y[1] - y[0])) / area;
+    triangle.depthB = ((x[1] - x[0]) * (z[2] - z[0]) - (x[2] - x[0]) * (z[1] - z[0])) / area;
+    triangle.depthC = z[0] - triangle.depthA * x[0] - triangle.depthB * y[0];
+
+    triangles.push_back(triangle);
+  }
+}
+
+/**
+ * Bin the triangles into the tiles their bounds overlap, then rasterize each tile with its triangles and record its
+ * farthest depth
+ */
+void OcclusionCuller::rasterize() {
+  std::fill(depth.begin(), depth.end(), 1.0f);
+  for (auto& bin : tileTriangles) {
+    bin.clear();
+  }
+
+  for (uint32_t index = 0; index < triangles.size(); index++) {
+    const ScreenTriangle& triangle = triangles[index];
+    for (uint32_t tileY = triangle.minY / TILE_HEIGHT; tileY <= triangle.maxY / TILE_HEIGHT; tileY++) {
+      for (uint32_t tileX = triangle.minX / TILE_WIDTH; tileX <= triangle.maxX / TILE_WIDTH; tileX++) {
+        tileTriangles[tileY * tileColumns + tileX].push_back(index);
+      }
+    }
+  }
+
+  for (uint32_t tileY = 0; tileY < tileRows; tileY++) {
+    for (uint32_t tileX = 0; tileX < tileColumns; tileX++) {
+      uint32_t tile = tileY * tileColumns + tileX;
+      int32_t x0 = tileX * TILE_WIDTH;
+      int32_t y0 = tileY * TILE_HEIGHT;
+
+      for (uint32_t index : tileTriangles[tile]) {
+        const ScreenTriangle& triangle = triangles[index];
+        float depthPlane[3] = {triangle.depthA, triangle.depthB, triangle.depthC};
+        rasterizeTile(triangle.edgeA, triangle.edgeB, triangle.edgeC, depthPlane, depth.data(), width, x0,
+                      std::max(y0, triangle.minY), std::min<int32_t>(y0 + TILE_HEIGHT - 1, triangle.maxY), simdLevel);
+      }
+
+      float farthest = 0.0f;
+      for (uint32_t y = 0; y < TILE_HEIGHT; y++) {
+        const float* row = depth.data() + (y0 + y) * width + x0;
+        farthest = std::max(farthest, *std::max_element(row, row + TILE_WIDTH));
+      }
+      tileDepth[tile] = farthest;
+    }
+  }
+}
+
+/**
+ * Test the screen rectangle of a bounding box at its nearest depth. A tile hides the box where its farthest depth is
+ * nearer, and otherwise the pixels under the rectangle are checked. Boxes reaching in front of the near plane are
+ * always visible
+ */
+bool OcclusionCuller::isVisible(const Instance& instance, const glm::mat4& viewProjection) const {
+  float minX = INFINITY, minY = INFINITY, maxX = -INFINITY, maxY = -INFINITY;
+  float nearest = INFINITY;
+
+  for (uint32_t corner = 0; corner < 8; corner++) {
+    glm::vec4 clip = viewProjection * glm::vec4{corner & 1 ? instance.maximum.x : instance.minimum.x,
+                                                corner & 2 ? instance.maximum.y : instance.minimum.y,
+                                                corner & 4 ? instance.maximum.z : instance.minimum.z, 1.0f};
+    if (clip.z < 0.0f) {
+      return true;
+    }
+    float x = (clip.x / clip.w * 0.5f + 0.5f) * width;
+    float y = (clip.y / clip.w * 0.5f + 0.5f) * height;
+    minX = std::min(minX, x);
+    minY = std::min(minY, y);
+    maxX = std::max(maxX, x);
+    maxY = std::max(maxY, y);
+    nearest = std::min(nearest, clip.z / clip.w);
+  }
+
+  // Pixels whose centres the rectangle covers, widened by one so that a box between centres is not lost
+  int32_t x0 = std::max(0, static_cast<int32_t>(std::floor(minX)));
+  int32_t y0 = std::max(0, static_cast<int32_t>(std::floor(minY)));
+  int32_t x1 = std::min(static_cast<int32_t>(width) - 1, static_cast<int32_t>(std::ceil(maxX)));
+  int32_t y1 = std::min(static_cast<int32_t>(height) - 1, static_cast<int32_t>(std::ceil(maxY)));
+  if (x0 > x1 || y0 > y1) {
+    // Off screen, which is left to frustum culling
+    return true;
+  }
+
+  for (uint32_t tileY = y0 / TILE_HEIGHT; tileY <= y1 / TILE_HEIGHT; tileY++) {
+    for (uint32_t tileX = x0 / TILE_WIDTH; tileX <= x1 / TILE_WIDTH; tileX++) {
+      if (tileDepth[tileY * tileColumns + tileX] < nearest) {
+        continue;
+      }
+
+      int32_t rowStart = std::max<int32_t>(y0, tileY * TILE_HEIGHT);
+      int32_t rowEnd = std::min<int32_t>(y1, tileY * TILE_HEIGHT + TILE_HEIGHT - 1);
+      int32_t columnStart = std::max<int32_t>(x0, tileX * TILE_WIDTH);
+      int32_t columnEnd = std::min<int32_t>(x1, tileX * TILE_WIDTH + TILE_WIDTH - 1);
+      for (int32_t y = rowStart; y <= rowEnd; y++) {
+        const float* row = depth.data() + y * width;
+        for (int32_t x = columnStart; x <= columnEnd; x++) {
+          if (row[x] >= nearest) {
+            return true;
+          }
+        }
+      }
+    }
+  }
+
+  return false;
+}
+
+/*----- Benchmark -----*/
+
+// Unit cube centred on the origin with each face split into a grid, standing in for a detailed mesh
+static void createBoxMesh(uint32_t divisions, std::vector<glm::vec3>& positions, std::vector<uint32_t>& indices) {
+  for (int axis = 0; axis < 3; axis++) {
+    for (float side : {-0.5f, 0.5f}) {
+      uint32_t first = static_cast<uint32_t>(positions.size());
+      for (uint32_t j = 0; j <= divisions; j++) {
+        for (uint32_t i = 0; i <= divisions; i++) {
+          glm::vec3 position;
+          position[axis] = side;
+          position[(axis + 1) % 3] = static_cast<float>(i) / divisions - 0.5f;
+          position[(axis + 2) % 3] = static_cast<float>(j) / divisions - 0.5f;
+          positions.push_back(position);
+        }
+      }
+      for (uint32_t j = 0; j < divisions; j++) {
+        for (uint32_t i = 0; i < divisions; i++) {
+          uint32_t corner = first + j * (divisions + 1) + i;
+          indices.insert(indices.end(), {corner, corner + 1, corner + divisions + 2, corner, corner + divisions + 2,
+                                         corner + divisions + 1});
+        }
+      }
+    }
+  }
+}
+
+/**
+ * Cull a city of tall blocks seen from street level with every instruction set. Instances outside the frustum are
+ * removed first, as in the renderer. Needs no window or GPU
+ */
+void benchmarkOcclusion(uint32_t instanceCount) {
+  const uint32_t frames = 200;
+  const float pi = 3.14159265f;
+
+  std::vector<glm::vec3> positions;
+  std::vector<uint32_t> indices;
+  createBoxMesh(16, positions, indices);
+  OccluderMesh mesh = simplifyOccluder(positions, indices, 64);
+
+  uint32_t columns = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<double>(instanceCount))));
+  float extent = 2.0f * columns;
+
+  std::vector<glm::mat4> models;
+  SphereBounds bounds;
+  for (uint32_t i = 0; i < instanceCount; i++) {
+    glm::vec3 position{2.0f * (i % columns) - 0.5f * extent, 2.0f * (i / columns) - 0.5f * extent, 1.5f};
+    models.push_back(glm::scale(glm::translate(glm::mat4{1.0f}, position), glm::vec3{1.6f, 1.6f, 3.0f}));
+    bounds.push(position.x, position.y, position.z, 0.5f * glm::length(glm::vec3{1.6f, 1.6f, 3.0f}));
+  }
+
+  CpuCuller frustumCuller(bounds);
+  std::vector<glm::mat4> viewProjections;
+  std::vector<glm::vec3> eyes;
+  std::vector<std::vector<uint32_t>> frustumVisible(frames);
+  for (uint32_t frame = 0; frame < frames; frame++) {
+    float angle = 2.0f * pi * frame / frames;
+    // Walk a circle along a street between the blocks
+    glm::vec3 eye{0.25f * extent * std::cos(angle) + 1.0f, 0.25f * extent * std::sin(angle) + 1.0f, 1.0f};
+    glm::mat4 view = glm::lookAt(eye, glm::vec3{1.0f, 1.0f, 1.0f}, glm::vec3{0.0f, 0.0f, 1.0f});
+    glm::mat4 projection = glm::perspective(glm::radians(60.0f), 16.0f / 10.0f, 0.1f, extent);
+    eyes.push_back(eye);
+    viewProjections.push_back(projection * view);
+    frustumCuller.cull(extractFrustum(projection * view), frustumVisible[frame]);
+  }
+
+  std::cout << "Occlusion culling " << instanceCount << " blocks of " << mesh.triangleCount() << " triangles (from "
+            << indices.size() / 3 << "), average of " << frames << " frames" << std::endl;
+
+  SimdLevel bestLevel = detectSimdLevel();
+  std::vector<std::vector<uint32_t>> reference;
+  for (SimdLevel level : {SimdLevel::Scalar, SimdLevel::SSE2, SimdLevel::AVX2}) {
+    if (level > bestLevel) {
+      break;
+    }
+
+    OcclusionCuller culler({mesh});
+    culler.simdLevel = level;
+    for (const auto& model : models) {
+      culler.addInstance(model, 0);
+    }
+
+    std::vector<std::vector<uint32_t>> results = frustumVisible;
+    for (uint32_t frame = 0; frame < frames; frame++) {
+      culler.cull(viewProjections[frame], eyes[frame], results[frame]);
+    }
+    culler.report();
+
+    // Instruction sets evaluate the same expressions in the same order, so their results should match exactly
+    if (reference.empty()) {
+      reference = std::move(results);
+    } else {
+      uint32_t mismatches = 0;
+      for (uint32_t frame = 0; frame < frames; frame++) {
+        mismatches += results[frame] != reference[frame];
+      }
+      if (mismatches > 0) {
+        std::cout << "  " << mismatches << " frames differ from the scalar result" << std::endl;
+      }
+    }
+  }
+}
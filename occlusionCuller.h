@@ -0,0 +1,104 @@
+#pragma once
+
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "frustum.h"
+
+/**
+ * Mesh rasterized into the software depth buffer, with positions as one array per component. The bounds are those
+ * of the original mesh, which instances are tested with
+ */
+struct OccluderMesh {
+  std::vector<float> x;
+  std::vector<float> y;
+  std::vector<float> z;
+  std::vector<uint32_t> indices;
+  glm::vec3 minimum;
+  glm::vec3 maximum;
+
+  uint32_t triangleCount() const;
+};
+
+OccluderMesh simplifyOccluder(const std::vector<glm::vec3>& positions, const std::vector<uint32_t>& indices, uint32_t maxTriangles);
+
+/**
+ * Occlusion culling on the CPU. Each frame the instances nearest to the camera relative to their size are chosen as
+ * occluders and their simplified meshes rasterized into a low resolution depth buffer. Triangles are binned into tiles
+ * and each tile is rasterized a row of pixels at a time with the widest instruction set available. The bounding boxes
+ * of the frustum culled instances are then tested against the farthest depth of each tile they cover, and against
+ * the pixels of tiles which may not hide them
+ */
+class OcclusionCuller {
+ public:
+  OcclusionCuller() = delete;
+  OcclusionCuller(std::vector<OccluderMesh> meshes, uint32_t width = 256, uint32_t height = 128, uint32_t maxOccluders = 16);
+  OcclusionCuller(const OcclusionCuller& occlusionCuller) = delete;
+  ~OcclusionCuller() = default;
+
+  void addInstance(const glm::mat4& model, uint32_t meshIndex);
+  void cull(const glm::mat4& viewProjection, const glm::vec3& eye, std::vector<uint32_t>& visible);
+  void report() const;
+
+  SimdLevel simdLevel;
+  uint32_t maxOccluders;
+
+ private:
+  // Edge functions are positive inside the triangle. Depth is a plane over the screen
+  struct ScreenTriangle {
+    float edgeA[3];
+    float edgeB[3];
+    float edgeC[3];
+    float depthA;
+    float depthB;
+    float depthC;
+    int32_t minX;
+    int32_t minY;
+    int32_t maxX;
+    int32_t maxY;
+  };
+
+  struct Instance {
+    glm::mat4 model;
+    uint32_t meshIndex;
+    // World space bounding box
+    glm::vec3 minimum;
+    glm::vec3 maximum;
+  };
+
+  std::vector<OccluderMesh> meshes;
+  std::vector<Instance> instances;
+
+  uint32_t width;
+  uint32_t height;
+  uint32_t tileColumns;
+  uint32_t tileRows;
+  // Row major, cleared to the far plane
+  std::vector<float> depth;
+  // Farthest depth in each tile
+  std::vector<float> tileDepth;
+  std::vector<std::vector<uint32_t>> tileTriangles;
+
+  // Scratch space reused between frames
+  std::vector<ScreenTriangle> triangles;
+  std::vector<float> screenX;
+  std::vector<float> screenY;
+  std::vector<float> screenZ;
+  std::vector<float> clipZ;
+  std::vector<uint32_t> occluders;
+
+  uint64_t culledFrames = 0;
+  uint64_t testedTotal = 0;
+  uint64_t occludedTotal = 0;
+  uint64_t triangleTotal = 0;
+  double rasterTime = 0.0;
+  double testTime = 0.0;
+
+  void chooseOccluders(const glm::vec3& eye, const std::vector<uint32_t>& visible);
+  void setupTriangles(const OccluderMesh& mesh, const glm::mat4& modelViewProjection);
+  void rasterize();
+  bool isVisible(const Instance& instance, const glm::mat4& viewProjection) const;
+};
+
+void benchmarkOcclusion(uint32_t instanceCount);
@@ -0,0 +1,125 @@
+#include "offscreenTarget.h"
+
+#include <cstring>
+#include <stdexcept>
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <stb_image_write.h>
+
+#include "image.h"
+
+OffscreenTarget::OffscreenTarget(const VulkanContext& ctx, VkExtent2D extent, uint32_t imageCount) : ctx{ctx}, extent{extent} {
+  images.resize(imageCount);
+  imageMemory.resize(imageCount);
+
+  for (uint32_t i = 0; i < imageCount; i++) {
+    createImage(ctx, extent.width, extent.height, 1, VK_SAMPLE_COUNT_1_BIT, format, VK_IMAGE_TILING_OPTIMAL,
+                VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, images[i], imageMemory[i]);
+  }
+}
+
+// The device must be idle
+OffscreenTarget::~OffscreenTarget() {
+  for (size_t i = 0; i < images.size(); i++) {
+    vkDestroyImage(ctx.device, images[i], nullptr);
+    vkFreeMemory(ctx.device, imageMemory[i], nullptr);
+  }
+  for (size_t i = 0; i < readbackBuffers.size(); i++) {
+    vkDestroyBuffer(ctx.device, readbackBuffers[i], nullptr);
+    vkFreeMemory(ctx.device, readbackMemory[i], nullptr);
+  }
+}
+
+VkDeviceSize OffscreenTarget::imageSize() const {
+  return static_cast<VkDeviceSize>(extent.width) * extent.height * 4;
+}
+
+void OffscreenTarget::createReadbackBuffers() {
+  readbackBuffers.resize(images.size());
+  readbackMemory.resize(images.size());
+  readbackMapped.resize(images.size());
+
+  for (size_t i = 0; i < images.size(); i++) {
+    createBuffer(ctx, imageSize(), VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, readbackBuffers[i], readbackMemory[i]);
+    vkMapMemory(ctx.device, readbackMemory[i], 0, imageSize(), 0, &readbackMapped[i]);
+  }
+}
+
+/**
+ * Copy an image to its readback buffer after the render pass which wrote it, in the same or a later submission
+ */
+void OffscreenTarget::recordReadback(VkCommandBuffer commandBuffer, uint32_t index) {
+  if (readbackBuffers.empty()) {
+    createReadbackBuffers();
+  }
+
+  VkImageMemoryBarrier barrier{};
+  barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+  barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+  barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.image = images[index];
+  barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+  barrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+  vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+                       0, nullptr, 0, nullptr, 1, &barrier);
+
+  VkBufferImageCopy region{};
+  region.bufferOffset = 0;
+  // Tightly packed
+  region.bufferRowLength = 0;
+  region.bufferImageHeight = 0;
+  region.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+  region.imageOffset = {0, 0, 0};
+  region.imageExtent = {extent.width, extent.height, 1};
+
+  vkCmdCopyImageToBuffer(commandBuffer, images[index], VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, readbackBuffers[index], 1, &region);
+
+  // Make the copy visible to the host
+  VkBufferMemoryBarrier bufferBarrier{};
+  bufferBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+  bufferBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  bufferBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+  bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  bufferBarrier.buffer = readbackBuffers[index];
+  bufferBarrier.offset = 0;
+  bufferBarrier.size = VK_WHOLE_SIZE;
+
+  vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0,
+                       0, nullptr, 1, &bufferBarrier, 0, nullptr);
+}
+
+// Pixels of the last recorded readback. The submission containing it must have completed
+FrameImage OffscreenTarget::readback(uint32_t index) const {
+  FrameImage frame{extent.width, extent.height};
+  frame.pixels.resize(imageSize());
+  memcpy(frame.pixels.data(), readbackMapped[index], imageSize());
+
+  return frame;
+}
+
+/**
+ * Copy an image out once the frame rendering to it has completed. The copy is submitted after the frame on the same
+ * queue, so the barrier orders it after the attachment writes. Blocks until the pixels are on the host
+ */
+FrameImage OffscreenTarget::read(uint32_t index) {
+  VkCommandBuffer commandBuffer;
+  beginCommand(ctx, commandBuffer);
+  recordReadback(commandBuffer, index);
+  submitCommand(ctx, commandBuffer, ctx.graphicsQueue);
+
+  return readback(index);
+}
+
+void writePng(const std::string& path, const FrameImage& image) {
+  if (!stbi_write_png(path.c_str(), static_cast<int>(image.width), static_cast<int>(image.height), 4, image.pixels.data(),
+                      static_cast<int>(image.width * 4))) {
+    throw std::runtime_error("Failed to write image " + path);
+  }
+}
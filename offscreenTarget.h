@@ -0,0 +1,54 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "vulkanUtils.h"
+
+/**
+ * Pixels of a rendered frame as tightly packed RGBA8 rows, top row first
+ */
+struct FrameImage {
+  uint32_t width = 0;
+  uint32_t height = 0;
+  std::vector<uint8_t> pixels;
+};
+
+/**
+ * Color images rendered to in place of swap chain images when there is no surface. There is one image per frame in
+ * flight, so an image is free once the timeline value of its frame has been reached. The render pass leaves them in
+ * VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL to be copied out.
+ * Every image has a host-visible readback buffer. Recording the copy into the frame's own command buffer makes the
+ * pixels available as soon as the frame completes, so readback of one frame overlaps rendering of the next
+ */
+class OffscreenTarget {
+ public:
+  const VulkanContext& ctx;
+
+  // Rows map directly to FrameImage pixels
+  VkFormat format = VK_FORMAT_R8G8B8A8_SRGB;
+  VkExtent2D extent;
+  std::vector<VkImage> images;
+
+  OffscreenTarget() = delete;
+  OffscreenTarget(const VulkanContext& ctx, VkExtent2D extent, uint32_t imageCount);
+  OffscreenTarget(const OffscreenTarget& offscreenTarget) = delete;
+  ~OffscreenTarget();
+
+  void recordReadback(VkCommandBuffer commandBuffer, uint32_t index);
+  FrameImage readback(uint32_t index) const;
+  FrameImage read(uint32_t index);
+
+ private:
+  std::vector<VkDeviceMemory> imageMemory;
+
+  // Created on the first readback
+  std::vector<VkBuffer> readbackBuffers;
+  std::vector<VkDeviceMemory> readbackMemory;
+  std::vector<void*> readbackMapped;
+
+  VkDeviceSize imageSize() const;
+  void createReadbackBuffers();
+};
+
+void writePng(const std::string& path, const FrameImage& image);
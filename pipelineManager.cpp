@@ -0,0 +1,541 @@
+#include "pipelineManager.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
+#include "hash.h"
+
+bool PipelineDescription::isCompute() const {
+  return stages.size() == 1 && stages[0].stage == VK_SHADER_STAGE_COMPUTE_BIT;
+}
+
+/*----- Hashing -----*/
+
+uint64_t PipelineDescription::hash() const {
+  uint64_t hash = HASH_SEED;
+
+  for (const auto& stage : stages) {
+    hashValue(hash, stage.stage);
+    hashVector(hash, stage.code);
+  }
+
+  // Hash member by member as the Vulkan structs may contain padding
+  for (const auto& binding : bindings) {
+    hashValue(hash, binding.binding);
+    hashValue(hash, binding.stride);
+    hashValue(hash, binding.inputRate);
+  }
+  for (const auto& attribute : attributes) {
+    hashValue(hash, attribute.location);
+    hashValue(hash, attribute.binding);
+    hashValue(hash, attribute.format);
+    hashValue(hash, attribute.offset);
+  }
+
+  hashValue(hash, layout);
+  hashValue(hash, renderPassKey);
+  hashValue(hash, subpass);
+  hashVector(hash, colorFormats);
+  hashValue(hash, depthFormat);
+  hashValue(hash, samples);
+  hashValue(hash, viewMask);
+  hashValue(hash, sampleShading);
+  hashValue(hash, cullMode);
+  hashValue(hash, depthBiasConstant);
+  hashValue(hash, depthBiasSlope);
+  hashValue(hash, depthTest);
+  hashValue(hash, depthWrite);
+  hashValue(hash, depthCompareOp);
+  hashValue(hash, blendMode);
+  hashValue(hash, colorWrite);
+
+  for (const auto& entry : specializationEntries) {
+    hashValue(hash, entry.constantID);
+    hashValue(hash, entry.offset);
+    hashValue(hash, entry.size);
+  }
+  hashVector(hash, specializationData);
+
+  return hash;
+}
+
+/*--------------- PipelineManager ---------------*/
+
+PipelineManager::PipelineManager(const VulkanContext& ctx, std::string cachePath, uint32_t workerCount, DeletionQueue& deletionQueue)
+    : ctx{ctx}, cachePath{cachePath}, deletionQueue{deletionQueue} {
+  std::vector<char> cacheData = loadCacheData();
+
+  VkPipelineCacheCreateInfo cacheInfo{};
+  cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+  cacheInfo.initialDataSize = cacheData.size();
+  cacheInfo.pInitialData = cacheData.empty() ? nullptr : cacheData.data();
+
+  workerCaches.resize(workerCount);
+  for (auto& cache : workerCaches) {
+    if (vkCreatePipelineCache(ctx.device, &cacheInfo, nullptr, &cache) != VK_SUCCESS) {
+      throw std::runtime_error("Failed to create pipeline cache");
+    }
+  }
+
+  for (uint32_t i = 0; i < workerCount; i++) {
+    workers.emplace_back(&PipelineManager::workerLoop, this, i);
+  }
+}
+
+PipelineManager::~PipelineManager() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  jobAvailable.notify_all();
+  for (auto& worker : workers) {
+    worker.join();
+  }
+
+  saveCacheData();
+
+  for (auto& cache : workerCaches) {
+    vkDestroyPipelineCache(ctx.device, cache, nullptr);
+  }
+  for (const auto& entry : entries) {
+    vkDestroyPipeline(ctx.device, entry->handle->pipeline, nullptr);
+  }
+  for (auto& [hash, layout] : layouts) {
+    vkDestroyPipelineLayout(ctx.device, layout, nullptr);
+  }
+}
+
+/**
+ * Return the pipeline for a description. On a cache miss the pipeline is queued for compilation and the returned
+ * handle becomes ready later
+ */
+std::shared_ptr<PipelineHandle> PipelineManager::request(const PipelineDescription& description) {
+  uint64_t hash = description.hash();
+
+  std::lock_guard<std::mutex> lock(mutex);
+
+  auto position = pipelines.find(hash);
+  if (position != pipelines.end()) {
+    return position->second->handle;
+  }
+
+  auto entry = std::make_shared<Entry>();
+  entry->handle = std::make_shared<PipelineHandle>();
+  entry->description = description;
+  entry->hash = hash;
+  entries.push_back(entry);
+  pipelines[hash] = entry;
+
+  jobs.push_back({entry, description, entry->serial});
+  pending++;
+  jobAvailable.notify_one();
+
+  return entry->handle;
+}
+
+/**
+ * Block until the pipeline has been compiled. Used for pipelines which the renderer cannot run without
+ */
+void PipelineManager::wait(const PipelineHandle& handle) {
+  std::unique_lock<std::mutex> lock(mutex);
+  jobFinished.wait(lock, [&] { return handle.ready() || handle.failed; });
+
+  if (handle.failed) {
+    throw std::runtime_error("Failed to create graphics pipeline");
+  }
+}
+
+/**
+ * Pipeline to bind for a draw. Returns the fallback while the pipeline is compiling. VK_NULL_HANDLE means skip the draw
+ */
+VkPipeline PipelineManager::resolve(const PipelineHandle& handle, VkPipeline fallback) const {
+  return handle.ready() ? handle.pipeline.load(std::memory_order_acquire) : fallback;
+}
+
+/**
+ * Layout for the descriptor set layouts and push constants. Equal requests return the same layout. The descriptor set
+ * layouts must not be destroyed while layouts may still be requested with them, as their handles are the key
+ */
+VkPipelineLayout PipelineManager::layout(const std::vector<VkDescriptorSetLayout>& setLayouts,
+                                         const std::vector<VkPushConstantRange>& pushConstantRanges) {
+  uint64_t hash = HASH_SEED;
+  hashVector(hash, setLayouts);
+  for (const auto& range : pushConstantRanges) {
+    hashValue(hash, range.stageFlags);
+    hashValue(hash, range.offset);
+    hashValue(hash, range.size);
+  }
+
+  std::lock_guard<std::mutex> lock(mutex);
+
+  auto position = layouts.find(hash);
+  if (position != layouts.end()) {
+    return position->second;
+  }
+
+  VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+  pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+  pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(setLayouts.size());
+  pipelineLayoutInfo.pSetLayouts = setLayouts.data();
+  pipelineLayoutInfo.pushConstantRangeCount = static_cast<uint32_t>(pushConstantRanges.size());
+  pipelineLayoutInfo.pPushConstantRanges = pushConstantRanges.data();
+
+  VkPipelineLayout layout;
+  if (vkCreatePipelineLayout(ctx.device, &pipelineLayoutInfo, nullptr, &layout) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to create pipeline layout");
+  }
+  layouts[hash] = layout;
+  return layout;
+}
+
+uint32_t PipelineManager::pendingCount() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  return pending;
+}
+
+uint64_t PipelineManager::generation() const {
+  return pipelineGeneration.load(std::memory_order_acquire);
+}
+
+/*----- Hot reloading -----*/
+
+/**
+ * Recompile every pipeline with a stage which depends on one of the changed files. Handles keep returning the
+ * previous pipeline until the new one is ready. A stage which fails to compile leaves its pipelines untouched
+ */
+void PipelineManager::reload(ShaderLibrary& shaderLibrary, const std::set<std::string>& changedFiles) {
+  std::vector<std::pair<std::shared_ptr<Entry>, PipelineDescription>> affected;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const auto& entry : entries) {
+      if (std::any_of(entry->description.stages.begin(), entry->description.stages.end(),
+                      [&](const auto& stage) { return shaderLibrary.dependsOn(stage.source, changedFiles); })) {
+        affected.emplace_back(entry, entry->description);
+      }
+    }
+  }
+
+  // Compile outside the lock so that requests and finishing workers are not blocked by shaderc
+  std::vector<std::pair<std::shared_ptr<Entry>, PipelineDescription>> reloaded;
+  for (auto& [entry, description] : affected) {
+    uint64_t previousHash = description.hash();
+    try {
+      for (auto& stage : description.stages) {
+        stage = shaderLibrary.load(stage.source, stage.stage, stage.defines);
+      }
+    } catch (const std::exception& e) {
+      std::cerr << e.what() << std::endl;
+      continue;
+    }
+
+    if (description.hash() != previousHash) {
+      reloaded.emplace_back(entry, std::move(description));
+    }
+  }
+
+  std::lock_guard<std::mutex> lock(mutex);
+  for (auto& [entry, description] : reloaded) {
+    // Supersede reloads of the same handle which no worker has started yet
+    pending -= static_cast<uint32_t>(std::erase_if(jobs, [&](const Job& job) { return job.entry == entry; }));
+
+    entry->serial++;
+    jobs.push_back({entry, std::move(description), entry->serial});
+    pending++;
+  }
+
+  jobAvailable.notify_all();
+}
+
+void PipelineManager::workerLoop(uint32_t workerIndex) {
+  while (true) {
+    Job job;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      jobAvailable.wait(lock, [&] { return stopping || !jobs.empty(); });
+      if (stopping) {
+        return;
+      }
+      job = std::move(jobs.front());
+      jobs.pop_front();
+    }
+
+    // vkCreateGraphicsPipelines is free-threaded. Only the cache needs external synchronization
+    VkPipeline pipeline = VK_NULL_HANDLE;
+    try {
+      pipeline = compile(job.description, workerCaches[workerIndex]);
+    } catch (const std::exception& e) {
+      std::cerr << e.what() << std::endl;
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      pending--;
+      Entry& entry = *job.entry;
+
+      if (job.serial != entry.serial) {
+        // Superseded by a newer reload while compiling. The pipeline was never published
+        if (pipeline != VK_NULL_HANDLE) {
+          vkDestroyPipeline(ctx.device, pipeline, nullptr);
+        }
+      } else if (pipeline == VK_NULL_HANDLE) {
+        // A failed reload keeps the previous pipeline
+        entry.handle->failed = !entry.handle->ready();
+      } else {
+        // Command buffers recorded before the swap may still reference the previous pipeline
+        VkPipeline previous = entry.handle->pipeline.exchange(pipeline, std::memory_order_acq_rel);
+        entry.handle->failed = false;
+        pipelineGeneration++;
+
+        if (previous != VK_NULL_HANDLE) {
+          deletionQueue.push([device = ctx.device, previous] { vkDestroyPipeline(device, previous, nullptr); });
+          std::cout << "Reloaded pipeline" << std::endl;
+        }
+
+        uint64_t hash = job.description.hash();
+        if (hash != entry.hash) {
+          auto position = pipelines.find(entry.hash);
+          if (position != pipelines.end() && position->second == job.entry) {
+            pipelines.erase(position);
+          }
+          // Another handle may already own the new hash. Requests keep receiving that one
+          pipelines.emplace(hash, job.entry);
+          entry.hash = hash;
+          entry.description = std::move(job.description);
+        }
+      }
+    }
+    jobFinished.notify_all();
+  }
+}
+
+/*----- Compilation -----*/
+
+VkPipeline PipelineManager::compile(const PipelineDescription& description, VkPipelineCache cache) {
+  // ----- Shader stages -----
+  VkSpecializationInfo specializationInfo{};
+  specializationInfo.mapEntryCount = static_cast<uint32_t>(description.specializationEntries.size());
+  specializationInfo.pMapEntries = description.specializationEntries.data();
+  specializationInfo.dataSize = description.specializationData.size();
+  specializationInfo.pData = description.specializationData.data();
+
+  std::vector<VkShaderModule> shaderModules;
+  std::vector<VkPipelineShaderStageCreateInfo> shaderStages;
+  for (const auto& stage : description.stages) {
+    shaderModules.push_back(createShaderModule(ctx, stage.code));
+
+    VkPipelineShaderStageCreateInfo shaderStageInfo{};
+    shaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    shaderStageInfo.stage = stage.stage;
+    shaderStageInfo.module = shaderModules.back();
+    // Specify the entrypoint
+    shaderStageInfo.pName = "main";
+    shaderStageInfo.pSpecializationInfo = description.specializationEntries.empty() ? nullptr : &specializationInfo;
+    shaderStages.push_back(shaderStageInfo);
+  }
+
+  // ----- Compute pipeline -----
+  if (description.isCompute()) {
+    VkComputePipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage = shaderStages[0];
+    pipelineInfo.layout = description.layout;
+
+    VkPipeline pipeline;
+    VkResult result = vkCreateComputePipelines(ctx.device, cache, 1, &pipelineInfo, nullptr, &pipeline);
+    vkDestroyShaderModule(ctx.device, shaderModules[0], nullptr);
+
+    if (result != VK_SUCCESS) {
+      throw std::runtime_error("Failed to create compute pipeline");
+    }
+    return pipeline;
+  }
+
+  // ----- Specify which stages will be provided during draw -----
+  std::vector<VkDynamicState> dynamicStates = {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
+
+  VkPipelineDynamicStateCreateInfo dynamicState{};
+  dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+  dynamicState.dynamicStateCount = dynamicStates.size();
+  dynamicState.pDynamicStates = dynamicStates.data();
+
+  // ----- Specify vertex format -----
+  VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
+  vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+  vertexInputInfo.vertexBindingDescriptionCount = static_cast<uint32_t>(description.bindings.size());
+  vertexInputInfo.pVertexBindingDescriptions = description.bindings.data();
+  vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(description.attributes.size());
+  vertexInputInfo.pVertexAttributeDescriptions = description.attributes.data();
+
+  // ----- Input assembly -----
+  VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
+  inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+  inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+  inputAssembly.primitiveRestartEnable = VK_FALSE;
+
+  VkPipelineViewportStateCreateInfo viewportState{};
+  viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+  viewportState.viewportCount = 1;
+  viewportState.scissorCount = 1;
+
+  // ----- Rasterizer -----
+  VkPipelineRasterizationStateCreateInfo rasterizer{};
+  rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+  // Discard fragments beyond the near and far planes instead of clamping them
+  rasterizer.depthClampEnable = VK_FALSE;
+  rasterizer.rasterizerDiscardEnable = VK_FALSE;
+  // Fill, wireframe or point
+  rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
+  rasterizer.lineWidth = 1.0f;
+
+  rasterizer.cullMode = description.cullMode;
+  rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+
+  rasterizer.depthBiasEnable = description.depthBiasConstant != 0.0f || description.depthBiasSlope != 0.0f ? VK_TRUE : VK_FALSE;
+  rasterizer.depthBiasConstantFactor = description.depthBiasConstant;
+  rasterizer.depthBiasSlopeFactor = description.depthBiasSlope;
+
+  // ----- Multisampling -----
+  VkPipelineMultisampleStateCreateInfo multisampling{};
+  multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+  multisampling.rasterizationSamples = description.samples;
+  multisampling.sampleShadingEnable = description.sampleShading ? VK_TRUE : VK_FALSE;
+  multisampling.minSampleShading = 0.2f;  // min fraction for sample shading; closer to one is smoother
+
+  // ----- Blending -----
+  VkPipelineColorBlendAttachmentState colorBlendAttachment{};
+  colorBlendAttachment.colorWriteMask = !description.colorWrite ? 0 :
+      VK_COLOR_COMPONENT_R_BIT |
+      VK_COLOR_COMPONENT_G_BIT |
+      VK_COLOR_COMPONENT_B_BIT |
+      VK_COLOR_COMPONENT_A_BIT;
+
+  if (description.blendMode == BlendMode::Additive) {
+    colorBlendAttachment.blendEnable = VK_TRUE;
+    colorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_ONE;
+    colorBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE;
+    colorBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
+    colorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+    colorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+    colorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
+  } else {
+    colorBlendAttachment.blendEnable = VK_FALSE;
+  }
+
+  std::vector<VkPipelineColorBlendAttachmentState> colorBlendAttachments(description.colorFormats.size(), colorBlendAttachment);
+
+  VkPipelineColorBlendStateCreateInfo colorBlending{};
+  colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+  colorBlending.logicOpEnable = VK_FALSE;
+  colorBlending.attachmentCount = static_cast<uint32_t>(colorBlendAttachments.size());
+  colorBlending.pAttachments = colorBlendAttachments.data();
+
+  // ----- Depth -----
+  VkPipelineDepthStencilStateCreateInfo depthStencil{};
+  depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+  depthStencil.depthTestEnable = description.depthTest ? VK_TRUE : VK_FALSE;
+  depthStencil.depthWriteEnable = description.depthWrite ? VK_TRUE : VK_FALSE;
+  depthStencil.depthCompareOp = description.depthCompareOp;
+  depthStencil.depthBoundsTestEnable = VK_FALSE;
+  depthStencil.minDepthBounds = 0.0f;
+  depthStencil.maxDepthBounds = 1.0f;
+  depthStencil.stencilTestEnable = VK_FALSE;
+
+  // ----- Create pipeline ----
+  VkGraphicsPipelineCreateInfo pipelineInfo{};
+  pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+  pipelineInfo.stageCount = static_cast<uint32_t>(shaderStages.size());
+  pipelineInfo.pStages = shaderStages.data();
+
+  pipelineInfo.pVertexInputState = &vertexInputInfo;
+  pipelineInfo.pInputAssemblyState = &inputAssembly;
+  pipelineInfo.pViewportState = &viewportState;
+  pipelineInfo.pRasterizationState = &rasterizer;
+  pipelineInfo.pMultisampleState = &multisampling;
+  pipelineInfo.pDepthStencilState = description.depthFormat == VK_FORMAT_UNDEFINED ? nullptr : &depthStencil;
+  pipelineInfo.pColorBlendState = &colorBlending;
+  pipelineInfo.pDynamicState = &dynamicState;
+
+  pipelineInfo.layout = description.layout;
+
+  pipelineInfo.renderPass = description.renderPass;
+  pipelineInfo.subpass = description.subpass;
+
+  VkPipeline pipeline;
+  VkResult result = vkCreateGraphicsPipelines(ctx.device, cache, 1, &pipelineInfo, nullptr, &pipeline);
+
+  // Can be destroyed after pipeline creation
+  for (auto shaderModule : shaderModules) {
+    vkDestroyShaderModule(ctx.device, shaderModule, nullptr);
+  }
+
+  if (result != VK_SUCCESS) {
+    throw std::runtime_error("Failed to create graphics pipeline");
+  }
+
+  return pipeline;
+}
+
+/*----- Cache persistence -----*/
+
+/**
+ * Read a previously saved cache. Data from a different driver or device is discarded
+ */
+std::vector<char> PipelineManager::loadCacheData() {
+  std::ifstream file(cachePath, std::ios::ate | std::ios::binary);
+  if (!file.is_open()) {
+    return {};
+  }
+
+  size_t fileSize = (size_t)file.tellg();
+  std::vector<char> data(fileSize);
+  file.seekg(0);
+  file.read(data.data(), fileSize);
+
+  // VkPipelineCacheHeaderVersionOne: header size, header version, vendor ID, device ID, pipeline cache UUID
+  const size_t headerSize = 16 + VK_UUID_SIZE;
+  if (data.size() < headerSize) {
+    return {};
+  }
+
+  uint32_t header[4];
+  memcpy(header, data.data(), sizeof(header));
+
+  VkPhysicalDeviceProperties properties{};
+  vkGetPhysicalDeviceProperties(ctx.physicalDevice, &properties);
+
+  if (header[1] != VK_PIPELINE_CACHE_HEADER_VERSION_ONE ||
+      header[2] != properties.vendorID ||
+      header[3] != properties.deviceID ||
+      memcmp(data.data() + 16, properties.pipelineCacheUUID, VK_UUID_SIZE) != 0) {
+    std::cout << "Discarding pipeline cache from a different device or driver" << std::endl;
+    return {};
+  }
+
+  return data;
+}
+
+void PipelineManager::saveCacheData() {
+  if (workerCaches.empty()) {
+    return;
+  }
+
+  VkPipelineCache mergedCache = workerCaches[0];
+  if (workerCaches.size() > 1) {
+    vkMergePipelineCaches(ctx.device, mergedCache, static_cast<uint32_t>(workerCaches.size() - 1), workerCaches.data() + 1);
+  }
+
+  size_t dataSize{};
+  vkGetPipelineCacheData(ctx.device, mergedCache, &dataSize, nullptr);
+  std::vector<char> data(dataSize);
+  vkGetPipelineCacheData(ctx.device, mergedCache, &dataSize, data.data());
+
+  std::ofstream file(cachePath, std::ios::binary);
+  if (!file.is_open()) {
+    std::cerr << "Failed to write pipeline cache " << cachePath << std::endl;
+    return;
+  }
+  file.write(data.data(), dataSize);
+}
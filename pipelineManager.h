@@ -0,0 +1,154 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "deletionQueue.h"
+#include "shaderLibrary.h"
+#include "vulkanUtils.h"
+
+enum class BlendMode {
+  Opaque,
+  Additive
+};
+
+/**
+ * Everything which affects a compiled graphics pipeline. Render pass compatibility is described by a key computed
+ * from the render pass create info so that a recreated but compatible render pass reuses cached pipelines.
+ * A description with a single compute stage creates a compute pipeline from the stage, layout and specialization
+ */
+struct PipelineDescription {
+  std::vector<ShaderStage> stages;
+
+  std::vector<VkVertexInputBindingDescription> bindings;
+  std::vector<VkVertexInputAttributeDescription> attributes;
+
+  // Created by PipelineManager::layout, which keeps one layout per set of descriptor set layouts and push constants
+  // alive as long as the manager. The handle therefore identifies the layout in the hash
+  VkPipelineLayout layout = VK_NULL_HANDLE;
+
+  // Only used for creation, not part of the hash. Pipelines are shared by all render passes with the same key
+  VkRenderPass renderPass = VK_NULL_HANDLE;
+  // hashRenderPassCompatibility of the render pass: formats, samples and references of every subpass and view masks
+  uint64_t renderPassKey = 0;
+  uint32_t subpass = 0;
+  std::vector<VkFormat> colorFormats;
+  VkFormat depthFormat = VK_FORMAT_UNDEFINED;
+
+  VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT;
+  // Views rendered by a multiview subpass. 0 without multiview
+  uint32_t viewMask = 0;
+  bool sampleShading = false;
+
+  VkCullModeFlags cullMode = VK_CULL_MODE_BACK_BIT;
+  // Pushes depth away from the light in shadow passes. Disabled when both are 0
+  float depthBiasConstant = 0.0f;
+  float depthBiasSlope = 0.0f;
+
+  bool depthTest = true;
+  bool depthWrite = true;
+  VkCompareOp depthCompareOp = VK_COMPARE_OP_LESS;
+
+  BlendMode blendMode = BlendMode::Opaque;
+  // Off for depth only passes in a subpass with color attachments
+  bool colorWrite = true;
+
+  // Shared by all stages
+  std::vector<VkSpecializationMapEntry> specializationEntries;
+  std::vector<uint8_t> specializationData;
+
+  bool isCompute() const;
+  uint64_t hash() const;
+};
+
+/**
+ * Pipeline which becomes ready once a worker thread has compiled it
+ */
+struct PipelineHandle {
+  std::atomic<VkPipeline> pipeline{VK_NULL_HANDLE};
+  std::atomic<bool> failed{false};
+
+  bool ready() const {
+    return pipeline.load(std::memory_order_acquire) != VK_NULL_HANDLE;
+  }
+};
+
+/**
+ * Deduplicates pipelines by the hash of their description and compiles misses on worker threads.
+ * Every worker owns a VkPipelineCache so that no cache is accessed by more than one thread at a time.
+ * The caches are merged and written to disk on destruction.
+ * Pipelines replaced by a reload are retired through the deletion queue. Every handle has at most one reload in flight:
+ * a newer reload supersedes queued ones and the result of an older one still compiling is discarded
+ */
+class PipelineManager {
+ public:
+  const VulkanContext& ctx;
+
+  PipelineManager() = delete;
+  PipelineManager(const VulkanContext& ctx, std::string cachePath, uint32_t workerCount, DeletionQueue& deletionQueue);
+  PipelineManager(const PipelineManager& pipelineManager) = delete;
+  ~PipelineManager();
+
+  std::shared_ptr<PipelineHandle> request(const PipelineDescription& description);
+  void wait(const PipelineHandle& handle);
+  VkPipeline resolve(const PipelineHandle& handle, VkPipeline fallback) const;
+  uint32_t pendingCount() const;
+  uint64_t generation() const;
+
+  VkPipelineLayout layout(const std::vector<VkDescriptorSetLayout>& setLayouts,
+                          const std::vector<VkPushConstantRange>& pushConstantRanges = {});
+
+  void reload(ShaderLibrary& shaderLibrary, const std::set<std::string>& changedFiles);
+
+ private:
+  /**
+   * A handle and the description its current pipeline was compiled from. Owns the pipeline of the handle
+   */
+  struct Entry {
+    std::shared_ptr<PipelineHandle> handle;
+    PipelineDescription description;
+    uint64_t hash;
+    // Serial of the newest job queued for the handle. Only its result is installed
+    uint64_t serial = 0;
+  };
+
+  struct Job {
+    std::shared_ptr<Entry> entry;
+    PipelineDescription description;
+    uint64_t serial;
+  };
+
+  std::string cachePath;
+  DeletionQueue& deletionQueue;
+  std::vector<VkPipelineCache> workerCaches;
+  std::vector<std::thread> workers;
+
+  std::vector<std::shared_ptr<Entry>> entries;
+  // Entries by the hash of their current description
+  std::unordered_map<uint64_t, std::shared_ptr<Entry>> pipelines;
+  std::deque<Job> jobs;
+  // By the hash of their descriptor set layout handles and push constant ranges
+  std::unordered_map<uint64_t, VkPipelineLayout> layouts;
+
+  uint32_t pending = 0;
+  // Incremented whenever a handle receives a new pipeline so that recorded command buffers can be invalidated
+  std::atomic<uint64_t> pipelineGeneration{0};
+  bool stopping = false;
+
+  mutable std::mutex mutex;
+  std::condition_variable jobAvailable;
+  std::condition_variable jobFinished;
+
+  void workerLoop(uint32_t workerIndex);
+  VkPipeline compile(const PipelineDescription& description, VkPipelineCache cache);
+  std::vector<char> loadCacheData();
+  void saveCacheData();
+};
@@ -0,0 +1,863 @@
+#include "renderGraph.h"
+
+#include <algorithm>
+#include <iostream>
+#include <optional>
+#include <stdexcept>
+
+#include "image.h"
+
+// Memory type with all of the properties which the image can be bound to, if there is one
+static std::optional<uint32_t> findImageMemoryType(VkPhysicalDevice physicalDevice, uint32_t typeBits, VkMemoryPropertyFlags properties) {
+  VkPhysicalDeviceMemoryProperties memProperties;
+  vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
+
+  for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
+    if ((typeBits & (1u << i)) && (memProperties.memoryTypes[i].propertyFlags & properties) == properties) {
+      return i;
+    }
+  }
+  return std::nullopt;
+}
+
+static VkImageUsageFlags usageOf(ImageAccess access) {
+  switch (access) {
+    case ImageAccess::ColorAttachment:
+      return VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+    case ImageAccess::DepthAttachment:
+      return VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+    case ImageAccess::DepthSampled:
+    case ImageAccess::ShaderSampled:
+      return VK_IMAGE_USAGE_SAMPLED_BIT;
+    case ImageAccess::TransferSource:
+      return VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+    case ImageAccess::TransferDestination:
+      return VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    default:
+      return 0;
+  }
+}
+
+RenderGraph::RenderGraph(const VulkanContext& ctx, DeletionQueue& deletionQueue) : ctx{ctx}, deletionQueue{deletionQueue} {}
+
+// The device must be idle
+RenderGraph::~RenderGraph() {
+  for (auto& pass : passes) {
+    for (auto framebuffer : pass.framebuffers) {
+      vkDestroyFramebuffer(ctx.device, framebuffer, nullptr);
+    }
+    if (pass.renderPass != VK_NULL_HANDLE) {
+      vkDestroyRenderPass(ctx.device, pass.renderPass, nullptr);
+    }
+  }
+  for (auto& resource : resources) {
+    if (resource.imported) {
+      continue;
+    }
+    for (auto view : resource.views) {
+      vkDestroyImageView(ctx.device, view, nullptr);
+    }
+    for (auto image : resource.images) {
+      vkDestroyImage(ctx.device, image, nullptr);
+    }
+  }
+  for (auto& block : memoryBlocks) {
+    vkFreeMemory(ctx.device, block.memory, nullptr);
+  }
+}
+
+/*----- Declaration -----*/
+
+RenderGraph::Resource RenderGraph::createImage(const std::string& name, VkFormat format, VkSampleCountFlagBits samples,
+                                               VkImageAspectFlags aspect) {
+  resources.push_back({name, format, samples, aspect, false, ImageAccess::Undefined});
+  return static_cast<Resource>(resources.size() - 1);
+}
+
+/**
+ * Image owned elsewhere, such as the swap chain images. Left in the final access after the frame, and written over
+ * unless the first pass using it loads it
+ */
+RenderGraph::Resource RenderGraph::importImage(const std::string& name, VkFormat format, VkImageAspectFlags aspect,
+                                               ImageAccess finalAccess) {
+  resources.push_back({name, format, VK_SAMPLE_COUNT_1_BIT, aspect, true, finalAccess});
+  return static_cast<Resource>(resources.size() - 1);
+}
+
+// Passes with inputs begin in their first subpass. Their record function moves on to the second
+RenderGraph::Pass RenderGraph::addRasterPass(const std::string& name, const RasterPassDescription& description, RecordFunction record) {
+  std::vector<ImageUse> uses;
+  if (description.color.resource != NONE) {
+    uses.push_back({description.color.resource, ImageAccess::ColorAttachment});
+  }
+  if (description.depth.resource != NONE) {
+    uses.push_back({description.depth.resource, ImageAccess::DepthAttachment});
+  }
+  if (description.resolve != NONE) {
+    uses.push_back({description.resolve, ImageAccess::ColorAttachment});
+  }
+  for (const auto& input : description.inputs) {
+    uses.push_back({input.resource, ImageAccess::ColorAttachment});
+  }
+
+  PassData pass{name, true, description, std::move(uses), false, std::move(record)};
+  passes.push_back(std::move(pass));
+  return static_cast<Pass>(passes.size() - 1);
+}
+
+/**
+ * Pass recorded outside a render pass. Passes with side effects, such as writing buffers the graph does not track,
+ * are never culled
+ */
+RenderGraph::Pass RenderGraph::addPass(const std::string& name, std::vector<ImageUse> uses, bool sideEffects, RecordFunction record) {
+  PassData pass{name, false, {}, std::move(uses), sideEffects, std::move(record)};
+  passes.push_back(std::move(pass));
+  return static_cast<Pass>(passes.size() - 1);
+}
+
+// Render passes are recorded inline unless their draws are executed from secondary command buffers
+void RenderGraph::setSubpassContents(Pass pass, VkSubpassContents contents) {
+  passes[pass].contents = contents;
+}
+
+/*----- Compilation -----*/
+
+/**
+ * Cull the passes, collect the uses of each image and plan the alias groups and barriers. Needs no device, so the
+ * plan can be inspected without creating anything
+ */
+void RenderGraph::plan() {
+  if (planned) {
+    throw std::runtime_error("Failed to plan render graph: already planned");
+  }
+
+  cullPasses();
+  collectUses();
+  assignAliasGroups();
+  planBarriers();
+  planned = true;
+}
+
+// Plans the graph if that was not done yet and creates the render passes
+void RenderGraph::compile() {
+  if (compiled) {
+    throw std::runtime_error("Failed to compile render graph: already compiled");
+  }
+
+  if (!planned) {
+    plan();
+  }
+  for (Pass p = 0; p < passes.size(); p++) {
+    if (passes[p].raster && !passes[p].culled) {
+      createRenderPass(p);
+    }
+  }
+  compiled = true;
+}
+
+// Images used by a pass in the order of its attachments, with whether the pass reads their previous contents
+std::vector<std::pair<RenderGraph::Resource, RenderGraph::Use>> RenderGraph::usesOf(Pass pass) const {
+  const PassData& data = passes[pass];
+  std::vector<std::pair<Resource, Use>> uses;
+
+  if (data.raster) {
+    const RasterPassDescription& description = data.description;
+    if (description.color.resource != NONE) {
+      uses.push_back({description.color.resource, {pass, ImageAccess::ColorAttachment, !description.color.clear, true, true}});
+    }
+    if (description.depth.resource != NONE) {
+      uses.push_back({description.depth.resource, {pass, ImageAccess::DepthAttachment, !description.depth.clear, true, true}});
+    }
+    if (description.resolve != NONE) {
+      uses.push_back({description.resolve, {pass, ImageAccess::ColorAttachment, false, true, true}});
+    }
+    for (const auto& input : description.inputs) {
+      uses.push_back({input.resource, {pass, ImageAccess::ColorAttachment, !input.clear, true, true}});
+    }
+    return uses;
+  }
+
+  for (const auto& use : data.uses) {
+    bool writes = accessWrites(use.access);
+    // Transfer destinations are written over as a whole
+    bool reads = use.access != ImageAccess::TransferDestination && use.access != ImageAccess::Undefined;
+    uses.push_back({use.resource, {pass, use.access, reads, writes, false}});
+  }
+  return uses;
+}
+
+/**
+ * Walk the passes backwards from the imported images, which are the results of the frame. A pass is kept if it has
+ * side effects or writes an image which a later kept pass reads. Earlier writers of images which a kept pass writes
+ * over without reading are not needed for it
+ */
+void RenderGraph::cullPasses() {
+  std::vector<bool> needed(resources.size());
+  for (size_t i = 0; i < resources.size(); i++) {
+    needed[i] = resources[i].imported;
+  }
+
+  for (Pass p = static_cast<Pass>(passes.size()); p-- > 0;) {
+    auto uses = usesOf(p);
+
+    bool alive = passes[p].sideEffects;
+    for (const auto& [resource, use] : uses) {
+      alive |= use.writes && needed[resource];
+    }
+    passes[p].culled = !alive;
+    if (!alive) {
+      continue;
+    }
+
+    for (const auto& [resource, use] : uses) {
+      if (use.writes && !use.reads) {
+        needed[resource] = false;
+      }
+    }
+    for (const auto& [resource, use] : uses) {
+      if (use.reads) {
+        needed[resource] = true;
+      }
+    }
+  }
+}
+
+/**
+ * Record the uses of each image by the kept passes and derive its usage. An image used only as an attachment of one
+ * render pass, which neither loads nor stores it, is transient
+ */
+void RenderGraph::collectUses() {
+  for (Pass p = 0; p < passes.size(); p++) {
+    if (passes[p].culled) {
+      continue;
+    }
+    for (const auto& [resource, use] : usesOf(p)) {
+      resources[resource].uses.push_back(use);
+      resources[resource].usage |= usageOf(use.access);
+    }
+
+    // The second subpass reads the inputs and the depth at its own pixel
+    const RasterPassDescription& description = passes[p].description;
+    for (const auto& input : description.inputs) {
+      resources[input.resource].usage |= VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT;
+    }
+    if (!description.inputs.empty()) {
+      resources[description.depth.resource].usage |= VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT;
+    }
+  }
+
+  for (auto& resource : resources) {
+    resource.transient = !resource.imported && resource.uses.size() == 1 && resource.uses[0].attachment && !resource.uses[0].reads;
+    if (resource.transient) {
+      resource.usage |= VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+    }
+  }
+}
+
+/**
+ * Group the images created by the graph into sets whose lifetimes, from the first to the last pass using them, do
+ * not overlap. Each set is bound to the same memory. Images loaded before they are written keep their contents
+ * between frames and are not aliased. Transient images are grouped separately, as only they can be bound to lazily
+ * allocated memory
+ */
+void RenderGraph::assignAliasGroups() {
+  struct Group {
+    bool transient;
+    std::vector<std::pair<Pass, Pass>> lifetimes;
+  };
+  std::vector<Group> groups;
+
+  for (auto& resource : resources) {
+    if (resource.imported || resource.uses.empty() || resource.uses[0].reads) {
+      continue;
+    }
+    Pass first = resource.uses.front().pass;
+    Pass last = resource.uses.back().pass;
+
+    auto fits = [&](const Group& group) {
+      if (group.transient != resource.transient) {
+        return false;
+      }
+      return std::all_of(group.lifetimes.begin(), group.lifetimes.end(),
+                         [&](const auto& lifetime) { return lifetime.second < first || lifetime.first > last; });
+    };
+    auto group = std::find_if(groups.begin(), groups.end(), fits);
+    if (group == groups.end()) {
+      groups.push_back({resource.transient, {}});
+      group = groups.end() - 1;
+    }
+    group->lifetimes.push_back({first, last});
+    resource.aliasGroup = static_cast<uint32_t>(group - groups.begin());
+  }
+}
+
+/**
+ * What a use of an image has to wait for. The first use in a frame waits for the last use in the previous frame, and
+ * for the last uses of the images sharing its memory
+ */
+RenderGraph::Source RenderGraph::sourceOf(Resource resource, uint32_t useIndex) const {
+  const ResourceData& data = resources[resource];
+
+  if (useIndex > 0) {
+    ImageAccessInfo previous = imageAccessInfo(data.uses[useIndex - 1].access);
+    return {previous.stages, writeAccess(previous.access), layoutAfter(resource, useIndex - 1)};
+  }
+
+  bool loads = data.uses[0].reads;
+  if (data.imported) {
+    ImageAccessInfo final = imageAccessInfo(data.finalAccess);
+    return {final.stages, writeAccess(final.access), loads ? final.layout : VK_IMAGE_LAYOUT_UNDEFINED};
+  }
+
+  ImageAccessInfo last = imageAccessInfo(data.uses.back().access);
+  Source source{last.stages, writeAccess(last.access),
+                loads ? layoutAfter(resource, static_cast<uint32_t>(data.uses.size() - 1)) : VK_IMAGE_LAYOUT_UNDEFINED};
+
+  if (data.aliasGroup != NONE) {
+    for (const auto& other : resources) {
+      if (other.aliasGroup == data.aliasGroup && other.transient == data.transient && !other.uses.empty()) {
+        ImageAccessInfo otherLast = imageAccessInfo(other.uses.back().access);
+        source.stages |= otherLast.stages;
+        source.access |= writeAccess(otherLast.access);
+      }
+    }
+  }
+  return source;
+}
+
+// Render passes transition their attachments into the layout of the next use, so that it needs no barrier
+VkImageLayout RenderGraph::layoutAfter(Resource resource, uint32_t useIndex) const {
+  const ResourceData& data = resources[resource];
+  const Use& use = data.uses[useIndex];
+
+  if (!use.attachment) {
+    return imageAccessInfo(use.access).layout;
+  }
+  if (useIndex + 1 < data.uses.size()) {
+    return imageAccessInfo(data.uses[useIndex + 1].access).layout;
+  }
+  return imageAccessInfo(data.imported ? data.finalAccess : use.access).layout;
+}
+
+/**
+ * Attachments are loaded if earlier uses wrote them and stored if later uses read them. The dependency into the
+ * render pass waits for the uses before it which were not in a render pass, whose own outgoing dependency covers
+ * this one. The dependency out of it makes the attachments visible to the uses after it. Passes with inputs have a
+ * second subpass which reads them at its own pixel, so that tiled GPUs keep them in tile memory
+ */
+void RenderGraph::createRenderPass(Pass p) {
+  PassData& pass = passes[p];
+  const RasterPassDescription& description = pass.description;
+  uint32_t subpassCount = description.inputs.empty() ? 1 : 2;
+  uint32_t lastSubpass = subpassCount - 1;
+
+  std::vector<VkAttachmentDescription> attachments;
+  std::vector<VkAttachmentReference> references;
+
+  // Into the subpass which first uses each attachment
+  std::vector<VkSubpassDependency> incoming(subpassCount);
+  for (uint32_t i = 0; i < subpassCount; i++) {
+    incoming[i].srcSubpass = VK_SUBPASS_EXTERNAL;
+    incoming[i].dstSubpass = i;
+  }
+  VkSubpassDependency outgoing{};
+  outgoing.srcSubpass = lastSubpass;
+  outgoing.dstSubpass = VK_SUBPASS_EXTERNAL;
+
+  std::vector<Attachment> declared;
+  if (description.color.resource != NONE) {
+    declared.push_back(description.color);
+  }
+  if (description.depth.resource != NONE) {
+    declared.push_back(description.depth);
+  }
+  if (description.resolve != NONE) {
+    declared.push_back({description.resolve, false, {}});
+  }
+  declared.insert(declared.end(), description.inputs.begin(), description.inputs.end());
+
+  for (const auto& [resource, clear, clearValue] : declared) {
+    const ResourceData& data = resources[resource];
+    uint32_t useIndex = 0;
+    while (data.uses[useIndex].pass != p) {
+      useIndex++;
+    }
+    const Use& use = data.uses[useIndex];
+    bool hasNext = useIndex + 1 < data.uses.size();
+    ImageAccessInfo info = imageAccessInfo(use.access);
+    // The color and resolve attachments are written by the last subpass, the depth and inputs by the first
+    bool lastOnly = resource == description.color.resource || resource == description.resolve;
+    VkSubpassDependency& into = incoming[lastOnly ? lastSubpass : 0];
+
+    VkAttachmentDescription attachment{};
+    attachment.format = data.format;
+    attachment.samples = data.samples;
+    attachment.loadOp = clear ? VK_ATTACHMENT_LOAD_OP_CLEAR : use.reads ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    // Images loaded at the start of the frame keep their contents to the next
+    attachment.storeOp = hasNext || data.imported || data.uses[0].reads ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    attachment.initialLayout = use.reads ? sourceOf(resource, useIndex).layout : VK_IMAGE_LAYOUT_UNDEFINED;
+    attachment.finalLayout = layoutAfter(resource, useIndex);
+
+    references.push_back({static_cast<uint32_t>(attachments.size()), info.layout});
+    attachments.push_back(attachment);
+    pass.attachments.push_back(resource);
+    pass.clearValues.push_back(clearValue);
+
+    if (useIndex == 0 || !data.uses[useIndex - 1].attachment) {
+      Source source = sourceOf(resource, useIndex);
+      into.srcStageMask |= source.stages;
+      into.srcAccessMask |= source.access;
+    }
+    into.dstStageMask |= info.stages;
+    into.dstAccessMask |= info.access;
+
+    ImageAccessInfo next{};
+    if (hasNext) {
+      next = imageAccessInfo(data.uses[useIndex + 1].access);
+    } else if (data.imported) {
+      next = imageAccessInfo(data.finalAccess);
+    }
+    if (next.stages != 0) {
+      outgoing.srcStageMask |= info.stages;
+      outgoing.srcAccessMask |= writeAccess(info.access);
+      outgoing.dstStageMask |= next.stages;
+      outgoing.dstAccessMask |= next.access;
+    }
+  }
+
+  std::vector<VkSubpassDescription> subpasses(subpassCount);
+  for (auto& subpass : subpasses) {
+    subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+  }
+  uint32_t next = 0;
+  const VkAttachmentReference* colorReference = nullptr;
+  const VkAttachmentReference* depthReference = nullptr;
+  const VkAttachmentReference* resolveReference = nullptr;
+  if (description.color.resource != NONE) {
+    colorReference = &references[next++];
+  }
+  if (description.depth.resource != NONE) {
+    depthReference = &references[next++];
+  }
+  if (description.resolve != NONE) {
+    resolveReference = &references[next++];
+  }
+
+  VkSubpassDescription& shading = subpasses[lastSubpass];
+  shading.colorAttachmentCount = colorReference != nullptr ? 1 : 0;
+  shading.pColorAttachments = colorReference;
+  shading.pResolveAttachments = resolveReference;
+
+  // The inputs are written as colors by the first subpass and read in the second, followed by the depth
+  std::vector<VkAttachmentReference> inputReferences;
+  if (subpassCount > 1) {
+    for (uint32_t i = next; i < references.size(); i++) {
+      inputReferences.push_back({references[i].attachment, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL});
+    }
+    inputReferences.push_back({depthReference->attachment, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL});
+    shading.inputAttachmentCount = static_cast<uint32_t>(inputReferences.size());
+    shading.pInputAttachments = inputReferences.data();
+
+    subpasses[0].colorAttachmentCount = static_cast<uint32_t>(references.size() - next);
+    subpasses[0].pColorAttachments = &references[next];
+    subpasses[0].pDepthStencilAttachment = depthReference;
+  } else {
+    shading.pDepthStencilAttachment = depthReference;
+  }
+
+  std::vector<VkSubpassDependency> dependencies;
+  for (const auto& dependency : incoming) {
+    if (dependency.srcStageMask != 0) {
+      dependencies.push_back(dependency);
+    }
+  }
+  if (subpassCount > 1) {
+    // Each pixel only reads what the first subpass wrote at the same pixel
+    VkSubpassDependency inputs{};
+    inputs.srcSubpass = 0;
+    inputs.dstSubpass = 1;
+    inputs.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT |
+                          VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+    inputs.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    inputs.dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+    inputs.dstAccessMask = VK_ACCESS_INPUT_ATTACHMENT_READ_BIT;
+    inputs.dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+    dependencies.push_back(inputs);
+    // Chains the writes of the first subpass through the reads of the second to the uses after the render pass
+    if (outgoing.dstStageMask != 0) {
+      outgoing.srcStageMask |= VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+    }
+  }
+  if (outgoing.dstStageMask != 0) {
+    dependencies.push_back(outgoing);
+  }
+  renderPassDependencies += static_cast<uint32_t>(dependencies.size());
+
+  VkRenderPassCreateInfo renderPassInfo{};
+  renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+  renderPassInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+  renderPassInfo.pAttachments = attachments.data();
+  renderPassInfo.subpassCount = subpassCount;
+  renderPassInfo.pSubpasses = subpasses.data();
+  renderPassInfo.dependencyCount = static_cast<uint32_t>(dependencies.size());
+  renderPassInfo.pDependencies = dependencies.data();
+
+  if (vkCreateRenderPass(ctx.device, &renderPassInfo, nullptr, &pass.renderPass) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to create render pass " + pass.name);
+  }
+  pass.renderPassKey = hashRenderPassCompatibility(renderPassInfo);
+}
+
+/**
+ * Plan the transitions before each pass outside a render pass. Uses following a render pass were transitioned by it.
+ * Reads following reads in the same layout need no barrier
+ */
+void RenderGraph::planBarriers() {
+  for (Resource r = 0; r < resources.size(); r++) {
+    const ResourceData& data = resources[r];
+    for (uint32_t i = 0; i < data.uses.size(); i++) {
+      const Use& use = data.uses[i];
+      if (use.attachment || (i > 0 && data.uses[i - 1].attachment)) {
+        continue;
+      }
+
+      Source source = sourceOf(r, i);
+      if (source.layout != imageAccessInfo(use.access).layout || source.access != 0 || use.writes) {
+        passes[use.pass].barriers.push_back({r, source, use.access});
+      }
+    }
+
+    if (data.imported && !data.uses.empty() && !data.uses.back().attachment && data.uses.back().access != data.finalAccess) {
+      uint32_t last = static_cast<uint32_t>(data.uses.size() - 1);
+      finalBarriers.push_back({r, {imageAccessInfo(data.uses[last].access).stages, writeAccess(imageAccessInfo(data.uses[last].access).access),
+                                   layoutAfter(r, last)},
+                               data.finalAccess});
+    }
+  }
+
+  barrierBatches = finalBarriers.empty() ? 0 : 1;
+  for (const auto& pass : passes) {
+    barrierBatches += pass.barriers.empty() ? 0 : 1;
+  }
+}
+
+/*----- Resources -----*/
+
+// One image and view per variant, such as one per swap chain image. Set before allocating
+void RenderGraph::setImportedImages(Resource resource, const std::vector<VkImage>& images, const std::vector<VkImageView>& views) {
+  resources[resource].images = images;
+  resources[resource].views = views;
+}
+
+/**
+ * Create or recreate the images and framebuffers at an extent. The previous ones are retired through the deletion
+ * queue. Memory is reused where the new images fit, which is the common case while a window is being resized.
+ * Returns the number of reused allocations
+ */
+uint32_t RenderGraph::allocate(VkExtent2D extent) {
+  if (!compiled) {
+    throw std::runtime_error("Failed to allocate render graph: not compiled");
+  }
+
+  retire();
+  createImages(extent);
+  uint32_t reused = bindMemory();
+  for (auto& resource : resources) {
+    if (!resource.imported && !resource.images.empty()) {
+      resource.views.push_back(createImageView(ctx.device, resource.images[0], resource.format, resource.aspect, 1));
+    }
+  }
+  createFramebuffers(extent);
+  return reused;
+}
+
+void RenderGraph::createImages(VkExtent2D extent) {
+  for (auto& resource : resources) {
+    if (resource.imported || resource.uses.empty()) {
+      continue;
+    }
+    resource.images.push_back(::createImage(ctx, extent.width, extent.height, 1, resource.samples, resource.format,
+                                            VK_IMAGE_TILING_OPTIMAL, resource.usage));
+  }
+}
+
+/**
+ * Place the images of each alias group into shared blocks of memory, splitting the group where its images need
+ * different memory types. Transient images prefer lazily allocated memory, which tile based GPUs may never back
+ */
+uint32_t RenderGraph::bindMemory() {
+  struct Placement {
+    uint32_t aliasGroup;
+    bool transient;
+    uint32_t typeBits;
+    VkDeviceSize size;
+    std::vector<Resource> members;
+  };
+  std::vector<Placement> placements;
+
+  requiredBytes = 0;
+  aliasedBytes = 0;
+  lazyImages = 0;
+
+  for (Resource r = 0; r < resources.size(); r++) {
+    const ResourceData& resource = resources[r];
+    if (resource.imported || resource.images.empty()) {
+      continue;
+    }
+
+    VkMemoryRequirements requirements;
+    vkGetImageMemoryRequirements(ctx.device, resource.images[0], &requirements);
+    requiredBytes += requirements.size;
+
+    auto placement = std::find_if(placements.begin(), placements.end(), [&](const Placement& placement) {
+      return resource.aliasGroup != NONE && placement.aliasGroup == resource.aliasGroup &&
+             (placement.typeBits & requirements.memoryTypeBits) != 0;
+    });
+    if (placement == placements.end()) {
+      placements.push_back({resource.aliasGroup, resource.transient, requirements.memoryTypeBits, 0, {}});
+      placement = placements.end() - 1;
+    }
+    placement->typeBits &= requirements.memoryTypeBits;
+    placement->size = std::max(placement->size, requirements.size);
+    placement->members.push_back(r);
+  }
+
+  std::vector<MemoryBlock> previous = std::move(memoryBlocks);
+  memoryBlocks.clear();
+  uint32_t reused = 0;
+
+  for (const auto& placement : placements) {
+    std::optional<uint32_t> type;
+    if (placement.transient) {
+      type = findImageMemoryType(ctx.physicalDevice, placement.typeBits, VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT);
+      if (type) {
+        lazyImages += static_cast<uint32_t>(placement.members.size());
+      }
+    }
+    if (!type) {
+      type = findMemoryType(ctx.physicalDevice, placement.typeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    }
+    aliasedBytes += placement.size;
+
+    // Frames in flight may still render to the previous images while the next frame renders to the new ones. This
+    // is safe as the first use of each image in a frame waits for the last uses of the images in its memory
+    auto fitting = std::find_if(previous.begin(), previous.end(), [&](const MemoryBlock& block) {
+      return block.memory != VK_NULL_HANDLE && block.type == *type && block.size >= placement.size;
+    });
+
+    MemoryBlock block;
+    if (fitting != previous.end()) {
+      block = *fitting;
+      fitting->memory = VK_NULL_HANDLE;
+      reused++;
+    } else {
+      // Leave headroom so that growing a window a few pixels at a time does not reallocate on every frame
+      VkMemoryAllocateInfo allocInfo{};
+      allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+      allocInfo.allocationSize = placement.size + placement.size / 4;
+      allocInfo.memoryTypeIndex = *type;
+
+      if (vkAllocateMemory(ctx.device, &allocInfo, nullptr, &block.memory) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to allocate render graph memory");
+      }
+      block.size = allocInfo.allocationSize;
+      block.type = *type;
+    }
+
+    for (Resource member : placement.members) {
+      vkBindImageMemory(ctx.device, resources[member].images[0], block.memory, 0);
+    }
+    memoryBlocks.push_back(block);
+  }
+
+  for (const auto& block : previous) {
+    if (block.memory != VK_NULL_HANDLE) {
+      deletionQueue.push([device = ctx.device, memory = block.memory] { vkFreeMemory(device, memory, nullptr); });
+    }
+  }
+
+  return reused;
+}
+
+// Passes using imported images with several variants get a framebuffer per variant
+void RenderGraph::createFramebuffers(VkExtent2D extent) {
+  for (auto& pass : passes) {
+    if (pass.culled || !pass.raster) {
+      continue;
+    }
+
+    size_t variants = 1;
+    for (Resource resource : pass.attachments) {
+      variants = std::max(variants, resources[resource].views.size());
+    }
+
+    for (size_t variant = 0; variant < variants; variant++) {
+      std::vector<VkImageView> views;
+      for (Resource resource : pass.attachments) {
+        views.push_back(view(resource, static_cast<uint32_t>(variant)));
+      }
+
+      VkFramebufferCreateInfo framebufferInfo{};
+      framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+      framebufferInfo.renderPass = pass.renderPass;
+      framebufferInfo.attachmentCount = static_cast<uint32_t>(views.size());
+      framebufferInfo.pAttachments = views.data();
+      framebufferInfo.width = extent.width;
+      framebufferInfo.height = extent.height;
+      framebufferInfo.layers = 1;
+
+      VkFramebuffer framebuffer;
+      if (vkCreateFramebuffer(ctx.device, &framebufferInfo, nullptr, &framebuffer) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create framebuffer for " + pass.name);
+      }
+      pass.framebuffers.push_back(framebuffer);
+    }
+  }
+}
+
+// Memory is kept for reuse by the next allocation
+void RenderGraph::retire() {
+  std::vector<VkFramebuffer> framebuffers;
+  for (auto& pass : passes) {
+    framebuffers.insert(framebuffers.end(), pass.framebuffers.begin(), pass.framebuffers.end());
+    pass.framebuffers.clear();
+  }
+
+  std::vector<VkImageView> views;
+  std::vector<VkImage> images;
+  for (auto& resource : resources) {
+    if (resource.imported) {
+      continue;
+    }
+    views.insert(views.end(), resource.views.begin(), resource.views.end());
+    images.insert(images.end(), resource.images.begin(), resource.images.end());
+    resource.views.clear();
+    resource.images.clear();
+  }
+
+  if (framebuffers.empty() && images.empty()) {
+    return;
+  }
+  deletionQueue.push([device = ctx.device, framebuffers, views, images] {
+    for (auto framebuffer : framebuffers) {
+      vkDestroyFramebuffer(device, framebuffer, nullptr);
+    }
+    for (auto view : views) {
+      vkDestroyImageView(device, view, nullptr);
+    }
+    for (auto image : images) {
+      vkDestroyImage(device, image, nullptr);
+    }
+  });
+}
+
+uint32_t RenderGraph::allocationCount() const {
+  return static_cast<uint32_t>(memoryBlocks.size());
+}
+
+bool RenderGraph::isCulled(Pass pass) const {
+  return passes[pass].culled;
+}
+
+bool RenderGraph::isTransient(Resource resource) const {
+  return resources[resource].transient;
+}
+
+// NONE for imported images and those kept between frames
+uint32_t RenderGraph::aliasGroup(Resource resource) const {
+  return resources[resource].aliasGroup;
+}
+
+// Transitions recorded before a pass, or after the last pass for NONE
+const std::vector<RenderGraph::Transition>& RenderGraph::barriers(Pass pass) const {
+  return pass == NONE ? finalBarriers : passes[pass].barriers;
+}
+
+// Null for culled passes
+VkRenderPass RenderGraph::renderPass(Pass pass) const {
+  return passes[pass].renderPass;
+}
+
+uint64_t RenderGraph::renderPassKey(Pass pass) const {
+  return passes[pass].renderPassKey;
+}
+
+VkFramebuffer RenderGraph::framebuffer(Pass pass, uint32_t variant) const {
+  const auto& framebuffers = passes[pass].framebuffers;
+  return framebuffers[variant % framebuffers.size()];
+}
+
+VkImage RenderGraph::image(Resource resource, uint32_t variant) const {
+  const auto& images = resources[resource].images;
+  return images[variant % images.size()];
+}
+
+VkImageView RenderGraph::view(Resource resource, uint32_t variant) const {
+  const auto& views = resources[resource].views;
+  return views[variant % views.size()];
+}
+
+/*----- Recording -----*/
+
+/**
+ * Record the kept passes with their barriers. The variant selects the imported images, such as the swap chain image
+ * being rendered to
+ */
+void RenderGraph::execute(VkCommandBuffer commandBuffer, uint32_t variant, VkRect2D renderArea) {
+  for (const auto& pass : passes) {
+    if (pass.culled) {
+      continue;
+    }
+    recordBarriers(commandBuffer, pass.barriers, variant);
+
+    if (!pass.raster) {
+      pass.record(commandBuffer, {VK_NULL_HANDLE, VK_NULL_HANDLE, variant});
+      continue;
+    }
+
+    VkFramebuffer passFramebuffer = pass.framebuffers[variant % pass.framebuffers.size()];
+
+    VkRenderPassBeginInfo renderPassInfo{};
+    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+    renderPassInfo.renderPass = pass.renderPass;
+    renderPassInfo.framebuffer = passFramebuffer;
+    renderPassInfo.renderArea = renderArea;
+    renderPassInfo.clearValueCount = static_cast<uint32_t>(pass.clearValues.size());
+    renderPassInfo.pClearValues = pass.clearValues.data();
+
+    vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, pass.contents);
+    pass.record(commandBuffer, {pass.renderPass, passFramebuffer, variant});
+    vkCmdEndRenderPass(commandBuffer);
+  }
+
+  recordBarriers(commandBuffer, finalBarriers, variant);
+}
+
+void RenderGraph::recordBarriers(VkCommandBuffer commandBuffer, const std::vector<Transition>& transitions, uint32_t variant) const {
+  BarrierBatch batch;
+  for (const auto& transition : transitions) {
+    const ResourceData& resource = resources[transition.resource];
+    batch.transition(image(transition.resource, variant), {resource.aspect, 0, 1, 0, 1}, transition.source.stages,
+                     transition.source.access, transition.source.layout, transition.access);
+  }
+  batch.record(commandBuffer);
+}
+
+void RenderGraph::report() const {
+  uint32_t kept = 0;
+  uint32_t images = 0;
+  for (const auto& pass : passes) {
+    kept += pass.culled ? 0 : 1;
+  }
+  for (const auto& resource : resources) {
+    images += !resource.imported && !resource.uses.empty() ? 1 : 0;
+  }
+
+  const double mebibyte = 1024.0 * 1024.0;
+  std::cout << "Render graph: " << kept << " of " << passes.size() << " passes recorded, " << barrierBatches
+            << " barrier batches and " << renderPassDependencies << " render pass dependencies per frame. " << images
+            << " images in " << memoryBlocks.size() << " allocations, " << aliasedBytes / mebibyte << " MiB ("
+            << requiredBytes / mebibyte << " MiB without aliasing), " << lazyImages << " lazily allocated" << std::endl;
+}
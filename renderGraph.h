@@ -0,0 +1,198 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "deletionQueue.h"
+#include "imageAccess.h"
+#include "vulkanUtils.h"
+
+/**
+ * Passes of a frame declared with the images they read and write, in the order they are recorded. Compiling the
+ * graph culls passes whose results are never used, creates the render passes with load and store operations and
+ * layouts taken from the neighbouring uses of each attachment, and plans one batched barrier before each pass
+ * outside a render pass. Images created by the graph are sized to the framebuffer. Those used within a single render
+ * pass are transient and lazily allocated where the device supports it, and images whose lifetimes do not overlap
+ * share memory
+ */
+class RenderGraph {
+ public:
+  using Resource = uint32_t;
+  using Pass = uint32_t;
+  static const uint32_t NONE = ~0u;
+
+  struct PassContext {
+    // Null outside render passes
+    VkRenderPass renderPass;
+    VkFramebuffer framebuffer;
+    uint32_t variant;
+  };
+  using RecordFunction = std::function<void(VkCommandBuffer, const PassContext&)>;
+
+  struct Attachment {
+    Resource resource = NONE;
+    // Otherwise the contents of earlier passes are loaded, if there are any
+    bool clear = false;
+    VkClearValue clearValue{};
+  };
+
+  struct RasterPassDescription {
+    Attachment color;
+    Attachment depth;
+    // Single sampled image the color attachment is resolved into
+    Resource resolve = NONE;
+    // Written with the depth by a first subpass, and read by a second subpass as input attachments in this order
+    // followed by the depth. The second subpass writes the color and resolve attachments. Empty for a single subpass
+    std::vector<Attachment> inputs;
+  };
+
+  struct ImageUse {
+    Resource resource;
+    ImageAccess access;
+  };
+
+  // Source of a transition: the stages and writes to wait for and the layout the image is in
+  struct Source {
+    VkPipelineStageFlags stages;
+    VkAccessFlags access;
+    VkImageLayout layout;
+  };
+
+  struct Transition {
+    Resource resource;
+    Source source;
+    ImageAccess access;
+  };
+
+  const VulkanContext& ctx;
+
+  RenderGraph() = delete;
+  RenderGraph(const VulkanContext& ctx, DeletionQueue& deletionQueue);
+  RenderGraph(const RenderGraph& renderGraph) = delete;
+  ~RenderGraph();
+
+  // ----- Declaration -----
+
+  Resource createImage(const std::string& name, VkFormat format, VkSampleCountFlagBits samples, VkImageAspectFlags aspect);
+  Resource importImage(const std::string& name, VkFormat format, VkImageAspectFlags aspect, ImageAccess finalAccess);
+  Pass addRasterPass(const std::string& name, const RasterPassDescription& description, RecordFunction record);
+  Pass addPass(const std::string& name, std::vector<ImageUse> uses, bool sideEffects, RecordFunction record);
+  void setSubpassContents(Pass pass, VkSubpassContents contents);
+
+  void plan();
+  void compile();
+
+  // ----- Resources -----
+
+  void setImportedImages(Resource resource, const std::vector<VkImage>& images, const std::vector<VkImageView>& views);
+  uint32_t allocate(VkExtent2D extent);
+  uint32_t allocationCount() const;
+
+  bool isCulled(Pass pass) const;
+  bool isTransient(Resource resource) const;
+  uint32_t aliasGroup(Resource resource) const;
+  const std::vector<Transition>& barriers(Pass pass) const;
+  VkRenderPass renderPass(Pass pass) const;
+  uint64_t renderPassKey(Pass pass) const;
+  VkFramebuffer framebuffer(Pass pass, uint32_t variant) const;
+  VkImage image(Resource resource, uint32_t variant = 0) const;
+  VkImageView view(Resource resource, uint32_t variant = 0) const;
+
+  // ----- Recording -----
+
+  void execute(VkCommandBuffer commandBuffer, uint32_t variant, VkRect2D renderArea);
+  void report() const;
+
+ private:
+  struct Use {
+    Pass pass;
+    ImageAccess access;
+    bool reads;
+    bool writes;
+    bool attachment;
+  };
+
+  struct ResourceData {
+    std::string name;
+    VkFormat format;
+    VkSampleCountFlagBits samples;
+    VkImageAspectFlags aspect;
+    bool imported;
+    ImageAccess finalAccess;
+
+    // ----- Compiled -----
+    std::vector<Use> uses;
+    VkImageUsageFlags usage = 0;
+    // Only used as an attachment of one render pass, so it never needs to be in memory
+    bool transient = false;
+    // Images sharing memory. NONE for images kept between frames and imported images
+    uint32_t aliasGroup = NONE;
+
+    // ----- Allocated -----
+    std::vector<VkImage> images;
+    std::vector<VkImageView> views;
+  };
+
+  struct PassData {
+    std::string name;
+    bool raster;
+    RasterPassDescription description;
+    std::vector<ImageUse> uses;
+    bool sideEffects;
+    RecordFunction record;
+    VkSubpassContents contents = VK_SUBPASS_CONTENTS_INLINE;
+
+    // ----- Compiled -----
+    bool culled = false;
+    VkRenderPass renderPass = VK_NULL_HANDLE;
+    // Compatibility key of the render pass for pipeline descriptions
+    uint64_t renderPassKey = 0;
+    std::vector<Resource> attachments;
+    std::vector<VkClearValue> clearValues;
+    std::vector<Transition> barriers;
+
+    // ----- Allocated -----
+    std::vector<VkFramebuffer> framebuffers;
+  };
+
+  struct MemoryBlock {
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkDeviceSize size = 0;
+    uint32_t type = 0;
+  };
+
+  DeletionQueue& deletionQueue;
+
+  std::vector<ResourceData> resources;
+  std::vector<PassData> passes;
+  // Transitions of imported images into their final layout after the last pass
+  std::vector<Transition> finalBarriers;
+  std::vector<MemoryBlock> memoryBlocks;
+  bool planned = false;
+  bool compiled = false;
+
+  // ----- Statistics -----
+  uint32_t barrierBatches = 0;
+  uint32_t renderPassDependencies = 0;
+  // Memory of the images bound to their own allocations, and as bound with aliasing
+  VkDeviceSize requiredBytes = 0;
+  VkDeviceSize aliasedBytes = 0;
+  uint32_t lazyImages = 0;
+
+  std::vector<std::pair<Resource, Use>> usesOf(Pass pass) const;
+  void cullPasses();
+  void collectUses();
+  void assignAliasGroups();
+  Source sourceOf(Resource resource, uint32_t useIndex) const;
+  VkImageLayout layoutAfter(Resource resource, uint32_t useIndex) const;
+  void createRenderPass(Pass pass);
+  void planBarriers();
+
+  void createImages(VkExtent2D extent);
+  uint32_t bindMemory();
+  void createFramebuffers(VkExtent2D extent);
+  void retire();
+
+  void recordBarriers(VkCommandBuffer commandBuffer, const std::vector<Transition>& transitions, uint32_t variant) const;
+};
@@ -0,0 +1,77 @@
+#include "resolutionScaler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+// Weight of the latest measurement in the moving average
+static const double SMOOTHING = 0.1;
+// Frames measured after a change before the next one. Frames in flight were recorded at the previous scale
+static const uint32_t SETTLE_FRAMES = 8;
+// The scale rises only when the frame time is below this fraction of the target, and then aims for the middle
+// of the band
+static const double HEADROOM = 0.85;
+// Largest change of the scale in one step, down and up. Rising slowly avoids overshooting into dropped frames
+static const float MAX_DECREASE = 0.8f;
+static const float MAX_INCREASE = 1.1f;
+// Scales are multiples of this so that small corrections do not change the resolution every few frames
+static const float SCALE_STEP = 1.0f / 64.0f;
+
+ResolutionScaler::ResolutionScaler(double targetFrameTime, float minScale, float maxScale)
+    : targetFrameTime{targetFrameTime}, minScale{minScale}, maxScale{maxScale}, currentScale{maxScale} {}
+
+/**
+ * Record the GPU time of a frame. Returns true if the scale has changed, in which case the following frames should
+ * be rendered at the new scaled extent
+ */
+bool ResolutionScaler::update(double gpuTime) {
+  frameCount++;
+  totalScale += currentScale;
+  if (gpuTime > targetFrameTime) {
+    framesOverTarget++;
+  }
+
+  smoothedTime = smoothedTime == 0.0 ? gpuTime : smoothedTime + SMOOTHING * (gpuTime - smoothedTime);
+  if (++framesSinceChange < SETTLE_FRAMES) {
+    return false;
+  }
+
+  double desiredTime;
+  if (smoothedTime > targetFrameTime) {
+    desiredTime = targetFrameTime;
+  } else if (smoothedTime < HEADROOM * targetFrameTime && currentScale < maxScale) {
+    desiredTime = 0.5 * (1.0 + HEADROOM) * targetFrameTime;
+  } else {
+    return false;
+  }
+
+  float factor = std::clamp(static_cast<float>(std::sqrt(desiredTime / smoothedTime)), MAX_DECREASE, MAX_INCREASE);
+  float scale = std::clamp(std::round(currentScale * factor / SCALE_STEP) * SCALE_STEP, minScale, maxScale);
+  if (scale == currentScale) {
+    return false;
+  }
+
+  smoothedTime *= (scale * scale) / (currentScale * currentScale);
+  currentScale = scale;
+  framesSinceChange = 0;
+  scaleChanges++;
+  return true;
+}
+
+float ResolutionScaler::scale() const {
+  return currentScale;
+}
+
+VkExtent2D ResolutionScaler::scaledExtent(VkExtent2D extent) const {
+  return {std::max(1u, static_cast<uint32_t>(std::lround(extent.width * currentScale))),
+          std::max(1u, static_cast<uint32_t>(std::lround(extent.height * currentScale)))};
+}
+
+void ResolutionScaler::report() const {
+  if (frameCount == 0) {
+    return;
+  }
+  std::cout << "Resolution scale: average " << totalScale / frameCount << ", current " << currentScale << ", "
+            << scaleChanges << " changes, " << 100.0 * framesOverTarget / frameCount << "% of frames over the "
+            << targetFrameTime << " ms target" << std::endl;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "vulkanUtils.h"
+
+/**
+ * Chooses the fraction of the swap chain extent to render at so that the GPU frame time holds a target. GPU time is
+ * taken to grow with the number of pixels, so the scale moves by the square root of the ratio of target to measured
+ * time. Measurements are smoothed and the scale only changes outside a band below the target, so that the
+ * resolution does not oscillate
+ */
+class ResolutionScaler {
+ public:
+  ResolutionScaler() = delete;
+  ResolutionScaler(double targetFrameTime, float minScale, float maxScale = 1.0f);
+  ResolutionScaler(const ResolutionScaler& resolutionScaler) = delete;
+
+  bool update(double gpuTime);
+  float scale() const;
+  VkExtent2D scaledExtent(VkExtent2D extent) const;
+  void report() const;
+
+ private:
+  double targetFrameTime;
+  float minScale;
+  float maxScale;
+
+  float currentScale;
+  // Exponential moving average, predicted for the new scale when it changes
+  double smoothedTime = 0.0;
+  uint32_t framesSinceChange = 0;
+
+  uint64_t frameCount = 0;
+  uint64_t framesOverTarget = 0;
+  uint64_t scaleChanges = 0;
+  double totalScale = 0.0;
+};
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <glm/glm.hpp>
+
+#include "vulkanUtils.h"
+
+// Structs in this file are read by shaders and match their std430 layout
+
+/**
+ * Range of one mesh in the shared vertex and index buffers
+ */
+struct MeshData {
+  uint32_t indexCount;
+  uint32_t firstIndex;
+  int32_t vertexOffset;
+  uint32_t padding;
+  // Model space bounding sphere. xyz is the center and w the radius
+  glm::vec4 boundingSphere;
+};
+
+/**
+ * Placement of a mesh in the scene. Indexed by gl_InstanceIndex, either in a storage buffer or as instance rate
+ * vertex attributes. The transform holds the top three rows of an affine model matrix, which shaders read as a
+ * mat3x4 and multiply with a homogeneous position from the left
+ */
+struct InstanceData {
+  glm::vec4 transform[3];
+  uint32_t meshIndex;
+  uint32_t padding[3];
+
+  static InstanceData create(const glm::mat4& model, uint32_t meshIndex) {
+    InstanceData instance{};
+    for (int row = 0; row < 3; row++) {
+      instance.transform[row] = {model[0][row], model[1][row], model[2][row], model[3][row]};
+    }
+    instance.meshIndex = meshIndex;
+    return instance;
+  }
+
+  glm::mat4 model() const {
+    glm::mat4 model{1.0f};
+    for (int row = 0; row < 3; row++) {
+      for (int column = 0; column < 4; column++) {
+        model[column][row] = transform[row][column];
+      }
+    }
+    return model;
+  }
+
+  static VkVertexInputBindingDescription getBindingDescription() {
+    VkVertexInputBindingDescription bindingDescription{};
+
+    bindingDescription.binding = 1;
+    bindingDescription.stride = sizeof(InstanceData);
+    bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
+
+    return bindingDescription;
+  }
+
+  // One location per transform row, after the vertex attributes
+  static std::array<VkVertexInputAttributeDescription, 3> getAttributeDescriptions() {
+    std::array<VkVertexInputAttributeDescription, 3> attributeDescriptions{};
+
+    for (uint32_t row = 0; row < 3; row++) {
+      attributeDescriptions[row].binding = 1;
+      attributeDescriptions[row].location = 3 + row;
+      attributeDescriptions[row].format = VK_FORMAT_R32G32B32A32_SFLOAT;
+      attributeDescriptions[row].offset = row * sizeof(glm::vec4);
+    }
+
+    return attributeDescriptions;
+  }
+};
@@ -0,0 +1,283 @@
+#include "settings.h"
+
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+static void printUsage() {
+  std::cout << "Usage: VulkanRenderer [options]\n"
+            << "  --frames-in-flight <1-4>\n"
+            << "  --present-mode <fifo|fifo-relaxed|mailbox|immediate>\n"
+            << "  --fps-cap <frames per second>\n"
+            << "  --on-demand\n"
+            << "  --depth-prepass\n"
+            << "  --overdraw\n"
+            << "  --target-frame-time <milliseconds>\n"
+            << "  --min-resolution-scale <0.1-1>\n"
+            << "  --device <index|name>\n"
+            << "  --feature-tier <minimal|standard|high>\n"
+            << "  --headless\n"
+            << "  --frames <count>\n"
+            << "  --output <file.png>\n"
+            << "  --batch <camera views file>\n"
+            << "  --batch-output <directory>\n"
+            << "  --capture-interval <0-10000 frames>\n"
+            << "  --recording-threads <0-64>\n"
+            << "  --draw-count <1-1048576>\n"
+            << "  --cache-command-buffers\n"
+            << "  --benchmark-recording\n"
+            << "  --benchmark-multiview <cube|stereo>\n"
+            << "  --instance-count <1-1048576>\n"
+            << "  --instance-attributes\n"
+            << "  --gpu-driven\n"
+            << "  --occlusion-culling\n"
+            << "  --no-cpu-culling\n"
+            << "  --software-occlusion\n"
+            << "  --benchmark-culling\n"
+            << "  --benchmark-occlusion\n"
+            << "  --lights <0-65536>\n"
+            << "  --cpu-light-assignment\n"
+            << "  --benchmark-lights\n"
+            << "  --shadows\n"
+            << "  --shadow-cascades <1-4>\n"
+            << "  --shadow-resolution <64-16384 texels>\n"
+            << "  --no-shadow-cache\n"
+            << "  --shadow-update-budget <0-4 cascades>\n"
+            << "  --shadow-distant-interval <frames>\n"
+            << "  --dynamic-objects <0-1024>\n"
+            << "  --sun-speed <-10-10 radians per second>\n"
+            << "  --deferred\n"
+            << "  --benchmark-shading" << std::endl;
+}
+
+static VkPresentModeKHR parsePresentMode(const std::string& name) {
+  if (name == "fifo") {
+    return VK_PRESENT_MODE_FIFO_KHR;
+  } else if (name == "fifo-relaxed") {
+    return VK_PRESENT_MODE_FIFO_RELAXED_KHR;
+  } else if (name == "mailbox") {
+    return VK_PRESENT_MODE_MAILBOX_KHR;
+  } else if (name == "immediate") {
+    return VK_PRESENT_MODE_IMMEDIATE_KHR;
+  }
+  throw std::invalid_argument("Unknown present mode " + name);
+}
+
+/**
+ * Whole number between the bounds. The range is checked before narrowing, as std::stoul wraps negative numbers
+ * around and a wide value would otherwise be truncated into the range
+ */
+static uint32_t parseCount(const std::string& value, const std::string& name, uint32_t minimum, uint32_t maximum) {
+  unsigned long count = std::stoul(value);
+  if (value.find('-') != std::string::npos || count < minimum || count > maximum) {
+    throw std::invalid_argument(name + " must be between " + std::to_string(minimum) + " and " + std::to_string(maximum));
+  }
+  return static_cast<uint32_t>(count);
+}
+
+static FeatureTier parseTier(const std::string& name) {
+  auto tier = parseFeatureTier(name);
+  if (!tier) {
+    throw std::invalid_argument("Unknown feature tier " + name);
+  }
+  return *tier;
+}
+
+Settings parseSettings(int argc, char** argv) {
+  Settings settings{};
+
+  // ----- Environment -----
+  if (const char* device = std::getenv("VULKAN_RENDERER_DEVICE")) {
+    settings.deviceSelection.device = device;
+  }
+  if (const char* tier = std::getenv("VULKAN_RENDERER_FEATURE_TIER")) {
+    settings.deviceSelection.maxTier = parseTier(tier);
+  }
+
+  for (int i = 1; i < argc; i++) {
+    std::string option = argv[i];
+
+    if (option == "--help") {
+      printUsage();
+      exit(EXIT_SUCCESS);
+    }
+
+    // ----- Flags -----
+    if (option == "--on-demand") {
+      settings.onDemand = true;
+      continue;
+    }
+    if (option == "--depth-prepass") {
+      settings.depthPrepass = true;
+      continue;
+    }
+    if (option == "--overdraw") {
+      settings.overdrawView = true;
+      continue;
+    }
+    if (option == "--headless") {
+      settings.headless = true;
+      continue;
+    }
+    if (option == "--cache-command-buffers") {
+      settings.cacheCommandBuffers = true;
+      continue;
+    }
+    if (option == "--benchmark-recording") {
+      settings.benchmarkRecording = true;
+      continue;
+    }
+    if (option == "--instance-attributes") {
+      settings.instanceAttributes = true;
+      continue;
+    }
+    if (option == "--gpu-driven") {
+      settings.gpuDriven = true;
+      continue;
+    }
+    if (option == "--occlusion-culling") {
+      // Occlusion is tested in the culling compute pass
+      settings.occlusionCulling = true;
+      settings.gpuDriven = true;
+      continue;
+    }
+    if (option == "--no-cpu-culling") {
+      settings.cpuCulling = false;
+      continue;
+    }
+    if (option == "--software-occlusion") {
+      settings.softwareOcclusion = true;
+      continue;
+    }
+    if (option == "--benchmark-culling") {
+      settings.benchmarkCulling = true;
+      continue;
+    }
+    if (option == "--benchmark-occlusion") {
+      settings.benchmarkOcclusion = true;
+      continue;
+    }
+    if (option == "--cpu-light-assignment") {
+      settings.cpuLightAssignment = true;
+      continue;
+    }
+    if (option == "--benchmark-lights") {
+      settings.benchmarkLights = true;
+      continue;
+    }
+    if (option == "--shadows") {
+      settings.shadows = true;
+      continue;
+    }
+    if (option == "--no-shadow-cache") {
+      settings.shadowCache = false;
+      continue;
+    }
+    if (option == "--deferred") {
+      settings.deferredShading = true;
+      continue;
+    }
+    if (option == "--benchmark-shading") {
+      // Renders offscreen, so no window is needed
+      settings.benchmarkShading = true;
+      settings.headless = true;
+      continue;
+    }
+
+    // ----- Options with values -----
+
+    if (i + 1 >= argc) {
+      printUsage();
+      throw std::invalid_argument("Missing value for " + option);
+    }
+    std::string value = argv[++i];
+
+    if (option == "--frames-in-flight") {
+      settings.framesInFlight = std::stoul(value);
+      if (settings.framesInFlight < 1 || settings.framesInFlight > 4) {
+        throw std::invalid_argument("Frames in flight must be between 1 and 4");
+      }
+    } else if (option == "--present-mode") {
+      settings.presentMode = parsePresentMode(value);
+    } else if (option == "--device") {
+      settings.deviceSelection.device = value;
+    } else if (option == "--feature-tier") {
+      settings.deviceSelection.maxTier = parseTier(value);
+    } else if (option == "--fps-cap") {
+      settings.maxFrameRate = std::stod(value);
+      if (settings.maxFrameRate < 0.0) {
+        throw std::invalid_argument("Frame rate cap must not be negative");
+      }
+    } else if (option == "--target-frame-time") {
+      settings.targetFrameTime = std::stod(value);
+      if (settings.targetFrameTime < 0.0) {
+        throw std::invalid_argument("Target frame time must not be negative");
+      }
+    } else if (option == "--min-resolution-scale") {
+      settings.minResolutionScale = std::stof(value);
+      if (settings.minResolutionScale < 0.1f || settings.minResolutionScale > 1.0f) {
+        throw std::invalid_argument("Minimum resolution scale must be between 0.1 and 1");
+      }
+    } else if (option == "--frames") {
+      settings.headlessFrames = std::stoul(value);
+      if (settings.headlessFrames < 1) {
+        throw std::invalid_argument("Frame count must be at least 1");
+      }
+    } else if (option == "--output") {
+      settings.outputPath = value;
+    } else if (option == "--batch") {
+      // Batches are always rendered offscreen
+      settings.batchPath = value;
+      settings.headless = true;
+    } else if (option == "--batch-output") {
+      settings.batchOutputPath = value;
+    } else if (option == "--capture-interval") {
+      settings.captureInterval = parseCount(value, "Capture interval", 0, 10000);
+    } else if (option == "--benchmark-multiview") {
+      if (value == "cube") {
+        settings.benchmarkMultiviewViews = 6;
+      } else if (value == "stereo") {
+        settings.benchmarkMultiviewViews = 2;
+      } else {
+        throw std::invalid_argument("Unknown multiview layout " + value);
+      }
+    } else if (option == "--recording-threads") {
+      settings.recordingThreads = parseCount(value, "Recording threads", 0, 64);
+    } else if (option == "--draw-count") {
+      settings.drawCount = parseCount(value, "Draw count", 1, 1048576);
+    } else if (option == "--instance-count") {
+      settings.instanceCount = parseCount(value, "Instance count", 1, 1048576);
+    } else if (option == "--lights") {
+      settings.lightCount = parseCount(value, "Light count", 0, 65536);
+    } else if (option == "--shadow-cascades") {
+      settings.shadowCascades = std::stoul(value);
+      if (settings.shadowCascades < 1 || settings.shadowCascades > 4) {
+        throw std::invalid_argument("Shadow cascades must be between 1 and 4");
+      }
+    } else if (option == "--shadow-resolution") {
+      // 16384 is the largest image dimension devices commonly support
+      settings.shadowResolution = parseCount(value, "Shadow resolution", 64, 16384);
+    } else if (option == "--shadow-update-budget") {
+      settings.shadowUpdateBudget = parseCount(value, "Shadow update budget", 0, 4);
+    } else if (option == "--shadow-distant-interval") {
+      settings.shadowDistantInterval = std::stoul(value);
+      if (settings.shadowDistantInterval < 1) {
+        throw std::invalid_argument("Shadow distant interval must be at least 1");
+      }
+    } else if (option == "--dynamic-objects") {
+      settings.dynamicObjects = parseCount(value, "Dynamic objects", 0, 1024);
+    } else if (option == "--sun-speed") {
+      settings.sunSpeed = std::stof(value);
+      // Negated so that NaN is rejected too
+      if (!(settings.sunSpeed >= -10.0f && settings.sunSpeed <= 10.0f)) {
+        throw std::invalid_argument("Sun speed must be between -10 and 10");
+      }
+    } else {
+      printUsage();
+      throw std::invalid_argument("Unknown option " + option);
+    }
+  }
+
+  return settings;
+}
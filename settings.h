@@ -0,0 +1,107 @@
+#pragma once
+
+#include <optional>
+#include <string>
+
+#include "vulkanUtils.h"
+
+/**
+ * Runtime configuration from the command line
+ */
+struct Settings {
+  // Number of frames the CPU may record ahead of the GPU. More frames increase throughput and latency
+  uint32_t framesInFlight = 2;
+  // Mailbox if available and FIFO otherwise when not set
+  std::optional<VkPresentModeKHR> presentMode;
+  // Frames per second, 0 is uncapped
+  double maxFrameRate = 0.0;
+  // Block for events and only draw when the view or scene has changed
+  bool onDemand = false;
+  // Draw the scene's depth before shading it, so that overdrawn samples are not shaded. Pays off for scenes with
+  // heavy overdraw and costly shading, at the cost of transforming the geometry twice. Toggled with P
+  bool depthPrepass = false;
+  // Show and report the number of fragments shaded per pixel. Toggled with O
+  bool overdrawView = false;
+  // GPU frame time in milliseconds held by lowering the resolution the scene is rendered at and upscaling it to the
+  // swap chain. 0 always renders at full resolution
+  double targetFrameTime = 0.0;
+  // Lowest fraction of the swap chain width and height the scene is rendered at
+  float minResolutionScale = 0.5f;
+
+  // Device and highest feature tier. Taken from VULKAN_RENDERER_DEVICE and VULKAN_RENDERER_FEATURE_TIER unless
+  // given on the command line
+  DeviceSelection deviceSelection;
+
+  // Render offscreen without a window, surface or swap chain. Any device can be used, including CPU implementations
+  bool headless = false;
+  // Frames rendered in headless mode before the last one is read back
+  uint32_t headlessFrames = 1;
+  // PNG file the last headless frame is written to. Not written when empty
+  std::string outputPath;
+  // File of camera views, one "pitch yaw distance fov" per line, each rendered headless to a PNG file
+  std::string batchPath;
+  // Directory the batch images are written to
+  std::string batchOutputPath = "batch";
+  // Capture and discard every Nth frame to measure the cost of capturing. 0 disables
+  uint32_t captureInterval = 0;
+
+  // Threads recording secondary command buffers. 0 records the draw list directly into the primary command buffer
+  uint32_t recordingThreads = 0;
+  // Number of draws the model is split into, to stress command recording
+  uint32_t drawCount = 1;
+  // Record command buffers per swap chain image once and replay them until the draw list changes
+  bool cacheCommandBuffers = false;
+  // Measure recording time for 1 to N threads and exit
+  bool benchmarkRecording = false;
+  // Render 6 cube map faces or 2 stereo eyes with multiview and with a pass per view, compare and exit. 0 disables
+  uint32_t benchmarkMultiviewViews = 0;
+
+  // Copies of the model placed on a grid
+  uint32_t instanceCount = 1;
+  // Fetch instance transforms as instance rate vertex attributes rather than from the storage buffer
+  bool instanceAttributes = false;
+  // Cull instances in a compute shader and draw the visible ones with indirect draws
+  bool gpuDriven = false;
+  // Also cull GPU-driven instances hidden behind others, by testing them against a depth pyramid in two phases
+  bool occlusionCulling = false;
+  // Frustum cull instances on the CPU before recording when not GPU-driven
+  bool cpuCulling = true;
+  // Also remove CPU culled instances hidden behind the nearest ones, using a software rasterized depth buffer
+  bool softwareOcclusion = false;
+  // Measure CPU culling of instance count spheres without a window and exit
+  bool benchmarkCulling = false;
+  // Measure software occlusion culling of a city of instance count blocks without a window and exit
+  bool benchmarkOcclusion = false;
+
+  // Point lights scattered over the scene and shaded with clustered forward lighting. 0 draws the scene unlit
+  uint32_t lightCount = 0;
+  // Assign lights to clusters on the CPU rather than in a compute shader
+  bool cpuLightAssignment = false;
+  // Measure CPU light assignment of 1k to 16k lights without a window and exit
+  bool benchmarkLights = false;
+
+  // Light the scene with a sun casting cascaded shadows
+  bool shadows = false;
+  uint32_t shadowCascades = 3;
+  // Width and height of each cascade
+  uint32_t shadowResolution = 2048;
+  // Keep the static casters of each cascade until the cascade or the sun moves, rather than rendering every caster
+  // every frame
+  bool shadowCache = true;
+  // Cascades whose static casters may be rendered again per frame. 0 is unlimited
+  uint32_t shadowUpdateBudget = 0;
+  // Frames between updates of the dynamic casters in all but the nearest cascade
+  uint32_t shadowDistantInterval = 1;
+  // Copies of the model circling above the scene, drawn as dynamic shadow casters
+  uint32_t dynamicObjects = 0;
+  // Radians per second the sun turns around the scene. 0 keeps it still, so that static shadows stay cached
+  float sunSpeed = 0.0f;
+
+  // Draw the scene into a compact G-buffer and light each pixel once in a second subpass, rather than shading every
+  // MSAA sample of every fragment. Single sampled, without occlusion culling, the depth pre-pass or the overdraw view
+  bool deferredShading = false;
+  // Measure the scene pass with forward and deferred shading and exit. Implies headless, as no window is needed
+  bool benchmarkShading = false;
+};
+
+Settings parseSettings(int argc, char** argv);
@@ -0,0 +1,211 @@
+#include "shaderLibrary.h"
+
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+#include "hash.h"
+
+// Bump when compile options change so that stale SPIR-V is not picked up from the cache
+const uint32_t SHADER_CACHE_VERSION = 1;
+
+static std::string readTextFile(const std::string& path) {
+  std::ifstream file(path);
+  if (!file.is_open()) {
+    throw std::runtime_error("Failed to open shader source " + path);
+  }
+  std::stringstream stream;
+  stream << file.rdbuf();
+  return stream.str();
+}
+
+static shaderc_shader_kind getShaderKind(VkShaderStageFlagBits stage) {
+  switch (stage) {
+    case VK_SHADER_STAGE_VERTEX_BIT:
+      return shaderc_vertex_shader;
+    case VK_SHADER_STAGE_FRAGMENT_BIT:
+      return shaderc_fragment_shader;
+    case VK_SHADER_STAGE_COMPUTE_BIT:
+      return shaderc_compute_shader;
+    default:
+      throw std::invalid_argument("Unsupported shader stage");
+  }
+}
+
+/*----- Includes -----*/
+
+/**
+ * Resolves #include directives relative to the source directory and records every included file
+ */
+class ShaderIncluder : public shaderc::CompileOptions::IncluderInterface {
+ public:
+  ShaderIncluder(const std::string& directory, std::set<std::string>& includes) : directory{directory}, includes{includes} {}
+
+  shaderc_include_result* GetInclude(const char* requestedSource, shaderc_include_type type,
+                                     const char* requestingSource, size_t includeDepth) override {
+    auto* data = new IncludeData{requestedSource, ""};
+    auto* result = new shaderc_include_result{};
+    result->user_data = data;
+
+    try {
+      data->content = readTextFile(directory + "/" + data->name);
+      includes.insert(data->name);
+      result->source_name = data->name.c_str();
+      result->source_name_length = data->name.size();
+    } catch (const std::exception& e) {
+      // An empty source name signals failure and the content holds the error message
+      data->content = e.what();
+    }
+
+    result->content = data->content.c_str();
+    result->content_length = data->content.size();
+    return result;
+  }
+
+  void ReleaseInclude(shaderc_include_result* result) override {
+    delete static_cast<IncludeData*>(result->user_data);
+    delete result;
+  }
+
+ private:
+  struct IncludeData {
+    std::string name;
+    std::string content;
+  };
+
+  std::string directory;
+  std::set<std::string>& includes;
+};
+
+/*--------------- ShaderLibrary ---------------*/
+
+ShaderLibrary::ShaderLibrary(std::string sourceDirectory, std::string cacheDirectory) : sourceDirectory{sourceDirectory}, cacheDirectory{cacheDirectory} {
+  std::filesystem::create_directories(cacheDirectory);
+
+  // Editors either write in place or move a temporary file over the source
+  inotifyDescriptor = inotify_init1(IN_NONBLOCK);
+  if (inotifyDescriptor < 0 || inotify_add_watch(inotifyDescriptor, sourceDirectory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+    std::cerr << "Failed to watch " << sourceDirectory << ". Shader hot reloading is disabled" << std::endl;
+  }
+}
+
+ShaderLibrary::~ShaderLibrary() {
+  if (inotifyDescriptor >= 0) {
+    close(inotifyDescriptor);
+  }
+}
+
+/**
+ * Return SPIR-V for a source file and set of defines, from the disk cache if it has been compiled before
+ */
+ShaderStage ShaderLibrary::load(const std::string& source, VkShaderStageFlagBits stage, const std::vector<ShaderDefine>& defines) {
+  return {stage, source, defines, compile(source, stage, defines)};
+}
+
+std::vector<char> ShaderLibrary::compile(const std::string& source, VkShaderStageFlagBits stage, const std::vector<ShaderDefine>& defines) {
+  std::set<std::string> includes = {source};
+
+  shaderc::CompileOptions options;
+  options.SetTargetEnvironment(shaderc_target_env_vulkan, shaderc_env_version_vulkan_1_0);
+  options.SetOptimizationLevel(shaderc_optimization_level_performance);
+  options.SetIncluder(std::make_unique<ShaderIncluder>(sourceDirectory, includes));
+  for (const auto& define : defines) {
+    options.AddMacroDefinition(define.name, define.value);
+  }
+
+  shaderc_shader_kind kind = getShaderKind(stage);
+
+  // The preprocessed text covers includes and defines, which makes it a complete cache key
+  auto preprocessed = compiler.PreprocessGlsl(readTextFile(sourceDirectory + "/" + source), kind, source.c_str(), options);
+  if (preprocessed.GetCompilationStatus() != shaderc_compilation_status_success) {
+    throw std::runtime_error("Failed to preprocess " + source + ":\n" + preprocessed.GetErrorMessage());
+  }
+  std::string preprocessedText(preprocessed.begin(), preprocessed.end());
+
+  dependencies[source] = includes;
+
+  uint64_t hash = HASH_SEED;
+  hashValue(hash, SHADER_CACHE_VERSION);
+  hashValue(hash, kind);
+  hashString(hash, preprocessedText);
+
+  std::stringstream cachePath;
+  cachePath << cacheDirectory << "/" << std::hex << std::setw(16) << std::setfill('0') << hash << ".spv";
+
+  std::ifstream cachedFile(cachePath.str(), std::ios::ate | std::ios::binary);
+  if (cachedFile.is_open()) {
+    std::vector<char> code((size_t)cachedFile.tellg());
+    cachedFile.seekg(0);
+    cachedFile.read(code.data(), code.size());
+    return code;
+  }
+
+  auto result = compiler.CompileGlslToSpv(preprocessedText, kind, source.c_str(), options);
+  if (result.GetCompilationStatus() != shaderc_compilation_status_success) {
+    throw std::runtime_error("Failed to compile " + source + ":\n" + result.GetErrorMessage());
+  }
+
+  std::vector<uint32_t> words(result.begin(), result.end());
+  std::vector<char> code(words.size() * sizeof(uint32_t));
+  memcpy(code.data(), words.data(), code.size());
+
+  // Write beside the cache file and rename over it, so that an interrupted write or another process compiling the
+  // same shader never leaves a truncated file which would be read back as SPIR-V
+  std::string temporaryPath = cachePath.str() + "." + std::to_string(getpid()) + ".tmp";
+  {
+    std::ofstream file(temporaryPath, std::ios::binary);
+    file.write(code.data(), code.size());
+  }
+  std::error_code error;
+  std::filesystem::rename(temporaryPath, cachePath.str(), error);
+  if (error) {
+    std::filesystem::remove(temporaryPath, error);
+  }
+
+  std::cout << "Compiled " << source << std::endl;
+
+  return code;
+}
+
+/*----- Hot reloading -----*/
+
+/**
+ * Names of files in the source directory which have been written since the last call. Does not block
+ */
+std::set<std::string> ShaderLibrary::pollChanges() {
+  std::set<std::string> changedFiles;
+  if (inotifyDescriptor < 0) {
+    return changedFiles;
+  }
+
+  alignas(struct inotify_event) char buffer[4096];
+  ssize_t length;
+  while ((length = read(inotifyDescriptor, buffer, sizeof(buffer))) > 0) {
+    for (char* position = buffer; position < buffer + length;) {
+      auto* event = reinterpret_cast<struct inotify_event*>(position);
+      if (event->len > 0) {
+        changedFiles.insert(event->name);
+      }
+      position += sizeof(struct inotify_event) + event->len;
+    }
+  }
+
+  return changedFiles;
+}
+
+bool ShaderLibrary::dependsOn(const std::string& source, const std::set<std::string>& files) const {
+  auto position = dependencies.find(source);
+  if (position == dependencies.end()) {
+    return false;
+  }
+  return std::any_of(position->second.begin(), position->second.end(),
+                     [&](const auto& dependency) { return files.count(dependency) > 0; });
+}
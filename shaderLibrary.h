@@ -0,0 +1,55 @@
+#pragma once
+
+#include <shaderc/shaderc.hpp>
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "vulkanUtils.h"
+
+struct ShaderDefine {
+  std::string name;
+  std::string value;
+};
+
+/**
+ * Compiled shader stage together with the source it was built from so that it can be rebuilt when the source changes
+ */
+struct ShaderStage {
+  VkShaderStageFlagBits stage;
+  std::string source;
+  std::vector<ShaderDefine> defines;
+  // SPIR-V
+  std::vector<char> code;
+};
+
+/**
+ * Compiles GLSL in-process. SPIR-V is cached on disk under the hash of the preprocessed source, which covers
+ * includes and defines. The source directory is watched with inotify for hot reloading
+ */
+class ShaderLibrary {
+ public:
+  ShaderLibrary() = delete;
+  ShaderLibrary(std::string sourceDirectory, std::string cacheDirectory);
+  ShaderLibrary(const ShaderLibrary& shaderLibrary) = delete;
+  ~ShaderLibrary();
+
+  ShaderStage load(const std::string& source, VkShaderStageFlagBits stage, const std::vector<ShaderDefine>& defines = {});
+  std::set<std::string> pollChanges();
+  bool dependsOn(const std::string& source, const std::set<std::string>& files) const;
+
+ private:
+  std::string sourceDirectory;
+  std::string cacheDirectory;
+
+  shaderc::Compiler compiler;
+
+  // Files included by each source, including the source itself
+  std::map<std::string, std::set<std::string>> dependencies;
+
+  int inotifyDescriptor = -1;
+
+  std::vector<char> compile(const std::string& source, VkShaderStageFlagBits stage, const std::vector<ShaderDefine>& defines);
+};
@@ -0,0 +1,33 @@
+// Declarations shared by the light assignment and the shading of clustered forward lighting. CLUSTER_SET is the
+// descriptor set of the light buffers and the cluster data. CLUSTER_COUNT_X/Y/Z and MAX_CLUSTER_LIGHTS are the
+// dimensions of the froxel grid and the capacity of each cluster
+
+struct PointLight {
+    // World space position and radius of influence
+    vec4 positionRadius;
+    vec4 colorIntensity;
+};
+
+layout(std430, set = CLUSTER_SET, binding = 0) readonly buffer Lights {
+    PointLight lights[];
+};
+
+layout(set = CLUSTER_SET, binding = 4) uniform ClusterData {
+    mat4 view;
+    vec4 cameraPosition;
+    // Tangent of half the field of view along x and y
+    vec2 tanHalfFov;
+    // In pixels. The tiles along the right and bottom edges may reach past the render extent
+    vec2 tileSize;
+    vec2 renderExtent;
+    float near;
+    float far;
+    // Slice of a view depth d is floor(log(d) * sliceScale + sliceBias)
+    float sliceScale;
+    float sliceBias;
+    uint lightCount;
+};
+
+uint clusterIndex(uvec3 cluster) {
+    return (cluster.z * CLUSTER_COUNT_Y + cluster.y) * CLUSTER_COUNT_X + cluster.x;
+}
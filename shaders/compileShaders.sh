@@ -1,2 +0,0 @@
-/usr/bin/glslc shader.vert -o vert.spv
-/usr/bin/glslc shader.frag -o frag.spv
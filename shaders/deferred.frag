@@ -0,0 +1,36 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+
+// Second subpass of deferred shading. Lights each covered pixel once from the G-buffer written by the first subpass.
+// LIGHTING and SHADOWS select the lighting as in forward shading, otherwise the albedo is output unlit
+
+layout(location = 0) noperspective in vec4 fragWorldAtZero;
+layout(location = 1) flat in vec4 fragWorldPerDepth;
+layout(location = 2) noperspective in vec4 fragViewAtZero;
+layout(location = 3) flat in vec4 fragViewPerDepth;
+
+layout(location = 0) out vec4 outColor;
+
+layout(input_attachment_index = 0, set = 1, binding = 0) uniform subpassInput albedoInput;
+layout(input_attachment_index = 1, set = 1, binding = 1) uniform subpassInput normalInput;
+layout(input_attachment_index = 2, set = 1, binding = 2) uniform subpassInput depthInput;
+
+#include "lighting.glsl"
+#include "surface.glsl"
+
+void main() {
+    vec4 albedo = subpassLoad(albedoInput);
+    if (albedo.a == 0.0) {
+        discard;
+    }
+#if LIGHTING || SHADOWS
+    float depth = subpassLoad(depthInput).r;
+    vec4 worldPosition = fragWorldAtZero + depth * fragWorldPerDepth;
+    vec4 viewPosition = fragViewAtZero + depth * fragViewPerDepth;
+    vec3 normal = octahedralDecode(subpassLoad(normalInput).xy);
+    vec3 lighting = surfaceLighting(worldPosition.xyz / worldPosition.w, -viewPosition.z / viewPosition.w, normal);
+    outColor = vec4(albedo.rgb * lighting, 1.0);
+#else
+    outColor = vec4(albedo.rgb, 1.0);
+#endif
+}
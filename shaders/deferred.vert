@@ -0,0 +1,28 @@
+#version 450
+
+// Full screen triangle of the lighting subpass of deferred shading. The world position of a pixel is reconstructed
+// from its depth: for a fixed pixel, the homogeneous position is linear in the depth, so the positions at depth 0
+// and their change per unit of depth are interpolated across the screen and scaled by the stored depth
+
+layout(location = 0) noperspective out vec4 fragWorldAtZero;
+layout(location = 1) flat out vec4 fragWorldPerDepth;
+layout(location = 2) noperspective out vec4 fragViewAtZero;
+layout(location = 3) flat out vec4 fragViewPerDepth;
+
+// Camera matrices, updated every frame
+layout(set = 0, binding = 0) uniform UniformBufferObject {
+    mat4 view;
+    mat4 proj;
+};
+
+void main() {
+    vec2 ndc = vec2((gl_VertexIndex << 1) & 2, gl_VertexIndex & 2) * 2.0 - 1.0;
+    gl_Position = vec4(ndc, 0.0, 1.0);
+
+    mat4 inverseProj = inverse(proj);
+    mat4 inverseView = inverse(view);
+    fragViewAtZero = inverseProj * vec4(ndc, 0.0, 1.0);
+    fragViewPerDepth = inverseProj[2];
+    fragWorldAtZero = inverseView * fragViewAtZero;
+    fragWorldPerDepth = inverseView * fragViewPerDepth;
+}
@@ -0,0 +1,28 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+
+// First subpass of deferred shading. Writes the surface attributes which the lighting subpass reads at the same pixel
+
+layout(location = 0) in vec3 fragColor;
+layout(location = 1) in vec2 fragTexCoord;
+layout(location = 2) in vec3 fragWorldPosition;
+
+// Alpha marks the pixel as covered, as the lighting subpass leaves uncovered pixels at the clear color
+layout(location = 0) out vec4 outAlbedo;
+layout(location = 1) out vec2 outNormal;
+
+layout(set = 1, binding = 0) uniform sampler2D textures[TEXTURE_COUNT];
+
+layout(push_constant) uniform DrawConstants {
+    // Top three rows of the draw's model matrix
+    mat3x4 transform;
+    uint materialIndex;
+    uint instanceOffset;
+} draw;
+
+#include "surface.glsl"
+
+void main() {
+    outAlbedo = vec4(texture(textures[draw.materialIndex], fragTexCoord).rgb, 1.0);
+    outNormal = octahedralEncode(faceNormal(fragWorldPosition));
+}
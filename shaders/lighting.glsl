@@ -0,0 +1,90 @@
+// Lighting shared by forward shading and the lighting subpass of deferred shading. LIGHTING shades with the point
+// lights of the cluster at the fragment and SHADOWS with a shadowed directional light. The cluster data is in set 2
+// and the shadows in SHADOW_SET
+
+#if LIGHTING
+#define CLUSTER_SET 2
+#include "clusters.glsl"
+
+layout(std430, set = 2, binding = 1) readonly buffer Clusters {
+    uvec2 clusters[];
+};
+
+layout(std430, set = 2, binding = 2) readonly buffer LightIndices {
+    uint lightIndices[];
+};
+
+// Sum of the diffuse light of the lights assigned to the fragment's cluster
+vec3 clusterLighting(vec3 position, float viewDepth, vec3 normal) {
+    uvec2 tile = min(uvec2(gl_FragCoord.xy / tileSize), uvec2(CLUSTER_COUNT_X - 1, CLUSTER_COUNT_Y - 1));
+    uint slice = uint(clamp(log(viewDepth) * sliceScale + sliceBias, 0.0, float(CLUSTER_COUNT_Z - 1)));
+    uvec2 cluster = clusters[clusterIndex(uvec3(tile, slice))];
+
+    vec3 lighting = vec3(0.0);
+    for (uint i = cluster.x; i < cluster.x + cluster.y; i++) {
+        PointLight light = lights[lightIndices[i]];
+        vec3 toLight = light.positionRadius.xyz - position;
+        float distanceSquared = dot(toLight, toLight);
+        float radiusSquared = light.positionRadius.w * light.positionRadius.w;
+
+        // Falls off smoothly to 0 at the radius, so that lights beyond it can be skipped without a visible edge
+        float window = clamp(1.0 - (distanceSquared * distanceSquared) / (radiusSquared * radiusSquared), 0.0, 1.0);
+        float diffuse = max(dot(normal, toLight * inversesqrt(max(distanceSquared, 1e-8))), 0.0);
+        lighting += light.colorIntensity.rgb * light.colorIntensity.w * diffuse * window * window;
+    }
+    return lighting;
+}
+#endif
+
+#if SHADOWS
+layout(set = SHADOW_SET, binding = 0) uniform ShadowData {
+    // Light space view projection of each cascade, nearest first
+    mat4 cascadeMatrices[MAX_SHADOW_CASCADES];
+    // World space size of a texel of each cascade
+    vec4 cascadeTexelSizes;
+    // Towards the light
+    vec4 lightDirection;
+    vec4 lightColor;
+    uint cascadeCount;
+    // Margin in normalized device coordinates where a cascade is not sampled
+    float cascadeEdge;
+};
+
+layout(set = SHADOW_SET, binding = 1) uniform sampler2DArrayShadow shadowMap;
+
+// Fraction of the light reaching the fragment, from the nearest cascade which covers it. The position is offset
+// along the normal by a texel or so, which removes self shadowing on surfaces at a grazing angle to the light
+float shadowVisibility(vec3 position, vec3 normal) {
+    for (uint i = 0; i < cascadeCount; i++) {
+        vec4 ndc = cascadeMatrices[i] * vec4(position + normal * (1.5 * cascadeTexelSizes[i]), 1.0);
+        if (all(lessThan(abs(ndc.xy), vec2(1.0 - cascadeEdge)))) {
+            return texture(shadowMap, vec4(ndc.xy * 0.5 + 0.5, float(i), ndc.z));
+        }
+    }
+    return 1.0;
+}
+
+vec3 sunLighting(vec3 position, vec3 normal) {
+    float diffuse = max(dot(normal, lightDirection.xyz), 0.0);
+    if (diffuse == 0.0) {
+        return vec3(0.0);
+    }
+    return lightColor.rgb * lightColor.a * diffuse * shadowVisibility(position, normal);
+}
+#endif
+
+#if LIGHTING || SHADOWS
+const float AMBIENT = 0.05;
+
+// Light reaching a surface, to be multiplied by its albedo
+vec3 surfaceLighting(vec3 position, float viewDepth, vec3 normal) {
+    vec3 lighting = vec3(AMBIENT);
+#if LIGHTING
+    lighting += clusterLighting(position, viewDepth, normal);
+#endif
+#if SHADOWS
+    lighting += sunLighting(position, normal);
+#endif
+    return lighting;
+}
+#endif
@@ -0,0 +1,8 @@
+#version 450
+
+// Every shaded fragment adds one step with additive blending, so the color counts the fragments shaded per pixel
+layout(location = 0) out vec4 outColor;
+
+void main() {
+    outColor = vec4(vec3(OVERDRAW_STEP), 1.0);
+}
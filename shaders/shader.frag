@@ -1,12 +1,36 @@
 #version 450
+#extension GL_GOOGLE_include_directive : require
+
+// LIGHTING shades with the point lights of the fragment's cluster and SHADOWS with a shadowed directional light.
+// Otherwise the texture is output unlit
 
 layout(location = 0) in vec3 fragColor;
 layout(location = 1) in vec2 fragTexCoord;
+#if LIGHTING || SHADOWS
+layout(location = 2) in vec3 fragWorldPosition;
+layout(location = 3) in float fragViewDepth;
+#endif
 
 layout(location = 0) out vec4 outColor;
 
-layout(binding = 1) uniform sampler2D texSampler;
+layout(set = 1, binding = 0) uniform sampler2D textures[TEXTURE_COUNT];
+
+layout(push_constant) uniform DrawConstants {
+    // Top three rows of the draw's model matrix
+    mat3x4 transform;
+    uint materialIndex;
+    uint instanceOffset;
+} draw;
+
+#include "lighting.glsl"
+#include "surface.glsl"
 
 void main() {
-    outColor = texture(texSampler, fragTexCoord);
-}
\ No newline at end of file
+    vec4 albedo = texture(textures[draw.materialIndex], fragTexCoord);
+#if LIGHTING || SHADOWS
+    vec3 normal = faceNormal(fragWorldPosition);
+    outColor = vec4(albedo.rgb * surfaceLighting(fragWorldPosition, fragViewDepth, normal), albedo.a);
+#else
+    outColor = albedo;
+#endif
+}
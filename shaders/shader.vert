@@ -1,20 +1,88 @@
 #version 450
 
+// Number of views rendered in one pass by a multiview render pass. 0 renders a single view
+#if MULTIVIEW
+#extension GL_EXT_multiview : require
+#endif
+
+// DEPTH_ONLY reads positions only, for the depth pre-pass. WORLD_POSITION outputs what lighting and shadows need
 layout(location = 0) in vec3 pos;
+#if !DEPTH_ONLY
 layout(location = 1) in vec3 col;
 layout(location = 2) in vec2 inTexCoord;
+#endif
+
+#if INSTANCE_ATTRIBUTES
+// Rows of the instance transform from the instance rate binding
+layout(location = 3) in vec4 transformRow0;
+layout(location = 4) in vec4 transformRow1;
+layout(location = 5) in vec4 transformRow2;
+#endif
 
+#if !DEPTH_ONLY
 layout(location = 0) out vec3 fragColor;
 layout(location = 1) out vec2 fragTexCoord;
+#endif
+#if WORLD_POSITION
+layout(location = 2) out vec3 fragWorldPosition;
+// Distance in front of the camera, which selects the depth slice of the cluster
+layout(location = 3) out float fragViewDepth;
+#endif
+
+// The color pass after a depth pre-pass tests for equal depth, so both variants must compute identical positions
+invariant gl_Position;
 
-layout(binding = 0) uniform UniformBufferObject {
-    mat4 model;
+#if MULTIVIEW
+// Matrices of every view, indexed by the view being rendered
+layout(set = 0, binding = 0) uniform UniformBufferObject {
+    mat4 views[MULTIVIEW];
+    mat4 projections[MULTIVIEW];
+};
+#define VIEW views[gl_ViewIndex]
+#define PROJ projections[gl_ViewIndex]
+#else
+// Camera matrices, updated every frame
+layout(set = 0, binding = 0) uniform UniformBufferObject {
     mat4 view;
     mat4 proj;
 };
+#define VIEW view
+#define PROJ proj
+#endif
+
+struct Instance {
+    // Top three rows of the affine model matrix
+    mat3x4 transform;
+    uint meshIndex;
+};
+
+layout(std430, set = 1, binding = 1) readonly buffer Instances {
+    Instance instances[];
+};
+
+layout(push_constant) uniform DrawConstants {
+    // Top three rows of the draw's model matrix
+    mat3x4 transform;
+    uint materialIndex;
+    uint instanceOffset;
+} draw;
 
 void main() {
-    gl_Position = proj * view * model * vec4(pos, 1.0);
+#if INSTANCE_ATTRIBUTES
+    mat3x4 transform = mat3x4(transformRow0, transformRow1, transformRow2);
+#else
+    mat3x4 transform = instances[draw.instanceOffset + gl_InstanceIndex].transform;
+#endif
+    vec3 instancePos = vec4(pos, 1.0) * draw.transform;
+    vec3 worldPos = vec4(instancePos, 1.0) * transform;
+    vec4 viewPos = VIEW * vec4(worldPos, 1.0);
+    gl_Position = PROJ * viewPos;
+#if !DEPTH_ONLY
     fragColor = col;
     fragTexCoord = inTexCoord;
-}
\ No newline at end of file
+#endif
+#if WORLD_POSITION
+    fragWorldPosition = worldPos;
+    fragViewDepth = -viewPos.z;
+#endif
+}
@@ -0,0 +1,24 @@
+// Surface normals shared by forward shading and the G-buffer
+
+// The model has no normals, so the face normal is taken from the derivatives of the position. With y pointing down
+// the screen, this order of the derivatives turns it towards the camera
+vec3 faceNormal(vec3 position) {
+    return normalize(cross(dFdy(position), dFdx(position)));
+}
+
+// Unit vector folded onto the octahedron and flattened onto a square in [-1, 1], which keeps the error even over the
+// sphere with two components
+vec2 octahedralEncode(vec3 normal) {
+    vec2 square = normal.xy / (abs(normal.x) + abs(normal.y) + abs(normal.z));
+    if (normal.z < 0.0) {
+        square = (1.0 - abs(square.yx)) * mix(vec2(-1.0), vec2(1.0), greaterThanEqual(square, vec2(0.0)));
+    }
+    return square;
+}
+
+vec3 octahedralDecode(vec2 square) {
+    vec3 normal = vec3(square, 1.0 - abs(square.x) - abs(square.y));
+    float fold = max(-normal.z, 0.0);
+    normal.xy -= fold * mix(vec2(-1.0), vec2(1.0), greaterThanEqual(normal.xy, vec2(0.0)));
+    return normalize(normal);
+}
@@ -0,0 +1,572 @@
+#include "shadowMaps.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <glm/gtc/matrix_transform.hpp>
+#include <iostream>
+#include <stdexcept>
+
+#include "camera.h"
+
+// Color of the light in rgb and its intensity in a
+const glm::vec4 LIGHT_COLOR{1.0f, 0.95f, 0.85f, 1.0f};
+
+// Each cascade covers a region this many times larger than the previous one
+const float CASCADE_RATIO = 3.0f;
+
+// Looking along the light from the origin, so that light space does not depend on the camera
+static glm::mat4 lightView(glm::vec3 lightDirection) {
+  glm::vec3 up = std::abs(lightDirection.z) > 0.99f ? glm::vec3{0.0f, 1.0f, 0.0f} : glm::vec3{0.0f, 0.0f, 1.0f};
+  return glm::lookAt(lightDirection, glm::vec3{0.0f}, up);
+}
+
+// Half the radius rounded down to whole texels, and at least one texel
+float cascadeSnapStep(float radius, float halfExtent, uint32_t resolution) {
+  float texelSize = 2.0f * halfExtent / resolution;
+  return std::max(std::floor(0.5f * radius / texelSize), 1.0f) * texelSize;
+}
+
+glm::vec2 snapCascadeCenter(glm::vec2 focus, float snapStep) {
+  return {std::round(focus.x / snapStep) * snapStep, std::round(focus.y / snapStep) * snapStep};
+}
+
+static VkImageView createLayerView(const VulkanContext& ctx, VkImage image, VkFormat format, uint32_t baseLayer, uint32_t layerCount) {
+  VkImageViewCreateInfo viewInfo{};
+  viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+  viewInfo.image = image;
+  viewInfo.viewType = layerCount > 1 ? VK_IMAGE_VIEW_TYPE_2D_ARRAY : VK_IMAGE_VIEW_TYPE_2D;
+  viewInfo.format = format;
+  viewInfo.subresourceRange = {VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, baseLayer, layerCount};
+
+  VkImageView imageView;
+  if (vkCreateImageView(ctx.device, &viewInfo, nullptr, &imageView) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to create shadow map view");
+  }
+  return imageView;
+}
+
+ShadowMaps::ShadowMaps(const VulkanContext& ctx, const ShadowConfig& config, uint32_t framesInFlight, VkDescriptorSetLayout viewSetLayout,
+                       glm::vec4 sceneBounds)
+    : ctx{ctx}, depthFormat{findDepthFormat(ctx)}, config{config}, sceneBounds{sceneBounds} {
+  if (config.cascadeCount == 0 || config.cascadeCount > MAX_SHADOW_CASCADES) {
+    throw std::runtime_error("Unsupported number of shadow cascades");
+  }
+
+  // The farthest cascade covers the scene's radius, or more with the margins
+  for (uint32_t i = 0; i < config.cascadeCount; i++) {
+    Cascade cascade{};
+    cascade.radius = sceneBounds.w / std::pow(CASCADE_RATIO, static_cast<float>(config.cascadeCount - 1 - i));
+    // The snapped center is at most half a step from the focus along each axis
+    cascade.halfExtent = 1.25f * cascade.radius;
+    cascade.snapStep = cascadeSnapStep(cascade.radius, cascade.halfExtent, config.resolution);
+    cascades.push_back(cascade);
+  }
+  work.resize(config.cascadeCount);
+
+  // ----- Render passes -----
+  if (config.cache) {
+    renderPass = createRenderPass(VK_ATTACHMENT_LOAD_OP_CLEAR, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+    dynamicRenderPass = createRenderPass(VK_ATTACHMENT_LOAD_OP_LOAD, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                                         VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL);
+  } else {
+    renderPass = createRenderPass(VK_ATTACHMENT_LOAD_OP_CLEAR, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL);
+  }
+
+  createImages();
+
+  // ----- Sampler -----
+  // Compares with the reference depth and filters the results of the four nearest texels
+  VkFormatProperties formatProperties;
+  vkGetPhysicalDeviceFormatProperties(ctx.physicalDevice, depthFormat, &formatProperties);
+  VkFilter filter = (formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT) ? VK_FILTER_LINEAR
+                                                                                                                 : VK_FILTER_NEAREST;
+
+  VkSamplerCreateInfo samplerInfo{};
+  samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+  samplerInfo.magFilter = filter;
+  samplerInfo.minFilter = filter;
+  samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+  samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+  samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+  samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+  samplerInfo.compareEnable = VK_TRUE;
+  samplerInfo.compareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+  samplerInfo.maxLod = 0.0f;
+
+  if (vkCreateSampler(ctx.device, &samplerInfo, nullptr, &sampler) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to create shadow map sampler");
+  }
+
+  // ----- Uniforms -----
+  VkDeviceSize alignment = ctx.properties.limits.minUniformBufferOffsetAlignment;
+  auto align = [alignment](VkDeviceSize size) { return (size + alignment - 1) / alignment * alignment; };
+
+  viewOffset = align(sizeof(ShadowData));
+  viewStride = align(2 * sizeof(glm::mat4));
+  frameStride = align(viewOffset + config.cascadeCount * viewStride);
+  VkDeviceSize uniformSize = framesInFlight * frameStride;
+
+  createBuffer(ctx, uniformSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+               VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, uniformBuffer, uniformMemory);
+  vkMapMemory(ctx.device, uniformMemory, 0, uniformSize, 0, &uniformMapped);
+
+  descriptorSets.resize(framesInFlight);
+  createDescriptorSets(viewSetLayout);
+}
+
+// The device must be idle
+ShadowMaps::~ShadowMaps() {
+  vkDestroyDescriptorPool(ctx.device, descriptorPool, nullptr);
+  vkDestroyDescriptorSetLayout(ctx.device, setLayout, nullptr);
+  vkDestroyBuffer(ctx.device, uniformBuffer, nullptr);
+  vkFreeMemory(ctx.device, uniformMemory, nullptr);
+  vkDestroySampler(ctx.device, sampler, nullptr);
+
+  for (auto framebuffer : cacheFramebuffers) {
+    vkDestroyFramebuffer(ctx.device, framebuffer, nullptr);
+  }
+  for (auto framebuffer : shadowFramebuffers) {
+    vkDestroyFramebuffer(ctx.device, framebuffer, nullptr);
+  }
+  for (auto view : cacheLayerViews) {
+    vkDestroyImageView(ctx.device, view, nullptr);
+  }
+  for (auto view : shadowLayerViews) {
+    vkDestroyImageView(ctx.device, view, nullptr);
+  }
+  vkDestroyImageView(ctx.device, shadowArrayView, nullptr);
+
+  vkDestroyImage(ctx.device, cacheImage, nullptr);
+  vkFreeMemory(ctx.device, cacheMemory, nullptr);
+  vkDestroyImage(ctx.device, shadowImage, nullptr);
+  vkFreeMemory(ctx.device, shadowMemory, nullptr);
+
+  vkDestroyRenderPass(ctx.device, renderPass, nullptr);
+  vkDestroyRenderPass(ctx.device, dynamicRenderPass, nullptr);
+}
+
+// Rendered to, sampled with a filter and copied. 16 bit depth is supported everywhere
+VkFormat ShadowMaps::findDepthFormat(const VulkanContext& ctx) {
+  const VkFormatFeatureFlags features = VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT |
+                                        VK_FORMAT_FEATURE_TRANSFER_SRC_BIT | VK_FORMAT_FEATURE_TRANSFER_DST_BIT;
+
+  for (VkFormat format : {VK_FORMAT_D32_SFLOAT, VK_FORMAT_D16_UNORM}) {
+    VkFormatProperties properties;
+    vkGetPhysicalDeviceFormatProperties(ctx.physicalDevice, format, &properties);
+    if ((properties.optimalTilingFeatures & features) == features) {
+      return format;
+    }
+  }
+  throw std::runtime_error("Failed to find a shadow map format");
+}
+
+/**
+ * Depth only pass over one layer. The dependencies cover every earlier use of the layer: sampling by the scene,
+ * copies and rendering. Afterwards the layer may be copied or sampled
+ */
+VkRenderPass ShadowMaps::createRenderPass(VkAttachmentLoadOp loadOp, VkImageLayout initialLayout, VkImageLayout finalLayout) {
+  VkAttachmentDescription depthAttachment{};
+  depthAttachment.format = depthFormat;
+  depthAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+  depthAttachment.loadOp = loadOp;
+  depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+  depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+  depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+  depthAttachment.initialLayout = initialLayout;
+  depthAttachment.finalLayout = finalLayout;
+
+  VkAttachmentReference depthAttachmentRef{0, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL};
+
+  VkSubpassDescription subpass{};
+  subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+  subpass.pDepthStencilAttachment = &depthAttachmentRef;
+
+  std::array<VkSubpassDependency, 2> dependencies{};
+
+  dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+  dependencies[0].dstSubpass = 0;
+  dependencies[0].srcStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+  dependencies[0].srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+  dependencies[0].dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+  dependencies[0].dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+  dependencies[1].srcSubpass = 0;
+  dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+  dependencies[1].srcStageMask = VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+  dependencies[1].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+  dependencies[1].dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT;
+  dependencies[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT;
+
+  VkRenderPassCreateInfo renderPassInfo{};
+  renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+  renderPassInfo.attachmentCount = 1;
+  renderPassInfo.pAttachments = &depthAttachment;
+  renderPassInfo.subpassCount = 1;
+  renderPassInfo.pSubpasses = &subpass;
+  renderPassInfo.dependencyCount = static_cast<uint32_t>(dependencies.size());
+  renderPassInfo.pDependencies = dependencies.data();
+
+  VkRenderPass pass;
+  if (vkCreateRenderPass(ctx.device, &renderPassInfo, nullptr, &pass) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to create shadow render pass");
+  }
+  // The cached and dynamic passes only differ in load operations and layouts, so they share the key
+  renderPassKey = hashRenderPassCompatibility(renderPassInfo);
+  return pass;
+}
+
+void ShadowMaps::createImages() {
+  auto createLayeredImage = [&](VkImageUsageFlags usage, VkImage& image, VkDeviceMemory& memory) {
+    VkImageCreateInfo imageInfo{};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.extent = {config.resolution, config.resolution, 1};
+    imageInfo.mipLevels = 1;
+    imageInfo.arrayLayers = config.cascadeCount;
+    imageInfo.format = depthFormat;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    imageInfo.usage = usage;
+    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    if (vkCreateImage(ctx.device, &imageInfo, nullptr, &image) != VK_SUCCESS) {
+      throw std::runtime_error("Failed to create shadow map");
+    }
+
+    VkMemoryRequirements memRequirements;
+    vkGetImageMemoryRequirements(ctx.device, image, &memRequirements);
+
+    VkMemoryAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.allocationSize = memRequirements.size;
+    allocInfo.memoryTypeIndex = findMemoryType(ctx.physicalDevice, memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+    if (vkAllocateMemory(ctx.device, &allocInfo, nullptr, &memory) != VK_SUCCESS) {
+      throw std::runtime_error("Failed to allocate shadow map memory");
+    }
+    vkBindImageMemory(ctx.device, image, memory, 0);
+  };
+
+  auto createFramebuffer = [&](VkImageView view) {
+    VkFramebufferCreateInfo framebufferInfo{};
+    framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+    framebufferInfo.renderPass = renderPass;
+    framebufferInfo.attachmentCount = 1;
+    framebufferInfo.pAttachments = &view;
+    framebufferInfo.width = config.resolution;
+    framebufferInfo.height = config.resolution;
+    framebufferInfo.layers = 1;
+
+    VkFramebuffer framebuffer;
+    if (vkCreateFramebuffer(ctx.device, &framebufferInfo, nullptr, &framebuffer) != VK_SUCCESS) {
+      throw std::runtime_error("Failed to create shadow map framebuffer");
+    }
+    return framebuffer;
+  };
+
+  VkImageUsageFlags shadowUsage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+  if (config.cache) {
+    createLayeredImage(VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, cacheImage, cacheMemory);
+    shadowUsage |= VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+  }
+  createLayeredImage(shadowUsage, shadowImage, shadowMemory);
+
+  for (uint32_t i = 0; i < config.cascadeCount; i++) {
+    if (config.cache) {
+      cacheLayerViews.push_back(createLayerView(ctx, cacheImage, depthFormat, i, 1));
+      cacheFramebuffers.push_back(createFramebuffer(cacheLayerViews[i]));
+    }
+    shadowLayerViews.push_back(createLayerView(ctx, shadowImage, depthFormat, i, 1));
+    shadowFramebuffers.push_back(createFramebuffer(shadowLayerViews[i]));
+  }
+
+  // Sampled as an array even with a single cascade
+  VkImageViewCreateInfo viewInfo{};
+  viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+  viewInfo.image = shadowImage;
+  viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D_ARRAY;
+  viewInfo.format = depthFormat;
+  viewInfo.subresourceRange = {VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, 0, config.cascadeCount};
+
+  if (vkCreateImageView(ctx.device, &viewInfo, nullptr, &shadowArrayView) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to create shadow map view");
+  }
+}
+
+// Per frame, one set sampled by the scene and one set of the renderer's frame set layout per cascade
+void ShadowMaps::createDescriptorSets(VkDescriptorSetLayout viewSetLayout) {
+  std::array<VkDescriptorSetLayoutBinding, 2> bindings{};
+  bindings[0].binding = 0;
+  bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+  bindings[0].descriptorCount = 1;
+  bindings[0].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+  bindings[1].binding = 1;
+  bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+  bindings[1].descriptorCount = 1;
+  bindings[1].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+  VkDescriptorSetLayoutCreateInfo layoutInfo{};
+  layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+  layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+  layoutInfo.pBindings = bindings.data();
+
+  if (vkCreateDescriptorSetLayout(ctx.device, &layoutInfo, nullptr, &setLayout) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to create shadow descriptor set layout");
+  }
+
+  uint32_t frameCount = static_cast<uint32_t>(descriptorSets.size());
+  uint32_t viewSetCount = frameCount * config.cascadeCount;
+
+  std::array<VkDescriptorPoolSize, 2> poolSizes{};
+  poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+  poolSizes[0].descriptorCount = frameCount + viewSetCount;
+  poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+  poolSizes[1].descriptorCount = frameCount;
+
+  VkDescriptorPoolCreateInfo poolInfo{};
+  poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+  poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+  poolInfo.pPoolSizes = poolSizes.data();
+  poolInfo.maxSets = frameCount + viewSetCount;
+
+  if (vkCreateDescriptorPool(ctx.device, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to create shadow descriptor pool");
+  }
+
+  std::vector<VkDescriptorSetLayout> layouts(frameCount, setLayout);
+  layouts.insert(layouts.end(), viewSetCount, viewSetLayout);
+  std::vector<VkDescriptorSet> sets(layouts.size());
+
+  VkDescriptorSetAllocateInfo allocInfo{};
+  allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+  allocInfo.descriptorPool = descriptorPool;
+  allocInfo.descriptorSetCount = static_cast<uint32_t>(sets.size());
+  allocInfo.pSetLayouts = layouts.data();
+
+  if (vkAllocateDescriptorSets(ctx.device, &allocInfo, sets.data()) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to allocate shadow descriptor sets");
+  }
+  descriptorSets.assign(sets.begin(), sets.begin() + frameCount);
+  viewSets.assign(sets.begin() + frameCount, sets.end());
+
+  VkDescriptorImageInfo imageInfo{sampler, shadowArrayView, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL};
+  std::vector<VkDescriptorBufferInfo> bufferInfos(frameCount + viewSetCount);
+  std::vector<VkWriteDescriptorSet> writes;
+
+  for (uint32_t frame = 0; frame < frameCount; frame++) {
+    bufferInfos[frame] = {uniformBuffer, frame * frameStride, sizeof(ShadowData)};
+    for (uint32_t i = 0; i < config.cascadeCount; i++) {
+      bufferInfos[frameCount + frame * config.cascadeCount + i] = {uniformBuffer, frame * frameStride + viewOffset + i * viewStride,
+                                                                   2 * sizeof(glm::mat4)};
+    }
+  }
+
+  for (uint32_t i = 0; i < sets.size(); i++) {
+    VkWriteDescriptorSet write{};
+    write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write.dstSet = sets[i];
+    write.dstBinding = 0;
+    write.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    write.descriptorCount = 1;
+    write.pBufferInfo = &bufferInfos[i];
+    writes.push_back(write);
+
+    if (i < frameCount) {
+      write.dstBinding = 1;
+      write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+      write.pBufferInfo = nullptr;
+      write.pImageInfo = &imageInfo;
+      writes.push_back(write);
+    }
+  }
+
+  vkUpdateDescriptorSets(ctx.device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+}
+
+VkExtent2D ShadowMaps::extent() const {
+  return {config.resolution, config.resolution};
+}
+
+VkDescriptorSet ShadowMaps::descriptorSet(uint32_t frame) const {
+  return descriptorSets[frame];
+}
+
+// The depth range covers the whole scene so that casters outside the region still cast into it
+void ShadowMaps::place(Cascade& cascade, glm::vec2 center, glm::vec3 lightDirection) const {
+  cascade.valid = true;
+  cascade.center = center;
+  cascade.lightDirection = lightDirection;
+  cascade.view = lightView(lightDirection);
+
+  float sceneDepth = -(cascade.view * glm::vec4{glm::vec3{sceneBounds}, 1.0f}).z;
+  float h = cascade.halfExtent;
+  cascade.projection = glm::ortho(center.x - h, center.x + h, center.y - h, center.y + h, sceneDepth - sceneBounds.w, sceneDepth + sceneBounds.w);
+}
+
+/**
+ * Called once per frame after waiting for the frame and before recording it. Places the cascades around the camera
+ * and decides which are rendered. Returns whether the recorded shadow work differs from the previous frame's, in which
+ * case recorded command buffers are stale. The light direction points towards the light
+ */
+bool ShadowMaps::update(uint32_t frame, const Camera& camera, glm::vec3 lightDirection, bool dynamicCasters) {
+  frames++;
+
+  glm::mat4 view = lightView(lightDirection);
+  // The orbit camera looks at the origin
+  glm::vec3 forward = -glm::normalize(camera.position);
+  uint32_t budget = config.updateBudget > 0 ? config.updateBudget : UINT32_MAX;
+
+  bool working = false;
+  for (uint32_t i = 0; i < cascades.size(); i++) {
+    Cascade& cascade = cascades[i];
+    CascadeWork& cascadeWork = work[i];
+    cascadeWork = {};
+
+    // Centered on the point a radius ahead of the camera, so that the cascade covers what the camera sees up to twice
+    // its radius away
+    glm::vec4 focus = view * glm::vec4{camera.position + forward * cascade.radius, 1.0f};
+    glm::vec2 center = snapCascadeCenter({focus.x, focus.y}, cascade.snapStep);
+    bool moved = !cascade.valid || center != cascade.center || lightDirection != cascade.lightDirection;
+
+    // Cascades which were never rendered cannot wait for their turn
+    if (!config.cache || !cascade.valid || (moved && budget > 0)) {
+      budget -= budget > 0 ? 1 : 0;
+      place(cascade, center, lightDirection);
+      cascadeWork.renderStatic = true;
+      staticRenders++;
+    } else if (moved) {
+      deferredRenders++;
+    }
+
+    if (config.cache) {
+      bool dynamicDue = dynamicCasters && (i == 0 || frames - cascade.compositedFrame >= config.distantInterval);
+      cascadeWork.composite = cascadeWork.renderStatic || dynamicDue;
+      if (cascadeWork.composite) {
+        cascade.compositedFrame = frames;
+        composites++;
+      }
+    }
+    working = working || cascadeWork.renderStatic || cascadeWork.composite;
+  }
+
+  // ----- Uniforms -----
+  char* base = static_cast<char*>(uniformMapped) + frame * frameStride;
+
+  ShadowData data{};
+  for (uint32_t i = 0; i < cascades.size(); i++) {
+    data.cascadeMatrices[i] = cascades[i].projection * cascades[i].view;
+    data.cascadeTexelSizes[i] = 2.0f * cascades[i].halfExtent / config.resolution;
+
+    char* viewBlock = base + viewOffset + i * viewStride;
+    memcpy(viewBlock, &cascades[i].view, sizeof(glm::mat4));
+    memcpy(viewBlock + sizeof(glm::mat4), &cascades[i].projection, sizeof(glm::mat4));
+  }
+  data.lightDirection = glm::vec4{lightDirection, 0.0f};
+  data.lightColor = LIGHT_COLOR;
+  data.cascadeCount = config.cascadeCount;
+  // Two texels, where filtering would read past the edge
+  data.cascadeEdge = 4.0f / config.resolution;
+  memcpy(base, &data, sizeof(data));
+
+  bool changed = working || worked;
+  worked = working;
+  return changed;
+}
+
+uint32_t ShadowMaps::cascadeCount() const {
+  return static_cast<uint32_t>(cascades.size());
+}
+
+// Whether the next record renders the static casters of the cascade, or all casters when nothing is cached. Valid
+// after update, so that the casters can be culled before recording
+bool ShadowMaps::rendersStaticCasters(uint32_t cascade) const {
+  return work[cascade].renderStatic;
+}
+
+glm::mat4 ShadowMaps::viewProjection(uint32_t cascade) const {
+  return cascades[cascade].projection * cascades[cascade].view;
+}
+
+void ShadowMaps::beginRenderPass(VkCommandBuffer commandBuffer, VkRenderPass pass, VkFramebuffer framebuffer) const {
+  VkClearValue clearDepth{};
+  clearDepth.depthStencil = {1.0f, 0};
+
+  VkRenderPassBeginInfo renderPassInfo{};
+  renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+  renderPassInfo.renderPass = pass;
+  renderPassInfo.framebuffer = framebuffer;
+  renderPassInfo.renderArea.offset = {0, 0};
+  renderPassInfo.renderArea.extent = extent();
+  renderPassInfo.clearValueCount = 1;
+  renderPassInfo.pClearValues = &clearDepth;
+
+  vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+}
+
+/**
+ * Render the cascades chosen by the last update. Must be recorded outside of a render pass, before the scene samples
+ * the shadow maps
+ */
+void ShadowMaps::record(VkCommandBuffer commandBuffer, uint32_t frame, const DrawFunction& draw) {
+  uint32_t frameDraws = 0;
+
+  for (uint32_t i = 0; i < cascades.size(); i++) {
+    VkDescriptorSet viewSet = viewSets[frame * config.cascadeCount + i];
+
+    if (work[i].renderStatic) {
+      beginRenderPass(commandBuffer, renderPass, config.cache ? cacheFramebuffers[i] : shadowFramebuffers[i]);
+      frameDraws += draw(commandBuffer, viewSet, i, config.cache ? ShadowCasters::Static : ShadowCasters::All);
+      vkCmdEndRenderPass(commandBuffer);
+    }
+    if (!work[i].composite) {
+      continue;
+    }
+
+    // ----- Copy the cache and draw the dynamic casters on top -----
+    // The previous contents are overwritten, but may still be sampled by the previous frame
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = shadowImage;
+    barrier.subresourceRange = {VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, i, 1};
+
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+                         0, nullptr, 0, nullptr, 1, &barrier);
+
+    VkImageCopy region{};
+    region.srcSubresource = {VK_IMAGE_ASPECT_DEPTH_BIT, 0, i, 1};
+    region.dstSubresource = {VK_IMAGE_ASPECT_DEPTH_BIT, 0, i, 1};
+    region.extent = {config.resolution, config.resolution, 1};
+    vkCmdCopyImage(commandBuffer, cacheImage, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, shadowImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                   1, &region);
+
+    beginRenderPass(commandBuffer, dynamicRenderPass, shadowFramebuffers[i]);
+    frameDraws += draw(commandBuffer, viewSet, i, ShadowCasters::Dynamic);
+    vkCmdEndRenderPass(commandBuffer);
+  }
+
+  drawTotal += frameDraws;
+  maxFrameDraws = std::max(maxFrameDraws, frameDraws);
+}
+
+void ShadowMaps::report() const {
+  if (frames == 0) {
+    return;
+  }
+  std::cout << "Shadow maps (" << config.cascadeCount << " cascades of " << config.resolution << "x" << config.resolution << ", "
+            << (config.cache ? "cached" : "uncached") << "): average " << (double)drawTotal / frames << " shadow draws per frame, max "
+            << maxFrameDraws << ". " << (double)staticRenders / frames << " cascade renders and " << (double)composites / frames
+            << " composites per frame";
+  if (config.cache && config.updateBudget > 0) {
+    std::cout << ", " << deferredRenders << " cascade renders deferred by the update budget";
+  }
+  std::cout << std::endl;
+}
@@ -0,0 +1,168 @@
+#pragma once
+
+#include <functional>
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "vulkanUtils.h"
+
+struct Camera;
+
+// Cascades the shaders have room for
+const uint32_t MAX_SHADOW_CASCADES = 4;
+
+// Casters drawn into a cascade
+enum class ShadowCasters {
+  // Geometry which never moves, rendered into the cache
+  Static,
+  // Geometry which moves, rendered on top of a copy of the cache
+  Dynamic,
+  // Both, when nothing is cached
+  All
+};
+
+struct ShadowConfig {
+  uint32_t cascadeCount = 3;
+  // Width and height of every cascade
+  uint32_t resolution = 2048;
+  // Keep the static casters of each cascade and only render them again when the cascade or the light moves.
+  // Otherwise every caster is rendered into every cascade every frame
+  bool cache = true;
+  // Cascades whose static casters are rendered again in one frame, nearest first. The others keep their previous
+  // placement until their turn. 0 is unlimited
+  uint32_t updateBudget = 0;
+  // Frames between updates of the dynamic casters in all but the nearest cascade
+  uint32_t distantInterval = 1;
+};
+
+// Step of a cascade's center in light space for a square of halfExtent on either side at a resolution
+float cascadeSnapStep(float radius, float halfExtent, uint32_t resolution);
+// Nearest multiple of the step, so that the region moves by whole texels
+glm::vec2 snapCascadeCenter(glm::vec2 focus, float snapStep);
+
+/**
+ * Cascaded shadow maps of a directional light. Each cascade is a square layer covering a region around the camera,
+ * larger for every cascade. The region is placed on a grid of whole texels in light space, so that it only moves, and
+ * is only rendered again, once the camera has travelled a fraction of its size.
+ *
+ * Static casters are rendered into a cache layer when the region or the light direction changes. Every frame with
+ * dynamic casters, the cache is copied into the sampled layer and the dynamic casters are drawn on top, so moving
+ * geometry never causes the static geometry to be drawn again. Cascades keep the matrices they were rendered with until
+ * they are rendered again, so stale cascades stay consistent. The scene samples all cascades through one descriptor set
+ */
+class ShadowMaps {
+ public:
+  const VulkanContext& ctx;
+
+  VkFormat depthFormat;
+  // Depth only. Renders the static casters into the cache, or all casters when nothing is cached
+  VkRenderPass renderPass;
+  // Compatibility key of renderPass for pipeline descriptions
+  uint64_t renderPassKey;
+  // Binding 0 holds the cascade matrices and the light, binding 1 all cascades with depth comparison
+  VkDescriptorSetLayout setLayout;
+
+  // Records the draws of the casters of one cascade and returns the number of draws. Set 0 holds the cascade's
+  // matrices in the layout of the renderer's frame set
+  using DrawFunction = std::function<uint32_t(VkCommandBuffer commandBuffer, VkDescriptorSet viewSet, uint32_t cascade,
+                                              ShadowCasters casters)>;
+
+  ShadowMaps() = delete;
+  ShadowMaps(const VulkanContext& ctx, const ShadowConfig& config, uint32_t framesInFlight, VkDescriptorSetLayout viewSetLayout,
+             glm::vec4 sceneBounds);
+  ShadowMaps(const ShadowMaps& shadowMaps) = delete;
+  ~ShadowMaps();
+
+  VkExtent2D extent() const;
+  VkDescriptorSet descriptorSet(uint32_t frame) const;
+  bool update(uint32_t frame, const Camera& camera, glm::vec3 lightDirection, bool dynamicCasters);
+  uint32_t cascadeCount() const;
+  bool rendersStaticCasters(uint32_t cascade) const;
+  glm::mat4 viewProjection(uint32_t cascade) const;
+  void record(VkCommandBuffer commandBuffer, uint32_t frame, const DrawFunction& draw);
+  void report() const;
+
+ private:
+  // Matches the uniform block in shader.frag
+  struct ShadowData {
+    glm::mat4 cascadeMatrices[MAX_SHADOW_CASCADES];
+    glm::vec4 cascadeTexelSizes;
+    glm::vec4 lightDirection;
+    glm::vec4 lightColor;
+    uint32_t cascadeCount;
+    float cascadeEdge;
+  };
+
+  struct Cascade {
+    // Radius of the region around the camera the cascade must cover, and half the side of the square it covers
+    float radius;
+    float halfExtent;
+    // Step of the region's center in light space, a whole number of texels
+    float snapStep;
+
+    // ----- Rendered -----
+    bool valid = false;
+    glm::vec2 center{};
+    glm::vec3 lightDirection{};
+    glm::mat4 view{1.0f};
+    glm::mat4 projection{1.0f};
+    uint64_t compositedFrame = 0;
+  };
+
+  // Work of a cascade in one frame
+  struct CascadeWork {
+    bool renderStatic = false;
+    bool composite = false;
+  };
+
+  ShadowConfig config;
+  glm::vec4 sceneBounds;
+  std::vector<Cascade> cascades;
+  std::vector<CascadeWork> work;
+  // Whether the previous frame rendered into any cascade
+  bool worked = false;
+
+  // Renders the dynamic casters on top of a copy of the cache. Compatible with renderPass. Null when nothing is cached
+  VkRenderPass dynamicRenderPass = VK_NULL_HANDLE;
+
+  // One layer per cascade. The cache is only created when caching
+  VkImage cacheImage = VK_NULL_HANDLE;
+  VkDeviceMemory cacheMemory = VK_NULL_HANDLE;
+  VkImage shadowImage;
+  VkDeviceMemory shadowMemory;
+  std::vector<VkImageView> cacheLayerViews;
+  std::vector<VkImageView> shadowLayerViews;
+  VkImageView shadowArrayView;
+  std::vector<VkFramebuffer> cacheFramebuffers;
+  std::vector<VkFramebuffer> shadowFramebuffers;
+  VkSampler sampler;
+
+  // Per frame in flight. The view block of each cascade follows the shadow data
+  VkBuffer uniformBuffer;
+  VkDeviceMemory uniformMemory;
+  void* uniformMapped;
+  VkDeviceSize frameStride;
+  VkDeviceSize viewOffset;
+  VkDeviceSize viewStride;
+
+  VkDescriptorPool descriptorPool;
+  std::vector<VkDescriptorSet> descriptorSets;
+  // Indexed by frame * cascade count + cascade
+  std::vector<VkDescriptorSet> viewSets;
+
+  // ----- Statistics -----
+  uint64_t frames = 0;
+  uint64_t staticRenders = 0;
+  uint64_t composites = 0;
+  // Cascades left stale for a frame by the update budget
+  uint64_t deferredRenders = 0;
+  uint64_t drawTotal = 0;
+  uint32_t maxFrameDraws = 0;
+
+  static VkFormat findDepthFormat(const VulkanContext& ctx);
+  VkRenderPass createRenderPass(VkAttachmentLoadOp loadOp, VkImageLayout initialLayout, VkImageLayout finalLayout);
+  void createImages();
+  void createDescriptorSets(VkDescriptorSetLayout viewSetLayout);
+  void place(Cascade& cascade, glm::vec2 center, glm::vec3 lightDirection) const;
+  void beginRenderPass(VkCommandBuffer commandBuffer, VkRenderPass pass, VkFramebuffer framebuffer) const;
+};
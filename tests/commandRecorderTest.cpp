@@ -0,0 +1,51 @@
+#include <algorithm>
+
+#include "commandRecorder.h"
+#include "test.h"
+
+// The ranges follow each other from the first draw and hold every draw
+static bool coversDrawList(const std::vector<DrawRange>& ranges, uint32_t drawCount) {
+  uint32_t next = 0;
+  for (const auto& range : ranges) {
+    if (range.firstDraw != next) {
+      return false;
+    }
+    next += range.drawCount;
+  }
+  return next == drawCount;
+}
+
+static uint32_t busyWorkers(const std::vector<DrawRange>& ranges) {
+  uint32_t busy = 0;
+  for (const auto& range : ranges) {
+    busy += range.drawCount > 0 ? 1 : 0;
+  }
+  return busy;
+}
+
+TEST(splitDrawsWithoutDraws) {
+  // Nothing is recorded, so there are no secondary command buffers to execute
+  for (uint32_t threads : {1u, 3u, 8u}) {
+    std::vector<DrawRange> ranges = splitDraws(0, threads, 4);
+    CHECK(ranges.size() == 4);
+    CHECK(busyWorkers(ranges) == 0);
+    CHECK(coversDrawList(ranges, 0));
+  }
+}
+
+TEST(splitDrawsBalancesRanges) {
+  for (uint32_t drawCount : {1u, 2u, 5u, 64u, 1001u}) {
+    for (uint32_t threads : {1u, 3u, 4u, 16u}) {
+      std::vector<DrawRange> ranges = splitDraws(drawCount, threads, 4);
+      CHECK(ranges.size() == 4);
+      CHECK(coversDrawList(ranges, drawCount));
+      CHECK(busyWorkers(ranges) == std::min({drawCount, threads, 4u}));
+
+      // Busy workers come first and differ by at most one draw
+      for (uint32_t i = 0; i < busyWorkers(ranges); i++) {
+        CHECK(ranges[i].drawCount > 0);
+        CHECK(ranges[i].drawCount - ranges[busyWorkers(ranges) - 1].drawCount <= 1);
+      }
+    }
+  }
+}
@@ -0,0 +1,124 @@
+#include <algorithm>
+#include <glm/gtc/matrix_transform.hpp>
+#include <random>
+#include <vector>
+
+#include "cpuCuller.h"
+#include "test.h"
+
+static SphereBounds randomSpheres(uint32_t count, uint32_t seed) {
+  std::mt19937 generator(seed);
+  std::uniform_real_distribution<float> position(-50.0f, 50.0f);
+  std::uniform_real_distribution<float> radius(0.1f, 2.0f);
+
+  SphereBounds bounds;
+  for (uint32_t i = 0; i < count; i++) {
+    bounds.push(position(generator), position(generator), position(generator), radius(generator));
+  }
+  return bounds;
+}
+
+// Looking at the origin from several directions, so that some spheres are inside, outside and on the planes
+static std::vector<Frustum> testFrustums() {
+  std::vector<Frustum> frustums;
+  glm::mat4 projection = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, 80.0f);
+  for (glm::vec3 eye : {glm::vec3{60.0f, 0.0f, 10.0f}, glm::vec3{-20.0f, 30.0f, 5.0f}, glm::vec3{5.0f, -5.0f, 70.0f}, glm::vec3{0.0f, 1.0f, 0.0f}}) {
+    glm::vec3 up = std::abs(eye.z) > 50.0f ? glm::vec3{0.0f, 1.0f, 0.0f} : glm::vec3{0.0f, 0.0f, 1.0f};
+    frustums.push_back(extractFrustum(projection * glm::lookAt(eye, glm::vec3{0.0f}, up)));
+  }
+  return frustums;
+}
+
+static std::vector<uint32_t> bruteForce(const Frustum& frustum, const SphereBounds& bounds) {
+  std::vector<uint32_t> visible;
+  for (uint32_t i = 0; i < bounds.size(); i++) {
+    if (sphereInFrustum(frustum, {bounds.x[i], bounds.y[i], bounds.z[i]}, bounds.radius[i])) {
+      visible.push_back(i);
+    }
+  }
+  return visible;
+}
+
+TEST(cullSpheresMatchesScalar) {
+  // Lengths with and without a tail for every batch width
+  for (uint32_t count : {0u, 3u, 8u, 37u, 1000u}) {
+    SphereBounds bounds = randomSpheres(count, count);
+    std::vector<uint32_t> ids(count);
+    for (uint32_t i = 0; i < count; i++) {
+      ids[i] = 1000 + i;
+    }
+
+    for (const Frustum& frustum : testFrustums()) {
+      std::vector<uint32_t> expected;
+      cullSpheres(frustum, bounds.x.data(), bounds.y.data(), bounds.z.data(), bounds.radius.data(), ids.data(), count,
+                  expected, SimdLevel::Scalar);
+      // Appended after what the list held, in the order of the spheres
+      expected.insert(expected.begin(), 7);
+      for (SimdLevel level : supportedSimdLevels()) {
+        std::vector<uint32_t> visible = {7};
+        cullSpheres(frustum, bounds.x.data(), bounds.y.data(), bounds.z.data(), bounds.radius.data(), ids.data(), count,
+                    visible, level);
+        CHECK(visible == expected);
+      }
+    }
+  }
+}
+
+TEST(hierarchyMatchesBruteForce) {
+  for (uint32_t count : {1u, 32u, 33u, 4099u}) {
+    SphereBounds bounds = randomSpheres(count, 7 * count);
+    CpuCuller culler(bounds);
+
+    for (SimdLevel level : supportedSimdLevels()) {
+      culler.simdLevel = level;
+      for (const Frustum& frustum : testFrustums()) {
+        std::vector<uint32_t> visible;
+        culler.cull(frustum, visible);
+        std::sort(visible.begin(), visible.end());
+        CHECK(visible == bruteForce(frustum, bounds));
+
+        culler.cullAll(frustum, visible);
+        std::sort(visible.begin(), visible.end());
+        CHECK(visible == bruteForce(frustum, bounds));
+      }
+    }
+  }
+}
+
+TEST(hierarchyMatchesBruteForceAfterRefit) {
+  SphereBounds bounds = randomSpheres(2000, 3);
+  CpuCuller culler(bounds);
+
+  // Move a tenth of the spheres, some of them far out of their leaves' boxes
+  std::mt19937 generator(5);
+  std::uniform_real_distribution<float> position(-60.0f, 60.0f);
+  for (uint32_t id = 0; id < bounds.size(); id += 10) {
+    bounds.x[id] = position(generator);
+    bounds.y[id] = position(generator);
+    bounds.z[id] = position(generator);
+    bounds.radius[id] *= 2.0f;
+    culler.update(id, bounds.x[id], bounds.y[id], bounds.z[id], bounds.radius[id]);
+  }
+  culler.refit();
+
+  for (const Frustum& frustum : testFrustums()) {
+    std::vector<uint32_t> visible;
+    culler.cull(frustum, visible);
+    std::sort(visible.begin(), visible.end());
+    CHECK(visible == bruteForce(frustum, bounds));
+  }
+}
+
+TEST(boxContainment) {
+  Frustum frustum = extractFrustum(glm::perspective(glm::radians(90.0f), 1.0f, 1.0f, 100.0f));
+  // The camera looks down -z
+  float insideMin[3] = {-1.0f, -1.0f, -11.0f};
+  float insideMax[3] = {1.0f, 1.0f, -9.0f};
+  float behindMin[3] = {-1.0f, -1.0f, 1.0f};
+  float behindMax[3] = {1.0f, 1.0f, 3.0f};
+  float crossingMin[3] = {-1.0f, -1.0f, -200.0f};
+  float crossingMax[3] = {1.0f, 1.0f, -50.0f};
+  CHECK(boxInFrustum(frustum, insideMin, insideMax) == Containment::Inside);
+  CHECK(boxInFrustum(frustum, behindMin, behindMax) == Containment::Outside);
+  CHECK(boxInFrustum(frustum, crossingMin, crossingMax) == Containment::Intersecting);
+}
@@ -0,0 +1,200 @@
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+#include <numeric>
+#include <vector>
+
+#include "camera.h"
+#include "lightClusters.h"
+#include "test.h"
+
+static Camera testCamera() {
+  return Camera(1.0f, 0.5f, 30.0f, {0.0f, 0.0f, 1.0f}, glm::radians(60.0f), 16.0f / 9.0f, 0.1f, 100.0f);
+}
+
+// Depth at which a slice begins, as the cluster boxes are built
+static float sliceDepth(const ClusterGrid& grid, uint32_t slice) {
+  return grid.near * std::pow(grid.far / grid.near, static_cast<float>(slice) / CLUSTER_COUNT_Z);
+}
+
+TEST(clusterSlices) {
+  ClusterGrid grid = ClusterGrid::create(testCamera(), {1920, 1080});
+  CHECK(grid.slice(grid.near) == 0);
+  CHECK(grid.slice(grid.far) == CLUSTER_COUNT_Z - 1);
+  // Depths outside the range are clamped to the first and last slice
+  CHECK(grid.slice(0.5f * grid.near) == 0);
+  CHECK(grid.slice(2.0f * grid.far) == CLUSTER_COUNT_Z - 1);
+
+  for (uint32_t z = 0; z < CLUSTER_COUNT_Z; z++) {
+    // The middle of the slice on the exponential scale
+    float middle = std::sqrt(sliceDepth(grid, z) * sliceDepth(grid, z + 1));
+    CHECK(grid.slice(middle) == z);
+  }
+
+  uint32_t previous = 0;
+  for (float depth = grid.near; depth <= grid.far; depth *= 1.01f) {
+    CHECK(grid.slice(depth) >= previous);
+    previous = grid.slice(depth);
+  }
+}
+
+struct Assignment {
+  std::vector<uint32_t> clusters = std::vector<uint32_t>(2 * CLUSTER_COUNT);
+  std::vector<uint32_t> lightIndices = std::vector<uint32_t>(CLUSTER_COUNT * MAX_CLUSTER_LIGHTS);
+
+  std::vector<uint32_t> lights(uint32_t cluster) const {
+    auto first = lightIndices.begin() + clusters[2 * cluster];
+    return {first, first + clusters[2 * cluster + 1]};
+  }
+};
+
+// View space frustum of a cluster, as ratios of x and y to depth, and its bounding box as built by the compute shader
+struct ClusterBounds {
+  glm::vec2 ratioMin;
+  glm::vec2 ratioMax;
+  float nearDepth;
+  float farDepth;
+  glm::vec3 boxMin;
+  glm::vec3 boxMax;
+};
+
+static std::vector<ClusterBounds> clusterBounds(const ClusterGrid& grid) {
+  std::vector<ClusterBounds> bounds(CLUSTER_COUNT);
+  for (uint32_t z = 0; z < CLUSTER_COUNT_Z; z++) {
+    for (uint32_t y = 0; y < CLUSTER_COUNT_Y; y++) {
+      for (uint32_t x = 0; x < CLUSTER_COUNT_X; x++) {
+        ClusterBounds& cluster = bounds[(z * CLUSTER_COUNT_Y + y) * CLUSTER_COUNT_X + x];
+        glm::vec2 ndcMin = glm::vec2{x, y} * grid.tileSize / grid.renderExtent * 2.0f - 1.0f;
+        glm::vec2 ndcMax = glm::vec2{x + 1, y + 1} * grid.tileSize / grid.renderExtent * 2.0f - 1.0f;
+        cluster.ratioMin = glm::vec2{ndcMin.x, -ndcMax.y} * grid.tanHalfFov;
+        cluster.ratioMax = glm::vec2{ndcMax.x, -ndcMin.y} * grid.tanHalfFov;
+        cluster.nearDepth = sliceDepth(grid, z);
+        cluster.farDepth = sliceDepth(grid, z + 1);
+        cluster.boxMin = glm::vec3{glm::min(cluster.ratioMin * cluster.nearDepth, cluster.ratioMin * cluster.farDepth),
+                                   -cluster.farDepth};
+        cluster.boxMax = glm::vec3{glm::max(cluster.ratioMax * cluster.nearDepth, cluster.ratioMax * cluster.farDepth),
+                                   -cluster.nearDepth};
+      }
+    }
+  }
+  return bounds;
+}
+
+static bool touchesBox(const ClusterBounds& cluster, glm::vec3 center, float radius) {
+  glm::vec3 offset = center - glm::clamp(center, cluster.boxMin, cluster.boxMax);
+  return glm::dot(offset, offset) <= radius * radius;
+}
+
+// Whether the sphere lies entirely outside one of the planes of the cluster frustum, with some slack for rounding
+static bool separated(const ClusterBounds& cluster, glm::vec3 center, float radius) {
+  float slack = 1e-3f * radius;
+  float depth = -center.z;
+  float distances[6] = {
+      (center.x + cluster.ratioMax.x * center.z) / std::sqrt(1.0f + cluster.ratioMax.x * cluster.ratioMax.x),
+      -(center.x + cluster.ratioMin.x * center.z) / std::sqrt(1.0f + cluster.ratioMin.x * cluster.ratioMin.x),
+      (center.y + cluster.ratioMax.y * center.z) / std::sqrt(1.0f + cluster.ratioMax.y * cluster.ratioMax.y),
+      -(center.y + cluster.ratioMin.y * center.z) / std::sqrt(1.0f + cluster.ratioMin.y * cluster.ratioMin.y),
+      depth - cluster.farDepth,
+      cluster.nearDepth - depth,
+  };
+  return std::any_of(std::begin(distances), std::end(distances), [&](float distance) { return distance > radius - slack; });
+}
+
+/**
+ * Every light is tested against the box of every cluster, like in the compute shader. The assigned lists must keep
+ * the order of those lists and may only leave out lights that are outside the frustum of the cluster
+ */
+TEST(lightAssignmentMatchesBruteForce) {
+  Camera camera = testCamera();
+  ClusterGrid grid = ClusterGrid::create(camera, {1280, 720});
+  // Around the camera, so that lights cross the near plane, the sides of the frustum and the far plane
+  std::vector<PointLight> lights = createLights(1001, {-60.0f, -60.0f, -10.0f}, {60.0f, 60.0f, 20.0f});
+  std::vector<ClusterBounds> bounds = clusterBounds(grid);
+
+  std::vector<std::vector<uint32_t>> boxLights(CLUSTER_COUNT);
+  for (uint32_t cluster = 0; cluster < CLUSTER_COUNT; cluster++) {
+    for (uint32_t i = 0; i < lights.size(); i++) {
+      glm::vec3 center{camera.viewMatrix * glm::vec4{glm::vec3{lights[i].positionRadius}, 1.0f}};
+      if (touchesBox(bounds[cluster], center, lights[i].positionRadius.w)) {
+        boxLights[cluster].push_back(i);
+      }
+    }
+    CHECK(boxLights[cluster].size() <= MAX_CLUSTER_LIGHTS);
+  }
+
+  LightAssigner assigner(lights);
+  for (SimdLevel level : supportedSimdLevels()) {
+    assigner.simdLevel = level;
+    Assignment assignment;
+    assigner.assign(camera.viewMatrix, grid, assignment.clusters.data(), assignment.lightIndices.data());
+
+    uint32_t assigned = 0;
+    for (uint32_t cluster = 0; cluster < CLUSTER_COUNT; cluster++) {
+      std::vector<uint32_t> clusterLights = assignment.lights(cluster);
+      CHECK(std::is_sorted(clusterLights.begin(), clusterLights.end()));
+      CHECK(std::includes(boxLights[cluster].begin(), boxLights[cluster].end(), clusterLights.begin(), clusterLights.end()));
+
+      std::vector<uint32_t> left;
+      std::set_difference(boxLights[cluster].begin(), boxLights[cluster].end(), clusterLights.begin(), clusterLights.end(),
+                          std::back_inserter(left));
+      for (uint32_t i : left) {
+        glm::vec3 center{camera.viewMatrix * glm::vec4{glm::vec3{lights[i].positionRadius}, 1.0f}};
+        CHECK(separated(bounds[cluster], center, lights[i].positionRadius.w));
+      }
+      assigned += static_cast<uint32_t>(clusterLights.size());
+    }
+    // Not a vacuous comparison
+    CHECK(assigned > lights.size());
+  }
+}
+
+TEST(lightAssignmentCapsClusters) {
+  Camera camera = testCamera();
+  ClusterGrid grid = ClusterGrid::create(camera, {1280, 720});
+  // More lights than a cluster holds, all at the focus of the camera
+  std::vector<PointLight> lights(MAX_CLUSTER_LIGHTS + 44, PointLight{glm::vec4{0.0f, 0.0f, 0.0f, 1.0f}, glm::vec4{1.0f}});
+
+  LightAssigner assigner(lights);
+  for (SimdLevel level : supportedSimdLevels()) {
+    assigner.simdLevel = level;
+    Assignment assignment;
+    assigner.assign(camera.viewMatrix, grid, assignment.clusters.data(), assignment.lightIndices.data());
+
+    // The first lights are kept
+    std::vector<uint32_t> expected(MAX_CLUSTER_LIGHTS);
+    std::iota(expected.begin(), expected.end(), 0);
+    uint32_t full = 0;
+    for (uint32_t cluster = 0; cluster < CLUSTER_COUNT; cluster++) {
+      std::vector<uint32_t> clusterLights = assignment.lights(cluster);
+      CHECK(clusterLights.empty() || clusterLights == expected);
+      full += clusterLights.empty() ? 0 : 1;
+    }
+    CHECK(full > 0);
+  }
+}
+
+TEST(lightAssignmentMatchesScalar) {
+  ClusterGrid grid = ClusterGrid::create(testCamera(), {1920, 1080});
+  std::vector<PointLight> lights = createLights(4099, {-50.0f, -50.0f, 0.0f}, {50.0f, 50.0f, 5.0f});
+  LightAssigner assigner(lights);
+
+  Camera camera = testCamera();
+  for (float yaw : {0.0f, 1.0f, 2.5f}) {
+    camera.yaw = yaw;
+    camera.updatePosition();
+    camera.updateMatrices();
+
+    Assignment scalar;
+    assigner.simdLevel = SimdLevel::Scalar;
+    assigner.assign(camera.viewMatrix, grid, scalar.clusters.data(), scalar.lightIndices.data());
+
+    for (SimdLevel level : supportedSimdLevels()) {
+      Assignment assignment;
+      assigner.simdLevel = level;
+      assigner.assign(camera.viewMatrix, grid, assignment.clusters.data(), assignment.lightIndices.data());
+      CHECK(assignment.clusters == scalar.clusters);
+      uint32_t count = scalar.clusters[2 * (CLUSTER_COUNT - 1)] + scalar.clusters[2 * CLUSTER_COUNT - 1];
+      CHECK(std::equal(scalar.lightIndices.begin(), scalar.lightIndices.begin() + count, assignment.lightIndices.begin()));
+    }
+  }
+}
@@ -0,0 +1,104 @@
+#include <cmath>
+#include <glm/gtc/matrix_transform.hpp>
+#include <numeric>
+
+#include "occlusionCuller.h"
+#include "test.h"
+
+// Unit cube centred on the origin
+static OccluderMesh cubeMesh() {
+  std::vector<glm::vec3> positions;
+  for (uint32_t corner = 0; corner < 8; corner++) {
+    positions.push_back({corner & 1 ? 0.5f : -0.5f, corner & 2 ? 0.5f : -0.5f, corner & 4 ? 0.5f : -0.5f});
+  }
+  std::vector<uint32_t> indices = {0, 2, 1, 1, 2, 3, 4, 5, 6, 5, 7, 6, 0, 1, 4, 1, 5, 4,
+                                   2, 6, 3, 3, 6, 7, 0, 4, 2, 2, 4, 6, 1, 3, 5, 3, 7, 5};
+  return simplifyOccluder(positions, indices, 64);
+}
+
+static glm::mat4 boxModel(glm::vec3 position, glm::vec3 size) {
+  return glm::scale(glm::translate(glm::mat4{1.0f}, position), size);
+}
+
+static std::vector<uint32_t> allInstances(uint32_t count) {
+  std::vector<uint32_t> ids(count);
+  std::iota(ids.begin(), ids.end(), 0);
+  return ids;
+}
+
+TEST(occlusionHidesBoxesBehindWall) {
+  glm::vec3 eye{0.0f, -10.0f, 0.0f};
+  glm::mat4 viewProjection = glm::perspective(glm::radians(60.0f), 2.0f, 0.1f, 100.0f) *
+                             glm::lookAt(eye, glm::vec3{0.0f}, glm::vec3{0.0f, 0.0f, 1.0f});
+
+  for (SimdLevel level : supportedSimdLevels()) {
+    // Only the wall, which covers the most of the screen, is an occluder
+    OcclusionCuller culler({cubeMesh()}, 256, 128, 1);
+    culler.simdLevel = level;
+    // Not square, as pixel centres on the diagonal of a face are inside neither of its triangles
+    culler.addInstance(boxModel({0.0f, 0.0f, 0.0f}, {7.0f, 0.5f, 5.0f}), 0);
+    // Hidden behind the wall
+    culler.addInstance(boxModel({0.0f, 5.0f, 0.0f}, glm::vec3{1.0f}), 0);
+    culler.addInstance(boxModel({1.5f, 8.0f, -1.0f}, glm::vec3{2.0f}), 0);
+    // In front of the wall, and behind it but to the side
+    culler.addInstance(boxModel({0.0f, -5.0f, 0.0f}, glm::vec3{1.0f}), 0);
+    culler.addInstance(boxModel({8.0f, 5.0f, 0.0f}, glm::vec3{1.0f}), 0);
+
+    std::vector<uint32_t> visible = allInstances(5);
+    culler.cull(viewProjection, eye, visible);
+    CHECK(visible == (std::vector<uint32_t>{0, 3, 4}));
+
+    // The order of the list is kept and only listed instances are returned
+    visible = {4, 1, 3};
+    culler.cull(viewProjection, eye, visible);
+    CHECK(visible == (std::vector<uint32_t>{4, 3}));
+  }
+}
+
+TEST(occlusionMatchesScalar) {
+  const float pi = 3.14159265f;
+  const uint32_t columns = 20;
+  const float extent = 2.0f * columns;
+
+  // A grid of blocks seen from the streets between them, as in the benchmark
+  std::vector<glm::mat4> models;
+  for (uint32_t i = 0; i < columns * columns; i++) {
+    glm::vec3 position{2.0f * (i % columns) - 0.5f * extent, 2.0f * (i / columns) - 0.5f * extent, 1.5f};
+    models.push_back(boxModel(position, {1.6f, 1.6f, 3.0f}));
+  }
+
+  std::vector<glm::vec3> eyes;
+  std::vector<glm::mat4> viewProjections;
+  for (uint32_t frame = 0; frame < 16; frame++) {
+    float angle = 2.0f * pi * frame / 16;
+    glm::vec3 eye{0.25f * extent * std::cos(angle) + 1.0f, 0.25f * extent * std::sin(angle) + 1.0f, 1.0f};
+    eyes.push_back(eye);
+    viewProjections.push_back(glm::perspective(glm::radians(60.0f), 16.0f / 10.0f, 0.1f, extent) *
+                              glm::lookAt(eye, glm::vec3{1.0f, 1.0f, 1.0f}, glm::vec3{0.0f, 0.0f, 1.0f}));
+  }
+
+  std::vector<std::vector<uint32_t>> reference;
+  for (SimdLevel level : supportedSimdLevels()) {
+    OcclusionCuller culler({cubeMesh()});
+    culler.simdLevel = level;
+    for (const auto& model : models) {
+      culler.addInstance(model, 0);
+    }
+
+    std::vector<std::vector<uint32_t>> results;
+    for (uint32_t frame = 0; frame < eyes.size(); frame++) {
+      std::vector<uint32_t> visible = allInstances(static_cast<uint32_t>(models.size()));
+      culler.cull(viewProjections[frame], eyes[frame], visible);
+      // Not a vacuous comparison
+      CHECK(!visible.empty() && visible.size() < models.size());
+      results.push_back(visible);
+    }
+
+    // Instruction sets evaluate the same expressions in the same order
+    if (level == SimdLevel::Scalar) {
+      reference = results;
+    } else {
+      CHECK(results == reference);
+    }
+  }
+}
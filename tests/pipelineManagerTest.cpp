@@ -0,0 +1,169 @@
+#include <cstdint>
+#include <vector>
+
+#include "pipelineManager.h"
+#include "test.h"
+
+static PipelineDescription exampleDescription() {
+  PipelineDescription description{};
+  description.stages = {{VK_SHADER_STAGE_VERTEX_BIT, "shader.vert", {}, {1, 2, 3, 4}},
+                        {VK_SHADER_STAGE_FRAGMENT_BIT, "shader.frag", {}, {5, 6, 7, 8}}};
+  description.bindings = {{0, 32, VK_VERTEX_INPUT_RATE_VERTEX}};
+  description.attributes = {{0, 0, VK_FORMAT_R32G32B32_SFLOAT, 0}, {1, 0, VK_FORMAT_R32G32_SFLOAT, 12}};
+  description.layout = reinterpret_cast<VkPipelineLayout>(uintptr_t{0x10});
+  description.renderPass = reinterpret_cast<VkRenderPass>(uintptr_t{0x20});
+  description.renderPassKey = 42;
+  description.colorFormats = {VK_FORMAT_B8G8R8A8_SRGB};
+  description.depthFormat = VK_FORMAT_D32_SFLOAT;
+  description.specializationEntries = {{0, 0, sizeof(uint32_t)}};
+  description.specializationData = {1, 0, 0, 0};
+  return description;
+}
+
+TEST(pipelineHashIsDeterministic) {
+  CHECK(exampleDescription().hash() == exampleDescription().hash());
+}
+
+TEST(pipelineHashIgnoresRenderPassHandle) {
+  // Compatible render passes share pipelines, so only the key counts
+  PipelineDescription description = exampleDescription();
+  description.renderPass = reinterpret_cast<VkRenderPass>(uintptr_t{0x30});
+  CHECK(description.hash() == exampleDescription().hash());
+
+  // The SPIR-V identifies the stage, whatever it was compiled from
+  description.stages[0].source = "other.vert";
+  CHECK(description.hash() == exampleDescription().hash());
+}
+
+TEST(pipelineHashCoversEveryState) {
+  uint64_t original = exampleDescription().hash();
+  std::vector<void (*)(PipelineDescription&)> changes = {
+      [](PipelineDescription& d) { d.stages[1].code.push_back(9); },
+      [](PipelineDescription& d) { d.stages[0].stage = VK_SHADER_STAGE_GEOMETRY_BIT; },
+      [](PipelineDescription& d) { d.bindings[0].stride = 48; },
+      [](PipelineDescription& d) { d.bindings[0].inputRate = VK_VERTEX_INPUT_RATE_INSTANCE; },
+      [](PipelineDescription& d) { d.attributes[1].offset = 16; },
+      [](PipelineDescription& d) { d.layout = reinterpret_cast<VkPipelineLayout>(uintptr_t{0x11}); },
+      [](PipelineDescription& d) { d.renderPassKey = 43; },
+      [](PipelineDescription& d) { d.subpass = 1; },
+      [](PipelineDescription& d) { d.colorFormats.push_back(VK_FORMAT_R16G16_SFLOAT); },
+      [](PipelineDescription& d) { d.depthFormat = VK_FORMAT_D24_UNORM_S8_UINT; },
+      [](PipelineDescription& d) { d.samples = VK_SAMPLE_COUNT_4_BIT; },
+      [](PipelineDescription& d) { d.viewMask = 0x3; },
+      [](PipelineDescription& d) { d.sampleShading = true; },
+      [](PipelineDescription& d) { d.cullMode = VK_CULL_MODE_NONE; },
+      [](PipelineDescription& d) { d.depthBiasConstant = 1.25f; },
+      [](PipelineDescription& d) { d.depthBiasSlope = 1.75f; },
+      [](PipelineDescription& d) { d.depthTest = false; },
+      [](PipelineDescription& d) { d.depthWrite = false; },
+      [](PipelineDescription& d) { d.depthCompareOp = VK_COMPARE_OP_EQUAL; },
+      [](PipelineDescription& d) { d.blendMode = BlendMode::Additive; },
+      [](PipelineDescription& d) { d.colorWrite = false; },
+      [](PipelineDescription& d) { d.specializationEntries[0].constantID = 1; },
+      [](PipelineDescription& d) { d.specializationData[0] = 2; },
+  };
+
+  for (auto change : changes) {
+    PipelineDescription description = exampleDescription();
+    change(description);
+    CHECK(description.hash() != original);
+  }
+}
+
+TEST(pipelineHashSeparatesVectors) {
+  // The sizes are hashed, so moving an element from one vector to the next changes the hash
+  PipelineDescription first = exampleDescription();
+  first.stages[0].code = {1, 2, 3};
+  first.stages[1].code = {4, 5, 6, 7, 8};
+  CHECK(first.hash() != exampleDescription().hash());
+}
+
+/*----- Render pass compatibility -----*/
+
+// Color and depth attachments in one subpass, optionally with multiview
+struct RenderPassInfo {
+  std::vector<VkAttachmentDescription> attachments;
+  VkAttachmentReference color{0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL};
+  VkAttachmentReference depth{1, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL};
+  VkSubpassDescription subpass{};
+  uint32_t viewMask = 0;
+  VkRenderPassMultiviewCreateInfo multiview{};
+  VkRenderPassCreateInfo info{};
+
+  RenderPassInfo(VkFormat colorFormat, VkSampleCountFlagBits samples) {
+    VkAttachmentDescription attachment{};
+    attachment.format = colorFormat;
+    attachment.samples = samples;
+    attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    attachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    attachments.push_back(attachment);
+    attachment.format = VK_FORMAT_D32_SFLOAT;
+    attachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+    attachments.push_back(attachment);
+  }
+
+  const VkRenderPassCreateInfo& build() {
+    subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    subpass.colorAttachmentCount = 1;
+    subpass.pColorAttachments = &color;
+    subpass.pDepthStencilAttachment = &depth;
+
+    info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+    info.attachmentCount = static_cast<uint32_t>(attachments.size());
+    info.pAttachments = attachments.data();
+    info.subpassCount = 1;
+    info.pSubpasses = &subpass;
+    if (viewMask != 0) {
+      multiview.sType = VK_STRUCTURE_TYPE_RENDER_PASS_MULTIVIEW_CREATE_INFO;
+      multiview.subpassCount = 1;
+      multiview.pViewMasks = &viewMask;
+      info.pNext = &multiview;
+    }
+    return info;
+  }
+};
+
+TEST(renderPassKeyIgnoresOperationsAndLayouts) {
+  RenderPassInfo original(VK_FORMAT_B8G8R8A8_SRGB, VK_SAMPLE_COUNT_1_BIT);
+  RenderPassInfo loading(VK_FORMAT_B8G8R8A8_SRGB, VK_SAMPLE_COUNT_1_BIT);
+  loading.attachments[0].loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+  loading.attachments[0].initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+  loading.attachments[1].storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+  loading.attachments[0].finalLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+  CHECK(hashRenderPassCompatibility(original.build()) == hashRenderPassCompatibility(loading.build()));
+}
+
+TEST(renderPassKeyCoversFormatsSamplesAndViews) {
+  RenderPassInfo original(VK_FORMAT_B8G8R8A8_SRGB, VK_SAMPLE_COUNT_1_BIT);
+  uint64_t key = hashRenderPassCompatibility(original.build());
+
+  RenderPassInfo format(VK_FORMAT_R8G8B8A8_SRGB, VK_SAMPLE_COUNT_1_BIT);
+  CHECK(hashRenderPassCompatibility(format.build()) != key);
+
+  RenderPassInfo samples(VK_FORMAT_B8G8R8A8_SRGB, VK_SAMPLE_COUNT_4_BIT);
+  CHECK(hashRenderPassCompatibility(samples.build()) != key);
+
+  RenderPassInfo multiview(VK_FORMAT_B8G8R8A8_SRGB, VK_SAMPLE_COUNT_1_BIT);
+  multiview.viewMask = 0x3f;
+  CHECK(hashRenderPassCompatibility(multiview.build()) != key);
+
+  RenderPassInfo depthless(VK_FORMAT_B8G8R8A8_SRGB, VK_SAMPLE_COUNT_1_BIT);
+  depthless.build();
+  depthless.subpass.pDepthStencilAttachment = nullptr;
+  CHECK(hashRenderPassCompatibility(depthless.info) != key);
+}
+
+TEST(renderPassKeyIgnoresResolveOfSingleSubpass) {
+  RenderPassInfo original(VK_FORMAT_B8G8R8A8_SRGB, VK_SAMPLE_COUNT_4_BIT);
+  uint64_t key = hashRenderPassCompatibility(original.build());
+
+  RenderPassInfo resolving(VK_FORMAT_B8G8R8A8_SRGB, VK_SAMPLE_COUNT_4_BIT);
+  VkAttachmentDescription resolve = resolving.attachments[0];
+  resolve.samples = VK_SAMPLE_COUNT_1_BIT;
+  resolving.attachments.push_back(resolve);
+  VkAttachmentReference resolveReference{2, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL};
+  resolving.build();
+  resolving.subpass.pResolveAttachments = &resolveReference;
+  CHECK(hashRenderPassCompatibility(resolving.info) == key);
+}
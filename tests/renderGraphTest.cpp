@@ -0,0 +1,214 @@
+#include <algorithm>
+
+#include "renderGraph.h"
+#include "test.h"
+
+// Planning never touches the device. The context is never destroyed, as its destructor calls into Vulkan
+static const VulkanContext& context() {
+  static const VulkanContext* ctx = new VulkanContext();
+  return *ctx;
+}
+
+static void recordNothing(VkCommandBuffer, const RenderGraph::PassContext&) {}
+
+static RenderGraph::Resource createColor(RenderGraph& graph, const std::string& name,
+                                         VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT) {
+  return graph.createImage(name, VK_FORMAT_R8G8B8A8_UNORM, samples, VK_IMAGE_ASPECT_COLOR_BIT);
+}
+
+static RenderGraph::Resource importSwapChain(RenderGraph& graph) {
+  return graph.importImage("swap chain", VK_FORMAT_B8G8R8A8_SRGB, VK_IMAGE_ASPECT_COLOR_BIT, ImageAccess::Present);
+}
+
+// Transitions of a resource before a pass
+static std::vector<RenderGraph::Transition> transitionsOf(const RenderGraph& graph, RenderGraph::Pass pass,
+                                                          RenderGraph::Resource resource) {
+  std::vector<RenderGraph::Transition> transitions;
+  for (const auto& transition : graph.barriers(pass)) {
+    if (transition.resource == resource) {
+      transitions.push_back(transition);
+    }
+  }
+  return transitions;
+}
+
+TEST(renderGraphCullsUnusedPasses) {
+  DeletionQueue deletionQueue(context());
+  RenderGraph graph(context(), deletionQueue);
+  RenderGraph::Resource swapChain = importSwapChain(graph);
+  RenderGraph::Resource unused = createColor(graph, "unused");
+  RenderGraph::Resource scene = createColor(graph, "scene");
+
+  RenderGraph::RasterPassDescription unusedDescription;
+  unusedDescription.color = {unused, true};
+  RenderGraph::Pass unusedPass = graph.addRasterPass("unused", unusedDescription, recordNothing);
+  RenderGraph::Pass sideEffects = graph.addPass("side effects", {}, true, recordNothing);
+
+  RenderGraph::RasterPassDescription sceneDescription;
+  sceneDescription.color = {scene, true};
+  // Written over by the next pass without being read
+  RenderGraph::Pass overwritten = graph.addRasterPass("overwritten", sceneDescription, recordNothing);
+  RenderGraph::Pass scenePass = graph.addRasterPass("scene", sceneDescription, recordNothing);
+  RenderGraph::Pass copy = graph.addPass("copy", {{scene, ImageAccess::TransferSource}, {swapChain, ImageAccess::TransferDestination}},
+                                         false, recordNothing);
+  graph.plan();
+
+  CHECK(graph.isCulled(unusedPass));
+  CHECK(!graph.isCulled(sideEffects));
+  CHECK(graph.isCulled(overwritten));
+  CHECK(!graph.isCulled(scenePass));
+  CHECK(!graph.isCulled(copy));
+  CHECK(graph.barriers(unusedPass).empty());
+  CHECK_THROWS(graph.plan(), std::runtime_error);
+}
+
+TEST(renderGraphTransientImages) {
+  DeletionQueue deletionQueue(context());
+  RenderGraph graph(context(), deletionQueue);
+  RenderGraph::Resource swapChain = importSwapChain(graph);
+  RenderGraph::Resource multisampled = createColor(graph, "multisampled", VK_SAMPLE_COUNT_4_BIT);
+  RenderGraph::Resource depth = graph.createImage("depth", VK_FORMAT_D32_SFLOAT, VK_SAMPLE_COUNT_4_BIT, VK_IMAGE_ASPECT_DEPTH_BIT);
+  RenderGraph::Resource sampledDepth = graph.createImage("sampled depth", VK_FORMAT_D32_SFLOAT, VK_SAMPLE_COUNT_1_BIT, VK_IMAGE_ASPECT_DEPTH_BIT);
+  RenderGraph::Resource history = createColor(graph, "history");
+
+  RenderGraph::RasterPassDescription scene;
+  scene.color = {multisampled, true};
+  scene.depth = {depth, true};
+  scene.resolve = swapChain;
+  graph.addRasterPass("scene", scene, recordNothing);
+
+  RenderGraph::RasterPassDescription prepass;
+  prepass.depth = {sampledDepth, true};
+  graph.addRasterPass("depth prepass", prepass, recordNothing);
+  graph.addPass("ambient occlusion", {{sampledDepth, ImageAccess::DepthSampled}}, true, recordNothing);
+
+  // Loaded, so it keeps its contents between frames
+  RenderGraph::RasterPassDescription accumulate;
+  accumulate.color = {history, false};
+  graph.addRasterPass("accumulate", accumulate, recordNothing);
+  graph.addPass("read back", {{history, ImageAccess::TransferSource}}, true, recordNothing);
+  graph.plan();
+
+  CHECK(graph.isTransient(multisampled));
+  CHECK(graph.isTransient(depth));
+  CHECK(!graph.isTransient(swapChain));
+  CHECK(!graph.isTransient(sampledDepth));
+  CHECK(!graph.isTransient(history));
+  CHECK(graph.aliasGroup(swapChain) == RenderGraph::NONE);
+  CHECK(graph.aliasGroup(history) == RenderGraph::NONE);
+}
+
+TEST(renderGraphAliasesDisjointLifetimes) {
+  DeletionQueue deletionQueue(context());
+  RenderGraph graph(context(), deletionQueue);
+  RenderGraph::Resource swapChain = importSwapChain(graph);
+  RenderGraph::Resource first = createColor(graph, "first");
+  RenderGraph::Resource second = createColor(graph, "second");
+  RenderGraph::Resource third = createColor(graph, "third");
+  RenderGraph::Resource depth = graph.createImage("depth", VK_FORMAT_D32_SFLOAT, VK_SAMPLE_COUNT_1_BIT, VK_IMAGE_ASPECT_DEPTH_BIT);
+  RenderGraph::Resource overlayDepth = graph.createImage("overlay depth", VK_FORMAT_D32_SFLOAT, VK_SAMPLE_COUNT_1_BIT,
+                                                         VK_IMAGE_ASPECT_DEPTH_BIT);
+
+  // Lifetimes: first in passes 0 to 1, second in 1 to 2, third in 2 to 3. The depth images are transient
+  RenderGraph::RasterPassDescription scene;
+  scene.color = {first, true};
+  scene.depth = {depth, true};
+  graph.addRasterPass("scene", scene, recordNothing);
+  graph.addPass("blur", {{first, ImageAccess::ShaderSampled}, {second, ImageAccess::TransferDestination}}, false, recordNothing);
+  graph.addPass("tonemap", {{second, ImageAccess::TransferSource}, {third, ImageAccess::TransferDestination}}, false, recordNothing);
+  graph.addPass("copy", {{third, ImageAccess::TransferSource}, {swapChain, ImageAccess::TransferDestination}}, false, recordNothing);
+
+  RenderGraph::RasterPassDescription overlay;
+  overlay.color = {swapChain, false};
+  overlay.depth = {overlayDepth, true};
+  graph.addRasterPass("overlay", overlay, recordNothing);
+  graph.plan();
+
+  CHECK(graph.aliasGroup(first) != RenderGraph::NONE);
+  CHECK(graph.aliasGroup(first) == graph.aliasGroup(third));
+  CHECK(graph.aliasGroup(second) != graph.aliasGroup(first));
+  // Transient images only share memory with each other
+  CHECK(graph.isTransient(depth) && graph.isTransient(overlayDepth));
+  CHECK(graph.aliasGroup(depth) == graph.aliasGroup(overlayDepth));
+  CHECK(graph.aliasGroup(depth) != graph.aliasGroup(first) && graph.aliasGroup(depth) != graph.aliasGroup(second));
+}
+
+TEST(renderGraphBarriers) {
+  DeletionQueue deletionQueue(context());
+  RenderGraph graph(context(), deletionQueue);
+  RenderGraph::Resource swapChain = importSwapChain(graph);
+  RenderGraph::Resource first = createColor(graph, "first");
+  RenderGraph::Resource second = createColor(graph, "second");
+  RenderGraph::Resource third = createColor(graph, "third");
+
+  RenderGraph::RasterPassDescription scene;
+  scene.color = {first, true};
+  RenderGraph::Pass scenePass = graph.addRasterPass("scene", scene, recordNothing);
+  RenderGraph::Pass blur = graph.addPass("blur", {{first, ImageAccess::ShaderSampled}, {second, ImageAccess::TransferDestination}},
+                                         false, recordNothing);
+  RenderGraph::Pass sample = graph.addPass("sample", {{second, ImageAccess::ShaderSampled}}, true, recordNothing);
+  RenderGraph::Pass sampleAgain = graph.addPass("sample again", {{second, ImageAccess::ShaderSampled}}, true, recordNothing);
+  RenderGraph::Pass tonemap = graph.addPass("tonemap", {{second, ImageAccess::TransferSource}, {third, ImageAccess::TransferDestination}},
+                                            false, recordNothing);
+  RenderGraph::Pass copy = graph.addPass("copy", {{third, ImageAccess::TransferSource}, {swapChain, ImageAccess::TransferDestination}},
+                                         false, recordNothing);
+  graph.plan();
+
+  // Render passes transition their attachments, and the next use after one needs no barrier
+  CHECK(graph.barriers(scenePass).empty());
+  CHECK(transitionsOf(graph, blur, first).empty());
+
+  // Written over, so the previous contents are discarded. Waits for the last use in the previous frame
+  auto written = transitionsOf(graph, blur, second);
+  CHECK(written.size() == 1);
+  CHECK(written[0].access == ImageAccess::TransferDestination);
+  CHECK(written[0].source.layout == VK_IMAGE_LAYOUT_UNDEFINED);
+  CHECK(written[0].source.stages & VK_PIPELINE_STAGE_TRANSFER_BIT);
+
+  auto sampled = transitionsOf(graph, sample, second);
+  CHECK(sampled.size() == 1);
+  CHECK(sampled[0].access == ImageAccess::ShaderSampled);
+  CHECK(sampled[0].source.stages == VK_PIPELINE_STAGE_TRANSFER_BIT);
+  CHECK(sampled[0].source.access == VK_ACCESS_TRANSFER_WRITE_BIT);
+  CHECK(sampled[0].source.layout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+  // A read following a read in the same layout
+  CHECK(graph.barriers(sampleAgain).empty());
+
+  // Reads only need an execution dependency
+  auto copied = transitionsOf(graph, tonemap, second);
+  CHECK(copied.size() == 1);
+  CHECK(copied[0].source.access == 0);
+  CHECK(copied[0].source.layout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+  // Shares memory with the first image, so it also waits for the last use of that one
+  CHECK(graph.aliasGroup(third) == graph.aliasGroup(first));
+  auto aliased = transitionsOf(graph, tonemap, third);
+  CHECK(aliased.size() == 1);
+  CHECK(aliased[0].source.layout == VK_IMAGE_LAYOUT_UNDEFINED);
+  CHECK(aliased[0].source.stages & VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+
+  // The swap chain image waits for presentation and returns to it after the last pass
+  auto acquired = transitionsOf(graph, copy, swapChain);
+  CHECK(acquired.size() == 1);
+  CHECK(acquired[0].source.stages == imageAccessInfo(ImageAccess::Present).stages);
+  CHECK(acquired[0].source.layout == VK_IMAGE_LAYOUT_UNDEFINED);
+  const auto& final = graph.barriers(RenderGraph::NONE);
+  CHECK(final.size() == 1);
+  CHECK(final[0].resource == swapChain && final[0].access == ImageAccess::Present);
+  CHECK(final[0].source.access == VK_ACCESS_TRANSFER_WRITE_BIT);
+  CHECK(final[0].source.layout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+}
+
+TEST(renderGraphFinalBarrierAfterRenderPass) {
+  DeletionQueue deletionQueue(context());
+  RenderGraph graph(context(), deletionQueue);
+  RenderGraph::Resource swapChain = importSwapChain(graph);
+
+  RenderGraph::RasterPassDescription scene;
+  scene.color = {swapChain, true};
+  graph.addRasterPass("scene", scene, recordNothing);
+  graph.plan();
+
+  // The render pass ends in the final layout
+  CHECK(graph.barriers(RenderGraph::NONE).empty());
+}
@@ -0,0 +1,101 @@
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "settings.h"
+#include "test.h"
+
+// The usage printed for invalid arguments is discarded
+static Settings parse(std::vector<std::string> arguments) {
+  arguments.insert(arguments.begin(), "VulkanRenderer");
+  std::vector<char*> argv;
+  for (auto& argument : arguments) {
+    argv.push_back(argument.data());
+  }
+
+  std::ostringstream usage;
+  std::streambuf* output = std::cout.rdbuf(usage.rdbuf());
+  try {
+    Settings settings = parseSettings(static_cast<int>(argv.size()), argv.data());
+    std::cout.rdbuf(output);
+    return settings;
+  } catch (...) {
+    std::cout.rdbuf(output);
+    throw;
+  }
+}
+
+TEST(settingsDefaults) {
+  Settings settings = parse({});
+  CHECK(settings.framesInFlight >= 1 && settings.framesInFlight <= 4);
+  CHECK(settings.recordingThreads == 0);
+  CHECK(settings.lightCount == 0);
+  CHECK(settings.cpuCulling);
+  CHECK(!settings.gpuDriven);
+}
+
+TEST(settingsFlagsAndValues) {
+  Settings settings = parse({"--occlusion-culling", "--frames-in-flight", "3", "--lights", "1024", "--sun-speed", "-0.5",
+                             "--benchmark-multiview", "stereo", "--present-mode", "mailbox"});
+  // Occlusion culling implies GPU-driven rendering
+  CHECK(settings.occlusionCulling);
+  CHECK(settings.gpuDriven);
+  CHECK(settings.framesInFlight == 3);
+  CHECK(settings.lightCount == 1024);
+  CHECK(settings.sunSpeed == -0.5f);
+  CHECK(settings.benchmarkMultiviewViews == 2);
+  CHECK(settings.presentMode == VK_PRESENT_MODE_MAILBOX_KHR);
+
+  // Batches and the shading benchmark are always headless
+  CHECK(parse({"--batch", "views.txt"}).headless);
+  CHECK(parse({"--benchmark-shading"}).headless);
+  CHECK(parse({"--feature-tier", "standard"}).deviceSelection.maxTier == FeatureTier::Standard);
+}
+
+TEST(settingsBounds) {
+  CHECK(parse({"--recording-threads", "64"}).recordingThreads == 64);
+  CHECK(parse({"--shadow-update-budget", "4"}).shadowUpdateBudget == 4);
+  CHECK(parse({"--capture-interval", "10000"}).captureInterval == 10000);
+  CHECK(parse({"--dynamic-objects", "1024"}).dynamicObjects == 1024);
+  CHECK(parse({"--lights", "65536"}).lightCount == 65536);
+  CHECK(parse({"--sun-speed", "10"}).sunSpeed == 10.0f);
+  CHECK(parse({"--instance-count", "1048576"}).instanceCount == 1048576);
+  CHECK(parse({"--draw-count", "1048576"}).drawCount == 1048576);
+  CHECK(parse({"--shadow-resolution", "16384"}).shadowResolution == 16384);
+
+  CHECK_THROWS(parse({"--frames-in-flight", "0"}), std::invalid_argument);
+  CHECK_THROWS(parse({"--frames-in-flight", "5"}), std::invalid_argument);
+  CHECK_THROWS(parse({"--recording-threads", "100000"}), std::invalid_argument);
+  CHECK_THROWS(parse({"--recording-threads", "-1"}), std::invalid_argument);
+  // Would be truncated to 64 when narrowed
+  CHECK_THROWS(parse({"--recording-threads", "4294967360"}), std::invalid_argument);
+  CHECK_THROWS(parse({"--capture-interval", "10001"}), std::invalid_argument);
+  CHECK_THROWS(parse({"--lights", "65537"}), std::invalid_argument);
+  CHECK_THROWS(parse({"--shadow-update-budget", "5"}), std::invalid_argument);
+  CHECK_THROWS(parse({"--dynamic-objects", "1025"}), std::invalid_argument);
+  CHECK_THROWS(parse({"--sun-speed", "11"}), std::invalid_argument);
+  CHECK_THROWS(parse({"--sun-speed", "nan"}), std::invalid_argument);
+  CHECK_THROWS(parse({"--min-resolution-scale", "0.05"}), std::invalid_argument);
+  CHECK_THROWS(parse({"--instance-count", "0"}), std::invalid_argument);
+  CHECK_THROWS(parse({"--instance-count", "1048577"}), std::invalid_argument);
+  CHECK_THROWS(parse({"--instance-count", "-1"}), std::invalid_argument);
+  CHECK_THROWS(parse({"--draw-count", "0"}), std::invalid_argument);
+  CHECK_THROWS(parse({"--draw-count", "1048577"}), std::invalid_argument);
+  CHECK_THROWS(parse({"--draw-count", "-5"}), std::invalid_argument);
+  CHECK_THROWS(parse({"--shadow-resolution", "32"}), std::invalid_argument);
+  CHECK_THROWS(parse({"--shadow-resolution", "16385"}), std::invalid_argument);
+  CHECK_THROWS(parse({"--shadow-resolution", "-2048"}), std::invalid_argument);
+  // Would be truncated to 1 when narrowed
+  CHECK_THROWS(parse({"--instance-count", "4294967297"}), std::invalid_argument);
+}
+
+TEST(settingsInvalidArguments) {
+  CHECK_THROWS(parse({"--no-such-option", "1"}), std::invalid_argument);
+  CHECK_THROWS(parse({"--lights"}), std::invalid_argument);
+  CHECK_THROWS(parse({"--lights", "many"}), std::invalid_argument);
+  CHECK_THROWS(parse({"--present-mode", "vsync"}), std::invalid_argument);
+  CHECK_THROWS(parse({"--feature-tier", "ultra"}), std::invalid_argument);
+  CHECK_THROWS(parse({"--benchmark-multiview", "quad"}), std::invalid_argument);
+}
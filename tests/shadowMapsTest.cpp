@@ -0,0 +1,70 @@
+#include <cmath>
+#include <random>
+
+#include "shadowMaps.h"
+#include "test.h"
+
+// Distance from x to the nearest whole number
+static float fraction(float x) {
+  return std::abs(x - std::round(x));
+}
+
+TEST(cascadeSnapStepIsWholeTexels) {
+  for (float radius : {0.01f, 1.0f, 7.3f, 250.0f, 3000.0f}) {
+    for (uint32_t resolution : {1u, 256u, 1024u, 2048u, 4096u}) {
+      float halfExtent = 1.25f * radius;
+      float texelSize = 2.0f * halfExtent / resolution;
+      float step = cascadeSnapStep(radius, halfExtent, resolution);
+
+      CHECK(fraction(step / texelSize) < 1e-3f);
+      CHECK(step >= texelSize * (1.0f - 1e-5f));
+      // As close to half the radius as whole texels allow, unless a single texel is larger
+      if (texelSize <= 0.5f * radius) {
+        CHECK(step <= 0.5f * radius * (1.0f + 1e-5f));
+        CHECK(step > 0.5f * radius - texelSize);
+      }
+    }
+  }
+}
+
+TEST(cascadeSnappedCenterCoversRadius) {
+  std::mt19937 generator(7);
+  std::uniform_real_distribution<float> coordinate(-500.0f, 500.0f);
+
+  for (float radius : {2.0f, 30.0f, 270.0f}) {
+    float halfExtent = 1.25f * radius;
+    float texelSize = 2.0f * halfExtent / 2048;
+    float step = cascadeSnapStep(radius, halfExtent, 2048);
+
+    for (int i = 0; i < 1000; i++) {
+      glm::vec2 focus{coordinate(generator), coordinate(generator)};
+      glm::vec2 center = snapCascadeCenter(focus, step);
+
+      // On the grid of whole texels
+      CHECK(fraction(center.x / texelSize) < 1e-2f);
+      CHECK(fraction(center.y / texelSize) < 1e-2f);
+      // At most half a step away, so the square still holds the radius around the focus
+      glm::vec2 offset = glm::abs(center - focus);
+      CHECK(offset.x <= 0.5f * step * (1.0f + 1e-4f) && offset.y <= 0.5f * step * (1.0f + 1e-4f));
+      CHECK(offset.x + radius <= halfExtent && offset.y + radius <= halfExtent);
+    }
+  }
+}
+
+TEST(cascadeCenterMovesInSteps) {
+  float radius = 30.0f;
+  float step = cascadeSnapStep(radius, 1.25f * radius, 2048);
+  glm::vec2 start{4.0f * step, -7.0f * step};
+  glm::vec2 center = snapCascadeCenter(start, step);
+  CHECK(center == snapCascadeCenter(center, step));
+
+  // Moves of less than half a step keep the center, so the cascade is not rendered again
+  for (glm::vec2 direction : {glm::vec2{1.0f, 0.0f}, glm::vec2{0.0f, -1.0f}, glm::vec2{0.6f, 0.8f}}) {
+    CHECK(snapCascadeCenter(start + 0.45f * step * direction, step) == center);
+  }
+
+  // A whole step moves it by exactly one step
+  glm::vec2 moved = snapCascadeCenter(start + glm::vec2{step, 0.0f}, step);
+  CHECK_NEAR(moved.x - center.x, step, 1e-4f * step);
+  CHECK(moved.y == center.y);
+}
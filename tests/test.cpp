@@ -0,0 +1,49 @@
+#include "test.h"
+
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+
+static uint32_t failures = 0;
+
+std::vector<TestCase>& testCases() {
+  // Constructed on first use, as registrations run during static initialization of the other units
+  static std::vector<TestCase> cases;
+  return cases;
+}
+
+void reportFailure(const char* file, int line, const std::string& expression) {
+  std::cerr << file << ":" << line << ": check failed: " << expression << std::endl;
+  failures++;
+}
+
+std::vector<SimdLevel> supportedSimdLevels() {
+  std::vector<SimdLevel> levels;
+  for (SimdLevel level : {SimdLevel::Scalar, SimdLevel::SSE2, SimdLevel::AVX2}) {
+    if (level <= detectSimdLevel()) {
+      levels.push_back(level);
+    }
+  }
+  return levels;
+}
+
+int main() {
+  uint32_t failed = 0;
+  for (const auto& testCase : testCases()) {
+    uint32_t before = failures;
+    try {
+      testCase.run();
+    } catch (const std::exception& e) {
+      std::cerr << testCase.name << ": unexpected exception: " << e.what() << std::endl;
+      failures++;
+    }
+    if (failures != before) {
+      std::cerr << testCase.name << " failed" << std::endl;
+      failed++;
+    }
+  }
+
+  std::cout << testCases().size() - failed << " of " << testCases().size() << " tests passed" << std::endl;
+  return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
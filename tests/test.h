@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cmath>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "frustum.h"
+
+/**
+ * Tests of the logic which runs without a device. Each TEST registers a function run by tests/test.cpp. A failed
+ * CHECK reports the expression and the test carries on, so one run lists every failure
+ */
+struct TestCase {
+  const char* name;
+  std::function<void()> run;
+};
+
+std::vector<TestCase>& testCases();
+void reportFailure(const char* file, int line, const std::string& expression);
+// Instruction sets this machine can run, from scalar up to the widest
+std::vector<SimdLevel> supportedSimdLevels();
+
+struct TestRegistration {
+  TestRegistration(const char* name, std::function<void()> run) {
+    testCases().push_back({name, std::move(run)});
+  }
+};
+
+#define TEST(name)                                                    \
+  static void name();                                                 \
+  static const TestRegistration name##Registration{#name, name};      \
+  static void name()
+
+#define CHECK(expression)                                \
+  do {                                                   \
+    if (!(expression)) {                                 \
+      reportFailure(__FILE__, __LINE__, #expression);    \
+    }                                                    \
+  } while (false)
+
+#define CHECK_NEAR(actual, expected, tolerance) CHECK(std::abs((actual) - (expected)) <= (tolerance))
+
+#define CHECK_THROWS(expression, Exception)                                         \
+  do {                                                                              \
+    bool thrown = false;                                                            \
+    try {                                                                           \
+      expression;                                                                   \
+    } catch (const Exception&) {                                                    \
+      thrown = true;                                                                \
+    }                                                                               \
+    if (!thrown) {                                                                  \
+      reportFailure(__FILE__, __LINE__, #expression " throws " #Exception);         \
+    }                                                                               \
+  } while (false)
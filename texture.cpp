@@ -1,12 +1,13 @@
 #include "texture.h"
 
-#include <stb_image.h>
-
 #include <algorithm>
 #include <cmath>
 #include <cstring>
 #include <stdexcept>
 
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+
 #include "image.h"
 
 Texture::Texture(const VulkanContext& ctx, std::string sourcePath) : ctx{ctx} {
@@ -41,7 +42,7 @@ Texture::Texture(const VulkanContext& ctx, std::string sourcePath) : ctx{ctx} {
               VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
               VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, image, memory);
 
-  transitionImageLayout(ctx, image, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, mipLevels);
+  transitionImageLayout(ctx, image, ImageAccess::Undefined, ImageAccess::TransferDestination, mipLevels);
   copyBufferToImage(ctx, stagingBuffer, image, static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight));
   generateMipmaps(ctx, image, VK_FORMAT_R8G8B8A8_SRGB, texWidth, texHeight, mipLevels);
 
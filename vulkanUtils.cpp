@@ -1,10 +1,13 @@
 #include "vulkanUtils.h"
 
 #include <algorithm>
+#include <cctype>
 #include <iostream>
 #include <set>
 #include <stdexcept>
 
+#include "hash.h"
+
 /*----- Extension and validation layer tests -----*/
 
 /* Tests whether required extensions are available */
@@ -46,13 +49,19 @@ void checkValidationLayerSupport() {
 
 /*--------------- VulkanContext ---------------*/
 
-void VulkanContext::initContext(GLFWwindow* window) {
+/**
+ * A null window creates a headless context, which has no surface and does not enable the swap chain extension
+ */
+void VulkanContext::initContext(GLFWwindow* window, const DeviceSelection& selection) {
   this->window = window;
   createInstance();
-  createSurface();
-  pickPhysicalDevice();
+  if (window != nullptr) {
+    createSurface();
+  }
+  pickPhysicalDevice(selection);
   createLogicalDevice();
   createCommandPool();
+  createTimeline();
   setupDebugMessenger();
 }
 
@@ -74,19 +83,20 @@ void VulkanContext::createInstance() {
   appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
   appInfo.pEngineName = "No Engine";
   appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-  appInfo.apiVersion = VK_API_VERSION_1_0;
+  appInfo.apiVersion = VK_API_VERSION_1_2;
 
   VkInstanceCreateInfo createInfo{};
   createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
   createInfo.pApplicationInfo = &appInfo;
 
-  uint32_t glfwExtensionCount{};
-  const char** glfwExtensionNames;
-
-  // Get array and count of extensions required by GLFW
-  glfwExtensionNames = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+  std::vector<const char*> requiredExtension;
 
-  std::vector<const char*> requiredExtension(glfwExtensionNames, glfwExtensionNames + glfwExtensionCount);
+  // Get array and count of extensions required by GLFW. GLFW is not initialized without a window
+  if (window != nullptr) {
+    uint32_t glfwExtensionCount{};
+    const char** glfwExtensionNames = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+    requiredExtension.assign(glfwExtensionNames, glfwExtensionNames + glfwExtensionCount);
+  }
 
   if (enableValidationLayers) {
     requiredExtension.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
@@ -118,7 +128,11 @@ void VulkanContext::createInstance() {
 
 /*----- Physical device -----*/
 
-void VulkanContext::pickPhysicalDevice() {
+/**
+ * Score every suitable device and take the highest unless the selection names one. The tier is the highest whose
+ * features the device supports, lowered to the selected maximum
+ */
+void VulkanContext::pickPhysicalDevice(const DeviceSelection& selection) {
   uint32_t deviceCount{};
   vkEnumeratePhysicalDevices(instance, &deviceCount, nullptr);
   if (deviceCount < 1) {
@@ -127,15 +141,59 @@ void VulkanContext::pickPhysicalDevice() {
   std::vector<VkPhysicalDevice> devices(deviceCount);
   vkEnumeratePhysicalDevices(instance, &deviceCount, devices.data());
 
-  auto position = std::find_if(devices.begin(), devices.end(),
-                               [&](auto const& d) { return isDeviceSuitable(d, surface); });
+  // A number selects by index, so that it never matches a digit in a name
+  bool selectsIndex = !selection.device.empty() && std::all_of(selection.device.begin(), selection.device.end(),
+                                                                        [](unsigned char c) { return std::isdigit(c); });
+
+  // Without a surface any device which can render is usable, including CPU implementations such as lavapipe
+  std::optional<DeviceCapabilities> selected;
+  for (uint32_t i = 0; i < deviceCount; i++) {
+    DeviceCapabilities capabilities = queryDeviceCapabilities(devices[i]);
+    bool suitable = isDeviceSuitable(devices[i], surface);
 
-  if (position == devices.end()) {
-    throw std::runtime_error("Failed to find a suitable GPU");
+    std::cout << "Device " << i << ": " << capabilities.properties.deviceName << ", "
+              << (capabilities.deviceLocalMemory >> 20) << " MiB, " << featureTierName(capabilities.tier) << " tier, ";
+    if (suitable) {
+      std::cout << "score " << capabilities.score << std::endl;
+    } else {
+      std::cout << "not suitable" << std::endl;
+    }
+
+    bool requested = !selection.device.empty() &&
+                     (selectsIndex ? selection.device == std::to_string(i)
+                                   : std::string(capabilities.properties.deviceName).find(selection.device) != std::string::npos);
+    if (requested && !suitable) {
+      throw std::runtime_error("Requested device " + std::string(capabilities.properties.deviceName) + " is not suitable");
+    }
+    if (!suitable || (!selection.device.empty() && !requested)) {
+      continue;
+    }
+    // The first match of a requested device wins
+    if (!selected || (!requested && capabilities.score > selected->score)) {
+      selected = capabilities;
+      if (requested) {
+        break;
+      }
+    }
+  }
+
+  if (!selected) {
+    throw std::runtime_error(selection.device.empty() ? "Failed to find a suitable GPU" : "Failed to find device " + selection.device);
   }
 
-  physicalDevice = *position;
+  physicalDevice = selected->physicalDevice;
+  properties = selected->properties;
   maxMSAASamples = getMaxUsableSampleCount(physicalDevice);
+
+  tier = selected->tier;
+  if (selection.maxTier && *selection.maxTier < tier) {
+    tier = *selection.maxTier;
+  } else if (selection.maxTier && *selection.maxTier > tier) {
+    std::cerr << "The device does not support the " << featureTierName(*selection.maxTier) << " tier" << std::endl;
+  }
+
+  std::cout << "Rendering " << (headless() ? "headless " : "") << "on " << properties.deviceName << " with the "
+            << featureTierName(tier) << " feature tier" << std::endl;
 }
 
 /*----- Logical device -----*/
@@ -161,16 +219,62 @@ void VulkanContext::createLogicalDevice() {
   // MSAA for shader (e.g. texture aliasing)
   deviceFeatures.sampleRateShading = VK_TRUE;
 
+  // ----- Optional features -----
+  VkPhysicalDeviceFeatures supportedFeatures{};
+  vkGetPhysicalDeviceFeatures(physicalDevice, &supportedFeatures);
+
+  // Vulkan 1.2 is required for timeline semaphores
+  VkPhysicalDeviceVulkan12Features supportedFeatures12{};
+  supportedFeatures12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+  VkPhysicalDeviceVulkan11Features supportedFeatures11{};
+  supportedFeatures11.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_1_FEATURES;
+  supportedFeatures12.pNext = &supportedFeatures11;
+  VkPhysicalDeviceFeatures2 features2{};
+  features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+  features2.pNext = &supportedFeatures12;
+  vkGetPhysicalDeviceFeatures2(physicalDevice, &features2);
+
+  // Features above the tier stay disabled even if supported
+  bool standardTier = tier >= FeatureTier::Standard;
+  bool highTier = tier >= FeatureTier::High;
+
+  // GPU-driven rendering
+  multiDrawIndirect = standardTier && supportedFeatures.multiDrawIndirect;
+  drawIndirectFirstInstance = standardTier && supportedFeatures.drawIndirectFirstInstance;
+  drawIndirectCount = highTier && supportedFeatures12.drawIndirectCount;
+  deviceFeatures.multiDrawIndirect = multiDrawIndirect;
+  deviceFeatures.drawIndirectFirstInstance = drawIndirectFirstInstance;
+
+  // Textures are indexed by the material index pushed with each draw
+  deviceFeatures.shaderSampledImageArrayDynamicIndexing = supportedFeatures.shaderSampledImageArrayDynamicIndexing;
+
+  // Cube maps and stereo pairs in a single pass
+  multiview = standardTier && supportedFeatures11.multiview;
+
+  VkPhysicalDeviceVulkan11Features features11{};
+  features11.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_1_FEATURES;
+  features11.multiview = multiview;
+
+  VkPhysicalDeviceVulkan12Features features12{};
+  features12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+  features12.drawIndirectCount = drawIndirectCount;
+  features12.timelineSemaphore = VK_TRUE;
+  features12.pNext = &features11;
+
   VkDeviceCreateInfo createInfo{};
   createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
 
   createInfo.queueCreateInfoCount = queueCreateInfos.size();
   createInfo.pQueueCreateInfos = queueCreateInfos.data();
 
-  createInfo.enabledExtensionCount = deviceExtensions.size();
-  createInfo.ppEnabledExtensionNames = deviceExtensions.data();
+  // Nothing is presented without a surface
+  if (!headless()) {
+    createInfo.enabledExtensionCount = deviceExtensions.size();
+    createInfo.ppEnabledExtensionNames = deviceExtensions.data();
+  }
 
   createInfo.pEnabledFeatures = &deviceFeatures;
+  createInfo.pNext = &features12;
 
   // There is no longer any difference between device and instance validation layers
   // On latest Vulkan implementations, these values are ignored
@@ -206,6 +310,99 @@ void VulkanContext::createCommandPool() {
   }
 }
 
+/*----- Timeline -----*/
+
+void VulkanContext::createTimeline() {
+  VkSemaphoreTypeCreateInfo typeInfo{};
+  typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+  typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+  typeInfo.initialValue = 0;
+
+  VkSemaphoreCreateInfo semaphoreInfo{};
+  semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+  semaphoreInfo.pNext = &typeInfo;
+
+  if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, &timelineSemaphore) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to create timeline semaphore");
+  }
+}
+
+/**
+ * Submit to a queue and return the timeline value which is signalled once the work has completed. As signal
+ * operations wait for all earlier work on the queue, reaching a value means everything submitted before it on the
+ * same queue has completed too. Safe to call from any thread
+ */
+uint64_t VulkanContext::submit(VkQueue queue, const Submission& submission) const {
+  std::lock_guard<std::mutex> lock(submitMutex);
+  uint64_t value = lastSubmittedValue + 1;
+
+  std::vector<VkSemaphore> signalSemaphores = submission.signalSemaphores;
+  signalSemaphores.push_back(timelineSemaphore);
+  // Values of binary semaphores are ignored
+  std::vector<uint64_t> signalValues(signalSemaphores.size(), 0);
+  signalValues.back() = value;
+  std::vector<uint64_t> waitValues(submission.waitSemaphores.size(), 0);
+
+  VkTimelineSemaphoreSubmitInfo timelineInfo{};
+  timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+  timelineInfo.waitSemaphoreValueCount = static_cast<uint32_t>(waitValues.size());
+  timelineInfo.pWaitSemaphoreValues = waitValues.data();
+  timelineInfo.signalSemaphoreValueCount = static_cast<uint32_t>(signalValues.size());
+  timelineInfo.pSignalSemaphoreValues = signalValues.data();
+
+  VkSubmitInfo submitInfo{};
+  submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+  submitInfo.pNext = &timelineInfo;
+  submitInfo.waitSemaphoreCount = static_cast<uint32_t>(submission.waitSemaphores.size());
+  submitInfo.pWaitSemaphores = submission.waitSemaphores.data();
+  submitInfo.pWaitDstStageMask = submission.waitStages.data();
+  submitInfo.commandBufferCount = static_cast<uint32_t>(submission.commandBuffers.size());
+  submitInfo.pCommandBuffers = submission.commandBuffers.data();
+  submitInfo.signalSemaphoreCount = static_cast<uint32_t>(signalSemaphores.size());
+  submitInfo.pSignalSemaphores = signalSemaphores.data();
+
+  if (vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to submit command buffers");
+  }
+
+  lastSubmittedValue = value;
+  return value;
+}
+
+uint64_t VulkanContext::submittedValue() const {
+  std::lock_guard<std::mutex> lock(submitMutex);
+  return lastSubmittedValue;
+}
+
+uint64_t VulkanContext::completedValue() const {
+  uint64_t value = 0;
+  vkGetSemaphoreCounterValue(device, timelineSemaphore, &value);
+  return value;
+}
+
+// Poll without blocking
+bool VulkanContext::isComplete(uint64_t value) const {
+  return completedValue() >= value;
+}
+
+/**
+ * Block until the value has been reached. Returns false on timeout. Value 0 is always complete
+ */
+bool VulkanContext::wait(uint64_t value, uint64_t timeout) const {
+  VkSemaphoreWaitInfo waitInfo{};
+  waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+  waitInfo.semaphoreCount = 1;
+  waitInfo.pSemaphores = &timelineSemaphore;
+  waitInfo.pValues = &value;
+
+  return vkWaitSemaphores(device, &waitInfo, timeout) == VK_SUCCESS;
+}
+
+// Rendering offscreen without a window, surface or swap chain
+bool VulkanContext::headless() const {
+  return surface == VK_NULL_HANDLE;
+}
+
 /*----- Debug messenger -----*/
 
 void VulkanContext::setupDebugMessenger() {
@@ -228,6 +425,7 @@ VulkanContext::~VulkanContext() {
   if (enableValidationLayers) {
     DestroyDebugUtilsMessengerEXT(instance, debugMessenger, nullptr);
   }
+  vkDestroySemaphore(device, timelineSemaphore, nullptr);
   vkDestroyCommandPool(device, commandPool, nullptr);
   vkDestroyDevice(device, nullptr);
   vkDestroyInstance(instance, nullptr);
@@ -280,6 +478,22 @@ bool checkSwapChainSupport(const VkPhysicalDevice& physicalDevice, const VkSurfa
   return !swapChainSupport.formats.empty() && !swapChainSupport.presentModes.empty();
 }
 
+bool supportsTimelineSemaphores(const VkPhysicalDevice& physicalDevice, const VkPhysicalDeviceProperties& properties) {
+  if (properties.apiVersion < VK_API_VERSION_1_2) {
+    return false;
+  }
+
+  VkPhysicalDeviceVulkan12Features features12{};
+  features12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+  VkPhysicalDeviceFeatures2 features2{};
+  features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+  features2.pNext = &features12;
+  vkGetPhysicalDeviceFeatures2(physicalDevice, &features2);
+
+  return features12.timelineSemaphore;
+}
+
+// The device type is chosen by the caller. A null surface skips the presentation requirements
 bool isDeviceSuitable(const VkPhysicalDevice& physicalDevice, const VkSurfaceKHR& surface) {
   VkPhysicalDeviceProperties properties{};
   vkGetPhysicalDeviceProperties(physicalDevice, &properties);
@@ -287,13 +501,19 @@ bool isDeviceSuitable(const VkPhysicalDevice& physicalDevice, const VkSurfaceKHR
   VkPhysicalDeviceFeatures deviceFeatures{};
 
   vkGetPhysicalDeviceFeatures(physicalDevice, &deviceFeatures);
-  return properties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU &&
-         deviceFeatures.geometryShader &&
-         findQueueFamilies(physicalDevice, surface).isComplete() &&
+  bool suitable = supportsTimelineSemaphores(physicalDevice, properties) &&
+                  deviceFeatures.geometryShader &&
+                  findQueueFamilies(physicalDevice, surface).isComplete() &&
+                  deviceFeatures.samplerAnisotropy;
+
+  if (surface == VK_NULL_HANDLE) {
+    return suitable;
+  }
+
+  return suitable &&
          checkDeviceExtensionSupport(physicalDevice) &&
          // Must be called after extensions have been checked
-         checkSwapChainSupport(physicalDevice, surface) &&
-         deviceFeatures.samplerAnisotropy;
+         checkSwapChainSupport(physicalDevice, surface);
 }
 
 /*----- Shader module -----*/
@@ -313,6 +533,48 @@ VkShaderModule createShaderModule(const VulkanContext& ctx, const std::vector<ch
   return shaderModule;
 }
 
+/*----- Render pass -----*/
+
+/**
+ * Hash of everything which makes two render passes compatible: the format and sample count behind every attachment
+ * reference of every subpass, and the view masks. Resolve attachments are ignored with a single subpass, layouts and
+ * load and store operations always
+ */
+uint64_t hashRenderPassCompatibility(const VkRenderPassCreateInfo& info) {
+  uint64_t hash = HASH_SEED;
+
+  auto hashReferences = [&](uint32_t count, const VkAttachmentReference* references) {
+    hashValue(hash, references == nullptr ? 0 : count);
+    for (uint32_t i = 0; references != nullptr && i < count; i++) {
+      uint32_t attachment = references[i].attachment;
+      hashValue(hash, attachment == VK_ATTACHMENT_UNUSED ? VK_FORMAT_UNDEFINED : info.pAttachments[attachment].format);
+      hashValue(hash, attachment == VK_ATTACHMENT_UNUSED ? VK_SAMPLE_COUNT_1_BIT : info.pAttachments[attachment].samples);
+    }
+  };
+
+  hashValue(hash, info.subpassCount);
+  for (uint32_t i = 0; i < info.subpassCount; i++) {
+    const VkSubpassDescription& subpass = info.pSubpasses[i];
+    hashReferences(subpass.colorAttachmentCount, subpass.pColorAttachments);
+    hashReferences(subpass.inputAttachmentCount, subpass.pInputAttachments);
+    if (info.subpassCount > 1) {
+      hashReferences(subpass.colorAttachmentCount, subpass.pResolveAttachments);
+    }
+    hashReferences(1, subpass.pDepthStencilAttachment);
+  }
+
+  for (auto next = static_cast<const VkBaseInStructure*>(info.pNext); next != nullptr; next = next->pNext) {
+    if (next->sType == VK_STRUCTURE_TYPE_RENDER_PASS_MULTIVIEW_CREATE_INFO) {
+      auto multiview = reinterpret_cast<const VkRenderPassMultiviewCreateInfo*>(next);
+      for (uint32_t i = 0; i < multiview->subpassCount; i++) {
+        hashValue(hash, multiview->pViewMasks[i]);
+      }
+    }
+  }
+
+  return hash;
+}
+
 /*----- Queue -----*/
 
 QueueFamilyIndices findQueueFamilies(const VkPhysicalDevice& device, const VkSurfaceKHR& surface) {
@@ -328,6 +590,16 @@ QueueFamilyIndices findQueueFamilies(const VkPhysicalDevice& device, const VkSur
   auto graphicsPosition = std::find_if(queueFamilies.begin(), queueFamilies.end(),
                                        [](auto const& p) { return p.queueFlags & VK_QUEUE_GRAPHICS_BIT; });
 
+  if (graphicsPosition != queueFamilies.end()) {
+    indices.graphicsFamily = graphicsPosition - queueFamilies.begin();
+  }
+
+  // Without a surface nothing is presented. The graphics queue stands in so that the present queue is always valid
+  if (surface == VK_NULL_HANDLE) {
+    indices.presentFamily = indices.graphicsFamily;
+    return indices;
+  }
+
   VkBool32 presentSupport = false;
   uint32_t presentIndex{};
   // Find index of first queue family which supports presenting to our surface. The function takes an index rather than an element
@@ -338,10 +610,6 @@ QueueFamilyIndices findQueueFamilies(const VkPhysicalDevice& device, const VkSur
     }
   }
 
-  if (graphicsPosition != queueFamilies.end()) {
-    indices.graphicsFamily = graphicsPosition - queueFamilies.begin();
-  }
-
   if (presentSupport) {
     indices.presentFamily = presentIndex;
   }
@@ -456,18 +724,13 @@ void beginCommand(const VulkanContext& ctx, VkCommandBuffer& commandBuffer) {
 }
 
 /**
- * End commandbuffer, submit it and free it back into the pool
+ * End commandbuffer, submit it and free it back into the pool. Waits for this submission only rather than for the
+ * queue to go idle
  */
 void submitCommand(const VulkanContext& ctx, VkCommandBuffer& commandBuffer, const VkQueue& queue) {
   vkEndCommandBuffer(commandBuffer);
 
-  VkSubmitInfo submitInfo{};
-  submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-  submitInfo.commandBufferCount = 1;
-  submitInfo.pCommandBuffers = &commandBuffer;
-
-  vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE);
-  vkQueueWaitIdle(queue);
+  ctx.wait(ctx.submit(queue, {{commandBuffer}}));
 
   vkFreeCommandBuffers(ctx.device, ctx.commandPool, 1, &commandBuffer);
 }
\ No newline at end of file
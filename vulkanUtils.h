@@ -2,11 +2,14 @@
 
 #include <GLFW/glfw3.h>
 
+#include <mutex>
 #include <optional>
 #include <vector>
 
 #pragma once
 
+#include "deviceCapabilities.h"
+
 #ifdef NDEBUG
 const bool enableValidationLayers = false;
 #else
@@ -35,6 +38,17 @@ struct SwapChainSupportDetails {
   std::vector<VkPresentModeKHR> presentModes;
 };
 
+/**
+ * Command buffers submitted together. The semaphores are binary, such as those of the swap chain. The timeline
+ * semaphore of the context is signalled in addition
+ */
+struct Submission {
+  std::vector<VkCommandBuffer> commandBuffers;
+  std::vector<VkSemaphore> waitSemaphores;
+  std::vector<VkPipelineStageFlags> waitStages;
+  std::vector<VkSemaphore> signalSemaphores;
+};
+
 /**
  * Wrapper class to manage and pass logical and physical device handles
  * together with application independent functionality
@@ -43,6 +57,8 @@ class VulkanContext {
  public:
   VkInstance instance;
   VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
+  // Limits and identification of the physical device
+  VkPhysicalDeviceProperties properties;
   VkDevice device;
 
   VkCommandPool commandPool;
@@ -50,28 +66,55 @@ class VulkanContext {
   VkQueue graphicsQueue;
   VkQueue presentQueue;
 
-  GLFWwindow* window;
-  VkSurfaceKHR surface;
+  // Both are null for a headless context
+  GLFWwindow* window = nullptr;
+  VkSurfaceKHR surface = VK_NULL_HANDLE;
 
   VkDebugUtilsMessengerEXT debugMessenger;
 
   // The maximum supported multi-sampling count supported by the physical device
   VkSampleCountFlagBits maxMSAASamples;
 
+  // Optional features of the selected tier which the device supports
+  FeatureTier tier = FeatureTier::Minimal;
+  bool multiDrawIndirect = false;
+  bool drawIndirectFirstInstance = false;
+  bool drawIndirectCount = false;
+  // Rendering several views of a layered attachment in one pass
+  bool multiview = false;
+
+  // Every submission signals the next value, so a value identifies a point in the work of the device
+  VkSemaphore timelineSemaphore = VK_NULL_HANDLE;
+
   VulkanContext() = default;
   ~VulkanContext();
 
-  void initContext(GLFWwindow* window);
+  uint64_t submit(VkQueue queue, const Submission& submission) const;
+  uint64_t submittedValue() const;
+  uint64_t completedValue() const;
+  bool isComplete(uint64_t value) const;
+  bool wait(uint64_t value, uint64_t timeout = UINT64_MAX) const;
+  bool headless() const;
+
+  void initContext(GLFWwindow* window, const DeviceSelection& selection = {});
   void createInstance();
   void createSurface();
-  void pickPhysicalDevice();
+  void pickPhysicalDevice(const DeviceSelection& selection);
   void createLogicalDevice();
   void createCommandPool();
+  void createTimeline();
   void setupDebugMessenger();
+
+ private:
+  // Queue submission must be externally synchronized and values must be signalled in order
+  mutable std::mutex submitMutex;
+  mutable uint64_t lastSubmittedValue = 0;
 };
 
+bool isDeviceSuitable(const VkPhysicalDevice& physicalDevice, const VkSurfaceKHR& surface);
 SwapChainSupportDetails querySwapChainSupport(const VkPhysicalDevice& physicalDevice, const VkSurfaceKHR& surface);
 VkShaderModule createShaderModule(const VulkanContext& ctx, const std::vector<char>& code);
+uint64_t hashRenderPassCompatibility(const VkRenderPassCreateInfo& info);
 
 void findSupportedFormat(const std::vector<VkFormat>& candidates, VkImageTiling tiling, VkFormatFeatureFlags features);
 